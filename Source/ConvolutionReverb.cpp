@@ -0,0 +1,761 @@
+/*
+  ==============================================================================
+
+    ConvolutionReverb.cpp
+    A zero-latency convolution reverb on the sampler's main output.
+
+  ==============================================================================
+*/
+
+#include "ConvolutionReverb.h"
+#include "Interpolation.h"
+#include "VoiceKernels.h"
+
+namespace
+{
+    // samples converted per pass while a response is brought to the host's rate
+    constexpr int convertChunkSize = 4096;
+
+    // the tail a recording trails off into is cut off below this, so it costs no partitions
+    constexpr float silenceLevel = 1.0e-6f;
+
+    int getOrder (int size) noexcept
+    {
+        int order = 0;
+
+        while ((1 << order) < size)
+            ++order;
+
+        return order;
+    }
+
+    /** Reads a response, converted to sampleRate with the same sinc as the samples. */
+    juce::AudioBuffer<float> readConverted (juce::AudioFormatReader& source, double sampleRate)
+    {
+        const auto numChannels = juce::jmin ((int) source.numChannels, ImpulseResponse::maxChannels);
+        const auto ratio = source.sampleRate / sampleRate;
+        const auto length = (int) juce::jmin ((juce::int64) std::ceil ((double) source.lengthInSamples / ratio),
+                                              (juce::int64) (ImpulseResponse::maxSeconds * sampleRate));
+
+        juce::AudioBuffer<float> converted (numChannels, length);
+
+        if (ratio == 1.0)
+        {
+            source.read (&converted, 0, length, 0, true, true);
+            return converted;
+        }
+
+        juce::SharedResourcePointer<InterpolationTables> tables;
+        tables->prepare();
+
+        const auto quality = InterpolationQuality::sinc32;
+        const auto footprint = getInterpolationFootprint (quality);
+        const auto* sincTable = tables->getSincTable (quality, ratio);
+
+        if (sincTable == nullptr)
+            return {};
+
+        juce::HeapBlock<int> index (convertChunkSize);
+        juce::HeapBlock<float> alpha (convertChunkSize);
+        juce::AudioBuffer<float> span (numChannels, (int) std::ceil (convertChunkSize * ratio)
+                                                      + footprint.framesBefore + footprint.framesAfter + 2);
+
+        for (int start = 0; start < length; start += convertChunkSize)
+        {
+            const auto numThisChunk = juce::jmin (convertChunkSize, length - start);
+
+            // worked out from the start of the chunk each time, so rounding errors don't add up
+            const auto position = (double) start * ratio;
+            const auto firstFrame = (juce::int64) position;
+
+            VoiceKernels::computeReadPositions (position - (double) firstFrame, ratio, index, alpha, numThisChunk);
+
+            const auto spanLength = footprint.framesBefore + index[numThisChunk - 1] + footprint.framesAfter + 1;
+            source.read (&span, 0, spanLength, firstFrame - footprint.framesBefore, true, true);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                VoiceKernels::interpolateSinc (span.getReadPointer (channel, footprint.framesBefore), index, alpha,
+                                               converted.getWritePointer (channel, start), numThisChunk,
+                                               sincTable, getNumSincTaps (quality));
+        }
+
+        return converted;
+    }
+
+    /** The length left once the silence at the end is cut off. */
+    int findAudibleLength (const juce::AudioBuffer<float>& response)
+    {
+        for (int end = response.getNumSamples(); end > 0; --end)
+            for (int channel = 0; channel < response.getNumChannels(); ++channel)
+                if (std::abs (response.getSample (channel, end - 1)) >= silenceLevel)
+                    return end;
+
+        return 0;
+    }
+
+    /** x * h for a block of bins, written to, or added to, sum. */
+    void multiplySpectra (float* sumReal, float* sumImag, const float* xReal, const float* xImag,
+                          const float* hReal, const float* hImag, int numBins, bool accumulate) noexcept
+    {
+        if (accumulate)
+        {
+            for (int i = 0; i < numBins; ++i)
+            {
+                sumReal[i] += xReal[i] * hReal[i] - xImag[i] * hImag[i];
+                sumImag[i] += xReal[i] * hImag[i] + xImag[i] * hReal[i];
+            }
+        }
+        else
+        {
+            for (int i = 0; i < numBins; ++i)
+            {
+                sumReal[i] = xReal[i] * hReal[i] - xImag[i] * hImag[i];
+                sumImag[i] = xReal[i] * hImag[i] + xImag[i] * hReal[i];
+            }
+        }
+    }
+}
+
+//==============================================================================
+bool ImpulseResponse::Key::operator== (const Key& other) const noexcept
+{
+    return path == other.path
+        && contentHash == other.contentHash
+        && sampleRate == other.sampleRate;
+}
+
+ImpulseResponse::ImpulseResponse (const Key& key, const juce::AudioBuffer<float>& response)
+    : mKey (key),
+      mNumChannels (juce::jmin (response.getNumChannels(), maxChannels)),
+      mLength (response.getNumSamples())
+{
+    mHead.setSize (mNumChannels, headLength, false, true);
+
+    for (int channel = 0; channel < mNumChannels; ++channel)
+        mHead.copyFrom (channel, 0, response, channel, 0, juce::jmin (headLength, mLength));
+
+    for (int index = 0; index < maxStages && getStageOffset (index) < mLength; ++index)
+    {
+        Stage stage;
+        stage.partitionSize = getPartitionSize (index);
+        stage.offset = getStageOffset (index);
+        stage.isDeferred = index > 0;
+
+        // the last stage runs to the end, the others up to where the next one starts
+        const auto end = index + 1 < maxStages ? juce::jmin (mLength, getStageOffset (index + 1)) : mLength;
+        stage.numPartitions = (end - stage.offset + stage.partitionSize - 1) / stage.partitionSize;
+
+        const auto numBins = stage.getNumBins();
+        stage.real.resize ((size_t) (mNumChannels * stage.numPartitions * numBins));
+        stage.imag.resize ((size_t) (mNumChannels * stage.numPartitions * numBins));
+
+        // each partition is padded to twice its length, and scaled down to make up for
+        // the inverse transform coming back that many times larger
+        RealFFT fft (getOrder (2 * stage.partitionSize));
+        std::vector<float> padded ((size_t) fft.getSize());
+        const auto scale = 1.0f / (float) fft.getSize();
+
+        for (int channel = 0; channel < mNumChannels; ++channel)
+        {
+            for (int partition = 0; partition < stage.numPartitions; ++partition)
+            {
+                const auto start = stage.offset + partition * stage.partitionSize;
+                const auto numTaps = juce::jmin (stage.partitionSize, end - start);
+
+                std::fill (padded.begin(), padded.end(), 0.0f);
+                juce::FloatVectorOperations::copyWithMultiply (padded.data(), response.getReadPointer (channel, start),
+                                                               scale, numTaps);
+
+                const auto binOffset = (size_t) ((channel * stage.numPartitions + partition) * numBins);
+                fft.forward (padded.data(), stage.real.data() + binOffset, stage.imag.data() + binOffset);
+            }
+        }
+
+        mStages.push_back (std::move (stage));
+    }
+}
+
+ImpulseResponse::Ptr ImpulseResponse::load (const juce::File& file, juce::uint64 contentHash, double sampleRate,
+                                            juce::AudioFormatManager& formatManager)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+    if (reader == nullptr || reader->sampleRate <= 0.0 || reader->lengthInSamples <= 0 || sampleRate <= 0.0)
+        return {};
+
+    auto response = readConverted (*reader, sampleRate);
+    const auto length = findAudibleLength (response);
+
+    if (length == 0)
+        return {};
+
+    // scaled so the loudest channel has unit energy, which keeps the mix level
+    // meaning much the same from one response to the next
+    double energy = 0.0;
+
+    for (int channel = 0; channel < response.getNumChannels(); ++channel)
+    {
+        double channelEnergy = 0.0;
+        const auto* data = response.getReadPointer (channel);
+
+        for (int i = 0; i < length; ++i)
+            channelEnergy += (double) data[i] * data[i];
+
+        energy = juce::jmax (energy, channelEnergy);
+    }
+
+    response.applyGain (0, length, (float) (1.0 / std::sqrt (energy)));
+
+    const juce::AudioBuffer<float> trimmed (response.getArrayOfWritePointers(), response.getNumChannels(), length);
+    return new ImpulseResponse ({ file.getFullPathName(), contentHash, sampleRate }, trimmed);
+}
+
+//==============================================================================
+ImpulseResponseCache::ImpulseResponseCache()
+{
+}
+
+ImpulseResponseCache::~ImpulseResponseCache()
+{
+}
+
+ImpulseResponse::Ptr ImpulseResponseCache::find (const ImpulseResponse::Key& key) const
+{
+    const juce::ScopedLock sl (mLock);
+
+    for (auto* response : mResponses)
+        if (response->getKey() == key)
+            return response;
+
+    return {};
+}
+
+ImpulseResponse::Ptr ImpulseResponseCache::add (ImpulseResponse::Ptr newResponse)
+{
+    jassert (newResponse != nullptr);
+
+    const juce::ScopedLock sl (mLock);
+
+    // two instances may have loaded the same response at once, in which case the first one wins
+    for (auto* response : mResponses)
+        if (response->getKey() == newResponse->getKey())
+            return response;
+
+    mResponses.add (newResponse);
+    return newResponse;
+}
+
+void ImpulseResponseCache::purgeUnused()
+{
+    const juce::ScopedLock sl (mLock);
+
+    for (int i = mResponses.size(); --i >= 0;)
+        if (mResponses.getObjectPointerUnchecked (i)->getReferenceCount() == 1)
+            mResponses.remove (i);
+}
+
+int ImpulseResponseCache::getNumResponses() const
+{
+    const juce::ScopedLock sl (mLock);
+    return mResponses.size();
+}
+
+//==============================================================================
+/**
+    One reverb's running state for one response: the input it has seen, the
+    spectra of its recent partitions and the output each stage has ready.
+    Everything is allocated when it's made, on a loading thread.
+
+    Stages work in overlap-save jobs. A job transforms the two partitions of
+    input that end where it starts, multiplies the spectra of the latest ones
+    with the stage's partitions and transforms the sum back; the second half
+    of that is the stage's output for a partition. The first stage's job is
+    done as soon as its input is in, and plays straight away. A later stage's
+    job is done a piece at a time over the following partition, and plays in
+    the one after that, which is what its offset into the response allows for.
+*/
+class ConvolutionReverb::Engine
+{
+public:
+    Engine (ImpulseResponse::Ptr responseToUse, int numChannelsToUse)
+        : mResponse (std::move (responseToUse)),
+          mNumChannels (mResponse != nullptr ? juce::jlimit (0, ImpulseResponse::maxChannels, numChannelsToUse) : 0)
+    {
+        if (mResponse == nullptr)
+            return;
+
+        mRecentInput.setSize (mNumChannels, 2 * headLength, false, true);
+        mWet.setSize (mNumChannels, headLength);
+
+        int longest = headLength;
+
+        for (int index = 0; index < mResponse->getNumStages(); ++index)
+        {
+            const auto& partitions = mResponse->getStage (index);
+            const auto spectraSize = (size_t) (mNumChannels * partitions.numPartitions * partitions.getNumBins());
+            const auto sumSize = (size_t) (mNumChannels * partitions.getNumBins());
+
+            Stage stage;
+            stage.partitions = &partitions;
+            stage.fft = std::make_unique<RealFFT> (getOrder (2 * partitions.partitionSize));
+            stage.numWorkUnits = 2 * mNumChannels + partitions.numPartitions;
+            stage.spectraReal.resize (spectraSize);
+            stage.spectraImag.resize (spectraSize);
+            stage.sumReal.resize (sumSize);
+            stage.sumImag.resize (sumSize);
+            stage.playing.setSize (mNumChannels, partitions.partitionSize, false, true);
+            stage.next.setSize (mNumChannels, partitions.partitionSize, false, true);
+
+            // a transform costs several multiplies' worth, so the work is paced by an
+            // estimate of what each unit costs rather than by how many there are
+            const auto transformCost = 0.25f * (float) getOrder (2 * partitions.partitionSize);
+            const auto multiplyCost = (float) mNumChannels;
+            const auto totalCost = 2.0f * (float) mNumChannels * transformCost
+                                     + (float) partitions.numPartitions * multiplyCost;
+
+            auto cost = 0.0f;
+
+            for (int unit = 0; unit < stage.numWorkUnits; ++unit)
+            {
+                stage.unitStarts.push_back (cost / totalCost);
+                cost += isTransform (stage, unit) ? transformCost : multiplyCost;
+            }
+
+            longest = partitions.partitionSize;
+            mStages.push_back (std::move (stage));
+        }
+
+        // the input has to stay in the ring until the longest stage has transformed the two
+        // partitions before a job, which it may not get to until a partition later;
+        // a power of two, so positions wrap round with a mask
+        mRingSize = juce::nextPowerOfTwo (3 * longest);
+        mHistory.setSize (mNumChannels, mRingSize, false, true);
+        mTime.resize ((size_t) (2 * longest));
+
+        // once the input has been silent this long, nothing it left behind is still to play
+        mRingLength = mResponse->getLength() + 4 * longest;
+
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        mPosition = 0;
+        mSilentSamples = mRingLength;
+        mHistory.clear();
+        mRecentInput.clear();
+
+        for (auto& stage : mStages)
+        {
+            std::fill (stage.spectraReal.begin(), stage.spectraReal.end(), 0.0f);
+            std::fill (stage.spectraImag.begin(), stage.spectraImag.end(), 0.0f);
+            stage.playing.clear();
+            stage.next.clear();
+            stage.newestSpectrum = 0;
+            stage.unitsDone = stage.numWorkUnits;
+        }
+    }
+
+    bool isRinging() const noexcept
+    {
+        return mResponse != nullptr && mSilentSamples < mRingLength;
+    }
+
+    void process (juce::AudioBuffer<float>& buffer, float startGain, float endGain) noexcept
+    {
+        const auto numChannels = juce::jmin (mNumChannels, buffer.getNumChannels());
+        const auto numSamples = buffer.getNumSamples();
+
+        if (numChannels == 0 || numSamples == 0)
+            return;
+
+        auto isSilent = true;
+
+        for (int channel = 0; channel < numChannels && isSilent; ++channel)
+        {
+            const auto range = juce::FloatVectorOperations::findMinAndMax (buffer.getReadPointer (channel), numSamples);
+            isSilent = range.getStart() == 0.0f && range.getEnd() == 0.0f;
+        }
+
+        mSilentSamples = isSilent ? juce::jmin (mRingLength, mSilentSamples + numSamples) : 0;
+
+        // in pieces that end on the head's boundaries, where the stages' jobs start
+        for (int done = 0; done < numSamples;)
+        {
+            const auto num = juce::jmin (numSamples - done, headLength - (int) (mPosition % headLength));
+            const auto gain = startGain + (endGain - startGain) * (float) done / (float) numSamples;
+            const auto nextGain = startGain + (endGain - startGain) * (float) (done + num) / (float) numSamples;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                convolve (channel, buffer.getReadPointer (channel, done), num);
+                buffer.addFromWithRamp (channel, done, mWet.getReadPointer (channel), num, gain, nextGain);
+            }
+
+            advance (num);
+            done += num;
+        }
+    }
+
+private:
+    static constexpr int headLength = ImpulseResponse::headLength;
+
+    struct Stage
+    {
+        const ImpulseResponse::Stage* partitions = nullptr;
+        std::unique_ptr<RealFFT> fft;
+
+        // a job is a forward transform for each channel, a multiply for each partition,
+        // then an inverse transform for each channel; each unit is started once the
+        // share of the partition before it in unitStarts has gone by
+        int numWorkUnits = 0;
+        int unitsDone = 0;
+        std::vector<float> unitStarts;
+        juce::int64 jobStart = 0;
+
+        // the spectra of the latest partitions of input, newest at newestSpectrum and
+        // going back from there: for each channel, numPartitions of them in turn
+        std::vector<float> spectraReal, spectraImag;
+        int newestSpectrum = 0;
+
+        // for each channel, the products summed so far
+        std::vector<float> sumReal, sumImag;
+
+        // the output for the partition playing now and, for the later stages, the next one
+        juce::AudioBuffer<float> playing, next;
+    };
+
+    /** Takes in a piece of input that stays inside one head, and works out the reverb
+        of it into mWet.
+    */
+    void convolve (int channel, const float* input, int numSamples) noexcept
+    {
+        const auto offset = (int) (mPosition % headLength);
+
+        juce::FloatVectorOperations::copy (mHistory.getWritePointer (channel, (int) (mPosition & (mRingSize - 1))),
+                                           input, numSamples);
+
+        // the current head's input, after the previous head's, which the taps reach back into
+        auto* recent = mRecentInput.getWritePointer (channel, headLength + offset);
+        juce::FloatVectorOperations::copy (recent, input, numSamples);
+
+        const auto* head = mResponse->getHead (channel % mResponse->getNumChannels());
+        auto* wet = mWet.getWritePointer (channel);
+
+        juce::FloatVectorOperations::copyWithMultiply (wet, recent, head[0], numSamples);
+
+        for (int tap = 1; tap < headLength; ++tap)
+            juce::FloatVectorOperations::addWithMultiply (wet, recent - tap, head[tap], numSamples);
+
+        for (auto& stage : mStages)
+            juce::FloatVectorOperations::add (wet, stage.playing.getReadPointer (channel, (int) (mPosition % stage.partitions->partitionSize)),
+                                              numSamples);
+    }
+
+    /** Moves on past a piece of input, starting jobs on the boundaries they fall on,
+        and catches the later stages up with the share of work that's due.
+    */
+    void advance (int numSamples) noexcept
+    {
+        mPosition += numSamples;
+
+        if (mPosition % headLength == 0)
+        {
+            for (int channel = 0; channel < mNumChannels; ++channel)
+                mRecentInput.copyFrom (channel, 0, mRecentInput, channel, headLength, headLength);
+
+            for (auto& stage : mStages)
+                if (mPosition % stage.partitions->partitionSize == 0)
+                    startJob (stage);
+        }
+
+        for (auto& stage : mStages)
+        {
+            if (! stage.partitions->isDeferred || stage.unitsDone == stage.numWorkUnits)
+                continue;
+
+            const auto elapsed = (float) (mPosition - stage.jobStart) / (float) stage.partitions->partitionSize;
+
+            while (stage.unitsDone < stage.numWorkUnits && stage.unitStarts[(size_t) stage.unitsDone] < elapsed)
+                doWorkUnit (stage, stage.unitsDone++);
+        }
+    }
+
+    void startJob (Stage& stage) noexcept
+    {
+        // a later stage's previous job plays from here, so whatever's left of it is done now
+        if (stage.partitions->isDeferred)
+        {
+            while (stage.unitsDone < stage.numWorkUnits)
+                doWorkUnit (stage, stage.unitsDone++);
+
+            std::swap (stage.playing, stage.next);
+        }
+
+        stage.jobStart = mPosition;
+        stage.unitsDone = 0;
+
+        if (! stage.partitions->isDeferred)
+            while (stage.unitsDone < stage.numWorkUnits)
+                doWorkUnit (stage, stage.unitsDone++);
+    }
+
+    void doWorkUnit (Stage& stage, int unit) noexcept
+    {
+        const auto& partitions = *stage.partitions;
+        const auto partitionSize = partitions.partitionSize;
+        const auto numPartitions = partitions.numPartitions;
+        const auto numBins = partitions.getNumBins();
+
+        auto spectrum = [&] (std::vector<float>& spectra, int channel, int slot)
+        {
+            return spectra.data() + (size_t) ((channel * numPartitions + slot) * numBins);
+        };
+
+        if (unit < mNumChannels)
+        {
+            const auto channel = unit;
+
+            if (channel == 0)
+                stage.newestSpectrum = (stage.newestSpectrum + 1) % numPartitions;
+
+            readHistory (channel, stage.jobStart - 2 * partitionSize, 2 * partitionSize, mTime.data());
+            stage.fft->forward (mTime.data(), spectrum (stage.spectraReal, channel, stage.newestSpectrum),
+                                spectrum (stage.spectraImag, channel, stage.newestSpectrum));
+        }
+        else if (unit < mNumChannels + numPartitions)
+        {
+            // partition p of the response goes with the input from p partitions ago
+            const auto partition = unit - mNumChannels;
+            const auto slot = (stage.newestSpectrum - partition + numPartitions) % numPartitions;
+
+            for (int channel = 0; channel < mNumChannels; ++channel)
+            {
+                const auto responseChannel = channel % mResponse->getNumChannels();
+
+                multiplySpectra (stage.sumReal.data() + (size_t) (channel * numBins),
+                                 stage.sumImag.data() + (size_t) (channel * numBins),
+                                 spectrum (stage.spectraReal, channel, slot), spectrum (stage.spectraImag, channel, slot),
+                                 partitions.getReal (responseChannel, partition), partitions.getImag (responseChannel, partition),
+                                 numBins, partition > 0);
+            }
+        }
+        else
+        {
+            const auto channel = unit - mNumChannels - numPartitions;
+            auto& output = partitions.isDeferred ? stage.next : stage.playing;
+
+            // the first half has wrapped round from the end, so only the second is kept
+            stage.fft->inverse (stage.sumReal.data() + (size_t) (channel * numBins),
+                                stage.sumImag.data() + (size_t) (channel * numBins), mTime.data());
+            output.copyFrom (channel, 0, mTime.data() + partitionSize, partitionSize);
+        }
+    }
+
+    bool isTransform (const Stage& stage, int unit) const noexcept
+    {
+        return unit < mNumChannels || unit >= mNumChannels + stage.partitions->numPartitions;
+    }
+
+    void readHistory (int channel, juce::int64 start, int numSamples, float* dest) const noexcept
+    {
+        const auto first = (int) (start & (mRingSize - 1));
+        const auto numBeforeWrap = juce::jmin (numSamples, mRingSize - first);
+
+        juce::FloatVectorOperations::copy (dest, mHistory.getReadPointer (channel, first), numBeforeWrap);
+        juce::FloatVectorOperations::copy (dest + numBeforeWrap, mHistory.getReadPointer (channel), numSamples - numBeforeWrap);
+    }
+
+    const ImpulseResponse::Ptr mResponse;
+    const int mNumChannels;
+    std::vector<Stage> mStages;
+
+    juce::AudioBuffer<float> mHistory, mRecentInput, mWet;
+    std::vector<float> mTime;
+    int mRingSize = 0;
+    juce::int64 mPosition = 0;
+    int mRingLength = 0;
+    int mSilentSamples = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Engine)
+};
+
+//==============================================================================
+class ConvolutionReverb::LoadJob  : public juce::ThreadPoolJob
+{
+public:
+    LoadJob (ConvolutionReverb& reverb, const juce::File& fileToLoad, double rate, int channels, int loadGeneration)
+        : juce::ThreadPoolJob ("Impulse response"),
+          owner (reverb), file (fileToLoad), sampleRate (rate), numChannels (channels), generation (loadGeneration)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        // a newer load would only replace what this one made
+        if (owner.mGeneration.load() != generation)
+            return jobHasFinished;
+
+        // a file that can't be read leaves the reverb silent, like an empty one
+        ImpulseResponse::Ptr response;
+
+        if (file.existsAsFile())
+        {
+            const ImpulseResponse::Key key { file.getFullPathName(), SamplePool::computeContentHash (file), sampleRate };
+            response = owner.mCache->find (key);
+
+            if (response == nullptr)
+                if (auto loaded = ImpulseResponse::load (file, key.contentHash, sampleRate, owner.mFormatManager))
+                    response = owner.mCache->add (loaded);
+        }
+
+        if (shouldExit())
+            return jobHasFinished;
+
+        const auto lengthInSeconds = response != nullptr ? response->getLengthInSeconds() : 0.0;
+        owner.handOver (std::make_unique<Engine> (response, numChannels), lengthInSeconds, generation);
+        return jobHasFinished;
+    }
+
+    ConvolutionReverb& owner;
+
+private:
+    const juce::File file;
+    const double sampleRate;
+    const int numChannels;
+    const int generation;
+};
+
+//==============================================================================
+ConvolutionReverb::ConvolutionReverb()
+{
+    mFormatManager.registerBasicFormats();
+}
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+    cancelLoad();
+
+    delete mPending.exchange (nullptr);
+    delete mRetired.exchange (nullptr);
+}
+
+void ConvolutionReverb::prepare (double sampleRate, int numChannels)
+{
+    numChannels = juce::jmin (numChannels, ImpulseResponse::maxChannels);
+
+    if (sampleRate == mSampleRate && numChannels == mNumChannels)
+        return;
+
+    mSampleRate = sampleRate;
+    mNumChannels = numChannels;
+
+    // the state was made for the old rate and channels, so the response is made again for these
+    if (getImpulseResponseFile() != juce::File())
+        startLoad();
+}
+
+void ConvolutionReverb::reset() noexcept
+{
+    if (mEngine != nullptr)
+        mEngine->reset();
+}
+
+void ConvolutionReverb::loadImpulseResponse (const juce::File& file)
+{
+    {
+        const juce::ScopedLock sl (mFileLock);
+        mFile = file;
+    }
+
+    startLoad();
+}
+
+juce::File ConvolutionReverb::getImpulseResponseFile() const
+{
+    const juce::ScopedLock sl (mFileLock);
+    return mFile;
+}
+
+void ConvolutionReverb::startLoad()
+{
+    juce::File file;
+    int generation = 0;
+
+    {
+        const juce::ScopedLock sl (mFileLock);
+        file = mFile;
+        generation = ++mGeneration;
+    }
+
+    // prepare() starts it once there's a rate to convert to
+    if (mSampleRate <= 0.0 || mNumChannels <= 0)
+        return;
+
+    mPool->addJob (new LoadJob (*this, file, mSampleRate, mNumChannels, generation), true);
+}
+
+void ConvolutionReverb::cancelLoad()
+{
+    // the pool is shared, so only pick out the jobs that belong to this reverb
+    struct OwnJobs  : public juce::ThreadPool::JobSelector
+    {
+        explicit OwnJobs (ConvolutionReverb& r) : reverb (r) {}
+
+        bool isJobSuitable (juce::ThreadPoolJob* job) override
+        {
+            if (auto* loadJob = dynamic_cast<LoadJob*> (job))
+                return &loadJob->owner == &reverb;
+
+            return false;
+        }
+
+        ConvolutionReverb& reverb;
+    };
+
+    OwnJobs selector (*this);
+    mPool->removeAllJobs (true, 10000, &selector);
+}
+
+void ConvolutionReverb::handOver (std::unique_ptr<Engine> engine, double lengthInSeconds, int generation)
+{
+    // under the lock, so a load that has just been overtaken can't hand over after the newer one
+    const juce::ScopedLock sl (mFileLock);
+
+    if (generation != mGeneration.load())
+        return;
+
+    mLengthInSeconds = lengthInSeconds;
+
+    // one the audio thread never got round to picking up is simply replaced
+    delete mPending.exchange (engine.release(), std::memory_order_acq_rel);
+    mReadyGeneration = generation;
+}
+
+//==============================================================================
+void ConvolutionReverb::process (juce::AudioBuffer<float>& buffer, float startGain, float endGain) noexcept
+{
+    // a new state is only picked up once the one before it has been collected, so the
+    // audio thread never frees anything; until then the old one keeps playing
+    if (mPending.load (std::memory_order_relaxed) != nullptr && mRetired.load (std::memory_order_acquire) == nullptr)
+    {
+        mRetired.store (mEngine.release(), std::memory_order_release);
+        mEngine.reset (mPending.exchange (nullptr, std::memory_order_acq_rel));
+    }
+
+    if (mEngine != nullptr)
+        mEngine->process (buffer, startGain, endGain);
+}
+
+bool ConvolutionReverb::isRinging() const noexcept
+{
+    return mEngine != nullptr && mEngine->isRinging();
+}
+
+void ConvolutionReverb::collectGarbage()
+{
+    delete mRetired.exchange (nullptr, std::memory_order_acq_rel);
+
+    // responses no instance's reverb uses any more
+    mCache->purgeUnused();
+}
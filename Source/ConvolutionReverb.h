@@ -0,0 +1,248 @@
+/*
+  ==============================================================================
+
+    ConvolutionReverb.h
+    A zero-latency convolution reverb on the sampler's main output.
+
+    Impulse responses are split into partitions that get longer the further
+    into the response they are, so a long hall costs little more per sample
+    than a short room, at any block size. Instances that load the same response
+    share its transformed partitions through the ImpulseResponseCache.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RealFFT.h"
+#include "SampleLoader.h"
+
+//==============================================================================
+/**
+    An impulse response, cut into partitions and transformed, ready to convolve
+    with. Immutable once made, so any number of reverbs in any number of
+    instances can use one at the same time.
+
+    The first headLength taps are kept as they are and applied directly, which is
+    what lets the reverb answer in the same sample. The rest is split into stages
+    whose partitions are four times as long as the stage before's: 64 samples,
+    then 256, 1024, and 4096 to the end. A stage starts late enough in the
+    response that its FFTs can be worked on while its previous partition plays.
+*/
+class ImpulseResponse  : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<ImpulseResponse>;
+
+    /** Taps applied directly, without an FFT. */
+    static constexpr int headLength = 64;
+
+    /** Stages of partitions, each four times as long as the one before. */
+    static constexpr int maxStages = 4;
+
+    /** The most channels a response is read with. Each output channel uses the
+        response channel at its index, wrapped round.
+    */
+    static constexpr int maxChannels = 8;
+
+    /** Anything longer is cut off; no room rings for this long. */
+    static constexpr double maxSeconds = 10.0;
+
+    /** Identifies a response: where it was read from, what it contained and the
+        rate it was converted to.
+    */
+    struct Key
+    {
+        juce::String path;
+        juce::uint64 contentHash = 0;
+        double sampleRate = 0.0;
+
+        bool operator== (const Key&) const noexcept;
+        bool operator!= (const Key& other) const noexcept   { return ! operator== (other); }
+    };
+
+    /** One stage's partitions, transformed at twice their length. */
+    struct Stage
+    {
+        int partitionSize = 0;
+        int offset = 0;             // the first tap of the response the stage covers
+        int numPartitions = 0;
+        bool isDeferred = false;    // worked on a partition ahead of when it plays
+
+        // for each channel, each partition's bins in turn
+        std::vector<float> real, imag;
+
+        int getNumBins() const noexcept                             { return partitionSize + 1; }
+
+        const float* getReal (int channel, int partition) const noexcept
+        {
+            return real.data() + (size_t) ((channel * numPartitions + partition) * getNumBins());
+        }
+
+        const float* getImag (int channel, int partition) const noexcept
+        {
+            return imag.data() + (size_t) ((channel * numPartitions + partition) * getNumBins());
+        }
+    };
+
+    /** Splits up and transforms a response that is already at the key's rate. */
+    ImpulseResponse (const Key&, const juce::AudioBuffer<float>& response);
+
+    //==============================================================================
+    const Key& getKey() const noexcept                              { return mKey; }
+    int getNumChannels() const noexcept                             { return mNumChannels; }
+    int getLength() const noexcept                                  { return mLength; }
+    double getLengthInSeconds() const noexcept                      { return mLength / mKey.sampleRate; }
+
+    /** The first headLength taps of a channel. */
+    const float* getHead (int channel) const noexcept               { return mHead.getReadPointer (channel); }
+
+    /** The stages the response reaches into; the ones past its end are left out. */
+    int getNumStages() const noexcept                               { return (int) mStages.size(); }
+    const Stage& getStage (int index) const noexcept                { return mStages[(size_t) index]; }
+
+    //==============================================================================
+    static int getPartitionSize (int stage) noexcept                { return headLength << (2 * stage); }
+
+    /** The first stage plays as soon as its partition's input is in, so it starts
+        a partition after the head; the later ones start two partitions in, which
+        leaves them a partition's time to be worked on.
+    */
+    static int getStageOffset (int stage) noexcept
+    {
+        return stage == 0 ? headLength : 2 * getPartitionSize (stage);
+    }
+
+    /** Reads a file, converts it to sampleRate and scales it to unit energy.
+        Returns nullptr if it can't be read. Loading threads only.
+    */
+    static Ptr load (const juce::File&, juce::uint64 contentHash, double sampleRate,
+                     juce::AudioFormatManager&);
+
+private:
+    const Key mKey;
+    int mNumChannels = 0;
+    int mLength = 0;
+    juce::AudioBuffer<float> mHead;
+    std::vector<Stage> mStages;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ImpulseResponse)
+};
+
+//==============================================================================
+/**
+    The process-wide table of transformed impulse responses, shared through a
+    SharedResourcePointer the same way as the SamplePool.
+
+    Entries are only freed by purgeUnused(), which the instances call from their
+    timers, so a response is never deleted on a loading or audio thread.
+*/
+class ImpulseResponseCache
+{
+public:
+    ImpulseResponseCache();
+    ~ImpulseResponseCache();
+
+    /** Returns the response made for this key, or nullptr if nobody has it. */
+    ImpulseResponse::Ptr find (const ImpulseResponse::Key&) const;
+
+    /** Adds a newly made response. If another thread added the same key in the
+        meantime, that response is returned instead and the new one should be dropped.
+    */
+    ImpulseResponse::Ptr add (ImpulseResponse::Ptr newResponse);
+
+    /** Frees the responses nothing outside the cache is using any more. */
+    void purgeUnused();
+
+    int getNumResponses() const;
+
+private:
+    juce::CriticalSection mLock;
+    juce::ReferenceCountedArray<ImpulseResponse> mResponses;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ImpulseResponseCache)
+};
+
+//==============================================================================
+/**
+    Adds the reverb of a buffer's channels back into them, as a send.
+
+    Nothing is delayed: the head is applied directly, the first stage as soon as
+    each 64 samples are in, and every later stage has a whole partition of time
+    between the input it transforms and the output it plays. That work is
+    spread over the partition, paced by what each piece of it costs, so no
+    block has to do a whole stage's FFTs at once and the cost stays even at
+    32 or 64 sample blocks.
+
+    Responses load on the SampleLoaderPool threads, which also build each new
+    state for the audio thread to pick up; only the most recent load matters.
+    The state it replaces is freed by collectGarbage(), on the message thread.
+*/
+class ConvolutionReverb
+{
+public:
+    ConvolutionReverb();
+    ~ConvolutionReverb();
+
+    /** Sets the rate and channels to convolve at, and loads the response again
+        if they've changed. Message thread, while process() isn't running.
+    */
+    void prepare (double sampleRate, int numChannels);
+
+    /** Silences what's still ringing. Not while process() is running. */
+    void reset() noexcept;
+
+    /** Loads a response in the background and returns straight away. An empty
+        file takes the response away. Message thread.
+    */
+    void loadImpulseResponse (const juce::File&);
+
+    /** The file last asked for, whether or not it has loaded. */
+    juce::File getImpulseResponseFile() const;
+
+    /** True from a load starting until its state is ready for process() to pick up. */
+    bool isLoading() const noexcept                                 { return mReadyGeneration.load() != mGeneration.load(); }
+
+    /** The length of the response that's loaded, or waiting to be picked up. */
+    double getLengthInSeconds() const noexcept                      { return mLengthInSeconds.load(); }
+
+    //==============================================================================
+    /** Adds the reverb of the buffer's first channels to them, at a gain that
+        ramps from startGain to endGain over the block. Audio thread.
+    */
+    void process (juce::AudioBuffer<float>&, float startGain, float endGain) noexcept;
+
+    /** True while input given to process() may still be heard. Audio thread. */
+    bool isRinging() const noexcept;
+
+    /** Frees the states the audio thread has replaced. Message thread. */
+    void collectGarbage();
+
+private:
+    class Engine;
+    class LoadJob;
+
+    void startLoad();
+    void cancelLoad();
+    void handOver (std::unique_ptr<Engine>, double lengthInSeconds, int generation);
+
+    juce::SharedResourcePointer<SampleLoaderPool> mPool;
+    juce::SharedResourcePointer<ImpulseResponseCache> mCache;
+    juce::AudioFormatManager mFormatManager;
+
+    juce::CriticalSection mFileLock;
+    juce::File mFile;
+    double mSampleRate = 0.0;
+    int mNumChannels = 0;
+    std::atomic<int> mGeneration { 0 }, mReadyGeneration { 0 };
+    std::atomic<double> mLengthInSeconds { 0.0 };
+
+    // only the audio thread touches the current state; new ones come through
+    // mPending and old ones leave through mRetired
+    std::unique_ptr<Engine> mEngine;
+    std::atomic<Engine*> mPending { nullptr };
+    std::atomic<Engine*> mRetired { nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConvolutionReverb)
+};
@@ -0,0 +1,296 @@
+/*
+  ==============================================================================
+
+    DecodedSampleCache.cpp
+    Keeps decoded copies of compressed samples on disk, so they only get
+    decoded once, and copies converted to the host's sample rate.
+
+  ==============================================================================
+*/
+
+#include "DecodedSampleCache.h"
+#include "Interpolation.h"
+#include "VoiceKernels.h"
+
+namespace
+{
+    constexpr juce::int64 defaultMaxSize = (juce::int64) 2 * 1024 * 1024 * 1024;
+    constexpr juce::int64 defaultMaxConvertedSize = (juce::int64) 1024 * 1024 * 1024;
+    constexpr int decodeChunkSize = 65536;
+
+    // entry names are always this many hex digits, which tells them apart from
+    // the temporary files a write in progress uses
+    constexpr int entryNameLength = 16;
+
+    juce::File getDefaultDirectory()
+    {
+       #if JUCE_MAC
+        const char* path = "Application Support/simpleSampler/Decoded Samples";
+       #else
+        const char* path = "simpleSampler/Decoded Samples";
+       #endif
+
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory).getChildFile (path);
+    }
+
+    juce::File getPeaksFile (const juce::File& entry)
+    {
+        return entry.withFileExtension ("peaks");
+    }
+
+    juce::File getConvertedDirectory (const juce::File& directory)
+    {
+        return directory.getChildFile ("Converted");
+    }
+
+    // deletes the entries in one directory used least recently until it fits
+    void trimDirectory (const juce::File& directory, juce::int64 maxSize,
+                        const juce::File& keep, const juce::Array<juce::File>& inUse)
+    {
+        struct Entry
+        {
+            juce::File file;
+            juce::int64 size;
+            juce::Time lastUsed;
+        };
+
+        std::vector<Entry> entries;
+        juce::int64 totalSize = 0;
+
+        for (auto& found : juce::RangedDirectoryIterator (directory, false, "*.wav"))
+        {
+            auto file = found.getFile();
+
+            if (file.getFileNameWithoutExtension().length() != entryNameLength)
+                continue;
+
+            auto size = file.getSize() + getPeaksFile (file).getSize();
+            entries.push_back ({ file, size, file.getLastAccessTime() });
+            totalSize += size;
+        }
+
+        std::sort (entries.begin(), entries.end(),
+                   [] (const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+
+        for (auto& entry : entries)
+        {
+            if (totalSize <= maxSize)
+                break;
+
+            // an entry that's playing stays until its data is purged, so its space isn't
+            // freed behind the pool's back; deleting a mapped file also fails on some
+            // systems, in which case it stays for now as well
+            if (entry.file == keep || inUse.contains (entry.file) || ! entry.file.deleteFile())
+                continue;
+
+            getPeaksFile (entry.file).deleteFile();
+            totalSize -= entry.size;
+        }
+    }
+
+    // output frames converted in one go
+    constexpr int convertChunkSize = 4096;
+
+    // writes the whole of a source out at another rate, reading it through the same
+    // kernels and tables the voices use for their 32-tap sinc mode
+    bool writeConverted (juce::AudioFormatReader& source, juce::AudioFormatWriter& writer, double sampleRate,
+                         const std::function<bool (float)>& progressCallback)
+    {
+        juce::SharedResourcePointer<InterpolationTables> tables;
+        tables->prepare();
+
+        const auto quality = InterpolationQuality::sinc32;
+        const auto ratio = source.sampleRate / sampleRate;
+        const auto footprint = getInterpolationFootprint (quality);
+        const auto* sincTable = tables->getSincTable (quality, ratio);
+        const auto numChannels = (int) writer.getNumChannels();
+        const auto length = (juce::int64) std::ceil ((double) source.lengthInSamples / ratio);
+
+        if (sincTable == nullptr)
+            return false;
+
+        juce::HeapBlock<int> index (convertChunkSize);
+        juce::HeapBlock<float> alpha (convertChunkSize);
+        juce::AudioBuffer<float> span (numChannels, (int) std::ceil (convertChunkSize * ratio)
+                                                      + footprint.framesBefore + footprint.framesAfter + 2);
+        juce::AudioBuffer<float> converted (numChannels, convertChunkSize);
+
+        for (juce::int64 start = 0; start < length; start += convertChunkSize)
+        {
+            if (! progressCallback ((float) start / (float) length))
+                return false;
+
+            const auto numThisChunk = (int) juce::jmin ((juce::int64) convertChunkSize, length - start);
+
+            // worked out from the start of the chunk each time, so rounding errors don't add up
+            const auto position = (double) start * ratio;
+            const auto firstFrame = (juce::int64) position;
+
+            VoiceKernels::computeReadPositions (position - (double) firstFrame, ratio, index, alpha, numThisChunk);
+
+            const auto spanLength = footprint.framesBefore + index[numThisChunk - 1] + footprint.framesAfter + 1;
+            source.read (&span, 0, spanLength, firstFrame - footprint.framesBefore, true, true);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                VoiceKernels::interpolateSinc (span.getReadPointer (channel, footprint.framesBefore), index, alpha,
+                                               converted.getWritePointer (channel), numThisChunk,
+                                               sincTable, getNumSincTaps (quality));
+
+            if (! writer.writeFromAudioSampleBuffer (converted, 0, numThisChunk))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+//==============================================================================
+DecodedSampleCache::DecodedSampleCache()
+    : mDirectory (getDefaultDirectory()), mMaxSize (defaultMaxSize), mMaxConvertedSize (defaultMaxConvertedSize)
+{
+}
+
+DecodedSampleCache::~DecodedSampleCache()
+{
+}
+
+juce::File DecodedSampleCache::find (const juce::File& source, juce::uint64 contentHash, double sampleRate)
+{
+    auto entry = getEntryFile (source, contentHash, sampleRate);
+
+    if (! entry.existsAsFile())
+        return {};
+
+    // the access time is what the size limit goes by
+    entry.setLastAccessTime (juce::Time::getCurrentTime());
+    return entry;
+}
+
+juce::File DecodedSampleCache::add (const juce::File& source, juce::uint64 contentHash, juce::AudioFormatReader& decoder,
+                                    double sampleRate, const std::function<bool (float)>& progressCallback)
+{
+    const auto length = decoder.lengthInSamples;
+    const auto numChannels = (int) decoder.numChannels;
+
+    auto entry = getEntryFile (source, contentHash, sampleRate);
+
+    if (length <= 0 || numChannels <= 0 || ! entry.getParentDirectory().createDirectory())
+        return {};
+    const auto needsConverting = sampleRate > 0.0 && sampleRate != decoder.sampleRate;
+
+    // written under another name and then moved into place, so a half-written
+    // entry is never found, and two threads adding the same file don't collide
+    juce::TemporaryFile temp (entry);
+
+    {
+        std::unique_ptr<juce::FileOutputStream> out (temp.getFile().createOutputStream());
+
+        if (out == nullptr)
+            return {};
+
+        juce::WavAudioFormat wav;
+        const auto entryRate = needsConverting ? sampleRate : decoder.sampleRate;
+        // the copy keeps the file's speaker layout, so the voices mix it down the same way
+        const auto layout = decoder.getChannelLayout();
+        std::unique_ptr<juce::AudioFormatWriter> writer (layout.size() == numChannels && wav.isChannelLayoutSupported (layout)
+                                                            ? wav.createWriterFor (out.get(), entryRate, layout, 32, {}, 0)
+                                                            : wav.createWriterFor (out.get(), entryRate,
+                                                                                   (unsigned int) numChannels, 32, {}, 0));
+
+        if (writer == nullptr)
+            return {};
+
+        out.release();  // the writer owns it now
+
+        if (needsConverting)
+        {
+            if (! writeConverted (decoder, *writer, sampleRate, progressCallback))
+                return {};
+        }
+        else
+        {
+            juce::AudioBuffer<float> chunk (numChannels, decodeChunkSize);
+
+            for (juce::int64 start = 0; start < length; start += decodeChunkSize)
+            {
+                if (! progressCallback ((float) start / (float) length))
+                    return {};
+
+                auto numToRead = (int) juce::jmin ((juce::int64) decodeChunkSize, length - start);
+
+                decoder.read (&chunk, 0, numToRead, start, true, true);
+
+                if (! writer->writeFromAudioSampleBuffer (chunk, 0, numToRead))
+                    return {};
+            }
+        }
+    }
+
+    if (! temp.overwriteTargetFileWithTemporary())
+        return {};
+
+    progressCallback (1.0f);
+    trim (entry);
+    return entry;
+}
+
+PeakPyramid::Ptr DecodedSampleCache::findPeaks (const juce::File& entry)
+{
+    juce::FileInputStream in (getPeaksFile (entry));
+
+    if (! in.openedOk())
+        return {};
+
+    return PeakPyramid::read (in);
+}
+
+void DecodedSampleCache::addPeaks (const juce::File& entry, const PeakPyramid& peaks)
+{
+    juce::TemporaryFile temp (getPeaksFile (entry));
+
+    {
+        juce::FileOutputStream out (temp.getFile());
+
+        if (! out.openedOk() || ! peaks.write (out))
+            return;
+    }
+
+    temp.overwriteTargetFileWithTemporary();
+}
+
+//==============================================================================
+void DecodedSampleCache::setMaxSize (juce::int64 maxBytes)
+{
+    mMaxSize = juce::jmax ((juce::int64) 0, maxBytes);
+    trim ({});
+}
+
+void DecodedSampleCache::setMaxConvertedSize (juce::int64 maxBytes)
+{
+    mMaxConvertedSize = juce::jmax ((juce::int64) 0, maxBytes);
+    trim ({});
+}
+
+juce::File DecodedSampleCache::getEntryFile (const juce::File& source, juce::uint64 contentHash, double sampleRate) const
+{
+    auto fingerprint = source.getFullPathName()
+                         + "|" + juce::String (source.getSize())
+                         + "|" + juce::String (source.getLastModificationTime().toMilliseconds())
+                         + "|" + juce::String (contentHash);
+
+    // plain decoded copies keep the names they had before there were converted ones
+    if (sampleRate > 0.0)
+        fingerprint << "|" << juce::String (sampleRate);
+
+    auto name = juce::String::toHexString (fingerprint.hashCode64()).paddedLeft ('0', entryNameLength);
+    return (sampleRate > 0.0 ? getConvertedDirectory (mDirectory) : mDirectory).getChildFile (name + ".wav");
+}
+
+void DecodedSampleCache::trim (const juce::File& keep)
+{
+    const juce::ScopedLock sl (mTrimLock);
+    const auto inUse = mSamplePool->getSourceFiles();
+
+    trimDirectory (mDirectory, mMaxSize.load(), keep, inUse);
+    trimDirectory (getConvertedDirectory (mDirectory), mMaxConvertedSize.load(), keep, inUse);
+}
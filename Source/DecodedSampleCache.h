@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    DecodedSampleCache.h
+    Keeps decoded copies of compressed samples on disk, so they only get
+    decoded once, and copies converted to the host's sample rate.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PeakPyramid.h"
+#include "SamplePool.h"
+
+//==============================================================================
+/**
+    A directory of compressed samples (MP3 and the like) decoded to 32-bit float
+    WAV files, which load like any other WAV: memory-mapped, with nothing to
+    decode. The peaks of each entry are kept next to it, so the editor doesn't
+    need the whole file read again either.
+
+    An entry can also be converted to another sample rate as it is written, with
+    the 32-tap windowed sinc the voices use at their best quality, so a sample
+    can be played at the host's rate without resampling every voice.
+
+    Entries are named after a hash of the source's path, size, modification time
+    and content hash, so an edited or replaced source gets a new entry, and the
+    stale one ages out. When the directory grows past its size limit, the
+    entries used least recently are deleted first, apart from any that data in
+    the SamplePool is still playing from.
+
+    Converted copies are kept in a directory of their own with a separate, smaller
+    limit, since every rate a host runs at adds another copy of each sample, and
+    they mustn't push the decoded copies out.
+
+    Shared by the whole process through a SharedResourcePointer, and safe to use
+    from any number of loading threads.
+*/
+class DecodedSampleCache
+{
+public:
+    DecodedSampleCache();
+    ~DecodedSampleCache();
+
+    /** Returns the decoded copy of a source file, or File() if there isn't one.
+        A sample rate other than 0 finds the copy converted to that rate.
+    */
+    juce::File find (const juce::File& source, juce::uint64 contentHash, double sampleRate = 0.0);
+
+    /** Decodes a source file into the cache and returns the new entry, or File()
+        if it couldn't be written. A sample rate other than 0 converts it to that
+        rate as well. Decoding is reported as a progress from 0 to 1, and stops if
+        the callback returns false.
+    */
+    juce::File add (const juce::File& source, juce::uint64 contentHash, juce::AudioFormatReader& decoder,
+                    double sampleRate, const std::function<bool (float)>& progressCallback);
+
+    /** The peaks saved for an entry, or nullptr if there aren't any. */
+    PeakPyramid::Ptr findPeaks (const juce::File& entry);
+
+    /** Saves the peaks of an entry, to be found by findPeaks() next time. */
+    void addPeaks (const juce::File& entry, const PeakPyramid& peaks);
+
+    //==============================================================================
+    /** Sets how big the decoded copies may get before old entries are deleted. */
+    void setMaxSize (juce::int64 maxBytes);
+    juce::int64 getMaxSize() const noexcept                 { return mMaxSize.load(); }
+
+    /** Sets how big the converted copies may get before old entries are deleted. */
+    void setMaxConvertedSize (juce::int64 maxBytes);
+    juce::int64 getMaxConvertedSize() const noexcept        { return mMaxConvertedSize.load(); }
+
+    juce::File getDirectory() const                         { return mDirectory; }
+
+private:
+    juce::File getEntryFile (const juce::File& source, juce::uint64 contentHash, double sampleRate) const;
+
+    /** Deletes the entries used least recently until both directories fit, apart
+        from keep and those the pool is playing from.
+    */
+    void trim (const juce::File& keep);
+
+    const juce::File mDirectory;
+    std::atomic<juce::int64> mMaxSize, mMaxConvertedSize;
+    juce::CriticalSection mTrimLock;
+    juce::SharedResourcePointer<SamplePool> mSamplePool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DecodedSampleCache)
+};
@@ -0,0 +1,225 @@
+/*
+  ==============================================================================
+
+    Downmix.cpp
+    How the channels of a sample are spread over those of the bus it plays
+    through, when the two don't have the same speakers.
+
+  ==============================================================================
+*/
+
+#include "Downmix.h"
+
+namespace Downmix
+{
+namespace
+{
+    using Set = juce::AudioChannelSet;
+
+    constexpr float minus3dB = 0.70710678f;
+
+    enum class Side { left, right, centre, lfe, unknown };
+
+    Side getSide (Set::ChannelType type) noexcept
+    {
+        switch (type)
+        {
+            case Set::left:
+            case Set::leftCentre:
+            case Set::leftSurround:
+            case Set::leftSurroundSide:
+            case Set::leftSurroundRear:
+            case Set::wideLeft:
+            case Set::topFrontLeft:
+            case Set::topRearLeft:
+                return Side::left;
+
+            case Set::right:
+            case Set::rightCentre:
+            case Set::rightSurround:
+            case Set::rightSurroundSide:
+            case Set::rightSurroundRear:
+            case Set::wideRight:
+            case Set::topFrontRight:
+            case Set::topRearRight:
+                return Side::right;
+
+            case Set::centre:
+            case Set::centreSurround:
+            case Set::topMiddle:
+            case Set::topFrontCentre:
+            case Set::topRearCentre:
+                return Side::centre;
+
+            case Set::LFE:
+            case Set::LFE2:
+                return Side::lfe;
+
+            default:
+                return Side::unknown;
+        }
+    }
+
+    bool isSurround (Set::ChannelType type) noexcept
+    {
+        return type == Set::leftSurround || type == Set::leftSurroundSide || type == Set::leftSurroundRear
+            || type == Set::rightSurround || type == Set::rightSurroundSide || type == Set::rightSurroundRear;
+    }
+
+    int findChannel (const Layout& layout, int numChannels, Set::ChannelType type) noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            if (layout[(size_t) channel] == type)
+                return channel;
+
+        return -1;
+    }
+
+    // where a surround goes when the bus doesn't have its speaker: the nearest other
+    // surround on its side, side before rear
+    int findOtherSurround (const Layout& output, int numOutputs, Side side) noexcept
+    {
+        const Set::ChannelType leftSurrounds[]  { Set::leftSurround, Set::leftSurroundSide, Set::leftSurroundRear };
+        const Set::ChannelType rightSurrounds[] { Set::rightSurround, Set::rightSurroundSide, Set::rightSurroundRear };
+
+        for (auto type : side == Side::left ? leftSurrounds : rightSurrounds)
+        {
+            auto channel = findChannel (output, numOutputs, type);
+
+            if (channel >= 0)
+                return channel;
+        }
+
+        return -1;
+    }
+
+    // the extra channels wrap round onto the ones the bus has, scaled so a stereo
+    // sound on a mono bus comes out as the average of its two sides
+    void fold (int numSourceChannels, int numOutputs, Matrix& matrix) noexcept
+    {
+        const auto gain = numSourceChannels > numOutputs ? (float) numOutputs / (float) numSourceChannels : 1.0f;
+
+        for (int channel = 0; channel < numSourceChannels; ++channel)
+            matrix.gains[channel][channel % numOutputs] += gain;
+    }
+
+    // a bus with a left and a right speaker
+    void mapBySpeaker (const Layout& source, int numSourceChannels,
+                       const Layout& output, int numOutputs, Matrix& matrix) noexcept
+    {
+        const auto outLeft = findChannel (output, numOutputs, Set::left);
+        const auto outRight = findChannel (output, numOutputs, Set::right);
+
+        for (int channel = 0; channel < numSourceChannels; ++channel)
+        {
+            const auto type = source[(size_t) channel];
+            auto* gains = matrix.gains[channel];
+
+            const auto same = findChannel (output, numOutputs, type);
+
+            if (same >= 0)
+            {
+                gains[same] = 1.0f;
+                continue;
+            }
+
+            switch (getSide (type))
+            {
+                case Side::centre:
+                    gains[outLeft] = minus3dB;
+                    gains[outRight] = minus3dB;
+                    break;
+
+                case Side::left:
+                case Side::right:
+                {
+                    const auto side = getSide (type);
+                    auto target = isSurround (type) ? findOtherSurround (output, numOutputs, side) : -1;
+
+                    if (target < 0)
+                        target = side == Side::left ? outLeft : outRight;
+
+                    gains[target] = minus3dB;
+                    break;
+                }
+
+                case Side::lfe:         // not heard unless the bus has an LFE of its own
+                case Side::unknown:
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+//==============================================================================
+Layout getLayout (const juce::AudioChannelSet& set)
+{
+    Layout layout;
+    layout.fill (Set::unknown);
+
+    for (int channel = 0; channel < juce::jmin (maxChannels, set.size()); ++channel)
+        layout[(size_t) channel] = set.getTypeOfChannel (channel);
+
+    return layout;
+}
+
+const Layout& getStereoLayout() noexcept
+{
+    static const Layout stereo { { Set::left, Set::right,
+                                   Set::unknown, Set::unknown, Set::unknown,
+                                   Set::unknown, Set::unknown, Set::unknown } };
+    return stereo;
+}
+
+void computeMatrix (const Layout& source, int numSourceChannels,
+                    const Layout& output, int numOutputs, Matrix& matrix) noexcept
+{
+    for (auto& row : matrix.gains)
+        std::fill (std::begin (row), std::end (row), 0.0f);
+
+    numSourceChannels = juce::jlimit (0, maxChannels, numSourceChannels);
+    numOutputs = juce::jlimit (0, maxChannels, numOutputs);
+
+    if (numSourceChannels == 0 || numOutputs == 0)
+        return;
+
+    // a mono sound plays in the middle of a stereo pair
+    if (numSourceChannels == 1)
+    {
+        for (int out = 0; out < juce::jmin (2, numOutputs); ++out)
+            matrix.gains[0][out] = 1.0f;
+
+        return;
+    }
+
+    auto isKnown = numOutputs == 1
+                    || (findChannel (output, numOutputs, Set::left) >= 0 && findChannel (output, numOutputs, Set::right) >= 0);
+
+    for (int channel = 0; channel < numSourceChannels; ++channel)
+        isKnown = isKnown && getSide (source[(size_t) channel]) != Side::unknown;
+
+    if (! isKnown)
+    {
+        fold (numSourceChannels, numOutputs, matrix);
+        return;
+    }
+
+    if (numOutputs > 1)
+    {
+        mapBySpeaker (source, numSourceChannels, output, numOutputs, matrix);
+        return;
+    }
+
+    // a mono bus sums what a stereo pair would have got
+    mapBySpeaker (source, numSourceChannels, getStereoLayout(), 2, matrix);
+
+    for (int channel = 0; channel < numSourceChannels; ++channel)
+    {
+        auto* gains = matrix.gains[channel];
+        gains[0] = 0.5f * (gains[0] + gains[1]);
+        gains[1] = 0.0f;
+    }
+}
+
+} // namespace Downmix
@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    Downmix.h
+    How the channels of a sample are spread over those of the bus it plays
+    through, when the two don't have the same speakers.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+namespace Downmix
+{
+    /** The most channels a sound or a bus is mixed with. */
+    constexpr int maxChannels = 8;
+
+    /** The speaker each of the first maxChannels channels is for. Channels of a
+        discrete layout, and those past the end of one, are unknown.
+    */
+    using Layout = std::array<juce::AudioChannelSet::ChannelType, (size_t) maxChannels>;
+
+    /** The layout of a channel set. Not for the audio thread. */
+    Layout getLayout (const juce::AudioChannelSet&);
+
+    /** A plain left and right pair, what a voice falls back to when its bus isn't there. */
+    const Layout& getStereoLayout() noexcept;
+
+    /** The gain from each channel of a sound to each channel of a bus, as gains[source][output]. */
+    struct Matrix
+    {
+        float gains[maxChannels][maxChannels];
+    };
+
+    /** Works out how a sound's channels play through a bus.
+
+        A channel goes to the bus channel for the same speaker at full level. If the
+        bus doesn't have that speaker, a centre goes to left and right at -3 dB, and
+        a surround to the next surround on its side, or else to that side's front
+        speaker, at -3 dB. LFE is only heard on a bus that has an LFE. A mono bus gets
+        what a stereo one would, with its two sides summed at -6 dB, and a mono sound
+        plays at full level on the first two channels, as it always has.
+
+        If either layout has speakers this doesn't know about, the sound's channels
+        wrap round onto the bus's instead, scaled so their sum keeps its level.
+    */
+    void computeMatrix (const Layout& source, int numSourceChannels,
+                        const Layout& output, int numOutputs, Matrix&) noexcept;
+}
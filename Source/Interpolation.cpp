@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    Interpolation.cpp
+    The interpolation quality modes the voices can play with, and the
+    windowed-sinc tables the polyphase modes read their coefficients from.
+
+  ==============================================================================
+*/
+
+#include "Interpolation.h"
+#include "VoiceKernels.h"
+
+namespace
+{
+    int getTapSizeIndex (int numTaps) noexcept
+    {
+        return numTaps == 8 ? 0 : (numTaps == 16 ? 1 : 2);
+    }
+
+    // shorter filters have wider transition bands, so they start rolling off lower down
+    double getPassbandFraction (int numTaps) noexcept
+    {
+        return numTaps == 8 ? 0.80 : (numTaps == 16 ? 0.88 : 0.94);
+    }
+
+    double getBandRatio (int band) noexcept
+    {
+        return std::pow (2.0, band / 4.0);
+    }
+
+    // 4-term Blackman-Harris, over 0 <= u <= 1
+    double blackmanHarris (double u) noexcept
+    {
+        const auto w = juce::MathConstants<double>::twoPi * u;
+        return 0.35875 - 0.48829 * std::cos (w) + 0.14128 * std::cos (2.0 * w) - 0.01168 * std::cos (3.0 * w);
+    }
+
+    double sinc (double x) noexcept
+    {
+        if (std::abs (x) < 1.0e-9)
+            return 1.0;
+
+        const auto px = juce::MathConstants<double>::pi * x;
+        return std::sin (px) / px;
+    }
+}
+
+//==============================================================================
+InterpolationFootprint getInterpolationFootprint (InterpolationQuality quality) noexcept
+{
+    switch (quality)
+    {
+        case InterpolationQuality::hermite:     return { 1, 2 };
+        case InterpolationQuality::sinc8:
+        case InterpolationQuality::sinc16:
+        case InterpolationQuality::sinc32:
+        {
+            auto numTaps = getNumSincTaps (quality);
+            return { numTaps / 2 - 1, numTaps / 2 };
+        }
+        case InterpolationQuality::linear:
+        default:                                return { 0, 1 };
+    }
+}
+
+int getNumSincTaps (InterpolationQuality quality) noexcept
+{
+    switch (quality)
+    {
+        case InterpolationQuality::sinc8:       return 8;
+        case InterpolationQuality::sinc16:      return 16;
+        case InterpolationQuality::sinc32:      return 32;
+        case InterpolationQuality::linear:
+        case InterpolationQuality::hermite:
+        default:                                return 0;
+    }
+}
+
+juce::String getInterpolationQualityName (InterpolationQuality quality)
+{
+    switch (quality)
+    {
+        case InterpolationQuality::hermite:     return "Hermite";
+        case InterpolationQuality::sinc8:       return "Sinc 8";
+        case InterpolationQuality::sinc16:      return "Sinc 16";
+        case InterpolationQuality::sinc32:      return "Sinc 32";
+        case InterpolationQuality::linear:
+        default:                                return "Linear";
+    }
+}
+
+//==============================================================================
+InterpolationTables::InterpolationTables()
+{
+}
+
+InterpolationTables::~InterpolationTables()
+{
+}
+
+void InterpolationTables::prepare()
+{
+    if (isPrepared())
+        return;
+
+    const juce::ScopedLock sl (mBuildLock);
+
+    // another instance may have built them while this one was waiting
+    if (isPrepared())
+        return;
+
+    for (int numTaps = 8; numTaps <= maxTaps; numTaps *= 2)
+    {
+        auto& tables = mTables[getTapSizeIndex (numTaps)];
+        const auto tableSize = getTableSize (numTaps);
+        tables.malloc ((size_t) (tableSize * numBands));
+
+        for (int band = 0; band < numBands; ++band)
+            buildTable (tables + band * tableSize, numTaps,
+                        getPassbandFraction (numTaps) / getBandRatio (band));
+    }
+
+    mPrepared.store (true, std::memory_order_release);
+}
+
+const float* InterpolationTables::getSincTable (InterpolationQuality quality, double pitchRatio) const noexcept
+{
+    const auto numTaps = getNumSincTaps (quality);
+
+    if (numTaps == 0 || ! isPrepared())
+        return nullptr;
+
+    // the lowest band whose cutoff is at or below the pitched-up Nyquist frequency
+    auto band = pitchRatio <= 1.0 ? 0 : (int) std::ceil (std::log2 (pitchRatio) * 4.0 - 1.0e-9);
+    band = juce::jlimit (0, numBands - 1, band);
+
+    return mTables[getTapSizeIndex (numTaps)] + band * getTableSize (numTaps);
+}
+
+int InterpolationTables::getTableSize (int numTaps) noexcept
+{
+    return (VoiceKernels::numSincPhases + 1) * 2 * numTaps;
+}
+
+void InterpolationTables::buildTable (float* table, int numTaps, double cutoff)
+{
+    const auto firstTap = -(numTaps / 2 - 1);
+
+    for (int phase = 0; phase <= VoiceKernels::numSincPhases; ++phase)
+    {
+        auto* coeffs = table + phase * 2 * numTaps;
+        const auto fraction = phase / (double) VoiceKernels::numSincPhases;
+
+        double sum = 0.0;
+
+        for (int k = 0; k < numTaps; ++k)
+        {
+            // distance from the read position to this tap's frame
+            const auto x = (firstTap + k) - fraction;
+            const auto u = (x + numTaps / 2) / (double) numTaps;
+
+            const auto h = cutoff * sinc (cutoff * x) * blackmanHarris (juce::jlimit (0.0, 1.0, u));
+            coeffs[k] = (float) h;
+            sum += h;
+        }
+
+        // normalise every phase to unity gain at DC, so sustained notes don't ripple
+        for (int k = 0; k < numTaps; ++k)
+            coeffs[k] = (float) (coeffs[k] / sum);
+    }
+
+    // the second half of each phase is the step to the next one, for interpolating between them
+    for (int phase = 0; phase <= VoiceKernels::numSincPhases; ++phase)
+    {
+        auto* coeffs = table + phase * 2 * numTaps;
+        auto* deltas = coeffs + numTaps;
+
+        for (int k = 0; k < numTaps; ++k)
+            deltas[k] = phase < VoiceKernels::numSincPhases ? coeffs[2 * numTaps + k] - coeffs[k] : 0.0f;
+    }
+}
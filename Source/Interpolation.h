@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    Interpolation.h
+    The interpolation quality modes the voices can play with, and the
+    windowed-sinc tables the polyphase modes read their coefficients from.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/** How a voice reads between source frames, from cheapest to best. Linear and
+    Hermite alias when a sample is pitched up; the sinc modes low-pass the source
+    at the pitched-up Nyquist frequency as they read it.
+*/
+enum class InterpolationQuality
+{
+    linear = 0,
+    hermite,
+    sinc8,
+    sinc16,
+    sinc32
+};
+
+/** The number of source frames a quality mode reads either side of a frame
+    index, not counting the frame at the index itself.
+*/
+struct InterpolationFootprint
+{
+    int framesBefore;
+    int framesAfter;
+};
+
+InterpolationFootprint getInterpolationFootprint (InterpolationQuality) noexcept;
+
+/** The number of filter taps of a sinc mode, or 0 for the others. */
+int getNumSincTaps (InterpolationQuality) noexcept;
+
+juce::String getInterpolationQualityName (InterpolationQuality);
+
+//==============================================================================
+/**
+    Polyphase windowed-sinc coefficients for the 8, 16 and 32-tap modes.
+
+    The tables don't depend on the sample rate, so one set is shared by every
+    instance in the process. They are built by the first prepare() call and never
+    change afterwards, so voices can read them from the audio thread without any
+    locking.
+
+    To keep pitched-up notes from aliasing, each tap count has a table per band
+    of pitch ratios, a quarter of an octave wide, with the cutoff lowered to the
+    Nyquist frequency of the highest ratio in the band.
+*/
+class InterpolationTables
+{
+public:
+    InterpolationTables();
+    ~InterpolationTables();
+
+    /** Builds the tables if that hasn't happened yet. Call this from prepareToPlay. */
+    void prepare();
+
+    bool isPrepared() const noexcept                { return mPrepared.load (std::memory_order_acquire); }
+
+    /** The table a voice reading at this pitch ratio should use, in the layout the
+        VoiceKernels sinc kernel expects. Returns nullptr for the non-sinc modes, or
+        if the tables haven't been prepared.
+    */
+    const float* getSincTable (InterpolationQuality, double pitchRatio) const noexcept;
+
+    static constexpr int maxTaps = 32;
+
+private:
+    static constexpr int numTapSizes = 3;
+    static constexpr int numBands = 13;     // pitch ratios up to 8, a quarter octave apart
+
+    static int getTableSize (int numTaps) noexcept;
+    static void buildTable (float* table, int numTaps, double cutoff);
+
+    juce::CriticalSection mBuildLock;
+    std::atomic<bool> mPrepared { false };
+    juce::HeapBlock<float> mTables[numTapSizes];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (InterpolationTables)
+};
@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    KeyMap.cpp
+    Which zones of an instrument play for a given note and velocity.
+
+  ==============================================================================
+*/
+
+#include "KeyMap.h"
+
+namespace
+{
+    constexpr int numNotes = 128;
+    constexpr int numVelocities = 128;
+}
+
+//==============================================================================
+KeyMap::KeyMap()
+{
+}
+
+KeyMap::~KeyMap()
+{
+}
+
+void KeyMap::build (const std::vector<KeyZone>& zones)
+{
+    mCells.assign ((size_t) (numNotes * numVelocities), {});
+    mSlots.clearQuick();
+    mZoneList.clearQuick();
+
+    // the groups get numbered from 0 in the order they first turn up
+    std::map<int, int> groupNumbers;
+
+    for (auto& zone : zones)
+        if (zone.roundRobinGroup >= 0 && groupNumbers.find (zone.roundRobinGroup) == groupNumbers.end())
+            groupNumbers.emplace (zone.roundRobinGroup, (int) groupNumbers.size());
+
+    jassert ((int) groupNumbers.size() <= maxRoundRobinGroups);
+    mNumRoundRobinGroups = juce::jmin ((int) groupNumbers.size(), maxRoundRobinGroups);
+
+    auto getGroup = [&] (const KeyZone& zone)
+    {
+        if (zone.roundRobinGroup < 0)
+            return -1;
+
+        auto group = groupNumbers[zone.roundRobinGroup];
+        return group < maxRoundRobinGroups ? group : -1;
+    };
+
+    // what plays at the cell being built, and at the one before it
+    std::vector<std::pair<int, int>> cellZones, previousZones;     // (group, zone)
+    Cell previousCell;
+
+    for (int note = 0; note < numNotes; ++note)
+    {
+        for (int velocity = 1; velocity < numVelocities; ++velocity)
+        {
+            cellZones.clear();
+
+            for (int i = 0; i < (int) zones.size(); ++i)
+            {
+                auto& zone = zones[(size_t) i];
+
+                if (note >= zone.lowNote && note <= zone.highNote
+                     && velocity >= zone.lowVelocity && velocity <= zone.highVelocity)
+                    cellZones.emplace_back (getGroup (zone), i);
+            }
+
+            auto& cell = mCells[(size_t) getCellIndex (note, velocity)];
+
+            // neighbouring cells mostly have the same zones, in which case they share slots
+            if (cellZones == previousZones)
+            {
+                cell = previousCell;
+                continue;
+            }
+
+            previousZones = cellZones;
+
+            // zones in a group go together, in order of their position in it
+            std::stable_sort (cellZones.begin(), cellZones.end(),
+                              [&zones] (const std::pair<int, int>& a, const std::pair<int, int>& b)
+                              {
+                                  if (a.first != b.first)
+                                      return a.first < b.first;
+
+                                  return zones[(size_t) a.second].roundRobinPosition
+                                           < zones[(size_t) b.second].roundRobinPosition;
+                              });
+
+            cell.firstSlot = mSlots.size();
+
+            for (size_t i = 0; i < cellZones.size();)
+            {
+                const auto group = cellZones[i].first;
+                Slot slot { group, mZoneList.size(), 0 };
+
+                do
+                {
+                    mZoneList.add (cellZones[i].second);
+                    ++slot.numZones;
+                    ++i;
+                }
+                while (group >= 0 && i < cellZones.size() && cellZones[i].first == group);
+
+                mSlots.add (slot);
+            }
+
+            cell.numSlots = mSlots.size() - cell.firstSlot;
+            previousCell = cell;
+        }
+    }
+
+    mSlots.minimiseStorageOverheads();
+    mZoneList.minimiseStorageOverheads();
+}
+
+const KeyMap::Slot* KeyMap::getSlots (int midiNoteNumber, int midiVelocity, int& numSlots) const noexcept
+{
+    numSlots = 0;
+
+    if (mCells.empty() || ! juce::isPositiveAndBelow (midiNoteNumber, numNotes))
+        return nullptr;
+
+    auto& cell = mCells[(size_t) getCellIndex (midiNoteNumber, juce::jlimit (1, numVelocities - 1, midiVelocity))];
+    numSlots = cell.numSlots;
+    return mSlots.begin() + cell.firstSlot;
+}
+
+int KeyMap::getCellIndex (int midiNoteNumber, int midiVelocity) noexcept
+{
+    return midiNoteNumber * numVelocities + midiVelocity;
+}
@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    KeyMap.h
+    Which zones of an instrument play for a given note and velocity.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/** The part of the keyboard and velocity range one sample covers. */
+struct KeyZone
+{
+    int lowNote = 0, highNote = 127;
+    int lowVelocity = 1, highVelocity = 127;
+    int rootNote = 60;
+
+    /** Zones in the same group take turns, in order of their position, each time
+        one of them would play. A zone that isn't in a group (-1) always plays.
+    */
+    int roundRobinGroup = -1;
+    int roundRobinPosition = 0;
+
+    /** The output bus the zone plays through: 0 is the main output, and the rest
+        are the extra outputs, which fall back to the main one while disabled.
+    */
+    int outputBus = 0;
+};
+
+//==============================================================================
+/**
+    A lookup table from every note and velocity to the zones that play there.
+
+    All the work happens in build(): each of the 128 x 128 cells gets a list of
+    slots, one for every zone that plays on its own and one for every round-robin
+    group, so a note-on only ever looks at what plays at its own cell, however
+    many zones the instrument has. Read-only once built, so the audio thread can
+    use it without locking.
+*/
+class KeyMap
+{
+public:
+    KeyMap();
+    ~KeyMap();
+
+    /** Something that plays at a cell: one zone, or a round-robin group of them. */
+    struct Slot
+    {
+        int roundRobinGroup;    // -1, or an index below getNumRoundRobinGroups()
+        int firstZone;          // where the slot's zones start in the zone list
+        int numZones;           // always 1 outside of a round-robin group
+    };
+
+    /** Builds the table for these zones, numbering them in the order they're given.
+        Round-robin group numbers are renumbered to count up from 0.
+    */
+    void build (const std::vector<KeyZone>& zones);
+
+    /** The slots at a MIDI note and velocity (1 to 127). */
+    const Slot* getSlots (int midiNoteNumber, int midiVelocity, int& numSlots) const noexcept;
+
+    /** The zone a slot refers to: zoneIndex goes from slot.firstZone up to
+        slot.firstZone + slot.numZones.
+    */
+    int getZone (int zoneIndex) const noexcept                  { return mZoneList.getUnchecked (zoneIndex); }
+
+    int getNumRoundRobinGroups() const noexcept                 { return mNumRoundRobinGroups; }
+
+    /** The synth keeps a counter for each group, so there can't be more than this. */
+    static constexpr int maxRoundRobinGroups = 1024;
+
+private:
+    //==============================================================================
+    struct Cell
+    {
+        int firstSlot = 0;
+        int numSlots = 0;
+    };
+
+    static int getCellIndex (int midiNoteNumber, int midiVelocity) noexcept;
+
+    std::vector<Cell> mCells;
+    juce::Array<Slot> mSlots;
+    juce::Array<int> mZoneList;
+    int mNumRoundRobinGroups = 0;
+
+    JUCE_LEAK_DETECTOR (KeyMap)
+};
@@ -0,0 +1,185 @@
+/*
+  ==============================================================================
+
+    PeakPyramid.cpp
+    Min/max peaks of a sample at a range of resolutions, for drawing it.
+
+  ==============================================================================
+*/
+
+#include "PeakPyramid.h"
+
+namespace
+{
+    // the finest level has a bin per this many samples, unless that would be too many bins
+    constexpr int minSamplesPerPeak = 64;
+    constexpr juce::int64 maxBasePeaks = 262144;
+
+    // levels stop halving once they are about as wide as a small editor
+    constexpr size_t minTopPeaks = 256;
+
+    constexpr int readChunkSize = 16384;
+
+    constexpr int fileMagic = 0x6b504d53;   // "SMPk"
+    constexpr int fileVersion = 1;
+
+    juce::Range<float> combine (juce::Range<float> a, juce::Range<float> b) noexcept
+    {
+        return { juce::jmin (a.getStart(), b.getStart()), juce::jmax (a.getEnd(), b.getEnd()) };
+    }
+}
+
+//==============================================================================
+PeakPyramid::PeakPyramid (juce::int64 length, int baseSamplesPerPeak)
+    : mLength (length), mBaseSamplesPerPeak (baseSamplesPerPeak)
+{
+}
+
+PeakPyramid::~PeakPyramid()
+{
+}
+
+PeakPyramid::Ptr PeakPyramid::build (juce::AudioFormatReader& reader, const std::function<bool (float)>& progressCallback)
+{
+    const auto length = juce::jmax ((juce::int64) 0, reader.lengthInSamples);
+
+    auto samplesPerPeak = minSamplesPerPeak;
+
+    while ((length + samplesPerPeak - 1) / samplesPerPeak > maxBasePeaks)
+        samplesPerPeak *= 2;
+
+    Ptr pyramid (new PeakPyramid (length, samplesPerPeak));
+    pyramid->mLevels.emplace_back ((size_t) ((length + samplesPerPeak - 1) / samplesPerPeak));
+    auto& base = pyramid->mLevels.front();
+
+    const auto numChannels = juce::jmax (1, (int) reader.numChannels);
+    juce::AudioBuffer<float> chunk (numChannels, readChunkSize);
+
+    // bins and chunks are both powers of two long, so a chunk either holds whole
+    // bins or is a whole part of one
+    jassert (readChunkSize % minSamplesPerPeak == 0);
+
+    for (juce::int64 start = 0; start < length; )
+    {
+        if (! progressCallback ((float) start / (float) length))
+            return {};
+
+        const auto numToRead = (int) juce::jmin ((juce::int64) readChunkSize, length - start);
+        reader.read (&chunk, 0, numToRead, start, true, numChannels > 1);
+
+        for (int offset = 0; offset < numToRead; offset += samplesPerPeak)
+        {
+            const auto num = juce::jmin (samplesPerPeak, numToRead - offset);
+            auto range = juce::FloatVectorOperations::findMinAndMax (chunk.getReadPointer (0, offset), num);
+
+            for (int channel = 1; channel < numChannels; ++channel)
+                range = combine (range, juce::FloatVectorOperations::findMinAndMax (chunk.getReadPointer (channel, offset), num));
+
+            const auto binIndex = (size_t) ((start + offset) / samplesPerPeak);
+            base[binIndex] = ((start + offset) % samplesPerPeak == 0) ? range : combine (base[binIndex], range);
+        }
+
+        start += numToRead;
+    }
+
+    pyramid->buildCoarserLevels();
+
+    progressCallback (1.0f);
+    return pyramid;
+}
+
+PeakPyramid::Ptr PeakPyramid::read (juce::InputStream& in)
+{
+    if (in.readInt() != fileMagic || in.readInt() != fileVersion)
+        return {};
+
+    const auto length = in.readInt64();
+    const auto samplesPerPeak = in.readInt();
+    const auto numPeaks = in.readInt64();
+
+    if (length < 0 || samplesPerPeak < minSamplesPerPeak || ! juce::isPowerOfTwo (samplesPerPeak)
+         || numPeaks != (length + samplesPerPeak - 1) / samplesPerPeak || numPeaks > maxBasePeaks)
+        return {};
+
+    Ptr pyramid (new PeakPyramid (length, samplesPerPeak));
+    pyramid->mLevels.emplace_back ((size_t) numPeaks);
+
+    const auto numBytes = (int) (numPeaks * (juce::int64) sizeof (juce::Range<float>));
+
+    if (in.read (pyramid->mLevels.front().data(), numBytes) != numBytes)
+        return {};
+
+    pyramid->buildCoarserLevels();
+    return pyramid;
+}
+
+bool PeakPyramid::write (juce::OutputStream& out) const
+{
+    const auto& base = mLevels.front();
+
+    return out.writeInt (fileMagic)
+        && out.writeInt (fileVersion)
+        && out.writeInt64 (mLength)
+        && out.writeInt (mBaseSamplesPerPeak)
+        && out.writeInt64 ((juce::int64) base.size())
+        && out.write (base.data(), base.size() * sizeof (juce::Range<float>));
+}
+
+void PeakPyramid::buildCoarserLevels()
+{
+    // every level above is made by merging pairs of bins of the one below
+    while (mLevels.back().size() > minTopPeaks)
+    {
+        const auto& below = mLevels.back();
+        std::vector<juce::Range<float>> level ((below.size() + 1) / 2);
+
+        for (size_t i = 0; i < level.size(); ++i)
+            level[i] = 2 * i + 1 < below.size() ? combine (below[2 * i], below[2 * i + 1]) : below[2 * i];
+
+        mLevels.push_back (std::move (level));
+    }
+}
+
+void PeakPyramid::getPeaks (juce::int64 startSample, juce::int64 endSample,
+                            juce::Range<float>* dest, int numPixels) const noexcept
+{
+    if (numPixels <= 0)
+        return;
+
+    const auto samplesPerPixel = (double) (endSample - startSample) / numPixels;
+
+    // the coarsest level that still has a bin for every pixel
+    int levelIndex = 0;
+
+    while (levelIndex + 1 < getNumLevels() && getSamplesPerPeak (levelIndex + 1) <= samplesPerPixel)
+        ++levelIndex;
+
+    const auto& level = mLevels[(size_t) levelIndex];
+    const auto samplesPerPeak = (double) getSamplesPerPeak (levelIndex);
+    const auto numBins = (juce::int64) level.size();
+
+    for (int pixel = 0; pixel < numPixels; ++pixel)
+    {
+        const auto pixelStart = (double) startSample + pixel * samplesPerPixel;
+        const auto pixelEnd = pixelStart + samplesPerPixel;
+
+        auto firstBin = (juce::int64) std::floor (pixelStart / samplesPerPeak);
+        auto endBin = juce::jmax (firstBin + 1, (juce::int64) std::ceil (pixelEnd / samplesPerPeak));
+
+        firstBin = juce::jmax ((juce::int64) 0, firstBin);
+        endBin = juce::jmin (numBins, endBin);
+
+        if (firstBin >= endBin)
+        {
+            dest[pixel] = {};
+            continue;
+        }
+
+        auto range = level[(size_t) firstBin];
+
+        for (auto bin = firstBin + 1; bin < endBin; ++bin)
+            range = combine (range, level[(size_t) bin]);
+
+        dest[pixel] = range;
+    }
+}
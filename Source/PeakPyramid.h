@@ -0,0 +1,72 @@
+/*
+  ==============================================================================
+
+    PeakPyramid.h
+    Min/max peaks of a sample at a range of resolutions, for drawing it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The lowest and highest sample value in every bin of a sample, over all its
+    channels, with each level having half as many bins as the one below it.
+
+    It is built once, on the loading thread, and is read-only after that. To draw
+    any part of the sample at any width, getPeaks() reads the coarsest level that
+    still has at least one bin per pixel, so drawing costs the same however long
+    the sample is, and zooming in or out doesn't mean going back to the file.
+*/
+class PeakPyramid  : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<PeakPyramid>;
+
+    /** Reads the whole of a sample to build its peaks. Reading is reported as a
+        progress from 0 to 1, and stops if the callback returns false, in which
+        case nullptr is returned.
+    */
+    static Ptr build (juce::AudioFormatReader& reader, const std::function<bool (float)>& progressCallback);
+
+    /** Reads peaks saved by write(), or returns nullptr if the stream doesn't hold any. */
+    static Ptr read (juce::InputStream&);
+
+    ~PeakPyramid() override;
+
+    /** Saves the finest level, which is all read() needs to rebuild the others.
+        The format is native-endian, so it is only meant for caches on this machine.
+    */
+    bool write (juce::OutputStream&) const;
+
+    juce::int64 getLengthInSamples() const noexcept         { return mLength; }
+
+    /** Fills numPixels ranges, each the span of sample values between two pixels
+        across samples [startSample, endSample). Pixels past the end are empty.
+        Doesn't allocate, so it's cheap enough to call from paint().
+    */
+    void getPeaks (juce::int64 startSample, juce::int64 endSample,
+                   juce::Range<float>* dest, int numPixels) const noexcept;
+
+    //==============================================================================
+    int getNumLevels() const noexcept                       { return (int) mLevels.size(); }
+
+    /** The number of samples each bin of a level covers. */
+    int getSamplesPerPeak (int level) const noexcept        { return mBaseSamplesPerPeak << level; }
+
+    const std::vector<juce::Range<float>>& getLevel (int level) const noexcept  { return mLevels[(size_t) level]; }
+
+private:
+    PeakPyramid (juce::int64 length, int baseSamplesPerPeak);
+
+    void buildCoarserLevels();
+
+    juce::int64 mLength;
+    int mBaseSamplesPerPeak;
+    std::vector<std::vector<juce::Range<float>>> mLevels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PeakPyramid)
+};
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    PerformanceMeter.cpp
+    Shows how much of its time the audio thread is using, and how many voices.
+
+  ==============================================================================
+*/
+
+#include "PerformanceMeter.h"
+
+namespace
+{
+    constexpr float peakDecayPerUpdate = 0.95f;     // about a second to fall away at 30 Hz
+    constexpr float warningLoad = 0.7f;
+    constexpr float dangerLoad = 0.9f;
+
+    juce::Colour getLoadColour (float load)
+    {
+        if (load >= dangerLoad)     return juce::Colours::red;
+        if (load >= warningLoad)    return juce::Colours::orange;
+        return juce::Colours::yellow;
+    }
+
+    void drawBar (juce::Graphics& g, juce::Rectangle<float> area, float fraction, juce::Colour colour)
+    {
+        g.setColour (juce::Colours::black.withAlpha (0.4f));
+        g.fillRect (area);
+        g.setColour (colour);
+        g.fillRect (area.withWidth (area.getWidth() * juce::jlimit (0.0f, 1.0f, fraction)));
+    }
+}
+
+//==============================================================================
+PerformanceMeter::PerformanceMeter (const TelemetryRing& telemetry)
+    : mTelemetry (telemetry),
+      mReadPosition (telemetry.getNumBlocks()),
+      mRecords ((size_t) TelemetryRing::capacity)
+{
+    setInterceptsMouseClicks (false, false);
+}
+
+void PerformanceMeter::update()
+{
+    const auto numRead = mTelemetry.read (mReadPosition, mRecords.data(), (int) mRecords.size());
+
+    // nothing is playing, or the host has stopped calling processBlock
+    if (numRead == 0)
+    {
+        if (mLoad > 0.0f || mPeakLoad > 0.0f)
+        {
+            mLoad = 0.0f;
+            mPeakLoad = mPeakLoad > 0.01f ? mPeakLoad * peakDecayPerUpdate : 0.0f;
+            repaint();
+        }
+
+        return;
+    }
+
+    float renderTime = 0.0f, budget = 0.0f, peak = 0.0f;
+
+    for (int i = 0; i < numRead; ++i)
+    {
+        auto& record = mRecords[(size_t) i];
+        renderTime += record.renderMicroseconds;
+        budget += record.budgetMicroseconds;
+        peak = juce::jmax (peak, record.getLoad());
+    }
+
+    auto& latest = mRecords[(size_t) numRead - 1];
+
+    mLoad = budget > 0.0f ? renderTime / budget : 0.0f;
+    mPeakLoad = juce::jmax (peak, mPeakLoad * peakDecayPerUpdate);
+    mActiveVoices = latest.activeVoices;
+    mPolyphony = latest.polyphony;
+    mNumOverruns = mTelemetry.getNumOverruns();
+    repaint();
+}
+
+void PerformanceMeter::paint (juce::Graphics& g)
+{
+    auto area = getLocalBounds().toFloat();
+    const auto rowHeight = area.getHeight() / 2.0f;
+    const auto textWidth = area.getWidth() * 0.45f;
+
+    g.setFont (juce::jmin (12.0f, rowHeight * 0.8f));
+
+    // CPU, with a line at the held peak
+    auto cpuRow = area.removeFromTop (rowHeight).reduced (0.0f, 2.0f);
+    auto cpuText = cpuRow.removeFromLeft (textWidth);
+    drawBar (g, cpuRow, mLoad, getLoadColour (mLoad));
+
+    auto peakX = cpuRow.getX() + cpuRow.getWidth() * juce::jlimit (0.0f, 1.0f, mPeakLoad);
+    g.setColour (getLoadColour (mPeakLoad));
+    g.drawVerticalLine (juce::roundToInt (peakX), cpuRow.getY(), cpuRow.getBottom());
+
+    g.setColour (juce::Colours::yellow);
+    g.drawText ("CPU " + juce::String (juce::roundToInt (mLoad * 100.0f)) + "% (peak "
+                  + juce::String (juce::roundToInt (mPeakLoad * 100.0f)) + "%)",
+                cpuText, juce::Justification::centredLeft);
+
+    // voices, and the blocks that came too late
+    auto voiceRow = area.reduced (0.0f, 2.0f);
+    auto voiceText = voiceRow.removeFromLeft (textWidth);
+    drawBar (g, voiceRow, mPolyphony > 0 ? (float) mActiveVoices / (float) mPolyphony : 0.0f, juce::Colours::purple);
+
+    g.setColour (juce::Colours::yellow);
+    auto voices = "Voices " + juce::String (mActiveVoices) + "/" + juce::String (mPolyphony);
+
+    if (mNumOverruns > 0)
+    {
+        g.drawText (voices, voiceText.removeFromLeft (textWidth * 0.5f), juce::Justification::centredLeft);
+        g.setColour (juce::Colours::red);
+        g.drawText (juce::String ((juce::int64) mNumOverruns) + " late", voiceText, juce::Justification::centredLeft);
+    }
+    else
+    {
+        g.drawText (voices, voiceText, juce::Justification::centredLeft);
+    }
+}
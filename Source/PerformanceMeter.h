@@ -0,0 +1,44 @@
+/*
+  ==============================================================================
+
+    PerformanceMeter.h
+    Shows how much of its time the audio thread is using, and how many voices.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Telemetry.h"
+
+//==============================================================================
+/**
+    A CPU bar and a voice bar, fed from the processor's TelemetryRing.
+
+    The CPU figure is the share of the blocks' audio duration that rendering
+    took since the last update; the peak is the worst single block, held for a
+    moment so short spikes are still seen. Blocks that missed their deadline are
+    counted up on the right.
+*/
+class PerformanceMeter  : public juce::Component
+{
+public:
+    explicit PerformanceMeter (const TelemetryRing& telemetry);
+
+    /** Reads the blocks rendered since the last call. Message thread, from a timer. */
+    void update();
+
+    void paint (juce::Graphics&) override;
+
+private:
+    const TelemetryRing& mTelemetry;
+    juce::uint64 mReadPosition = 0;
+    std::vector<BlockTelemetry> mRecords;   // what update() reads into, so it doesn't allocate
+
+    float mLoad = 0.0f, mPeakLoad = 0.0f;
+    int mActiveVoices = 0, mPolyphony = 0;
+    juce::uint64 mNumOverruns = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceMeter)
+};
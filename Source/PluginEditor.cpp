@@ -11,15 +11,13 @@
 
 //==============================================================================
 SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamplerAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p)
+    : AudioProcessorEditor (&p), mPerformanceMeter (p.getTelemetry()), audioProcessor (p)
 {
     
     //Attack Slider
     mAttackSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
     mAttackSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, true, 40, 20);
     mAttackSlider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::purple);
-    mAttackSlider.setRange(0.0f, 2.0f, 0.01f);
-    mAttackSlider.addListener(this); //add listener
     addAndMakeVisible(mAttackSlider);
     //set label
     mAttackLabel.setFont(10.0f);
@@ -32,8 +30,6 @@ SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamp
     mDecaySlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
     mDecaySlider.setTextBoxStyle(juce::Slider::TextBoxBelow, true, 40, 20);
     mDecaySlider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::purple);
-    mDecaySlider.setRange(0.0f, 2.0f, 0.01f);
-    mDecaySlider.addListener(this);
     addAndMakeVisible(mDecaySlider);
     
     mDecayLabel.setFont(10.0f);
@@ -46,8 +42,6 @@ SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamp
     mSustainSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
     mSustainSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, true, 40, 20);
     mSustainSlider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::purple);
-    mSustainSlider.setRange(0.0f, 1.0f, 0.01f);
-    mSustainSlider.addListener(this);
     addAndMakeVisible(mSustainSlider);
     
     mSustainLabel.setFont(10.0f);
@@ -60,8 +54,6 @@ SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamp
     mReleaseSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
     mReleaseSlider.setTextBoxStyle(juce::Slider::TextBoxBelow, true, 40, 20);
     mReleaseSlider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::purple);
-    mReleaseSlider.setRange(0.0f, 2.0f, 0.01f);
-    mReleaseSlider.addListener(this);
     addAndMakeVisible(mReleaseSlider);
     
     mReleaseLabel.setFont(10.0f);
@@ -70,10 +62,77 @@ SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamp
     mReleaseLabel.setJustificationType(juce::Justification::centredTop);
     mReleaseLabel.attachToComponent(&mReleaseSlider, false);
     
-    mAttackSlider.setValue(0.0);
-    mDecaySlider.setValue(0.0);
-    mSustainSlider.setValue(0.0);
-    mReleaseSlider.setValue(0.0);
+    //Filter dials, above the envelope's and looking the same
+    auto setUpDial = [this](juce::Slider& slider, juce::Label& label, const juce::String& name){
+        slider.setSliderStyle(juce::Slider::SliderStyle::RotaryVerticalDrag);
+        slider.setTextBoxStyle(juce::Slider::TextBoxBelow, true, 50, 20);
+        slider.setColour(juce::Slider::ColourIds::thumbColourId, juce::Colours::purple);
+        addAndMakeVisible(slider);
+        
+        label.setFont(10.0f);
+        label.setText(name, juce::NotificationType::dontSendNotification);
+        label.setColour(juce::Label::ColourIds::textColourId, juce::Colours::yellow);
+        label.setJustificationType(juce::Justification::centredTop);
+        label.attachToComponent(&slider, false);
+    };
+    setUpDial(mCutoffSlider, mCutoffLabel, "Cutoff");
+    setUpDial(mResonanceSlider, mResonanceLabel, "Resonance");
+    setUpDial(mKeyTrackingSlider, mKeyTrackingLabel, "Key Track");
+    setUpDial(mReverbMixSlider, mReverbMixLabel, "Reverb");
+    
+    //Filter type, in the same order as the parameter's choices
+    mFilterTypeBox.addItemList(juce::StringArray { "Off", "Low Pass", "Band Pass", "High Pass" }, 1);
+    addAndMakeVisible(mFilterTypeBox);
+    
+    mFilterTypeLabel.setFont(10.0f);
+    mFilterTypeLabel.setText("Filter", juce::NotificationType::dontSendNotification);
+    mFilterTypeLabel.setColour(juce::Label::ColourIds::textColourId, juce::Colours::yellow);
+    mFilterTypeLabel.setJustificationType(juce::Justification::centredTop);
+    mFilterTypeLabel.attachToComponent(&mFilterTypeBox, false);
+    
+    //Reverb response, picked from a file; its name shows once it's chosen
+    mImpulseResponseButton.setTooltip("Choose an impulse response for the reverb");
+    mImpulseResponseButton.onClick = [this] { chooseImpulseResponse(); };
+    addAndMakeVisible(mImpulseResponseButton);
+    mClearImpulseResponseButton.setTooltip("Turn the reverb off");
+    mClearImpulseResponseButton.onClick = [this] { audioProcessor.loadImpulseResponse(juce::File()); };
+    addAndMakeVisible(mClearImpulseResponseButton);
+    
+    mImpulseResponseLabel.setFont(10.0f);
+    mImpulseResponseLabel.setText("Reverb IR", juce::NotificationType::dontSendNotification);
+    mImpulseResponseLabel.setColour(juce::Label::ColourIds::textColourId, juce::Colours::yellow);
+    mImpulseResponseLabel.setJustificationType(juce::Justification::centredTop);
+    mImpulseResponseLabel.attachToComponent(&mImpulseResponseButton, false);
+    
+    //the attachments set the sliders' ranges and values from the parameters
+    auto& parameters = audioProcessor.getParameters();
+    mAttackAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::attack, mAttackSlider);
+    mDecayAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::decay, mDecaySlider);
+    mSustainAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::sustain, mSustainSlider);
+    mReleaseAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::release, mReleaseSlider);
+    mCutoffAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::cutoff, mCutoffSlider);
+    mResonanceAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::resonance, mResonanceSlider);
+    mKeyTrackingAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::keyTracking, mKeyTrackingSlider);
+    mFilterTypeAttachment = std::make_unique<ComboBoxAttachment>(parameters, ParameterIDs::filterType, mFilterTypeBox);
+    mReverbMixAttachment = std::make_unique<SliderAttachment>(parameters, ParameterIDs::reverbMix, mReverbMixSlider);
+    
+    //performance meter, fed by the timer
+    addAndMakeVisible(mPerformanceMeter);
+    mSaveTelemetryButton.setTooltip("Save the last few thousand blocks' timing, voices and dropouts to a CSV file");
+    mSaveTelemetryButton.onClick = [this] { saveTelemetry(); };
+    addAndMakeVisible(mSaveTelemetryButton);
+    
+    //loading progress, only visible while a sample loads
+    mLoadProgressBar.setPercentageDisplay(true);
+    addChildComponent(mLoadProgressBar);
+    mSampleVersion = audioProcessor.getSampleVersion();
+    mFileName = audioProcessor.getSampleName();
+    mWaveformCache.onImageReady = [this] { repaint(); };
+    startTimerHz(30);
+    
+    //the waveform image covers the whole editor
+    setOpaque(true);
+    
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
     setSize (800, 450);
@@ -81,53 +140,31 @@ SimpleSamplerAudioProcessorEditor::SimpleSamplerAudioProcessorEditor (SimpleSamp
 
 SimpleSamplerAudioProcessorEditor::~SimpleSamplerAudioProcessorEditor()
 {
+    stopTimer();
 }
 
 //==============================================================================
 void SimpleSamplerAudioProcessorEditor::paint (juce::Graphics& g)
 {
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-//    g.fillAll (juce::Colours::cadetblue.darker());
-    g.fillAll (juce::Colour(51,153, 102));
-    //get original waveform
-    auto waveform = audioProcessor.getWaveForm();
-    //draw waveform on screen
-    if (waveform.getNumSamples() > 0)
+    //the image is drawn at the screen's resolution, so it needs redrawing if that changes
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (scale != mPaintScale)
     {
-        juce::Path p;
-        p.clear();
-        mAudioPoints.clear(); //clear previous audio points
-        //find ratio: sample = 44100 (1 sec)... x axis of window = 600 sampleLength / getwidth()
-        auto ratio = waveform.getNumSamples() / getWidth(); //calculate the ratio for resizing
-        auto buffer = waveform.getReadPointer(0);
-        //scale audio file to window on x axis
-        for (int sample = 0; sample < waveform.getNumSamples(); sample += ratio)
-        {
-            //store audio data to AudioPoints every other "(int)ratio" samples
-            mAudioPoints.push_back (buffer[sample]);
-        }
-        g.setColour(juce::Colours::yellow); // set colour
-        p.startNewSubPath(0, getHeight() / 2); //set start point
-        
-        //scale on y axis
-        for (int sample = 0; sample <mAudioPoints.size(); ++sample)
-        {
-            //recaling the amplitude to pixels
-            auto point = juce::jmap<float> (mAudioPoints[sample], -1, 1, getHeight()/2+150, getHeight()/2-150);
-            p.lineTo (sample, point);
-        }
-        //draw recaled waveform
-        g.strokePath(p, juce::PathStrokeType(2));
-        g.setColour(juce::Colours::white);
-        g.setFont(15.0f);
-        auto textbounds = getLocalBounds().reduced(10, 10);
-        g.drawFittedText(mFileName, textbounds, juce::Justification::topRight, 1); // print the file name
+        mPaintScale = scale;
+        updateWaveform();
+    }
+    
+    //everything but the controls comes from the cached image, so moving a slider only blits its own bounds
+    auto& image = mWaveformCache.getImage();
+    if (image.isValid())
+    {
+        //while a new size is drawn, the old image is stretched to fit
+        g.drawImage(image, getLocalBounds().toFloat());
     }
     else
     {
-        g.setColour(juce::Colours::white);
-        g.setFont(40.0f);
-        g.drawFittedText("Drop an Audio File to Load", getLocalBounds(), juce::Justification::centred, 1);
+        // (Our component is opaque, so we must completely fill the background with a solid colour)
+        g.fillAll (juce::Colour(51,153, 102));
     }
 }
 
@@ -135,6 +172,7 @@ void SimpleSamplerAudioProcessorEditor::resized()
 {
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
+    updateWaveform();
 
     const auto startX = 0.6f;
     const auto startY = 0.75f;
@@ -147,6 +185,22 @@ void SimpleSamplerAudioProcessorEditor::resized()
     mSustainSlider.setBoundsRelative(startX + dialWidth * 2, startY, dialWidth, dialHeight);
     mReleaseSlider.setBoundsRelative(startX + dialWidth * 3, startY, dialWidth, dialHeight);
     
+    //the filter's row sits on top of the envelope's
+    const auto filterY = startY - dialHeight - 0.05f;
+    mFilterTypeBox.setBoundsRelative(startX + 0.005f, filterY + 0.07f, dialWidth - 0.01f, 0.06f);
+    mCutoffSlider.setBoundsRelative(startX + dialWidth, filterY, dialWidth, dialHeight);
+    mResonanceSlider.setBoundsRelative(startX + dialWidth * 2, filterY, dialWidth, dialHeight);
+    mKeyTrackingSlider.setBoundsRelative(startX + dialWidth * 3, filterY, dialWidth, dialHeight);
+    
+    //and the reverb's on top of that
+    const auto reverbY = filterY - dialHeight - 0.05f;
+    mImpulseResponseButton.setBoundsRelative(startX + 0.005f, reverbY + 0.07f, dialWidth * 2 - 0.01f, 0.06f);
+    mReverbMixSlider.setBoundsRelative(startX + dialWidth * 2, reverbY, dialWidth, dialHeight);
+    mClearImpulseResponseButton.setBoundsRelative(startX + dialWidth * 3 + 0.02f, reverbY + 0.07f, dialWidth - 0.04f, 0.06f);
+    
+    mLoadProgressBar.setBoundsRelative(0.3f, 0.05f, 0.4f, 0.05f);
+    mPerformanceMeter.setBoundsRelative(0.02f, 0.85f, 0.4f, 0.1f);
+    mSaveTelemetryButton.setBoundsRelative(0.43f, 0.87f, 0.08f, 0.06f);
 }
 
 bool SimpleSamplerAudioProcessorEditor::isInterestedInFileDrag(const juce::StringArray &files){
@@ -154,7 +208,7 @@ bool SimpleSamplerAudioProcessorEditor::isInterestedInFileDrag(const juce::Strin
     //check audio file format name
     for (auto file : files)
     {
-        if(file.contains(".wav") || file.contains(".mp3"))
+        if(file.contains(".wav") || file.contains(".mp3") || file.contains(".aif") || file.contains(".sfz"))
         {
             return true;
         }
@@ -169,33 +223,73 @@ void SimpleSamplerAudioProcessorEditor::filesDropped (const juce::StringArray &f
     {
         if (isInterestedInFileDrag (file))
         {
-            auto myFile = std::make_unique<juce::File>(file);
-            mFileName = myFile->getFileNameWithoutExtension();
-            
-            //load this file
+            //load this file in the background, timerCallback picks up the result
             audioProcessor .loadFile(file);
-            //set ADSR parameters according to initial value of sliders
-            audioProcessor.getADSRParams().attack = mAttackSlider.getValue();
-            audioProcessor.getADSRParams().decay = mDecaySlider.getValue();
-            audioProcessor.getADSRParams().sustain = mSustainSlider.getValue();
-            audioProcessor.getADSRParams().release = mReleaseSlider.getValue();
-            audioProcessor.updateADSR();
         }
     }
-    repaint();
 }
 
-void SimpleSamplerAudioProcessorEditor::sliderValueChanged(juce::Slider *slider){
-    //reset ADSR Parameters when user changes slider values
-    if (slider == &mAttackSlider){
-        audioProcessor.getADSRParams().attack = mAttackSlider.getValue();
-    }else if(slider == &mDecaySlider){
-        audioProcessor.getADSRParams().decay = mDecaySlider.getValue();
-    }else if(slider == &mSustainSlider){
-        audioProcessor.getADSRParams().sustain = mSustainSlider.getValue();
-    }else if(slider == &mReleaseSlider){
-        audioProcessor.getADSRParams().release = mReleaseSlider.getValue();
+void SimpleSamplerAudioProcessorEditor::timerCallback(){
+    mPerformanceMeter.update();
+    
+    auto loading = audioProcessor.isLoading();
+    mLoadProgress = audioProcessor.getLoadProgress();
+    
+    if (mLoadProgressBar.isVisible() != loading)
+    {
+        mLoadProgressBar.setVisible(loading);
+        updateWaveform();
+    }
+    
+    //redraw once a new sample has been swapped in
+    if (mSampleVersion != audioProcessor.getSampleVersion())
+    {
+        mSampleVersion = audioProcessor.getSampleVersion();
+        mFileName = audioProcessor.getSampleName();
+        updateWaveform();
     }
-    //update ADSR parameters from sliders
-    audioProcessor.updateADSR();
+    
+    //the response can change with a restored session as well as from the button
+    auto responseName = audioProcessor.getImpulseResponseFile().getFileNameWithoutExtension();
+    auto responseText = responseName.isEmpty() ? juce::String("Load IR...") : responseName;
+    if (mImpulseResponseButton.getButtonText() != responseText)
+    {
+        mImpulseResponseButton.setButtonText(responseText);
+    }
+}
+
+void SimpleSamplerAudioProcessorEditor::updateWaveform(){
+    mWaveformCache.update({ audioProcessor.getPeaks(), mFileName, audioProcessor.isLoading(), getWidth(), getHeight(), mPaintScale });
+}
+
+void SimpleSamplerAudioProcessorEditor::saveTelemetry(){
+    auto defaultFile = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                           .getChildFile("simpleSampler " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".csv");
+    mTelemetryChooser = std::make_unique<juce::FileChooser>("Save Performance Log", defaultFile, "*.csv");
+    
+    auto flags = juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                   | juce::FileBrowserComponent::warnAboutOverwriting;
+    mTelemetryChooser->launchAsync(flags, [this] (const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (file == juce::File() || audioProcessor.getTelemetry().writeToFile(file))
+            return;
+        
+        juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Save Performance Log",
+                                               "Couldn't write to " + file.getFullPathName());
+    });
+}
+
+void SimpleSamplerAudioProcessorEditor::chooseImpulseResponse(){
+    auto current = audioProcessor.getImpulseResponseFile();
+    auto start = current.existsAsFile() ? current : juce::File::getSpecialLocation(juce::File::userHomeDirectory);
+    mImpulseResponseChooser = std::make_unique<juce::FileChooser>("Choose an Impulse Response", start, "*.wav;*.aif;*.aiff;*.flac");
+    
+    auto flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+    mImpulseResponseChooser->launchAsync(flags, [this] (const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (file != juce::File())
+            audioProcessor.loadImpulseResponse(file);
+    });
 }
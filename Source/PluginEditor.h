@@ -10,13 +10,15 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "WaveformCache.h"
+#include "PerformanceMeter.h"
 
 //==============================================================================
 /**
 */
 class SimpleSamplerAudioProcessorEditor  : public juce::AudioProcessorEditor,
                                            public juce::FileDragAndDropTarget,
-                                           public juce::Slider::Listener
+                                           private juce::Timer
 {
 public:
     SimpleSamplerAudioProcessorEditor (SimpleSamplerAudioProcessor&);
@@ -29,16 +31,49 @@ public:
     //modified by ZY
     bool isInterestedInFileDrag(const juce::StringArray& files) override;
     void filesDropped(const juce::StringArray& files, int x, int y) override;
-    void sliderValueChanged(juce::Slider* slider) override;
 
 private:
+    void timerCallback() override;
+    void updateWaveform(); //asks for a new background image if the sample, size or scale changed
+    void saveTelemetry(); //asks where to, then writes the recent blocks' telemetry as CSV
+    void chooseImpulseResponse(); //asks for a response for the reverb, which loads it in the background
+    
     //modified by ZY
-    std::vector<float> mAudioPoints; //used to store the rescaled waveform on screen
+    WaveformCache mWaveformCache; //background, waveform and file name, drawn on its own thread
+    float mPaintScale { 1.0f }; //physical pixels per logical pixel when last painted
     juce::String mFileName { "" }; // store the file name
+    int mSampleVersion { 0 }; //version of the sample currently drawn
+    
+    //shown while a sample loads in the background
+    double mLoadProgress { 0.0 };
+    juce::ProgressBar mLoadProgressBar { mLoadProgress };
+    
+    //CPU and voice meter, and a button to save what it shows for when a user reports dropouts
+    PerformanceMeter mPerformanceMeter;
+    juce::TextButton mSaveTelemetryButton { "Save Log" };
+    std::unique_ptr<juce::FileChooser> mTelemetryChooser;
     
     //ADSR sliders and labels
     juce::Slider mAttackSlider, mDecaySlider, mSustainSlider, mReleaseSlider;
     juce::Label mAttackLabel, mDecayLabel, mSustainLabel, mReleaseLabel;
+    //keep the sliders and the processor's parameters in step
+    using SliderAttachment = juce::AudioProcessorValueTreeState::SliderAttachment;
+    std::unique_ptr<SliderAttachment> mAttackAttachment, mDecayAttachment, mSustainAttachment, mReleaseAttachment;
+    
+    //per-voice filter controls
+    juce::ComboBox mFilterTypeBox;
+    juce::Slider mCutoffSlider, mResonanceSlider, mKeyTrackingSlider;
+    juce::Label mFilterTypeLabel, mCutoffLabel, mResonanceLabel, mKeyTrackingLabel;
+    using ComboBoxAttachment = juce::AudioProcessorValueTreeState::ComboBoxAttachment;
+    std::unique_ptr<SliderAttachment> mCutoffAttachment, mResonanceAttachment, mKeyTrackingAttachment;
+    std::unique_ptr<ComboBoxAttachment> mFilterTypeAttachment;
+    
+    //reverb: its response, shown by name on the button that picks it, and how much of it is mixed in
+    juce::TextButton mImpulseResponseButton, mClearImpulseResponseButton { "Off" };
+    std::unique_ptr<juce::FileChooser> mImpulseResponseChooser;
+    juce::Slider mReverbMixSlider;
+    juce::Label mImpulseResponseLabel, mReverbMixLabel;
+    std::unique_ptr<SliderAttachment> mReverbMixAttachment;
 
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
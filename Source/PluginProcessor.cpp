@@ -8,34 +8,68 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "RealtimeChecker.h"
 
 //==============================================================================
 SimpleSamplerAudioProcessor::SimpleSamplerAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
-     : AudioProcessor (BusesProperties()
-                     #if ! JucePlugin_IsMidiEffect
-                      #if ! JucePlugin_IsSynth
-                       .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
-                      #endif
-                       .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
-                     #endif
-                       )
+     : AudioProcessor (createBusesProperties())
 #endif
 {
     //modified by ZY
     //allowing user to load .mp3 and .wav files
     mFormatManager.registerBasicFormats();
-    for (int i = 0; i < mNumVoices; i++){
-        //add samplerVoice for polyphonic
-        mSampler.addVoice(new juce::SamplerVoice());
+    //the audio thread reads the parameters straight from these
+    mAttackParam = mParameters.getRawParameterValue(ParameterIDs::attack);
+    mDecayParam = mParameters.getRawParameterValue(ParameterIDs::decay);
+    mSustainParam = mParameters.getRawParameterValue(ParameterIDs::sustain);
+    mReleaseParam = mParameters.getRawParameterValue(ParameterIDs::release);
+    mFilterTypeParam = mParameters.getRawParameterValue(ParameterIDs::filterType);
+    mCutoffParam = mParameters.getRawParameterValue(ParameterIDs::cutoff);
+    mResonanceParam = mParameters.getRawParameterValue(ParameterIDs::resonance);
+    mKeyTrackingParam = mParameters.getRawParameterValue(ParameterIDs::keyTracking);
+    mReverbMixParam = mParameters.getRawParameterValue(ParameterIDs::reverbMix);
+    //every voice there could ever be is created now, so note-ons never allocate;
+    //the extra ones play new notes while stolen voices fade out
+    for (int i = 0; i < mMaxPolyphony + SamplerSynthesiser::stealReserve; i++){
+        mSampler.addStreamingVoice(new StreamingSamplerVoice(*mDiskStreamer, mStreamingUnderruns));
     }
-    
+    //sized for the lowest common rate until prepareToPlay gives the real one
+    mStreamBufferLength = getStreamBufferLength(44100.0);
+    setPolyphony(mDefaultPolyphony);
+    //frees sound sets the audio thread is done with
+    startTimer(500);
 }
 
 SimpleSamplerAudioProcessor::~SimpleSamplerAudioProcessor()
 {
-    mFormatReader = nullptr;
+    stopTimer();
+    mLoader.cancelAllLoads();
+    cancelPendingUpdate();
+}
+
+#ifndef JucePlugin_PreferredChannelConfigurations
+juce::AudioProcessor::BusesProperties SimpleSamplerAudioProcessor::createBusesProperties()
+{
+    auto buses = BusesProperties()
+                 #if ! JucePlugin_IsMidiEffect
+                  #if ! JucePlugin_IsSynth
+                   .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
+                  #endif
+                   .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                 #endif
+                   ;
+    
+    //modified by ZY
+    //extra outputs that zones can be sent to, off until the host turns them on
+   #if ! JucePlugin_IsMidiEffect
+    for (int i = 0; i < mNumExtraOutputs; ++i){
+        buses = buses.withOutput("Output " + juce::String(i + 2), juce::AudioChannelSet::stereo(), false);
+    }
+   #endif
+    return buses;
 }
+#endif
 
 //==============================================================================
 const juce::String SimpleSamplerAudioProcessor::getName() const
@@ -72,7 +106,8 @@ bool SimpleSamplerAudioProcessor::isMidiEffect() const
 
 double SimpleSamplerAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    //after the last note-off the voices ring on for exactly the release time, and the reverb for as long as its response
+    return (double) mReleaseParam->load() + mReverb.getLengthInSeconds();
 }
 
 int SimpleSamplerAudioProcessor::getNumPrograms()
@@ -106,7 +141,58 @@ void SimpleSamplerAudioProcessor::prepareToPlay (double sampleRate, int samplesP
     // initialisation that you need..
     mSampler.setCurrentPlaybackSampleRate(sampleRate);
     
-    updateADSR();
+    //only does any work the first time an instance in this process gets here
+    mInterpolationTables->prepare();
+    
+    //ring buffers can only be resized while nothing is playing, and every voice that has one
+    //gets the new size, so none of them has to be resized later on
+    mSampler.allNotesOff(0, false);
+    mStreamBufferLength = getStreamBufferLength(sampleRate);
+    prepareVoices(juce::jmax(getPolyphony() + SamplerSynthesiser::stealReserve, mNumPreparedVoices));
+    //where each output bus's channels are in processBlock's buffer; disabled buses have none,
+    //so their zones play through the main output
+    //and which speakers they are, for mixing samples down onto them
+    juce::Array<juce::Range<int>> buses;
+    juce::Array<juce::AudioChannelSet> busLayouts;
+    for (int i = 0; i < getBusCount(false); ++i){
+        auto* bus = getBus(false, i);
+        auto first = bus->isEnabled() ? bus->getChannelIndexInProcessBlockBuffer(0) : 0;
+        buses.add(juce::Range<int>(first, first + (bus->isEnabled() ? bus->getNumberOfChannels() : 0)));
+        busLayouts.add(bus->getCurrentLayout());
+    }
+    mSampler.setOutputBuses(buses, busLayouts);
+    //buffers the render threads mix their share of the voices into
+    mSampler.prepareToRender(samplesPerBlock, getTotalNumOutputChannels());
+    
+    //start from the current parameter values, with nothing left to ramp
+    for (auto* smoothed : { &mAttack, &mDecay, &mSustain, &mRelease, &mResonance, &mKeyTracking }){
+        smoothed->reset(sampleRate, mEnvelopeSmoothingSeconds);
+    }
+    mCutoff.reset(sampleRate, mEnvelopeSmoothingSeconds);
+    mAttack.setCurrentAndTargetValue(mAttackParam->load());
+    mDecay.setCurrentAndTargetValue(mDecayParam->load());
+    mSustain.setCurrentAndTargetValue(mSustainParam->load());
+    mRelease.setCurrentAndTargetValue(mReleaseParam->load());
+    mCutoff.setCurrentAndTargetValue(mCutoffParam->load());
+    mResonance.setCurrentAndTargetValue(mResonanceParam->load());
+    mKeyTracking.setCurrentAndTargetValue(mKeyTrackingParam->load());
+    updateSmoothedParameters(0);
+    mReverbMix.reset(sampleRate, mEnvelopeSmoothingSeconds);
+    mReverbMix.setCurrentAndTargetValue(mReverbMixParam->load());
+    
+    //the reverb makes its response again if the rate or the main output's channels have changed
+    mReverb.prepare(sampleRate, getMainBusNumOutputChannels());
+    mReverb.reset();
+    
+    //samples are converted to the host's rate as they load, so a new rate means loading again;
+    //the current set keeps playing, resampled by the voices, until the converted one is ready.
+    //A session restored before the first call is loaded here for the first time
+    if (mTargetSampleRate.exchange(sampleRate) != sampleRate){
+        auto reference = getSampleReference();
+        if (! reference.isEmpty()){
+            loadReference(reference);
+        }
+    }
 }
 
 void SimpleSamplerAudioProcessor::releaseResources()
@@ -123,12 +209,20 @@ bool SimpleSamplerAudioProcessor::isBusesLayoutSupported (const BusesLayout& lay
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
     // Some plugin hosts, such as certain GarageBand versions, will only
     // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    //modified by ZY
+    //the main output takes anything up to 7.1; samples with speakers it doesn't have are mixed down onto it
+    auto mainOutput = layouts.getMainOutputChannelSet();
+    if (mainOutput.isDisabled() || mainOutput.size() > SampleData::maxChannels)
         return false;
+    
+    //the extra outputs carry single zones, in mono or stereo
+    for (int i = 1; i < layouts.outputBuses.size(); ++i){
+        auto bus = layouts.outputBuses.getReference(i);
+        if (! bus.isDisabled() && bus != juce::AudioChannelSet::mono() && bus != juce::AudioChannelSet::stereo())
+            return false;
+    }
 
     // This checks if the input layout matches the output layout
    #if ! JucePlugin_IsSynth
@@ -143,6 +237,8 @@ bool SimpleSamplerAudioProcessor::isBusesLayoutSupported (const BusesLayout& lay
 
 void SimpleSamplerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const RealtimeChecker::ScopedRealtimeThread realtimeThread; //only does anything in checking builds
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -163,15 +259,86 @@ void SimpleSamplerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
     
-    //Creates the next block of audio output
-    mSampler.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+    //pick up a newly loaded sample, if there is one, and any new render threads, buffers or buses
+    mSampler.updateSoundSet();
+    mSampler.updateRenderState();
     
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-    {
-        auto* channelData = buffer.getWritePointer (channel);
-
-        // ..do something to the data...
+    //hosts switch to non-realtime when bouncing, which is when the expensive modes are affordable
+    auto quality = isNonRealtime() ? mOfflineQuality.load() : mRealtimeQuality.load();
+    if (quality != mVoiceQuality){
+        for (int i = 0; i < mSampler.getNumVoices(); ++i){
+            mSampler.getStreamingVoice(i)->setInterpolationQuality(quality);
+        }
+        mVoiceQuality = quality;
+    }
+    
+    //parameters are read once per block, so automation lands on block boundaries; while the envelope
+    //or filter ramps towards them, the block is rendered in mEnvelopeSmoothingBlockSize pieces with the
+    //voices updated in between, so the ramp moves in 64 sample steps rather than every sample
+    updateSmoothingTargets();
+    mReverbMix.setTargetValue(mReverbMixParam->load(std::memory_order_relaxed));
+    const auto reverbIsOn = mReverbMix.isSmoothing() || mReverbMix.getTargetValue() > 0.0f;
+    
+    //with nothing sounding, no MIDI to start anything and no reverb tail left, the cleared buffer
+    //is already the output; only the ramps move on, so a note in the next block starts from the right values
+    if (midiMessages.isEmpty() && ! mSampler.hasActiveVoices() && ! (reverbIsOn && mReverb.isRinging())){
+        if (isSmoothing()){
+            updateSmoothedParameters(buffer.getNumSamples());
+        }
+        mReverbMix.skip(buffer.getNumSamples());
+        recordBlock(startTicks, buffer.getNumSamples(), 0);
+        return;
     }
+    
+    if (! isSmoothing()){
+        //the filter type isn't smoothed, so it's passed on as soon as it changes
+        auto filter = getSmoothedFilter(0);
+        if (filter.type != mSampler.getFilterParameters().type){
+            mSampler.setFilterParameters(filter);
+        }
+        //Creates the next block of audio output
+        mSampler.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+    }else{
+        for (int start = 0; start < buffer.getNumSamples(); start += mEnvelopeSmoothingBlockSize){
+            auto num = juce::jmin(mEnvelopeSmoothingBlockSize, buffer.getNumSamples() - start);
+            updateSmoothedParameters(num);
+            mSampler.renderNextBlock(buffer, midiMessages, start, num);
+        }
+    }
+    
+    //the reverb is a send on the main output: the dry signal stays as it is, with the reverb of it added at the mix level;
+    //a mix of 0 leaves it where it was, to carry on from there when it's turned up again
+    if (reverbIsOn){
+        auto mainOutput = getBusBuffer(buffer, false, 0);
+        auto startMix = mReverbMix.getCurrentValue();
+        auto endMix = mReverbMix.skip(buffer.getNumSamples());
+        mReverb.process(mainOutput, startMix, endMix);
+    }
+    
+    recordBlock(startTicks, buffer.getNumSamples(), mSampler.getNumActiveVoices());
+}
+
+void SimpleSamplerAudioProcessor::recordBlock(juce::int64 startTicks, int numSamples, int numActiveVoices){
+    const auto endTicks = juce::Time::getHighResolutionTicks();
+    
+    BlockTelemetry record;
+    record.blockNumber = mBlockNumber++;
+    record.startTime = juce::Time::highResolutionTicksToSeconds(startTicks) * 1000.0;
+    record.renderMicroseconds = (float) (juce::Time::highResolutionTicksToSeconds(endTicks - startTicks) * 1.0e6);
+    record.budgetMicroseconds = getSampleRate() > 0.0 ? (float) (numSamples * 1.0e6 / getSampleRate()) : 0.0f;
+    record.numSamples = numSamples;
+    record.activeVoices = numActiveVoices;
+    record.polyphony = getPolyphony();
+    
+    //the counters only ever go up, so each block's share is the difference
+    const auto steals = mSampler.getNumSteals();
+    const auto underruns = mStreamingUnderruns.load(std::memory_order_relaxed);
+    record.steals = steals - mLastNumSteals;
+    record.underruns = underruns - mLastNumUnderruns;
+    mLastNumSteals = steals;
+    mLastNumUnderruns = underruns;
+    
+    mTelemetry.push(record);
 }
 
 //==============================================================================
@@ -191,46 +358,300 @@ void SimpleSamplerAudioProcessor::getStateInformation (juce::MemoryBlock& destDa
     // You should use this method to store your parameters in the memory block.
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
+    auto state = mParameters.copyState();
+    auto reference = getSampleReference();
+    
+    //embedding reads the whole sample, so it's only done once, and kept for the next save
+    if (mEmbedSamples && ! reference.hasEmbeddedData() && ! reference.file.hasFileExtension("sfz")
+        && reference.file.existsAsFile() && reference.embed(mFormatManager)){
+        const juce::ScopedLock sl (mReferenceLock);
+        if (mReference.refersToSameSample(reference)){
+            mReference.embeddedData = reference.embeddedData;
+            mReference.embeddedExtension = reference.embeddedExtension;
+        }
+    }
+    
+    if (! mEmbedSamples){
+        reference.embeddedData.reset();
+    }
+    
+    //the sample is saved as a reference to its file, which is loaded again on restore
+    if (! reference.isEmpty()){
+        state.appendChild(reference.toValueTree(), nullptr);
+    }
+    state.setProperty(StateIDs::sample, reference.file.getFullPathName(), nullptr);
+    state.setProperty(StateIDs::embedSamples, mEmbedSamples.load(), nullptr);
+    state.setProperty(StateIDs::polyphony, getPolyphony(), nullptr);
+    state.setProperty(StateIDs::voiceStealing, (int) getVoiceStealingPolicy(), nullptr);
+    state.setProperty(StateIDs::realtimeInterpolation, (int) getRealtimeInterpolationQuality(), nullptr);
+    state.setProperty(StateIDs::offlineInterpolation, (int) getOfflineInterpolationQuality(), nullptr);
+    state.setProperty(StateIDs::impulseResponse, getImpulseResponseFile().getFullPathName(), nullptr);
+    
+    if (auto xml = state.createXml())
+        copyXmlToBinary (*xml, destData);
 }
 
 void SimpleSamplerAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
+    auto xml = getXmlFromBinary (data, sizeInBytes);
+
+    if (xml == nullptr || ! xml->hasTagName (mParameters.state.getType()))
+        return;
+    
+    auto state = juce::ValueTree::fromXml (*xml);
+    
+    //the reference (and whatever it embeds) doesn't belong in the parameters
+    auto referenceTree = state.getChildWithName(SampleReference::getType());
+    state.removeChild(referenceTree, nullptr);
+    mParameters.replaceState (state);
+    
+    //sessions saved before these were stored keep the current settings
+    setPolyphony(state.getProperty(StateIDs::polyphony, getPolyphony()));
+    setVoiceStealingPolicy((VoiceStealingPolicy) juce::jlimit(0, 2, (int) state.getProperty(StateIDs::voiceStealing, (int) getVoiceStealingPolicy())));
+    setRealtimeInterpolationQuality((InterpolationQuality) juce::jlimit(0, 4, (int) state.getProperty(StateIDs::realtimeInterpolation, (int) getRealtimeInterpolationQuality())));
+    setOfflineInterpolationQuality((InterpolationQuality) juce::jlimit(0, 4, (int) state.getProperty(StateIDs::offlineInterpolation, (int) getOfflineInterpolationQuality())));
+    mEmbedSamples = (bool) state.getProperty(StateIDs::embedSamples, mEmbedSamples.load());
+    
+    //sessions without a response, older ones included, have no reverb
+    auto responsePath = state.getProperty(StateIDs::impulseResponse).toString();
+    auto responseFile = juce::File::isAbsolutePath(responsePath) ? juce::File(responsePath) : juce::File();
+    if (responseFile != getImpulseResponseFile()){
+        loadImpulseResponse(responseFile);
+    }
+    
+    auto reference = SampleReference::fromValueTree(referenceTree);
+    auto path = state.getProperty(StateIDs::sample).toString();
+    if (reference.isEmpty() && juce::File::isAbsolutePath(path)){
+        reference.file = juce::File(path);
+    }
+    
+    {
+        const juce::ScopedLock sl (mReferenceLock);
+        if (! reference.isEmpty() && mReference.refersToSameSample(reference)){
+            //already loaded (or loading), so only keep the embedded copy, if the session has one
+            if (! mReference.hasEmbeddedData()){
+                mReference.embeddedData = reference.embeddedData;
+                mReference.embeddedExtension = reference.embeddedExtension;
+            }
+            return;
+        }
+    }
+    
+    //whatever was loaded doesn't belong to this session, so play silence until its own sample is ready
+    swapInSoundSet(new SoundSet());
+    
+    //the load happens on the loading threads, so this returns straight away and
+    //a project with many instances doesn't wait for their samples before it opens.
+    //Before the first prepareToPlay there's no rate to convert to, so the sample would only be
+    //loaded twice; it's left to prepareToPlay, which loads it once the rate is known
+    if (! reference.isEmpty() && mTargetSampleRate.load() <= 0.0){
+        mLoader.cancelAllLoads();
+        const juce::ScopedLock sl (mReferenceLock);
+        mReference = reference;
+    }
+    else if (! reference.isEmpty()){
+        loadReference(reference);
+    }
+    else{
+        mLoader.cancelAllLoads();
+        const juce::ScopedLock sl (mReferenceLock);
+        mReference = {};
+    }
+}
+
+SampleReference SimpleSamplerAudioProcessor::getSampleReference() const{
+    const juce::ScopedLock sl (mReferenceLock);
+    return mReference;
 }
 
 //modified by ZY
 void SimpleSamplerAudioProcessor::loadFile(const juce::String& path){
-    //clear former sampler sounds loaded previously
-    mSampler.clearSounds();
-    //read the audio file
-    auto file = juce::File (path);
-    mFormatReader = mFormatManager.createReaderFor(file);
-    auto sampleLength = static_cast<int>(mFormatReader->lengthInSamples);
-    //set size of the AudioBuffter
-    mWaveForm.setSize(1, sampleLength);
-    //read (AudioBuffer< float > *buffer, int startSampleInDestBuffer, int numSamples, int64 readerStartSample, bool useReaderLeftChan, bool useReaderRightChan)
-    mFormatReader->read(&mWaveForm, 0, sampleLength, 0, true, false);
-    juce::BigInteger range; // range on the midi keyboard we want to use
-    
-    range.setRange(0, 128, true); //setRange (int startBit, int numBits, bool shouldBeSet)
-    
-    //SynthesiserSound *     addSound (const SynthesiserSound::Ptr &newSound)
-    //SamplerSound (const String &name, AudioFormatReader &source, const BigInteger &midiNotes, int midiNoteForNormalPitch, double attackTimeSecs, double releaseTimeSecs, double maxSampleLengthSeconds)
-    //add SamplerSound to the Synthesiser
-    mSampler.addSound(new juce::SamplerSound ("Sample", *mFormatReader, range, 60, 0.1, 0.1, 10.0) );
+    SampleReference reference;
+    reference.file = juce::File(path);
+    loadReference(reference);
 }
 
-//modified by ZY
-void SimpleSamplerAudioProcessor::updateADSR(){
-    for (int i = 0; i < mSampler.getNumSounds(); ++i ){
-        //dynamic cast to SamplerSound is needed to use the getSound function
-        //.get() reuturns the pointer
-        if(auto sound = dynamic_cast<juce::SamplerSound*>(mSampler.getSound(i).get())){
-            //use set EnvelopeParameters function of SamplerSound to set ADSR Parameters
-            sound->setEnvelopeParameters(mADSRParams);
+void SimpleSamplerAudioProcessor::loadReference(const SampleReference& reference){
+    SampleLoadOptions options;
+    options.midiRootNote = 60;
+    options.preloadLength = mPreloadLength;
+    options.useMemoryMapping = mUseMemoryMapping;
+    options.targetSampleRate = mTargetSampleRate.load();
+    
+    {
+        const juce::ScopedLock sl (mReferenceLock);
+        mReference = reference;
+    }
+    
+    //this runs on the loading thread once the sample is ready; a moved sample is found by content,
+    //and one that is already open in another instance isn't decoded again. A newly loaded file's
+    //full hash comes in after its set, so reading the whole file doesn't hold up the sound
+    mLoader.loadReferenceAsync(reference, options, [this](SoundSet::Ptr set){ swapInSoundSet(set); },
+                               [this](const SampleReference& hashed){
+                                   const juce::ScopedLock sl (mFinishedSetLock);
+                                   mHashedReference = hashed;
+                                   triggerAsyncUpdate();
+                               });
+}
+
+void SimpleSamplerAudioProcessor::swapInSoundSet(SoundSet::Ptr set){
+    //the audio thread picks the new set up at its next block
+    mSampler.setSoundSet(set);
+    
+    const juce::ScopedLock sl (mFinishedSetLock);
+    mFinishedSet = set;
+    triggerAsyncUpdate();
+}
+
+void SimpleSamplerAudioProcessor::handleAsyncUpdate(){
+    SoundSet::Ptr finished;
+    SampleReference hashed;
+    {
+        const juce::ScopedLock sl (mFinishedSetLock);
+        std::swap(finished, mFinishedSet);
+        std::swap(hashed, mHashedReference);
+    }
+    
+    if (finished != nullptr){
+        //the old set may still be playing, so it goes with the other retired sets
+        if (mLoadedSet != nullptr)
+            mRetiredSets.addIfNotAlreadyThere(mLoadedSet.get());
+        
+        mLoadedSet = finished;
+        ++mSampleVersion;
+        
+        //from now on the session refers to where the sample was found, and what it holds
+        const juce::ScopedLock sl (mReferenceLock);
+        if (! finished->reference.isEmpty() && finished->reference.refersToSameSample(mReference)){
+            auto embeddedData = std::move(mReference.embeddedData);
+            auto embeddedExtension = mReference.embeddedExtension;
+            mReference = finished->reference;
+            mReference.embeddedData = std::move(embeddedData);
+            mReference.embeddedExtension = embeddedExtension;
         }
     }
+    
+    //the set is always taken in first, so the full hash lands on the reference it belongs to
+    if (hashed.fullContentHash != 0){
+        const juce::ScopedLock sl (mReferenceLock);
+        if (mReference.fullContentHash == 0 && mReference.refersToSameSample(hashed)){
+            mReference.fullContentHash = hashed.fullContentHash;
+        }
+    }
+}
+
+void SimpleSamplerAudioProcessor::timerCallback(){
+    mSampler.collectRetiredSets(mRetiredSets);
+    
+    //the disk thread may still be reading from a sound a voice has only just let go of
+    const juce::ScopedLock sl (mDiskStreamer->getStreamLock());
+    for (int i = mRetiredSets.size(); --i >= 0;){
+        auto set = mRetiredSets.getObjectPointerUnchecked(i);
+        //only this array is left holding it, and no voice plays any of its sounds
+        if (set->getReferenceCount() == 1 && set->isUnused())
+            mRetiredSets.remove(i);
+    }
+    
+    //drop any samples no instance has a sound for any more
+    mSamplePool->purgeUnused();
+    //the render threads and buffers the audio thread has replaced
+    mSampler.collectRetiredRenderState();
+    //and the reverb state the audio thread has replaced, with any responses nobody uses now
+    mReverb.collectGarbage();
+}
+
+void SimpleSamplerAudioProcessor::setPolyphony(int numVoices){
+    numVoices = juce::jlimit(1, mMaxPolyphony, numVoices);
+    
+    //the voices have to be ready before the audio thread is allowed to use them,
+    //and the ones that aren't ready yet have never played, so this can't glitch
+    prepareVoices(numVoices + SamplerSynthesiser::stealReserve);
+    mSampler.setPolyphony(numVoices);
+}
+
+void SimpleSamplerAudioProcessor::prepareVoices(int numVoices){
+    numVoices = juce::jmin(numVoices, mSampler.getNumVoices());
+    for (int i = 0; i < numVoices; ++i){
+        mSampler.getStreamingVoice(i)->prepareToStream(mReadAheadChannels, mStreamBufferLength);
+    }
+    mNumPreparedVoices = juce::jmax(mNumPreparedVoices, numVoices);
+}
+
+void SimpleSamplerAudioProcessor::setStreamReadAhead(double seconds, int numChannels){
+    //the rings are resized by the next prepareToPlay, as the voices may be playing now
+    mReadAheadSeconds = juce::jlimit(0.1, 10.0, seconds);
+    mReadAheadChannels = juce::jlimit(1, SampleData::maxChannels, numChannels);
+}
+
+int SimpleSamplerAudioProcessor::getStreamBufferLength(double sampleRate) const{
+    return (int) std::ceil(mReadAheadSeconds * sampleRate);
+}
+
+//modified by ZY
+juce::AudioProcessorValueTreeState::ParameterLayout SimpleSamplerAudioProcessor::createParameterLayout(){
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+    //skewed so the short times, where the ear is most sensitive, get more of the knob
+    juce::NormalisableRange<float> timeRange (0.0f, 2.0f, 0.001f, 0.5f);
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::attack, "Attack", timeRange, 0.0f, "s"));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::decay, "Decay", timeRange, 0.0f, "s"));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::sustain, "Sustain",
+                                                           juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 1.0f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::release, "Release", timeRange, 0.1f, "s"));
+    //each voice's filter; the cutoff is for a note at middle C, and key tracking moves it with the note
+    layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterIDs::filterType, "Filter",
+                                                            juce::StringArray { "Off", "Low Pass", "Band Pass", "High Pass" }, 0));
+    juce::NormalisableRange<float> cutoffRange (20.0f, 20000.0f, 0.1f);
+    cutoffRange.setSkewForCentre(1000.0f);
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::cutoff, "Cutoff", cutoffRange, 20000.0f, "Hz"));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::resonance, "Resonance",
+                                                           juce::NormalisableRange<float>(0.5f, 10.0f, 0.01f, 0.5f), 0.707f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::keyTracking, "Key Tracking",
+                                                           juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 0.0f));
+    //how much of the convolution reverb is added to the dry signal; nothing happens until a response is loaded
+    layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterIDs::reverbMix, "Reverb",
+                                                           juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 0.3f));
+    return layout;
+}
+
+void SimpleSamplerAudioProcessor::updateSmoothingTargets(){
+    mAttack.setTargetValue(mAttackParam->load(std::memory_order_relaxed));
+    mDecay.setTargetValue(mDecayParam->load(std::memory_order_relaxed));
+    mSustain.setTargetValue(mSustainParam->load(std::memory_order_relaxed));
+    mRelease.setTargetValue(mReleaseParam->load(std::memory_order_relaxed));
+    mCutoff.setTargetValue(mCutoffParam->load(std::memory_order_relaxed));
+    mResonance.setTargetValue(mResonanceParam->load(std::memory_order_relaxed));
+    mKeyTracking.setTargetValue(mKeyTrackingParam->load(std::memory_order_relaxed));
+}
+
+bool SimpleSamplerAudioProcessor::isSmoothing() const{
+    return mAttack.isSmoothing() || mDecay.isSmoothing() || mSustain.isSmoothing() || mRelease.isSmoothing()
+        || mCutoff.isSmoothing() || mResonance.isSmoothing() || mKeyTracking.isSmoothing();
+}
+
+juce::ADSR::Parameters SimpleSamplerAudioProcessor::getSmoothedEnvelope(int numSamplesToSkip){
+    juce::ADSR::Parameters params;
+    params.attack = mAttack.skip(numSamplesToSkip);
+    params.decay = mDecay.skip(numSamplesToSkip);
+    params.sustain = mSustain.skip(numSamplesToSkip);
+    params.release = mRelease.skip(numSamplesToSkip);
+    return params;
+}
+
+VoiceFilterParameters SimpleSamplerAudioProcessor::getSmoothedFilter(int numSamplesToSkip){
+    VoiceFilterParameters params;
+    params.type = (VoiceFilterType) juce::roundToInt(mFilterTypeParam->load(std::memory_order_relaxed));
+    params.cutoff = mCutoff.skip(numSamplesToSkip);
+    params.resonance = mResonance.skip(numSamplesToSkip);
+    params.keyTracking = mKeyTracking.skip(numSamplesToSkip);
+    return params;
+}
+
+void SimpleSamplerAudioProcessor::updateSmoothedParameters(int numSamplesToSkip){
+    mSampler.setEnvelopeParameters(getSmoothedEnvelope(numSamplesToSkip));
+    mSampler.setFilterParameters(getSmoothedFilter(numSamplesToSkip));
 }
 
 
@@ -9,11 +9,44 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SamplerSynthesiser.h"
+#include "SampleLoader.h"
+#include "Telemetry.h"
+#include "ConvolutionReverb.h"
+
+//modified by ZY
+//IDs of the host-automatable parameters
+namespace ParameterIDs
+{
+    constexpr const char* attack = "attack";
+    constexpr const char* decay = "decay";
+    constexpr const char* sustain = "sustain";
+    constexpr const char* release = "release";
+    constexpr const char* filterType = "filterType";
+    constexpr const char* cutoff = "cutoff";
+    constexpr const char* resonance = "resonance";
+    constexpr const char* keyTracking = "keyTracking";
+    constexpr const char* reverbMix = "reverbMix";
+}
+
+//the rest of the saved state, stored as properties next to the parameters
+namespace StateIDs
+{
+    constexpr const char* sample = "sample"; //the plain path, which is all older sessions have
+    constexpr const char* embedSamples = "embedSamples";
+    constexpr const char* polyphony = "polyphony";
+    constexpr const char* voiceStealing = "voiceStealing";
+    constexpr const char* realtimeInterpolation = "realtimeInterpolation";
+    constexpr const char* offlineInterpolation = "offlineInterpolation";
+    constexpr const char* impulseResponse = "impulseResponse";
+}
 
 //==============================================================================
 /**
 */
-class SimpleSamplerAudioProcessor  : public juce::AudioProcessor
+class SimpleSamplerAudioProcessor  : public juce::AudioProcessor,
+                                     private juce::Timer,
+                                     private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -54,23 +87,157 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
     
     //modified by ZY
-    void loadFile (const juce::String& path);
-    int getNumSamplerSounds() { return mSampler.getNumSounds(); }
-    juce::AudioBuffer<float>& getWaveForm() {return mWaveForm; }
-    void updateADSR(); //update ADSR Parameter
-    juce::ADSR::Parameters& getADSRParams() {return mADSRParams;}
+    void loadFile (const juce::String& path); //loads in the background and returns straight away; .sfz files load every zone
+    bool isLoading() const { return mLoader.isLoading(); } //also true while a restored session's sample loads
+    bool isBuildingMipMaps() const { return mLoader.isBuildingMipMaps(); } //notes play without them until they're ready
+    SampleReference getSampleReference() const; //the file last asked for, whether or not it has finished loading
+    //store the sample itself in the session, losslessly compressed, so it opens where the file doesn't exist
+    void setEmbedSamples (bool shouldEmbed) { mEmbedSamples = shouldEmbed; }
+    bool getEmbedSamples() const { return mEmbedSamples; }
+    //folders searched by content for samples a session can't find where it left them; shared by all instances
+    void addSampleFolder (const juce::File& folder) { mSampleIndex->addFolder(folder); }
+    void removeSampleFolder (const juce::File& folder) { mSampleIndex->removeFolder(folder); }
+    juce::Array<juce::File> getSampleFolders() const { return mSampleIndex->getFolders(); }
+    float getLoadProgress() const { return mLoader.getProgress(); }
+    int getSampleVersion() const { return mSampleVersion; } //bumped every time a new sample is ready
+    juce::String getSampleName() const { return mLoadedSet != nullptr ? mLoadedSet->name : juce::String(); }
+    int getNumSamplerSounds() const { return mLoadedSet != nullptr ? mLoadedSet->sounds.size() : 0; }
+    PeakPyramid::Ptr getPeaks() const { return mLoadedSet != nullptr ? mLoadedSet->peaks : nullptr; } //what the editor draws, if anything
+    //the host-automatable parameters, which the editor's controls attach to
+    juce::AudioProcessorValueTreeState& getParameters() { return mParameters; }
+    int getNumStreamingUnderruns() const { return mStreamingUnderruns.load(); }
+    //a record of every block the audio thread renders, for the editor's meter and for saving after a dropout
+    const TelemetryRing& getTelemetry() const { return mTelemetry; }
+    //how many notes can sound at once, up to getMaxPolyphony(); message thread only
+    void setPolyphony (int numVoices);
+    int getPolyphony() const { return mSampler.getPolyphony(); }
+    static int getMaxPolyphony() { return mMaxPolyphony; }
+    void setVoiceStealingPolicy (VoiceStealingPolicy policy) { mSampler.setStealingPolicy(policy); }
+    VoiceStealingPolicy getVoiceStealingPolicy() const { return mSampler.getStealingPolicy(); }
+    //threads that render voices, counting the audio thread; 1 (the default) keeps it all on the audio thread
+    //more threads than cores would only have them fighting over the same one
+    void setNumRenderThreads (int numThreads) { mSampler.setNumRenderThreads(juce::jmin(numThreads, getMaxRenderThreads())); }
+    int getNumRenderThreads() const { return mSampler.getNumRenderThreads(); }
+    static int getMaxRenderThreads() { return juce::jmin(VoiceRenderPool::maxWorkers + 1, juce::SystemStats::getNumPhysicalCpus()); }
+    //how far ahead of a streamed note its voice reads from disk, for sounds of up to numChannels channels;
+    //each voice's ring holds seconds * sample rate frames of numChannels floats, so the default 0.25 s of
+    //stereo costs 94 KB a voice at 48 kHz (4.4 MB at the default polyphony, 25 MB at 256 voices).
+    //Sounds with more channels read proportionally less far ahead. Takes effect at the next prepareToPlay
+    void setStreamReadAhead (double seconds, int numChannels);
+    double getStreamReadAheadSeconds() const { return mReadAheadSeconds; }
+    int getStreamReadAheadChannels() const { return mReadAheadChannels; }
+    //WAV/AIFF samples loaded after this is set are played from a memory-mapped file
+    void setUseMemoryMapping (bool shouldUseMapping) { mUseMemoryMapping = shouldUseMapping; }
+    bool getUseMemoryMapping() const { return mUseMemoryMapping; }
+    //MP3s and other compressed samples are decoded to disk once and reloaded from there; this caps the space that takes
+    //the cache is shared by every instance, so this changes it for all of them
+    void setDecodedCacheSize (juce::int64 maxBytes) { mDecodedCache->setMaxSize(maxBytes); }
+    juce::int64 getDecodedCacheSize() const { return mDecodedCache->getMaxSize(); }
+    //samples converted to the session's rate are kept in the same cache, with a limit of their own
+    void setConvertedCacheSize (juce::int64 maxBytes) { mDecodedCache->setMaxConvertedSize(maxBytes); }
+    juce::int64 getConvertedCacheSize() const { return mDecodedCache->getMaxConvertedSize(); }
+    //caps the memory the mip-maps of every instance take up together; samples past it play without one
+    void setMipMapMemoryLimit (juce::int64 maxBytes) { SampleMipMap::setMemoryLimit(maxBytes); }
+    juce::int64 getMipMapMemoryLimit() const { return SampleMipMap::getMemoryLimit(); }
+    //interpolation used while playing live, and while the host renders offline (bouncing)
+    void setRealtimeInterpolationQuality (InterpolationQuality quality) { mRealtimeQuality = quality; }
+    void setOfflineInterpolationQuality (InterpolationQuality quality) { mOfflineQuality = quality; }
+    InterpolationQuality getRealtimeInterpolationQuality() const { return mRealtimeQuality; }
+    InterpolationQuality getOfflineInterpolationQuality() const { return mOfflineQuality; }
+    //the response the reverb convolves the main output with; loads in the background, and an empty file turns it off
+    void loadImpulseResponse (const juce::File& file) { mReverb.loadImpulseResponse(file); }
+    juce::File getImpulseResponseFile() const { return mReverb.getImpulseResponseFile(); }
+    bool isLoadingImpulseResponse() const { return mReverb.isLoading(); } //true until prepareToPlay gives it a rate
 
 private:
+   #ifndef JucePlugin_PreferredChannelConfigurations
+    static BusesProperties createBusesProperties(); //the main output, then the extra ones
+   #endif
+    void timerCallback() override;
+    void handleAsyncUpdate() override;
+    void swapInSoundSet (SoundSet::Ptr set); //hands a set to the audio thread and, later, the editor
+    void loadReference (const SampleReference& reference); //finds and loads it in the background
+    void prepareVoices (int numVoices); //allocates ring buffers for the first numVoices voices
+    int getStreamBufferLength (double sampleRate) const; //frames of read-ahead at that rate
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+    void updateSmoothingTargets(); //audio thread, once per block
+    bool isSmoothing() const;
+    void recordBlock(juce::int64 startTicks, int numSamples, int numActiveVoices); //audio thread, at the end of each block
+    juce::ADSR::Parameters getSmoothedEnvelope(int numSamplesToSkip); //audio thread
+    VoiceFilterParameters getSmoothedFilter(int numSamplesToSkip); //audio thread
+    void updateSmoothedParameters(int numSamplesToSkip); //hands both of the above to the synth
     
     //modified by ZY
-    juce::Synthesiser mSampler;
-    const int mNumVoices {3} ;
-    juce::AudioBuffer<float> mWaveForm;
+    //disk thread shared by all instances, has to outlive the voices
+    juce::SharedResourcePointer<DiskStreamer> mDiskStreamer;
+    //decoded samples shared with the other instances
+    juce::SharedResourcePointer<SamplePool> mSamplePool;
+    //decoded copies of compressed samples, kept across sessions
+    juce::SharedResourcePointer<DecodedSampleCache> mDecodedCache;
+    //where samples are looked for by content
+    juce::SharedResourcePointer<SampleIndex> mSampleIndex;
+    std::atomic<int> mStreamingUnderruns { 0 };
+    SamplerSynthesiser mSampler;
+    //written once per block; the totals it was last given, so it can record each block's share
+    TelemetryRing mTelemetry;
+    juce::uint64 mBlockNumber { 0 };
+    int mLastNumSteals { 0 };
+    int mLastNumUnderruns { 0 };
+    static constexpr int mMaxPolyphony { 256 }; //voices are all allocated up front
+    static constexpr int mDefaultPolyphony { 32 };
+    static constexpr int mNumExtraOutputs { 7 }; //stereo buses after the main one, which SFZ zones pick with output=1 to 7
+    static constexpr int mPreloadLength { 65536 }; //samples of each sound kept in memory
+    //each voice's ring buffer, filled from disk; only resized in prepareToPlay, when nothing is playing
+    double mReadAheadSeconds { 0.25 };
+    int mReadAheadChannels { 2 };
+    int mStreamBufferLength { 0 };
+    int mNumPreparedVoices { 0 };
+    bool mUseMemoryMapping { true };
+    //the host rate samples are converted to as they load; 0 until prepareToPlay first gives one
+    std::atomic<double> mTargetSampleRate { 0.0 };
+    //sinc tables shared by all instances, built in prepareToPlay
+    juce::SharedResourcePointer<InterpolationTables> mInterpolationTables;
+    std::atomic<InterpolationQuality> mRealtimeQuality { InterpolationQuality::linear };
+    std::atomic<InterpolationQuality> mOfflineQuality { InterpolationQuality::sinc32 };
+    InterpolationQuality mVoiceQuality { InterpolationQuality::linear }; //what the voices were last set to
+    //the set the editor sees, only touched on the message thread
+    SoundSet::Ptr mLoadedSet;
+    //what was last asked for, saved with the session; filled in once the sample is found and loaded
+    SampleReference mReference;
+    juce::CriticalSection mReferenceLock;
+    std::atomic<bool> mEmbedSamples { false };
+    int mSampleVersion { 0 };
+    //handed over from the loading thread
+    juce::CriticalSection mFinishedSetLock;
+    SoundSet::Ptr mFinishedSet;
+    SampleReference mHashedReference; //the set's reference with the full hash, which comes later
+    //sets that have been replaced, freed once no voice plays them any more
+    juce::ReferenceCountedArray<SoundSet> mRetiredSets;
     //For Audio read
     juce::AudioFormatManager mFormatManager;
-    juce::AudioFormatReader* mFormatReader { nullptr };
-    //ADSR Parameters
-    juce::ADSR::Parameters mADSRParams;
+    SampleLoader mLoader { mFormatManager };
+    //host-automatable parameters; the audio thread reads them through the atomics
+    juce::AudioProcessorValueTreeState mParameters { *this, nullptr, "Parameters", createParameterLayout() };
+    std::atomic<float>* mAttackParam { nullptr };
+    std::atomic<float>* mDecayParam { nullptr };
+    std::atomic<float>* mSustainParam { nullptr };
+    std::atomic<float>* mReleaseParam { nullptr };
+    std::atomic<float>* mFilterTypeParam { nullptr };
+    std::atomic<float>* mCutoffParam { nullptr };
+    std::atomic<float>* mResonanceParam { nullptr };
+    std::atomic<float>* mKeyTrackingParam { nullptr };
+    //envelope and filter changes ramp in over mEnvelopeSmoothingSeconds, a sub-block at a time: the
+    //voices get new values every mEnvelopeSmoothingBlockSize samples, not every sample
+    static constexpr double mEnvelopeSmoothingSeconds { 0.05 };
+    static constexpr int mEnvelopeSmoothingBlockSize { 64 };
+    juce::SmoothedValue<float> mAttack, mDecay, mSustain, mRelease;
+    //the cutoff ramps in octaves rather than hertz, so sweeps sound even all the way down
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> mCutoff;
+    juce::SmoothedValue<float> mResonance, mKeyTracking;
+    //convolution reverb on the main output, added at the mix level, which ramps on its own
+    ConvolutionReverb mReverb;
+    std::atomic<float>* mReverbMixParam { nullptr };
+    juce::SmoothedValue<float> mReverbMix;
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SimpleSamplerAudioProcessor)
 };
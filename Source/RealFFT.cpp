@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    RealFFT.cpp
+    A power-of-two FFT of real signals, for the convolution reverb.
+
+  ==============================================================================
+*/
+
+#include "RealFFT.h"
+
+//==============================================================================
+RealFFT::RealFFT (int order)
+    : mSize (1 << order)
+{
+    jassert (order >= 2);
+
+    const auto half = mSize / 2;
+
+    mBitReverse.resize ((size_t) half);
+
+    for (int i = 0, bits = order - 1; i < half; ++i)
+    {
+        int reversed = 0;
+
+        for (int bit = 0; bit < bits; ++bit)
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+
+        mBitReverse[(size_t) i] = reversed;
+    }
+
+    // each pass's twiddles side by side, the pass of span s at [s - 1, 2s - 1), so the
+    // butterflies of a pass read them in order and vectorise
+    mCos.resize ((size_t) juce::jmax (1, half - 1));
+    mSin.resize ((size_t) juce::jmax (1, half - 1));
+
+    for (int span = 1; span < half; span *= 2)
+    {
+        for (int k = 0; k < span; ++k)
+        {
+            const auto angle = juce::MathConstants<double>::pi * k / span;
+            mCos[(size_t) (span - 1 + k)] = (float) std::cos (angle);
+            mSin[(size_t) (span - 1 + k)] = (float) std::sin (angle);
+        }
+    }
+
+    mUnpackCos.resize ((size_t) half);
+    mUnpackSin.resize ((size_t) half);
+
+    for (int i = 0; i < half; ++i)
+    {
+        const auto angle = juce::MathConstants<double>::twoPi * i / mSize;
+        mUnpackCos[(size_t) i] = (float) std::cos (angle);
+        mUnpackSin[(size_t) i] = (float) std::sin (angle);
+    }
+
+    mScratchReal.resize ((size_t) half);
+    mScratchImag.resize ((size_t) half);
+}
+
+//==============================================================================
+void RealFFT::forward (const float* input, float* real, float* imag) noexcept
+{
+    const auto half = mSize / 2;
+    auto* zr = mScratchReal.data();
+    auto* zi = mScratchImag.data();
+
+    // the even samples go in the real parts and the odd ones in the imaginary parts
+    for (int i = 0; i < half; ++i)
+    {
+        const auto to = (size_t) mBitReverse[(size_t) i];
+        zr[to] = input[2 * i];
+        zi[to] = input[2 * i + 1];
+    }
+
+    transform (zr, zi, false);
+
+    real[0] = zr[0] + zi[0];
+    imag[0] = 0.0f;
+    real[half] = zr[0] - zi[0];
+    imag[half] = 0.0f;
+
+    // bin k of the evens is (Z[k] + Z*[N/2 - k]) / 2 and of the odds (Z[k] - Z*[N/2 - k]) / 2i;
+    // the odds are a sample late, so they're turned back by e^(-2 pi i k / N) before adding
+    for (int k = 1; k < half; ++k)
+    {
+        const auto ar = zr[k], ai = zi[k];
+        const auto br = zr[half - k], bi = -zi[half - k];
+
+        const auto evenReal = 0.5f * (ar + br);
+        const auto evenImag = 0.5f * (ai + bi);
+        const auto oddReal = 0.5f * (ai - bi);
+        const auto oddImag = -0.5f * (ar - br);
+
+        const auto wr = mUnpackCos[(size_t) k];
+        const auto wi = -mUnpackSin[(size_t) k];
+
+        real[k] = evenReal + wr * oddReal - wi * oddImag;
+        imag[k] = evenImag + wr * oddImag + wi * oddReal;
+    }
+}
+
+void RealFFT::inverse (const float* real, const float* imag, float* output) noexcept
+{
+    const auto half = mSize / 2;
+    auto* zr = mScratchReal.data();
+    auto* zi = mScratchImag.data();
+
+    // the same untangling run backwards, leaving out the halves, which the unscaled
+    // transform makes up for along with everything else
+    for (int k = 0; k < half; ++k)
+    {
+        const auto ar = real[k], ai = imag[k];
+        const auto br = real[half - k], bi = -imag[half - k];
+
+        const auto evenReal = ar + br;
+        const auto evenImag = ai + bi;
+        const auto diffReal = ar - br;
+        const auto diffImag = ai - bi;
+
+        const auto wr = mUnpackCos[(size_t) k];
+        const auto wi = mUnpackSin[(size_t) k];
+
+        const auto oddReal = diffReal * wr - diffImag * wi;
+        const auto oddImag = diffReal * wi + diffImag * wr;
+
+        const auto to = (size_t) mBitReverse[(size_t) k];
+        zr[to] = evenReal - oddImag;
+        zi[to] = evenImag + oddReal;
+    }
+
+    transform (zr, zi, true);
+
+    for (int i = 0; i < half; ++i)
+    {
+        output[2 * i] = zr[i];
+        output[2 * i + 1] = zi[i];
+    }
+}
+
+//==============================================================================
+void RealFFT::transform (float* real, float* imag, bool isInverse) const noexcept
+{
+    const auto size = mSize / 2;
+    const auto sign = isInverse ? 1.0f : -1.0f;
+
+    for (int span = 1; span < size; span *= 2)
+    {
+        const auto* twiddleReal = mCos.data() + span - 1;
+        const auto* twiddleImag = mSin.data() + span - 1;
+
+        for (int start = 0; start < size; start += 2 * span)
+        {
+            auto* aReal = real + start;
+            auto* aImag = imag + start;
+            auto* bReal = aReal + span;
+            auto* bImag = aImag + span;
+
+            for (int k = 0; k < span; ++k)
+            {
+                const auto wr = twiddleReal[k];
+                const auto wi = sign * twiddleImag[k];
+                const auto tr = wr * bReal[k] - wi * bImag[k];
+                const auto ti = wr * bImag[k] + wi * bReal[k];
+
+                bReal[k] = aReal[k] - tr;
+                bImag[k] = aImag[k] - ti;
+                aReal[k] += tr;
+                aImag[k] += ti;
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*
+  ==============================================================================
+
+    RealFFT.h
+    A power-of-two FFT of real signals, for the convolution reverb.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Transforms blocks of real samples to and from their positive-frequency bins.
+
+    The project doesn't use juce_dsp, so this is a small radix-2 FFT of its own.
+    A real block of size N is packed into a complex one of N / 2, transformed,
+    and the two halves untangled afterwards, which is about twice as fast as
+    transforming it as a complex signal.
+
+    Spectra are kept as separate real and imaginary arrays of N / 2 + 1 bins, so
+    multiplying them together vectorises. Each object has scratch space of its
+    own, so it can only be used by one thread at a time.
+*/
+class RealFFT
+{
+public:
+    /** Creates a transform of 2 ^ order samples. order must be at least 2. */
+    explicit RealFFT (int order);
+
+    int getSize() const noexcept                    { return mSize; }
+    int getNumBins() const noexcept                 { return mSize / 2 + 1; }
+
+    /** Transforms getSize() samples into getNumBins() bins. */
+    void forward (const float* input, float* real, float* imag) noexcept;
+
+    /** The inverse of forward(), without the scaling: the output comes back
+        getSize() times larger than the signal that was transformed.
+    */
+    void inverse (const float* real, const float* imag, float* output) noexcept;
+
+private:
+    /** The complex transform of the packed half-size signal, in place. The input
+        must already be in bit-reversed order.
+    */
+    void transform (float* real, float* imag, bool isInverse) const noexcept;
+
+    int mSize = 0;
+    std::vector<int> mBitReverse;
+    std::vector<float> mCos, mSin;                  // twiddles of the half-size transform, a pass at a time
+    std::vector<float> mUnpackCos, mUnpackSin;      // twiddles that untangle the two halves
+    std::vector<float> mScratchReal, mScratchImag;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RealFFT)
+};
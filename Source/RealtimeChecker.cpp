@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    RealtimeChecker.cpp
+    Catches the audio thread allocating, locking or blocking, in builds that
+    ask for it.
+
+  ==============================================================================
+*/
+
+#include "RealtimeChecker.h"
+
+#if SIMPLESAMPLER_CHECK_REALTIME
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <execinfo.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    // plain ints, so reading them from inside malloc can't allocate
+    thread_local int realtimeDepth = 0;
+    thread_local int permitDepth = 0;
+
+    std::array<std::atomic<int>, (size_t) RealtimeChecker::Violation::numViolations> violationCounts {};
+
+    // the call stacks already reported, so a violation in every block is only printed once
+    constexpr int maxReportedStacks = 1024;
+    std::array<std::atomic<juce::uint64>, maxReportedStacks> reportedStacks {};
+
+    bool isFirstReport (juce::uint64 hash) noexcept
+    {
+        hash = juce::jmax ((juce::uint64) 1, hash);     // 0 marks an empty slot
+
+        for (int i = 0; i < maxReportedStacks; ++i)
+        {
+            auto& slot = reportedStacks[(size_t) ((hash + (juce::uint64) i) % maxReportedStacks)];
+            juce::uint64 expected = 0;
+
+            if (slot.compare_exchange_strong (expected, hash))
+                return true;
+
+            if (expected == hash)
+                return false;
+        }
+
+        return false;   // too many to keep track of; they've been seen by now
+    }
+
+    void writeToStderr (const char* text) noexcept
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        auto ignored = ::write (STDERR_FILENO, text, strlen (text));
+        juce::ignoreUnused (ignored);
+       #else
+        fputs (text, stderr);
+       #endif
+    }
+}
+
+//==============================================================================
+RealtimeChecker::ScopedRealtimeThread::ScopedRealtimeThread() noexcept    { ++realtimeDepth; }
+RealtimeChecker::ScopedRealtimeThread::~ScopedRealtimeThread() noexcept   { --realtimeDepth; }
+
+RealtimeChecker::ScopedPermit::ScopedPermit() noexcept                    { ++permitDepth; }
+RealtimeChecker::ScopedPermit::~ScopedPermit() noexcept                   { --permitDepth; }
+
+bool RealtimeChecker::isCheckingThisThread() noexcept
+{
+    return realtimeDepth > 0 && permitDepth == 0;
+}
+
+void RealtimeChecker::report (Violation violation, const char* function) noexcept
+{
+    if (! isCheckingThisThread())
+        return;
+
+    // whatever the reporting itself allocates or calls isn't the audio code's fault
+    const ScopedPermit permit;
+    violationCounts[(size_t) violation].fetch_add (1, std::memory_order_relaxed);
+
+   #if JUCE_LINUX || JUCE_MAC
+    void* frames[64];
+    const auto numFrames = backtrace (frames, 64);
+
+    // the checker's own frames are the same every time, so they don't tell stacks apart
+    juce::uint64 hash = 14695981039346656037ull;
+
+    for (int i = 2; i < numFrames; ++i)
+        hash = (hash ^ (juce::uint64) (juce::pointer_sized_uint) frames[i]) * 1099511628211ull;
+
+    if (! isFirstReport (hash ^ (juce::uint64) violation))
+        return;
+   #endif
+
+    writeToStderr ("\n*** Real-time violation: ");
+    writeToStderr (getName (violation));
+    writeToStderr (" in ");
+    writeToStderr (function);
+    writeToStderr (" on the audio thread\n");
+
+   #if JUCE_LINUX || JUCE_MAC
+    backtrace_symbols_fd (frames + 1, numFrames - 1, STDERR_FILENO);
+   #endif
+}
+
+int RealtimeChecker::getNumViolations (Violation violation) noexcept
+{
+    return violationCounts[(size_t) violation].load();
+}
+
+const char* RealtimeChecker::getName (Violation violation) noexcept
+{
+    switch (violation)
+    {
+        case Violation::allocation:         return "allocation";
+        case Violation::deallocation:       return "deallocation";
+        case Violation::lock:               return "lock";
+        case Violation::contendedLock:      return "contended lock";
+        case Violation::blockingCall:       return "blocking call";
+        case Violation::numViolations:      break;
+    }
+
+    return "unknown";
+}
+
+#endif
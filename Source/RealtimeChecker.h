@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    RealtimeChecker.h
+    Catches the audio thread allocating, locking or blocking, in builds that
+    ask for it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/** Set this to 1 in a project to have the checker count and report violations.
+    It only sees them in an executable that routes malloc, free, the pthread locks
+    and the blocking system calls through RealtimeChecker::report(), like the
+    RealtimeStress tool does; the plugin can't do that to its host, so in the
+    plugin itself this only marks where the real-time code is.
+*/
+#ifndef SIMPLESAMPLER_CHECK_REALTIME
+ #define SIMPLESAMPLER_CHECK_REALTIME 0
+#endif
+
+//==============================================================================
+class RealtimeChecker
+{
+public:
+    enum class Violation
+    {
+        allocation = 0,     // malloc and friends, and so operator new
+        deallocation,
+        lock,               // a mutex that happened to be free
+        contendedLock,      // a mutex another thread held, so this one waited for it
+        blockingCall,       // sleeping, waiting on a condition, or file I/O
+
+        numViolations
+    };
+
+    /** Everything this thread does while one of these exists is real-time code. */
+    struct ScopedRealtimeThread
+    {
+       #if SIMPLESAMPLER_CHECK_REALTIME
+        ScopedRealtimeThread() noexcept;
+        ~ScopedRealtimeThread() noexcept;
+       #else
+        ScopedRealtimeThread() noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedRealtimeThread)
+    };
+
+    /** Nothing this thread does while one of these exists is checked. For code
+        that is meant to break the rules, like the checker's own reporting.
+    */
+    struct ScopedPermit
+    {
+       #if SIMPLESAMPLER_CHECK_REALTIME
+        ScopedPermit() noexcept;
+        ~ScopedPermit() noexcept;
+       #else
+        ScopedPermit() noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedPermit)
+    };
+
+   #if SIMPLESAMPLER_CHECK_REALTIME
+    /** True if the calling thread is in real-time code and not in a ScopedPermit. */
+    static bool isCheckingThisThread() noexcept;
+
+    /** Counts a violation if the calling thread is being checked, and the first time
+        a violation comes from a given call stack, prints it to stderr with the stack.
+        Doesn't allocate or lock, so it can be called from inside malloc.
+    */
+    static void report (Violation violation, const char* function) noexcept;
+
+    static int getNumViolations (Violation violation) noexcept;
+    static const char* getName (Violation violation) noexcept;
+   #endif
+};
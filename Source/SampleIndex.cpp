@@ -0,0 +1,355 @@
+/*
+  ==============================================================================
+
+    SampleIndex.cpp
+    Finds samples by content in the user's sample folders.
+
+  ==============================================================================
+*/
+
+#include "SampleIndex.h"
+#include "SamplePool.h"
+
+namespace
+{
+    const juce::Identifier indexType ("SampleIndex");
+    const juce::Identifier folderType ("Folder");
+    const juce::Identifier fileType ("File");
+    const juce::Identifier pathID ("path");
+    const juce::Identifier sizeID ("size");
+    const juce::Identifier modifiedID ("modified");
+    const juce::Identifier hashID ("hash");
+    const juce::Identifier fullHashID ("fullHash");
+
+    juce::File getIndexFile()
+    {
+       #if JUCE_MAC
+        const char* path = "Application Support/simpleSampler/Sample Index.xml";
+       #else
+        const char* path = "simpleSampler/Sample Index.xml";
+       #endif
+
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory).getChildFile (path);
+    }
+}
+
+//==============================================================================
+SampleIndex::SampleIndex()
+    : mIndexFile (getIndexFile())
+{
+    loadFromDisk();
+}
+
+SampleIndex::~SampleIndex()
+{
+    saveIfChanged();
+}
+
+void SampleIndex::addFolder (const juce::File& folder)
+{
+    {
+        const juce::ScopedLock sl (mLock);
+
+        if (! mFolders.addIfNotAlreadyThere (folder))
+            return;
+
+        mScannedDirectories.clear();
+        mIsDirty = true;
+    }
+
+    saveIfChanged();
+}
+
+void SampleIndex::removeFolder (const juce::File& folder)
+{
+    {
+        const juce::ScopedLock sl (mLock);
+
+        mFolders.removeFirstMatchingValue (folder);
+
+        // as with files gone from the folders, only the full hashes of loaded files are kept
+        for (auto entry = mEntries.begin(); entry != mEntries.end();)
+        {
+            if (entry->second.fullContentHash == 0 && juce::File (entry->first).isAChildOf (folder))
+                entry = mEntries.erase (entry);
+            else
+                ++entry;
+        }
+
+        mIsDirty = true;
+    }
+
+    saveIfChanged();
+}
+
+juce::Array<juce::File> SampleIndex::getFolders() const
+{
+    const juce::ScopedLock sl (mLock);
+    return mFolders;
+}
+
+juce::File SampleIndex::find (juce::uint64 contentHash, juce::uint64 fullContentHash, const juce::String& wildcard)
+{
+    if (contentHash == 0)
+        return {};
+
+    auto found = findConfirmed (contentHash, fullContentHash);
+
+    if (found == juce::File() && scan (wildcard))
+        found = findConfirmed (contentHash, fullContentHash);
+
+    return found;
+}
+
+juce::uint64 SampleIndex::getFullContentHash (const juce::File& file)
+{
+    const auto path = file.getFullPathName();
+    const auto size = file.getSize();
+    const auto modificationTime = file.getLastModificationTime().toMilliseconds();
+
+    {
+        const juce::ScopedLock sl (mLock);
+        auto entry = mEntries.find (path);
+
+        if (entry != mEntries.end() && entry->second.size == size && entry->second.modificationTime == modificationTime
+             && entry->second.fullContentHash != 0)
+            return entry->second.fullContentHash;
+    }
+
+    // reading the whole file takes a while, so other loads can use the index meanwhile
+    const auto contentHash = SamplePool::computeContentHash (file);
+    const auto fullContentHash = SamplePool::computeFullContentHash (file);
+
+    if (contentHash == 0 || fullContentHash == 0)
+        return 0;
+
+    const juce::ScopedLock sl (mLock);
+
+    auto& entry = mEntries[path];
+    entry.size = size;
+    entry.modificationTime = modificationTime;
+    entry.contentHash = contentHash;
+    entry.fullContentHash = fullContentHash;
+
+    // written by saveIfChanged(), once the load is done, rather than for every file
+    mIsDirty = true;
+    return fullContentHash;
+}
+
+juce::File SampleIndex::findConfirmed (juce::uint64 contentHash, juce::uint64 fullContentHash)
+{
+    juce::Array<juce::File> candidates;
+
+    {
+        const juce::ScopedLock sl (mLock);
+        candidates = findInEntries (contentHash);
+    }
+
+    // different files can share a fingerprint, so the one with the same full content is picked out
+    for (auto& file : candidates)
+        if (fullContentHash == 0 || getFullContentHash (file) == fullContentHash)
+            return file;
+
+    return {};
+}
+
+juce::Array<juce::File> SampleIndex::findInEntries (juce::uint64 contentHash) const
+{
+    juce::Array<juce::File> found;
+
+    for (auto& entry : mEntries)
+    {
+        if (entry.second.contentHash != contentHash)
+            continue;
+
+        // only trusted if the file is still the one that was hashed
+        juce::File file (entry.first);
+
+        if (file.getSize() == entry.second.size
+             && file.getLastModificationTime().toMilliseconds() == entry.second.modificationTime)
+            found.add (file);
+    }
+
+    return found;
+}
+
+bool SampleIndex::scan (const juce::String& wildcard)
+{
+    // one scan at a time, so two lookups that miss don't both hash the folders; lookups and
+    // hashes in other instances carry on meanwhile, as mLock is only taken to copy and merge
+    const juce::ScopedLock scanLock (mScanLock);
+
+    juce::Array<juce::File> folders;
+    std::map<juce::String, Entry> previous;
+    std::map<juce::String, juce::int64> directories;
+
+    {
+        const juce::ScopedLock sl (mLock);
+
+        if (mScannedWildcard == wildcard)
+            directories = mScannedDirectories;
+    }
+
+    if (! haveDirectoriesChanged (directories))
+        return false;
+
+    directories.clear();
+
+    {
+        const juce::ScopedLock sl (mLock);
+        folders = mFolders;
+        previous = mEntries;
+    }
+
+    if (folders.isEmpty())
+        return false;
+
+    std::map<juce::String, Entry> scanned;
+
+    for (auto& folder : folders)
+    {
+        // adding, removing or renaming a file changes the date of the folder it's in
+        directories[folder.getFullPathName()] = folder.getLastModificationTime().toMilliseconds();
+
+        for (auto& found : juce::RangedDirectoryIterator (folder, true, "*", juce::File::findDirectories))
+            directories[found.getFile().getFullPathName()] = found.getModificationTime().toMilliseconds();
+
+        for (auto& found : juce::RangedDirectoryIterator (folder, true, wildcard))
+        {
+            auto file = found.getFile();
+            auto path = file.getFullPathName();
+
+            Entry entry;
+            entry.size = found.getFileSize();
+            entry.modificationTime = found.getModificationTime().toMilliseconds();
+
+            auto old = previous.find (path);
+
+            if (old != previous.end() && old->second.size == entry.size
+                 && old->second.modificationTime == entry.modificationTime)
+            {
+                entry.contentHash = old->second.contentHash;
+                entry.fullContentHash = old->second.fullContentHash;
+            }
+            else
+            {
+                entry.contentHash = SamplePool::computeContentHash (file);
+            }
+
+            if (entry.contentHash != 0)
+                scanned[path] = entry;
+        }
+    }
+
+    // files that have gone go from the index too, but the rest are kept, full hashes and
+    // all, whether they're outside the folders or just don't match this wildcard
+    std::vector<juce::String> gone;
+
+    for (auto& entry : previous)
+        if (scanned.find (entry.first) == scanned.end() && ! juce::File (entry.first).existsAsFile())
+            gone.push_back (entry.first);
+
+    const juce::ScopedLock sl (mLock);
+
+    for (auto& path : gone)
+        mEntries.erase (path);
+
+    for (auto& entry : scanned)
+    {
+        auto& current = mEntries[entry.first];
+
+        // a full hash worked out while the scan ran still holds if the file hasn't changed
+        if (entry.second.fullContentHash == 0 && current.size == entry.second.size
+             && current.modificationTime == entry.second.modificationTime)
+            entry.second.fullContentHash = current.fullContentHash;
+
+        current = entry.second;
+    }
+
+    // folders added while the scan ran haven't been, so they're left to the next one
+    if (folders == mFolders)
+    {
+        mScannedWildcard = wildcard;
+        mScannedDirectories = std::move (directories);
+    }
+
+    mIsDirty = true;
+    return true;
+}
+
+bool SampleIndex::haveDirectoriesChanged (const std::map<juce::String, juce::int64>& directories)
+{
+    if (directories.empty())
+        return true;
+
+    for (auto& directory : directories)
+        if (juce::File (directory.first).getLastModificationTime().toMilliseconds() != directory.second)
+            return true;
+
+    return false;
+}
+
+void SampleIndex::loadFromDisk()
+{
+    auto xml = juce::parseXMLIfTagMatches (mIndexFile, indexType);
+
+    if (xml == nullptr)
+        return;
+
+    auto tree = juce::ValueTree::fromXml (*xml);
+
+    for (auto child : tree)
+    {
+        const auto path = child[pathID].toString();
+
+        if (! juce::File::isAbsolutePath (path))
+            continue;
+
+        if (child.hasType (folderType))
+        {
+            mFolders.add (juce::File (path));
+        }
+        else if (child.hasType (fileType))
+        {
+            Entry entry;
+            entry.size = (juce::int64) child[sizeID];
+            entry.modificationTime = (juce::int64) child[modifiedID];
+            entry.contentHash = (juce::uint64) child[hashID].toString().getHexValue64();
+            entry.fullContentHash = (juce::uint64) child[fullHashID].toString().getHexValue64();
+            mEntries[path] = entry;
+        }
+    }
+}
+
+void SampleIndex::saveIfChanged()
+{
+    // held while the snapshot is taken and written, so an older one never replaces a newer one
+    const juce::ScopedLock writeLock (mWriteLock);
+
+    juce::ValueTree tree (indexType);
+
+    {
+        const juce::ScopedLock sl (mLock);
+
+        if (! mIsDirty)
+            return;
+
+        for (auto& folder : mFolders)
+            tree.appendChild (juce::ValueTree (folderType, { { pathID, folder.getFullPathName() } }), nullptr);
+
+        for (auto& entry : mEntries)
+            tree.appendChild (juce::ValueTree (fileType, { { pathID, entry.first },
+                                                           { sizeID, entry.second.size },
+                                                           { modifiedID, entry.second.modificationTime },
+                                                           { hashID, juce::String::toHexString ((juce::int64) entry.second.contentHash) },
+                                                           { fullHashID, juce::String::toHexString ((juce::int64) entry.second.fullContentHash) } }),
+                              nullptr);
+
+        mIsDirty = false;
+    }
+
+    // several processes may share the index, so it is replaced in one go
+    if (mIndexFile.getParentDirectory().createDirectory())
+        if (auto xml = tree.createXml())
+            xml->writeTo (mIndexFile);
+}
@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    SampleIndex.h
+    Finds samples by content in the user's sample folders.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The content hash of every sample in a set of folders, so a session whose
+    sample has been moved, or was made on another machine, can find it by what
+    it holds rather than where it was.
+
+    The content hash is only a fingerprint of parts of a file, so two takes of the
+    same length can share one. The index also keeps a hash of each file's whole
+    content, worked out the first time it's needed, and only returns a file
+    whose full hash matches too.
+
+    The index is kept in the user's application data and shared by the whole
+    process through a SharedResourcePointer. The folders are only scanned when a
+    lookup misses, and only again once a file has been added to, removed from or
+    renamed in one of them, which changes the folder's date. Files that haven't
+    changed size or date since the last scan aren't hashed again.
+*/
+class SampleIndex
+{
+public:
+    SampleIndex();
+    ~SampleIndex();
+
+    void addFolder (const juce::File& folder);
+    void removeFolder (const juce::File& folder);
+    juce::Array<juce::File> getFolders() const;
+
+    /** Returns a file in the folders with this content, or File() if there's none.
+        A file whose fingerprint matches is only returned if its full hash does too,
+        unless fullContentHash is 0, as it is for sessions saved before full hashes
+        were kept. May scan the folders and read whole files, so call it from a
+        loading thread.
+    */
+    juce::File find (juce::uint64 contentHash, juce::uint64 fullContentHash, const juce::String& wildcard);
+
+    /** Returns the hash of a file's whole content, reading it only if the index
+        doesn't have one for the file at its current size and date. Any file can be
+        looked up, in the folders or not. Returns 0 if the file can't be read.
+        Loading threads only.
+    */
+    juce::uint64 getFullContentHash (const juce::File&);
+
+    /** Writes the index to disk if it has changed since it was last written. The
+        lookups above only mark it as changed, so a load that hashes many files
+        writes it once; call this at the end of each load.
+    */
+    void saveIfChanged();
+
+private:
+    struct Entry
+    {
+        juce::int64 size = 0;
+        juce::int64 modificationTime = 0;
+        juce::uint64 contentHash = 0;
+        juce::uint64 fullContentHash = 0;       // 0 until it's been needed
+    };
+
+    juce::File findConfirmed (juce::uint64 contentHash, juce::uint64 fullContentHash);
+    juce::Array<juce::File> findInEntries (juce::uint64 contentHash) const;
+    bool scan (const juce::String& wildcard);   // false if there was nothing new to scan
+    static bool haveDirectoriesChanged (const std::map<juce::String, juce::int64>&);
+    void loadFromDisk();
+
+    const juce::File mIndexFile;
+
+    juce::CriticalSection mWriteLock;           // held while a snapshot is taken and written
+    juce::CriticalSection mScanLock;            // held for a whole scan, which takes mLock only to copy and merge
+    juce::CriticalSection mLock;
+    juce::Array<juce::File> mFolders;
+    std::map<juce::String, Entry> mEntries;     // by full path, including files loaded from outside the folders
+
+    // what the last scan covered: every folder and subfolder it went through, with their dates
+    juce::String mScannedWildcard;
+    std::map<juce::String, juce::int64> mScannedDirectories;
+    bool mIsDirty = false;                      // changed since it was last written
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleIndex)
+};
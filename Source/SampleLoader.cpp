@@ -0,0 +1,608 @@
+/*
+  ==============================================================================
+
+    SampleLoader.cpp
+    Loads samples into SoundSets on a background thread.
+
+  ==============================================================================
+*/
+
+#include "SampleLoader.h"
+#include "SfzReader.h"
+
+//==============================================================================
+class SampleLoader::LoadJob  : public juce::ThreadPoolJob
+{
+public:
+    LoadJob (SampleLoader& loader, const juce::String& setName, std::vector<ZoneSource> zonesToLoad,
+             const SampleLoadOptions& loadOptions, CompletionCallback callback, int loadGeneration)
+        : juce::ThreadPoolJob ("Load " + setName),
+          owner (loader), name (setName), zones (std::move (zonesToLoad)), options (loadOptions),
+          onLoaded (std::move (callback)), generation (loadGeneration)
+    {
+        ++owner.mNumActiveJobs;
+    }
+
+    LoadJob (SampleLoader& loader, const SampleReference& referenceToLoad, const SampleLoadOptions& loadOptions,
+             CompletionCallback callback, ReferenceCallback hashedCallback, int loadGeneration)
+        : juce::ThreadPoolJob ("Load " + referenceToLoad.file.getFileName()),
+          owner (loader), reference (referenceToLoad), hasReference (true), options (loadOptions),
+          onLoaded (std::move (callback)), onHashed (std::move (hashedCallback)), generation (loadGeneration)
+    {
+        ++owner.mNumActiveJobs;
+    }
+
+    ~LoadJob() override
+    {
+        --owner.mNumActiveJobs;
+    }
+
+    JobStatus runJob() override
+    {
+        auto set = hasReference ? owner.loadReference (reference, options, *this)
+                                : owner.loadSoundSet (name, zones, options, *this);
+
+        if (set != nullptr && ! isCancelled())
+        {
+            onLoaded (set);
+
+            // the full hash reads the whole file, so it waits until the sounds are already playing
+            if (hasReference && set->reference.fullContentHash == 0)
+            {
+                auto hashed = set->reference;
+
+                if (owner.addFullContentHash (hashed) && ! isCancelled() && onHashed != nullptr)
+                    onHashed (hashed);
+            }
+        }
+
+        // whatever the load hashed is written to the index in one go
+        owner.mSampleIndex->saveIfChanged();
+        return jobHasFinished;
+    }
+
+    bool isCancelled() const
+    {
+        return shouldExit() || generation != owner.mGeneration.load();
+    }
+
+    void setProgress (float newProgress)
+    {
+        if (! isCancelled())
+            owner.mProgress = mZoneProgressStart + newProgress * mZoneProgressScale;
+    }
+
+    /** From here on, setProgress() is the progress through this zone. */
+    void startZone (int zoneIndex, int numZones)
+    {
+        mZoneProgressScale = 1.0f / (float) numZones;
+        mZoneProgressStart = (float) zoneIndex * mZoneProgressScale;
+    }
+
+    SampleLoader& owner;
+
+private:
+    const juce::String name;
+    const std::vector<ZoneSource> zones;
+    const SampleReference reference;
+    const bool hasReference = false;
+    const SampleLoadOptions options;
+    const CompletionCallback onLoaded;
+    const ReferenceCallback onHashed;
+    const int generation;
+    float mZoneProgressStart = 0.0f, mZoneProgressScale = 1.0f;
+};
+
+//==============================================================================
+namespace
+{
+    // builds a sample's mip-map after its sounds have been handed over; it doesn't
+    // refer to the loader that started it, so it can outlive the instance
+    class MipMapJob  : public juce::ThreadPoolJob
+    {
+    public:
+        MipMapJob (SampleData::Ptr dataToBuildFor, std::unique_ptr<juce::AudioFormatReader> source,
+                   std::atomic<int>& jobCounter)
+            : juce::ThreadPoolJob ("Mip-map " + juce::File (dataToBuildFor->getKey().path).getFileName()),
+              data (std::move (dataToBuildFor)), reader (std::move (source)), numJobs (jobCounter)
+        {
+            ++numJobs;
+        }
+
+        ~MipMapJob() override
+        {
+            --numJobs;
+        }
+
+        JobStatus runJob() override
+        {
+            // gives up once only the pool and this job are left holding the data
+            auto mipMap = SampleMipMap::build (*reader, data->getNumChannels(),
+                                               [this] (float) { return ! shouldExit() && data->getReferenceCount() > 2; });
+
+            // nullptr hands the claim back, for whoever loads the sample next
+            data->setMipMap (std::move (mipMap));
+            return jobHasFinished;
+        }
+
+    private:
+        const SampleData::Ptr data;
+        const std::unique_ptr<juce::AudioFormatReader> reader;
+        std::atomic<int>& numJobs;
+    };
+
+    // voices only read the mip-map for notes that step through the data two or more
+    // frames at a time, so it's only worth building for a zone that reaches an octave
+    // above its root at the rate the data plays at, or at its own with no target rate
+    bool needsMipMap (const KeyZone& zone, const SampleData& data, double targetSampleRate)
+    {
+        const auto rateRatio = targetSampleRate > 0.0 ? data.getSampleRate() / targetSampleRate : 1.0;
+        return zone.highNote - zone.rootNote + 12.0 * std::log2 (rateRatio) >= 12.0;
+    }
+}
+
+//==============================================================================
+SampleLoader::SampleLoader (juce::AudioFormatManager& formatManagerToUse)
+    : mFormatManager (formatManagerToUse)
+{
+}
+
+SampleLoader::~SampleLoader()
+{
+    cancelAllLoads();
+}
+
+void SampleLoader::loadAsync (const juce::File& file, const SampleLoadOptions& options, CompletionCallback onLoaded)
+{
+    // a single sample covers the whole keyboard
+    ZoneSource source;
+    source.file = file;
+    source.zone.rootNote = options.midiRootNote;
+
+    loadZonesAsync (file.getFileNameWithoutExtension(), { source }, options, std::move (onLoaded));
+}
+
+void SampleLoader::loadZonesAsync (const juce::String& name, std::vector<ZoneSource> zones,
+                                   const SampleLoadOptions& options, CompletionCallback onLoaded)
+{
+    // anything still running for an older request will notice and give up
+    auto generation = ++mGeneration;
+    mProgress = 0.0f;
+
+    mPool->addJob (new LoadJob (*this, name, std::move (zones), options, std::move (onLoaded), generation), true);
+}
+
+void SampleLoader::loadReferenceAsync (const SampleReference& reference, const SampleLoadOptions& options,
+                                       CompletionCallback onLoaded, ReferenceCallback onHashed)
+{
+    auto generation = ++mGeneration;
+    mProgress = 0.0f;
+
+    mPool->addJob (new LoadJob (*this, reference, options, std::move (onLoaded), std::move (onHashed), generation), true);
+}
+
+void SampleLoader::cancelAllLoads()
+{
+    // the pool is shared, so only pick out the jobs that belong to this loader
+    struct OwnJobs  : public juce::ThreadPool::JobSelector
+    {
+        explicit OwnJobs (SampleLoader& l) : loader (l) {}
+
+        bool isJobSuitable (juce::ThreadPoolJob* job) override
+        {
+            if (auto* loadJob = dynamic_cast<LoadJob*> (job))
+                return &loadJob->owner == &loader;
+
+            return false;
+        }
+
+        SampleLoader& loader;
+    };
+
+    ++mGeneration;
+
+    OwnJobs selector (*this);
+    mPool->removeAllJobs (true, 10000, &selector);
+}
+
+//==============================================================================
+SoundSet::Ptr SampleLoader::loadReference (SampleReference reference, const SampleLoadOptions& options, LoadJob& job)
+{
+    auto file = findReferencedFile (reference);
+
+    if (file == juce::File() || job.isCancelled())
+        return {};
+
+    std::vector<ZoneSource> zones;
+
+    if (file.hasFileExtension ("sfz"))
+    {
+        // an instrument mapping its samples across the keyboard and velocity range
+        if (! readSfzZones (file, zones))
+            return {};
+
+        reference.formatName = "SFZ";
+        reference.lengthInSamples = 0;
+    }
+    else
+    {
+        // a single sample covers the whole keyboard
+        ZoneSource source;
+        source.file = file;
+        source.zone.rootNote = options.midiRootNote;
+        zones.push_back (source);
+    }
+
+    // a sample found by content keeps the name it was saved with
+    auto name = (reference.file != juce::File() ? reference.file : file).getFileNameWithoutExtension();
+    auto set = loadSoundSet (name, zones, options, job);
+
+    if (set == nullptr)
+        return {};
+
+    // a full hash, if there isn't one, is added after the set is handed over
+    if (reference.contentHash == 0)
+        reference.contentHash = SamplePool::computeContentHash (file);
+
+    if (zones.size() == 1)
+    {
+        auto* format = mFormatManager.findFormatForFileExtension (file.getFileExtension());
+        reference.formatName = format != nullptr ? format->getFormatName() : juce::String();
+
+        // the length of the file itself, not of a copy converted to the host's rate
+        std::unique_ptr<juce::AudioFormatReader> reader (mFormatManager.createReaderFor (file));
+        reference.lengthInSamples = reader != nullptr ? reader->lengthInSamples
+                                                      : set->sounds.getFirst()->getLengthInSamples();
+    }
+
+    reference.file = file;
+    reference.embeddedData.reset();
+    reference.embeddedExtension = {};
+    set->reference = reference;
+    return set;
+}
+
+bool SampleLoader::addFullContentHash (SampleReference& reference)
+{
+    // a copy extracted from the session has been re-encoded, so it keeps the original's
+    // hashes; anything else that holds the content gets a full hash of its own
+    if (SamplePool::computeContentHash (reference.file) != reference.contentHash)
+        return false;
+
+    reference.fullContentHash = mSampleIndex->getFullContentHash (reference.file);
+    return reference.fullContentHash != 0;
+}
+
+juce::File SampleLoader::findReferencedFile (const SampleReference& reference)
+{
+    auto& file = reference.file;
+
+    // the fingerprint only picks out candidates; the full hash, where the session has one,
+    // tells a different take of the same length apart
+    auto holdsContent = [this, &reference] (const juce::File& candidate)
+    {
+        return SamplePool::computeContentHash (candidate) == reference.contentHash
+                 && (reference.fullContentHash == 0 || mSampleIndex->getFullContentHash (candidate) == reference.fullContentHash);
+    };
+
+    if (file.existsAsFile() && (reference.contentHash == 0 || holdsContent (file)))
+        return file;
+
+    if (reference.contentHash == 0)
+        return {};
+
+    // another instance already has the same content open, under whatever path
+    for (auto* data : mSamplePool->findByContentHash (reference.contentHash))
+    {
+        const juce::File pooled (data->getKey().path);
+
+        if (holdsContent (pooled))
+            return pooled;
+    }
+
+    auto found = mSampleIndex->find (reference.contentHash, reference.fullContentHash,
+                                     mFormatManager.getWildcardForAllFormats() + ";*.sfz");
+
+    if (found != juce::File())
+        return found;
+
+    // the session's own copy, extracted once and shared by every session that has it
+    return reference.extractEmbedded();
+}
+
+SoundSet::Ptr SampleLoader::loadSoundSet (const juce::String& name, const std::vector<ZoneSource>& zones,
+                                         const SampleLoadOptions& options, LoadJob& job)
+{
+    SoundSet::Ptr set (new SoundSet());
+    set->name = name;
+
+    std::vector<KeyZone> loadedZones;
+
+    // instruments often use one file for several zones
+    std::map<juce::String, SampleData::Ptr> loadedFiles;
+
+    for (size_t i = 0; i < zones.size(); ++i)
+    {
+        if (job.isCancelled())
+            return {};
+
+        job.startZone ((int) i, (int) zones.size());
+
+        auto& source = zones[i];
+        auto& data = loadedFiles[source.file.getFullPathName()];
+
+        // only the first zone's peaks are ever drawn, so the others skip reading the whole file for them
+        if (data == nullptr)
+            data = findOrLoadSampleData (source.file, options, options.buildPeaks && loadedZones.empty(), job);
+
+        if (data == nullptr)
+            continue;
+
+        if (loadedZones.empty())
+            set->peaks = data->getPeaks();
+
+        juce::BigInteger range; // range on the midi keyboard we want to use
+        range.setRange (source.zone.lowNote, source.zone.highNote - source.zone.lowNote + 1, true);
+
+        auto* sound = new StreamingSamplerSound (source.file.getFileNameWithoutExtension(), data,
+                                                 range, source.zone.rootNote);
+        sound->setOutputBus (source.zone.outputBus);
+        set->sounds.add (sound);
+        loadedZones.push_back (source.zone);
+
+        if (options.buildMipMaps && needsMipMap (source.zone, *data, options.targetSampleRate))
+            startBuildingMipMap (data);
+    }
+
+    if (loadedZones.empty())
+        return {};
+
+    set->keyMap.build (loadedZones);
+
+    job.startZone (0, 1);
+    job.setProgress (1.0f);
+    return set;
+}
+
+SampleData::Ptr SampleLoader::findOrLoadSampleData (const juce::File& file, const SampleLoadOptions& options,
+                                                    bool buildPeaks, LoadJob& job)
+{
+    SampleData::Key key;
+    key.path = file.getFullPathName();
+    key.fileSize = file.getSize();
+    key.modificationTime = file.getLastModificationTime().toMilliseconds();
+    key.contentHash = SamplePool::computeContentHash (file);
+    key.preloadLength = options.preloadLength;
+    key.buildPeaks = buildPeaks;
+    key.allowMemoryMapping = options.useMemoryMapping;
+    key.useDecodedCache = options.useDecodedCache;
+    key.targetSampleRate = options.useDecodedCache ? options.targetSampleRate : 0.0;
+
+    if (key.contentHash == 0)
+        return {};
+
+    auto data = mSamplePool->find (key);
+
+    // a sample that already runs at the target rate is pooled as if there were no target
+    if (data == nullptr && key.targetSampleRate > 0.0)
+    {
+        auto unconverted = key;
+        unconverted.targetSampleRate = 0.0;
+        data = mSamplePool->find (unconverted);
+
+        if (data != nullptr && data->getSampleRate() != key.targetSampleRate)
+            data = nullptr;
+    }
+
+    if (data == nullptr)
+    {
+        data = loadSampleData (file, key, job);
+
+        if (data == nullptr)
+            return {};
+
+        data = mSamplePool->add (data);
+    }
+
+    return data;
+}
+
+SampleData::Ptr SampleLoader::loadSampleData (const juce::File& file, const SampleData::Key& key, LoadJob& job)
+{
+    // a compressed file plays from its decoded copy, if that can be had
+    auto source = file;
+    auto progressStart = 0.0f;
+    PeakPyramid::Ptr peaks;
+
+    if (key.useDecodedCache && ! canBeMapped (file))
+    {
+        auto decoded = mDecodedCache->find (file, key.contentHash);
+
+        if (decoded == juce::File())
+        {
+            // decoding takes most of the time, and building the peaks from the decoded copy the rest
+            decoded = decodeIntoCache (file, key, job);
+            progressStart = 0.75f;
+
+            if (job.isCancelled())
+                return {};
+        }
+
+        if (decoded != juce::File())
+        {
+            source = decoded;
+
+            if (key.buildPeaks)
+                peaks = mDecodedCache->findPeaks (decoded);
+        }
+    }
+
+    // a sample at another rate than the host's plays from a copy converted to it
+    auto isConverted = false;
+
+    if (key.targetSampleRate > 0.0)
+    {
+        auto converted = mDecodedCache->find (file, key.contentHash, key.targetSampleRate);
+
+        if (converted == juce::File())
+        {
+            // converting takes most of what's left, like decoding does
+            const auto progressEnd = progressStart + 0.75f * (0.95f - progressStart);
+            converted = convertIntoCache (file, source, key, job, progressStart, progressEnd);
+
+            if (job.isCancelled())
+                return {};
+
+            if (converted != juce::File())
+                progressStart = progressEnd;
+        }
+
+        if (converted != juce::File())
+        {
+            source = converted;
+            isConverted = true;
+            peaks = key.buildPeaks ? mDecodedCache->findPeaks (converted) : nullptr;
+        }
+    }
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+
+    if (key.allowMemoryMapping)
+        mappedReader = createMappedReader (source);
+
+    if (mappedReader == nullptr)
+        reader.reset (mFormatManager.createReaderFor (source));
+
+    if (mappedReader == nullptr && reader == nullptr)
+        return {};
+
+    if (key.buildPeaks && peaks == nullptr)
+    {
+        // reading the file dominates the load time, so it stands in for the overall progress
+        peaks = PeakPyramid::build (mappedReader != nullptr ? *mappedReader : *reader,
+                                    [&job, progressStart] (float progress)
+                                    {
+                                        job.setProgress (progressStart + (0.95f - progressStart) * progress);
+                                        return ! job.isCancelled();
+                                    });
+
+        if (peaks == nullptr)
+            return {};
+
+        if (source != file)
+            mDecodedCache->addPeaks (source, *peaks);
+    }
+
+    // data that wasn't converted because it already runs at the target rate is the same as
+    // with no target, so it gets the same key, and the pool only ever has one of it
+    auto dataKey = key;
+    const auto sourceRate = mappedReader != nullptr ? mappedReader->sampleRate : reader->sampleRate;
+
+    if (! isConverted && sourceRate == key.targetSampleRate)
+        dataKey.targetSampleRate = 0.0;
+
+    // a mapped sample plays straight from the file's pages; otherwise the data keeps
+    // the reader and only preloads the head, and the rest is streamed from disk
+    if (mappedReader != nullptr)
+        return new SampleData (dataKey, source, std::move (mappedReader), std::move (peaks));
+
+    return new SampleData (dataKey, source, std::move (reader), std::move (peaks));
+}
+
+void SampleLoader::startBuildingMipMap (const SampleData::Ptr& data)
+{
+    if (data->getMipMap() != nullptr || ! data->claimMipMapBuild())
+        return;
+
+    // read from the copy the data plays, so the levels line up with it frame for frame
+    auto source = findCachedSource (data->getKey());
+    std::unique_ptr<juce::AudioFormatReader> reader (mFormatManager.createReaderFor (source));
+
+    if (reader == nullptr || reader->lengthInSamples != data->getLengthInSamples())
+    {
+        data->setMipMap (nullptr);
+        return;
+    }
+
+    mPool->addJob (new MipMapJob (data, std::move (reader), mPool->numMipMapJobs), true);
+}
+
+std::unique_ptr<juce::MemoryMappedAudioFormatReader> SampleLoader::createMappedReader (const juce::File& file)
+{
+    // only uncompressed formats like WAV and AIFF can be mapped
+    auto* format = mFormatManager.findFormatForFileExtension (file.getFileExtension());
+
+    if (format == nullptr)
+        return {};
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader (file));
+
+    if (reader == nullptr || reader->numChannels > (unsigned int) SampleData::maxChannels
+         || ! reader->mapEntireFile())
+        return {};
+
+    return reader;
+}
+
+bool SampleLoader::canBeMapped (const juce::File& file)
+{
+    auto* format = mFormatManager.findFormatForFileExtension (file.getFileExtension());
+
+    if (format == nullptr)
+        return false;
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader (file));
+    return reader != nullptr;
+}
+
+juce::File SampleLoader::decodeIntoCache (const juce::File& file, const SampleData::Key& key, LoadJob& job)
+{
+    std::unique_ptr<juce::AudioFormatReader> decoder (mFormatManager.createReaderFor (file));
+
+    if (decoder == nullptr)
+        return {};
+
+    return mDecodedCache->add (file, key.contentHash, *decoder, 0.0,
+                               [&job] (float progress)
+                               {
+                                   job.setProgress (0.75f * progress);
+                                   return ! job.isCancelled();
+                               });
+}
+
+juce::File SampleLoader::convertIntoCache (const juce::File& file, const juce::File& source, const SampleData::Key& key,
+                                           LoadJob& job, float progressStart, float progressEnd)
+{
+    // reads the decoded copy of a compressed file, if it has one, rather than decode it again
+    std::unique_ptr<juce::AudioFormatReader> reader (mFormatManager.createReaderFor (source));
+
+    if (reader == nullptr || reader->sampleRate <= 0.0 || reader->sampleRate == key.targetSampleRate)
+        return {};
+
+    return mDecodedCache->add (file, key.contentHash, *reader, key.targetSampleRate,
+                               [&job, progressStart, progressEnd] (float progress)
+                               {
+                                   job.setProgress (progressStart + (progressEnd - progressStart) * progress);
+                                   return ! job.isCancelled();
+                               });
+}
+
+juce::File SampleLoader::findCachedSource (const SampleData::Key& key)
+{
+    juce::File source (key.path);
+
+    if (! key.useDecodedCache)
+        return source;
+
+    if (key.targetSampleRate > 0.0)
+    {
+        auto converted = mDecodedCache->find (source, key.contentHash, key.targetSampleRate);
+
+        if (converted != juce::File())
+            return converted;
+    }
+
+    auto decoded = mDecodedCache->find (source, key.contentHash);
+    return decoded != juce::File() ? decoded : source;
+}
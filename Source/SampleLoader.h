@@ -0,0 +1,148 @@
+/*
+  ==============================================================================
+
+    SampleLoader.h
+    Loads samples into SoundSets on a background thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SamplerSynthesiser.h"
+#include "DecodedSampleCache.h"
+#include "SampleIndex.h"
+
+//==============================================================================
+/** The loading threads, shared by every sampler instance in the process. */
+class SampleLoaderPool  : public juce::ThreadPool
+{
+public:
+    SampleLoaderPool() : juce::ThreadPool (2) {}
+
+    /** Mip-maps being built, or waiting to be, for any instance. */
+    std::atomic<int> numMipMapJobs { 0 };
+};
+
+//==============================================================================
+/** Settings a load takes a copy of when it is started. */
+struct SampleLoadOptions
+{
+    int midiRootNote = 60;
+    int preloadLength = 65536;
+    bool buildPeaks = true;         // read the whole file up front, for the editor to draw
+    bool useMemoryMapping = true;   // serve WAV/AIFF files straight from a mapping
+    bool useDecodedCache = true;    // decode compressed files once, into the DecodedSampleCache
+    bool buildMipMaps = true;       // build octave mip-maps for zones reaching an octave up, after the sounds are ready
+    double targetSampleRate = 0.0;  // convert samples to this rate through the DecodedSampleCache, or 0 to keep theirs
+};
+
+/** One sample of an instrument, and where it sits on the keyboard. */
+struct ZoneSource
+{
+    juce::File file;
+    KeyZone zone;
+};
+
+//==============================================================================
+/**
+    Turns sample files into SoundSets without blocking the caller.
+
+    Only the most recent request matters: starting a new load cancels any that
+    are still running, so dropping several files in a row doesn't queue up work.
+
+    The decoded data comes from the process-wide SamplePool, so a file another
+    instance already has open is only fingerprinted, not decoded again. Files in
+    formats that can't be mapped, like MP3, are decoded into the DecodedSampleCache
+    the first time they're loaded, and load from there like a WAV after that,
+    across sessions too.
+
+    With a target sample rate set, a sample at any other rate is converted to it
+    once, into the same cache, and plays from the converted copy; so voices at the
+    root note play it back frame for frame. The original file is still what the
+    set's reference and the SamplePool entry's path refer to.
+
+    Once a sample's data is ready, its octave mip-map is built by a job of its own
+    on the same threads. The set is handed over without waiting for it; voices
+    start using the mip-map for the notes that start after it's attached.
+
+    Sessions load through a SampleReference, which is found by content if its
+    file has moved: from the SamplePool, then the SampleIndex, and only then from
+    the data embedded in the session.
+*/
+class SampleLoader
+{
+public:
+    explicit SampleLoader (juce::AudioFormatManager& formatManagerToUse);
+    ~SampleLoader();
+
+    using CompletionCallback = std::function<void (SoundSet::Ptr)>;
+    using ReferenceCallback = std::function<void (const SampleReference&)>;
+
+    /** Starts loading a file and returns straight away. The callback is made on the
+        loading thread, and only if the load succeeded and wasn't superseded.
+    */
+    void loadAsync (const juce::File& file, const SampleLoadOptions& options, CompletionCallback onLoaded);
+
+    /** Same as loadAsync(), but for an instrument with several zones. Zones whose
+        file can't be read are left out; the load only fails if that's all of them.
+        The set's peaks are those of the first zone.
+    */
+    void loadZonesAsync (const juce::String& name, std::vector<ZoneSource> zones,
+                         const SampleLoadOptions& options, CompletionCallback onLoaded);
+
+    /** Finds the file a session refers to and loads it, as a single sample or an
+        SFZ instrument, all on the loading thread. The set's reference is filled
+        in with where the file was found and what it holds.
+
+        A file found without a full content hash only gets one after the set has
+        been handed over, as it means reading the whole file. onHashed is then
+        called on the loading thread with a copy of the set's reference that has
+        it filled in, unless the load has been superseded.
+    */
+    void loadReferenceAsync (const SampleReference& reference, const SampleLoadOptions& options,
+                             CompletionCallback onLoaded, ReferenceCallback onHashed);
+
+    /** Stops any running loads, waiting for them to finish. */
+    void cancelAllLoads();
+
+    bool isLoading() const noexcept                     { return mNumActiveJobs.load() > 0; }
+
+    /** True while any instance's mip-maps are still being built. */
+    bool isBuildingMipMaps() const noexcept             { return mPool->numMipMapJobs.load() > 0; }
+
+    /** Progress of the current load, from 0 to 1. */
+    float getProgress() const noexcept                  { return mProgress.load(); }
+
+private:
+    //==============================================================================
+    class LoadJob;
+
+    SoundSet::Ptr loadReference (SampleReference, const SampleLoadOptions&, LoadJob&);
+    juce::File findReferencedFile (const SampleReference&);
+    bool addFullContentHash (SampleReference&);
+    SoundSet::Ptr loadSoundSet (const juce::String& name, const std::vector<ZoneSource>&,
+                                const SampleLoadOptions&, LoadJob&);
+    SampleData::Ptr findOrLoadSampleData (const juce::File&, const SampleLoadOptions&, bool buildPeaks, LoadJob&);
+    SampleData::Ptr loadSampleData (const juce::File&, const SampleData::Key&, LoadJob&);
+    void startBuildingMipMap (const SampleData::Ptr&);
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> createMappedReader (const juce::File&);
+    bool canBeMapped (const juce::File&);
+    juce::File decodeIntoCache (const juce::File&, const SampleData::Key&, LoadJob&);
+    juce::File convertIntoCache (const juce::File& file, const juce::File& source, const SampleData::Key&,
+                                 LoadJob&, float progressStart, float progressEnd);
+    juce::File findCachedSource (const SampleData::Key&);
+
+    //==============================================================================
+    juce::AudioFormatManager& mFormatManager;
+    juce::SharedResourcePointer<SampleLoaderPool> mPool;
+    juce::SharedResourcePointer<SamplePool> mSamplePool;
+    juce::SharedResourcePointer<DecodedSampleCache> mDecodedCache;
+    juce::SharedResourcePointer<SampleIndex> mSampleIndex;
+
+    std::atomic<int> mGeneration { 0 }, mNumActiveJobs { 0 };
+    std::atomic<float> mProgress { 0.0f };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleLoader)
+};
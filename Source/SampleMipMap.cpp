@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    SampleMipMap.cpp
+    Band-limited copies of a sample at half, a quarter, an eighth... of its rate.
+
+  ==============================================================================
+*/
+
+#include "SampleMipMap.h"
+
+namespace
+{
+    // the decimation filter: a Blackman-windowed sinc, flat to 0.2 cycles per input
+    // frame and down by more than 75 dB at the new Nyquist frequency of 0.25, so
+    // the transition band is over before anything can fold back down
+    constexpr int numTaps = 95;
+    constexpr int halfTaps = numTaps / 2;
+    constexpr double cutoff = 0.22;
+
+    // levels shorter than this aren't worth having
+    constexpr int minLevelLength = 64;
+
+    // how many frames of a level are worked out in one go
+    constexpr int chunkSize = 16384;
+
+    constexpr juce::int64 defaultMemoryLimit = (juce::int64) 1024 * 1024 * 1024;
+
+    std::atomic<juce::int64> memoryLimit { defaultMemoryLimit };
+    std::atomic<juce::int64> memoryUsed { 0 };
+
+    // takes numBytes out of what's left of the limit, if there's that much
+    bool reserveMemory (juce::int64 numBytes) noexcept
+    {
+        auto used = memoryUsed.load();
+
+        do
+        {
+            if (used + numBytes > memoryLimit.load())
+                return false;
+        }
+        while (! memoryUsed.compare_exchange_weak (used, used + numBytes));
+
+        return true;
+    }
+
+    std::array<float, numTaps> makeFilter()
+    {
+        std::array<float, numTaps> taps;
+        const auto pi = juce::MathConstants<double>::pi;
+        double sum = 0.0;
+
+        for (int i = 0; i < numTaps; ++i)
+        {
+            const auto x = 2.0 * cutoff * (i - halfTaps);
+            const auto sinc = x == 0.0 ? 1.0 : std::sin (pi * x) / (pi * x);
+            const auto phase = (double) i / (numTaps - 1);
+            const auto window = 0.42 - 0.5 * std::cos (2.0 * pi * phase) + 0.08 * std::cos (4.0 * pi * phase);
+
+            taps[(size_t) i] = (float) (sinc * window);
+            sum += sinc * window;
+        }
+
+        // unity gain at DC
+        for (auto& tap : taps)
+            tap = (float) (tap / sum);
+
+        return taps;
+    }
+
+    // output frame i is centred on input frame 2i + halfTaps
+    void decimate (const float* taps, const float* input, float* output, int numOutput) noexcept
+    {
+        for (int i = 0; i < numOutput; ++i)
+        {
+            auto* in = input + 2 * i;
+            float sum = 0.0f;
+
+            for (int j = 0; j < numTaps; ++j)
+                sum += taps[j] * in[j];
+
+            output[i] = sum;
+        }
+    }
+
+    // copies frames [start, start + num) of a level into span, with silence outside the level
+    void copySpan (const juce::AudioBuffer<float>& level, juce::AudioBuffer<float>& span, juce::int64 start, int num)
+    {
+        span.clear (0, num);
+
+        const auto first = juce::jmax ((juce::int64) 0, start);
+        const auto end = juce::jmin ((juce::int64) level.getNumSamples(), start + num);
+
+        if (first < end)
+            for (int channel = 0; channel < span.getNumChannels(); ++channel)
+                span.copyFrom (channel, (int) (first - start), level, channel, (int) first, (int) (end - first));
+    }
+}
+
+//==============================================================================
+SampleMipMap::SampleMipMap (juce::int64 numBytes)
+    : mNumBytes (numBytes)
+{
+}
+
+SampleMipMap::~SampleMipMap()
+{
+    memoryUsed -= mNumBytes;
+}
+
+void SampleMipMap::setMemoryLimit (juce::int64 maxBytes) noexcept
+{
+    memoryLimit = juce::jmax ((juce::int64) 0, maxBytes);
+}
+
+juce::int64 SampleMipMap::getMemoryLimit() noexcept
+{
+    return memoryLimit.load();
+}
+
+juce::int64 SampleMipMap::getMemoryUsed() noexcept
+{
+    return memoryUsed.load();
+}
+
+std::unique_ptr<SampleMipMap> SampleMipMap::build (juce::AudioFormatReader& reader, int numChannels,
+                                                   const std::function<bool (float)>& progressCallback)
+{
+    const auto length = reader.lengthInSamples;
+
+    if (numChannels <= 0 || (length + 1) / 2 < minLevelLength
+         || length * numChannels * (juce::int64) sizeof (float) > maxSampleBytes)
+        return {};
+
+    // the memory is set aside before building, so two samples building at once can't
+    // both fit in what's left and then go past the limit together
+    juce::int64 numFrames = 0;
+    auto levelFrames = (length + 1) / 2;
+
+    for (int level = 1; level <= maxLevels && levelFrames >= minLevelLength; ++level)
+    {
+        numFrames += levelFrames;
+        levelFrames = (levelFrames + 1) / 2;
+    }
+
+    const auto numBytes = numFrames * numChannels * (juce::int64) sizeof (float);
+
+    if (! reserveMemory (numBytes))
+        return {};
+
+    static const auto taps = makeFilter();
+
+    std::unique_ptr<SampleMipMap> mipMap (new SampleMipMap (numBytes));
+    juce::AudioBuffer<float> span (numChannels, 2 * chunkSize + numTaps);
+
+    // the levels add up to about as many frames as the sample, and the first one,
+    // which is the one that reads the file, to half of them
+    juce::int64 numDone = 0;
+    auto levelLength = length;
+
+    for (int level = 1; level <= maxLevels; ++level)
+    {
+        const auto newLength = (levelLength + 1) / 2;
+
+        if (newLength < minLevelLength)
+            break;
+
+        juce::AudioBuffer<float> newLevel (numChannels, (int) newLength);
+        const auto* levelBelow = mipMap->mLevels.empty() ? nullptr : &mipMap->mLevels.back();
+
+        for (juce::int64 start = 0; start < newLength; start += chunkSize)
+        {
+            const auto numOutput = (int) juce::jmin ((juce::int64) chunkSize, newLength - start);
+            const auto spanStart = 2 * start - halfTaps;
+            const auto spanLength = 2 * (numOutput - 1) + numTaps;
+
+            if (levelBelow == nullptr)
+                reader.read (&span, 0, spanLength, spanStart, true, true);
+            else
+                copySpan (*levelBelow, span, spanStart, spanLength);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                decimate (taps.data(), span.getReadPointer (channel), newLevel.getWritePointer (channel, (int) start), numOutput);
+
+            numDone += numOutput;
+
+            if (! progressCallback (juce::jmin (1.0f, (float) numDone / (float) length)))
+                return {};
+        }
+
+        mipMap->mLevels.push_back (std::move (newLevel));
+        levelLength = newLength;
+    }
+
+    return mipMap;
+}
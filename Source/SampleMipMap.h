@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    SampleMipMap.h
+    Band-limited copies of a sample at half, a quarter, an eighth... of its rate.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Decimated copies of a sample, one per octave, each low-pass filtered below
+    its own Nyquist frequency before being halved, so it holds nothing that
+    would alias.
+
+    A voice playing more than an octave above the root steps through the sample
+    two or more frames at a time. Reading the level whose rate brings its step
+    back under two frames instead means fewer of the sample's high partials get
+    folded back down, and each output sample touches fewer, closer frames.
+
+    Levels are stored like the preloaded head: each channel in one contiguous
+    block. Every level is in memory, so voices reading one never need the disk
+    thread. Built once in the background and read-only after that.
+
+    All the mip-maps in the process share one memory limit. A sample whose levels
+    would take it past the limit gets none, and its high notes resample the sample
+    itself, as they would while the levels were still being built.
+*/
+class SampleMipMap
+{
+public:
+    /** Levels go down to a sixteenth of the rate, for notes four octaves up. */
+    static constexpr int maxLevels = 4;
+
+    /** Samples whose channels take up more than this as floats get no mip-map;
+        all the levels together take up about as much again.
+    */
+    static constexpr juce::int64 maxSampleBytes = 256 * 1024 * 1024;
+
+    /** Reads the whole of a sample to build its levels. Reading is reported as a
+        progress from 0 to 1, and stops if the callback returns false. Returns
+        nullptr if it was stopped, the sample is too long or too short to have
+        any levels, or they wouldn't fit in what's left of the memory limit.
+    */
+    static std::unique_ptr<SampleMipMap> build (juce::AudioFormatReader& reader, int numChannels,
+                                                const std::function<bool (float)>& progressCallback);
+
+    ~SampleMipMap();
+
+    /** Sets how much memory every mip-map in the process may take up together.
+        Mip-maps that are already built are kept.
+    */
+    static void setMemoryLimit (juce::int64 maxBytes) noexcept;
+    static juce::int64 getMemoryLimit() noexcept;
+
+    /** The memory the mip-maps that exist, or are being built, take up. */
+    static juce::int64 getMemoryUsed() noexcept;
+
+    /** The number of levels, not counting the sample itself. */
+    int getNumLevels() const noexcept                                   { return (int) mLevels.size(); }
+
+    /** Level n runs at 1 / 2^n of the sample's rate; frame i of it lines up with
+        frame i * 2^n of the sample. Levels count from 1.
+    */
+    const juce::AudioBuffer<float>& getLevel (int level) const noexcept  { return mLevels[(size_t) level - 1]; }
+
+private:
+    explicit SampleMipMap (juce::int64 numBytes);
+
+    std::vector<juce::AudioBuffer<float>> mLevels;
+    const juce::int64 mNumBytes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleMipMap)
+};
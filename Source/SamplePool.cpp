@@ -0,0 +1,291 @@
+/*
+  ==============================================================================
+
+    SamplePool.cpp
+    Decoded sample data shared by every sampler instance in the process.
+
+  ==============================================================================
+*/
+
+#include "SamplePool.h"
+
+namespace
+{
+    // the fingerprint hashes this many bytes at the start, the end, and a few places in between
+    constexpr int hashBlockSize = 65536;
+    constexpr int numInnerHashBlocks = 6;
+
+    // the full hash reads the file this much at a time
+    constexpr int fullHashBlockSize = 1 << 20;
+
+    // 64-bit FNV-1a
+    constexpr juce::uint64 fnvOffsetBasis = 14695981039346656037ull;
+    constexpr juce::uint64 fnvPrime = 1099511628211ull;
+
+    juce::uint64 hashBytes (juce::uint64 hash, const void* data, size_t numBytes) noexcept
+    {
+        auto* bytes = static_cast<const juce::uint8*> (data);
+
+        for (size_t i = 0; i < numBytes; ++i)
+            hash = (hash ^ bytes[i]) * fnvPrime;
+
+        return hash;
+    }
+}
+
+//==============================================================================
+bool SampleData::Key::operator== (const Key& other) const noexcept
+{
+    return contentHash == other.contentHash
+        && fileSize == other.fileSize
+        && modificationTime == other.modificationTime
+        && preloadLength == other.preloadLength
+        && buildPeaks == other.buildPeaks
+        && allowMemoryMapping == other.allowMemoryMapping
+        && useDecodedCache == other.useDecodedCache
+        && targetSampleRate == other.targetSampleRate
+        && path == other.path;
+}
+
+//==============================================================================
+SampleData::SampleData (const Key& key, const juce::File& sourceFile, std::unique_ptr<juce::AudioFormatReader> source,
+                        PeakPyramid::Ptr peaks)
+    : mKey (key),
+      mSourceFile (sourceFile),
+      mSource (std::move (source)),
+      mPeaks (std::move (peaks))
+{
+    if (mSource != nullptr && mSource->sampleRate > 0 && mSource->lengthInSamples > 0)
+    {
+        mSampleRate = mSource->sampleRate;
+        mLength = mSource->lengthInSamples;
+        mNumChannels = juce::jmin (maxChannels, (int) mSource->numChannels);
+        mChannelLayout = Downmix::getLayout (mSource->getChannelLayout());
+
+        mPreloadLength = (int) juce::jmin ((juce::int64) mKey.preloadLength, mLength);
+
+        mPreload.setSize (mNumChannels, mPreloadLength);
+        mSource->read (&mPreload, 0, mPreloadLength, 0, true, true);
+    }
+}
+
+SampleData::SampleData (const Key& key, const juce::File& sourceFile,
+                        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedSource, PeakPyramid::Ptr peaks)
+    : mKey (key),
+      mSourceFile (sourceFile),
+      mMappedSource (std::move (mappedSource)),
+      mPeaks (std::move (peaks))
+{
+    jassert (mMappedSource == nullptr || mMappedSource->numChannels <= (unsigned int) maxChannels);
+
+    if (mMappedSource != nullptr && mMappedSource->sampleRate > 0 && mMappedSource->lengthInSamples > 0)
+    {
+        mSampleRate = mMappedSource->sampleRate;
+        mLength = mMappedSource->lengthInSamples;
+        mNumChannels = (int) mMappedSource->numChannels;
+        mChannelLayout = Downmix::getLayout (mMappedSource->getChannelLayout());
+
+        // touching one sample per page is enough to fault the whole page in
+        auto bytesPerFrame = juce::jmax (1, (int) (mMappedSource->numChannels * mMappedSource->bitsPerSample / 8));
+        mPrefetchStep = juce::jmax (1, 4096 / bytesPerFrame);
+
+        mPreloadLength = (int) juce::jmin ((juce::int64) mKey.preloadLength, mLength);
+        prefetch (0, mPreloadLength);
+    }
+}
+
+SampleData::~SampleData()
+{
+    delete mMipMap.load();
+}
+
+void SampleData::setMipMap (std::unique_ptr<SampleMipMap> newMipMap) noexcept
+{
+    if (newMipMap == nullptr)
+    {
+        mMipMapClaimed = false;
+        return;
+    }
+
+    jassert (mMipMapClaimed && mMipMap.load() == nullptr);
+    mMipMap.store (newMipMap.release(), std::memory_order_release);
+}
+
+void SampleData::readFromDisk (juce::AudioBuffer<float>& dest, int destStartSample,
+                               juce::int64 sourceStartSample, int numSamples)
+{
+    jassert (mSource != nullptr);
+    mSource->read (&dest, destStartSample, numSamples, sourceStartSample, true, true);
+}
+
+void SampleData::getMappedFrame (juce::int64 index, float* frame) const noexcept
+{
+    mMappedSource->getSample (index, frame);
+}
+
+void SampleData::prefetch (juce::int64 start, juce::int64 end) const noexcept
+{
+    end = juce::jmin (end, mLength);
+
+    for (auto i = start; i < end; i += mPrefetchStep)
+        mMappedSource->touchSample (i);
+
+    if (start < end)
+        mMappedSource->touchSample (end - 1);
+}
+
+//==============================================================================
+SamplePool::SamplePool()
+{
+}
+
+SamplePool::~SamplePool()
+{
+}
+
+SampleData::Ptr SamplePool::find (const SampleData::Key& key) const
+{
+    const juce::ScopedLock sl (mLock);
+
+    for (auto* data : mSamples)
+        if (data->getKey() == key)
+            return data;
+
+    return {};
+}
+
+juce::ReferenceCountedArray<SampleData> SamplePool::findByContentHash (juce::uint64 contentHash) const
+{
+    const juce::ScopedLock sl (mLock);
+    juce::ReferenceCountedArray<SampleData> found;
+
+    for (auto* data : mSamples)
+        if (data->getKey().contentHash == contentHash)
+            found.add (data);
+
+    return found;
+}
+
+SampleData::Ptr SamplePool::add (SampleData::Ptr newData)
+{
+    jassert (newData != nullptr);
+
+    const juce::ScopedLock sl (mLock);
+
+    // two instances may have loaded the same file at once, in which case the first one wins
+    for (auto* data : mSamples)
+        if (data->getKey() == newData->getKey())
+            return data;
+
+    mSamples.add (newData);
+    return newData;
+}
+
+juce::Array<juce::File> SamplePool::getSourceFiles() const
+{
+    const juce::ScopedLock sl (mLock);
+    juce::Array<juce::File> files;
+
+    for (auto* data : mSamples)
+        files.addIfNotAlreadyThere (data->getSourceFile());
+
+    return files;
+}
+
+void SamplePool::purgeUnused()
+{
+    // find() and add() hand out references under the same lock, so nothing can
+    // pick up an entry between checking its count and removing it
+    const juce::ScopedLock sl (mLock);
+
+    for (int i = mSamples.size(); --i >= 0;)
+        if (mSamples.getObjectPointerUnchecked (i)->getReferenceCount() == 1)
+            mSamples.remove (i);
+}
+
+int SamplePool::getNumSamples() const
+{
+    const juce::ScopedLock sl (mLock);
+    return mSamples.size();
+}
+
+juce::uint64 SamplePool::computeContentHash (const juce::File& file)
+{
+    juce::FileInputStream in (file);
+
+    if (! in.openedOk())
+        return 0;
+
+    const auto fileSize = in.getTotalLength();
+    auto hash = hashBytes (fnvOffsetBasis, &fileSize, sizeof (fileSize));
+
+    juce::HeapBlock<char> block (hashBlockSize);
+
+    auto hashBlockAt = [&] (juce::int64 position)
+    {
+        if (in.setPosition (juce::jlimit ((juce::int64) 0, fileSize, position)))
+        {
+            auto numRead = in.read (block, hashBlockSize);
+
+            if (numRead > 0)
+                hash = hashBytes (hash, block, (size_t) numRead);
+        }
+    };
+
+    hashBlockAt (0);
+
+    if (fileSize > hashBlockSize)
+    {
+        // the blocks in the middle catch edits that leave the header and the end alone
+        for (int i = 1; i <= numInnerHashBlocks; ++i)
+            hashBlockAt ((fileSize * i) / (numInnerHashBlocks + 1));
+
+        hashBlockAt (fileSize - hashBlockSize);
+    }
+
+    // 0 is kept for "couldn't read the file"
+    return hash != 0 ? hash : 1;
+}
+
+juce::uint64 SamplePool::computeFullContentHash (const juce::File& file)
+{
+    juce::FileInputStream in (file);
+
+    if (! in.openedOk())
+        return 0;
+
+    const auto fileSize = in.getTotalLength();
+    auto hash = hashBytes (fnvOffsetBasis, &fileSize, sizeof (fileSize));
+
+    juce::HeapBlock<char> block (fullHashBlockSize);
+
+    for (;;)
+    {
+        // whole blocks until the end, however the reads come back, so the words line up the same every time
+        int numRead = 0;
+
+        while (numRead < fullHashBlockSize)
+        {
+            const auto num = in.read (block + numRead, fullHashBlockSize - numRead);
+
+            if (num <= 0)
+                break;
+
+            numRead += num;
+        }
+
+        if (numRead == 0)
+            break;
+
+        // FNV-1a a word at a time, which keeps up with the disk; the words are read
+        // little-endian so every machine agrees on the hash
+        const auto numWords = (size_t) numRead / sizeof (juce::uint64);
+
+        for (size_t i = 0; i < numWords; ++i)
+            hash = (hash ^ juce::ByteOrder::littleEndianInt64 (block + i * sizeof (juce::uint64))) * fnvPrime;
+
+        hash = hashBytes (hash, block + numWords * sizeof (juce::uint64), (size_t) numRead - numWords * sizeof (juce::uint64));
+    }
+
+    return hash != 0 ? hash : 1;
+}
@@ -0,0 +1,210 @@
+/*
+  ==============================================================================
+
+    SamplePool.h
+    Decoded sample data shared by every sampler instance in the process.
+
+    Loading the same file in several instances used to give each of them its
+    own reader, preloaded head and peaks. The pool hands out one SampleData
+    per file and content hash instead, and drops it once the last instance that
+    was using it has let go.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Downmix.h"
+#include "PeakPyramid.h"
+#include "SampleMipMap.h"
+
+//==============================================================================
+/**
+    Everything decoded from one sample file. Immutable once it is in the pool, so
+    any number of sounds in any number of instances can read from it, apart from
+    the mip-map, which is built afterwards and attached once it's ready.
+
+    The preloaded head keeps every channel of the file, up to maxChannels, each in
+    a contiguous block of its own, so voices can work on one channel at a time.
+
+    The stream reader is the one exception: it has a read position, so it must
+    only be used from the disk thread while the stream lock is held. The disk
+    thread is shared by the whole process too, which is what makes sharing the
+    reader safe.
+*/
+class SampleData  : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SampleData>;
+
+    /** The most channels a sample is played with, enough for 7.1. Channels past
+        these are left out.
+    */
+    static constexpr int maxChannels = 8;
+
+    /** Identifies a file's decoded data: where it lives, what it contained, and
+        the settings that change what gets decoded. The size and modification time
+        catch a file that was edited in place, the same way the decoded cache does.
+    */
+    struct Key
+    {
+        juce::String path;
+        juce::int64 fileSize = 0;
+        juce::int64 modificationTime = 0;
+        juce::uint64 contentHash = 0;
+        int preloadLength = 0;
+        bool buildPeaks = false;
+        bool allowMemoryMapping = false;
+        bool useDecodedCache = false;
+        double targetSampleRate = 0.0;
+
+        bool operator== (const Key&) const noexcept;
+        bool operator!= (const Key& other) const noexcept   { return ! operator== (other); }
+    };
+
+    /** Preloads the head of the file through the reader, and keeps the reader for
+        streaming the rest. The source file is the one the reader reads.
+    */
+    SampleData (const Key&, const juce::File& sourceFile, std::unique_ptr<juce::AudioFormatReader> source,
+                PeakPyramid::Ptr peaks);
+
+    /** Plays straight from a mapped file. The reader must already have mapped the
+        entire file. The first preloadLength samples are paged in straight away.
+    */
+    SampleData (const Key&, const juce::File& sourceFile,
+                std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedSource, PeakPyramid::Ptr peaks);
+
+    ~SampleData() override;
+
+    //==============================================================================
+    const Key& getKey() const noexcept                              { return mKey; }
+
+    /** The file the data plays from: the sample itself, or its copy in the DecodedSampleCache. */
+    const juce::File& getSourceFile() const noexcept                { return mSourceFile; }
+
+    int getNumChannels() const noexcept                             { return mNumChannels; }
+    juce::int64 getLengthInSamples() const noexcept                 { return mLength; }
+    double getSampleRate() const noexcept                           { return mSampleRate; }
+
+    /** The speaker each channel is for, as the file gives it, which is how the voices
+        mix it down onto buses with fewer channels.
+    */
+    const Downmix::Layout& getChannelLayout() const noexcept        { return mChannelLayout; }
+
+    /** The min/max peaks the editor draws, or nullptr if they weren't built. */
+    PeakPyramid::Ptr getPeaks() const noexcept                      { return mPeaks; }
+
+    /** The part of the sample that is always in memory. Empty for mapped samples. */
+    const juce::AudioBuffer<float>& getPreloadBuffer() const noexcept { return mPreload; }
+
+    /** The number of samples at the start that voices can play without the disk thread. */
+    int getPreloadLength() const noexcept                           { return mPreloadLength; }
+
+    /** The octave mip-map, or nullptr if it hasn't been built (yet). Safe to call
+        from the audio thread; once there is one, it stays until the data is freed.
+    */
+    const SampleMipMap* getMipMap() const noexcept                  { return mMipMap.load (std::memory_order_acquire); }
+
+    /** Returns true for the first caller, who is then the one to build the mip-map
+        and hand it to setMipMap(). Any thread.
+    */
+    bool claimMipMapBuild() noexcept                                { return ! mMipMapClaimed.exchange (true); }
+
+    /** Attaches a mip-map built after claimMipMapBuild(), or gives up the claim if
+        it's nullptr, so someone else can try later.
+    */
+    void setMipMap (std::unique_ptr<SampleMipMap> newMipMap) noexcept;
+
+    /** Reads a section of the sample from disk. Disk thread only. */
+    void readFromDisk (juce::AudioBuffer<float>& dest, int destStartSample,
+                       juce::int64 sourceStartSample, int numSamples);
+
+    //==============================================================================
+    bool isMemoryMapped() const noexcept                            { return mMappedSource != nullptr; }
+
+    /** Reads one frame from the mapping into the first getNumChannels() entries of
+        frame. Only valid for mapped samples; safe to call from the audio thread.
+    */
+    void getMappedFrame (juce::int64 index, float* frame) const noexcept;
+
+    /** Touches the mapped pages holding samples [start, end), so they are resident
+        before a voice gets there. Disk thread only.
+    */
+    void prefetch (juce::int64 start, juce::int64 end) const noexcept;
+
+private:
+    const Key mKey;
+    const juce::File mSourceFile;
+    std::unique_ptr<juce::AudioFormatReader> mSource;
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> mMappedSource;
+    juce::AudioBuffer<float> mPreload;
+    PeakPyramid::Ptr mPeaks;
+    int mPreloadLength = 0;
+    int mPrefetchStep = 1;
+    juce::int64 mLength = 0;
+    double mSampleRate = 0.0;
+    int mNumChannels = 0;
+    Downmix::Layout mChannelLayout {};
+    std::atomic<SampleMipMap*> mMipMap { nullptr };
+    std::atomic<bool> mMipMapClaimed { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleData)
+};
+
+//==============================================================================
+/**
+    The process-wide table of SampleData, shared through a SharedResourcePointer.
+
+    Lookups and additions can come from any loading thread. Entries are only
+    freed by purgeUnused(), which the instances call from their timers, so data
+    is never deleted on a loading or audio thread.
+*/
+class SamplePool
+{
+public:
+    SamplePool();
+    ~SamplePool();
+
+    /** Returns the data loaded for this key, or nullptr if nobody has it. */
+    SampleData::Ptr find (const SampleData::Key&) const;
+
+    /** Returns all the data loaded from files with this content hash, wherever the
+        files were. The hash is only a fingerprint, so the caller has to confirm
+        which of them, if any, really hold the content it is after.
+    */
+    juce::ReferenceCountedArray<SampleData> findByContentHash (juce::uint64 contentHash) const;
+
+    /** Adds newly loaded data. If another thread added the same key in the
+        meantime, that data is returned instead and the new one should be dropped.
+    */
+    SampleData::Ptr add (SampleData::Ptr newData);
+
+    /** The files the data in the pool plays from, which mustn't be deleted while it's there. */
+    juce::Array<juce::File> getSourceFiles() const;
+
+    /** Frees the data nothing outside the pool is using any more. */
+    void purgeUnused();
+
+    int getNumSamples() const;
+
+    //==============================================================================
+    /** A cheap fingerprint of a file's contents: its size, plus a hash of its
+        first and last blocks and a few spread out in between. Returns 0 if the
+        file can't be read.
+    */
+    static juce::uint64 computeContentHash (const juce::File&);
+
+    /** A hash of every byte of a file, for confirming that two files whose
+        fingerprints match really hold the same thing. Reads the whole file, so
+        look it up in the SampleIndex, which keeps it, rather than calling this
+        directly. Returns 0 if the file can't be read.
+    */
+    static juce::uint64 computeFullContentHash (const juce::File&);
+
+private:
+    juce::CriticalSection mLock;
+    juce::ReferenceCountedArray<SampleData> mSamples;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SamplePool)
+};
@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    SampleReference.cpp
+    How a session refers to its sample: by path, and by what the file held.
+
+  ==============================================================================
+*/
+
+#include "SampleReference.h"
+
+namespace
+{
+    const juce::Identifier pathID ("path");
+    const juce::Identifier hashID ("hash");
+    const juce::Identifier fullHashID ("fullHash");
+    const juce::Identifier lengthID ("length");
+    const juce::Identifier formatID ("format");
+    const juce::Identifier dataID ("data");
+    const juce::Identifier extensionID ("extension");
+
+    constexpr int flacQualityOption = 5;    // the encoder's default trade-off of size against speed
+
+    juce::File getEmbeddedSampleDirectory()
+    {
+       #if JUCE_MAC
+        const char* path = "Application Support/simpleSampler/Embedded Samples";
+       #else
+        const char* path = "simpleSampler/Embedded Samples";
+       #endif
+
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory).getChildFile (path);
+    }
+
+    // FLAC only holds integer samples, which only uncompressed files are known to be
+    bool canEncodeLosslessly (const juce::AudioFormatReader& reader)
+    {
+        auto& format = reader.getFormatName();
+
+        return (format == juce::WavAudioFormat().getFormatName() || format == juce::AiffAudioFormat().getFormatName())
+                 && ! reader.usesFloatingPointData && reader.bitsPerSample <= 24;
+    }
+}
+
+//==============================================================================
+bool SampleReference::refersToSameSample (const SampleReference& other) const noexcept
+{
+    if (contentHash != 0 && other.contentHash != 0)
+        return contentHash == other.contentHash
+                 && (fullContentHash == 0 || other.fullContentHash == 0 || fullContentHash == other.fullContentHash);
+
+    return file == other.file;
+}
+
+juce::ValueTree SampleReference::toValueTree() const
+{
+    juce::ValueTree tree (getType());
+    tree.setProperty (pathID, file.getFullPathName(), nullptr);
+    tree.setProperty (hashID, juce::String::toHexString ((juce::int64) contentHash), nullptr);
+    tree.setProperty (fullHashID, juce::String::toHexString ((juce::int64) fullContentHash), nullptr);
+    tree.setProperty (lengthID, lengthInSamples, nullptr);
+    tree.setProperty (formatID, formatName, nullptr);
+
+    if (hasEmbeddedData())
+    {
+        tree.setProperty (dataID, embeddedData, nullptr);
+        tree.setProperty (extensionID, embeddedExtension, nullptr);
+    }
+
+    return tree;
+}
+
+SampleReference SampleReference::fromValueTree (const juce::ValueTree& tree)
+{
+    SampleReference reference;
+
+    if (! tree.hasType (getType()))
+        return reference;
+
+    auto path = tree[pathID].toString();
+
+    if (juce::File::isAbsolutePath (path))
+        reference.file = juce::File (path);
+
+    reference.contentHash = (juce::uint64) tree[hashID].toString().getHexValue64();
+    reference.fullContentHash = (juce::uint64) tree[fullHashID].toString().getHexValue64();
+    reference.lengthInSamples = (juce::int64) tree[lengthID];
+    reference.formatName = tree[formatID].toString();
+
+    if (auto* data = tree[dataID].getBinaryData())
+    {
+        reference.embeddedData = *data;
+        reference.embeddedExtension = tree[extensionID].toString();
+    }
+
+    return reference;
+}
+
+//==============================================================================
+bool SampleReference::embed (juce::AudioFormatManager& formatManager)
+{
+    if (hasEmbeddedData())
+        return true;
+
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+    if (reader == nullptr)
+        return false;
+
+    if (canEncodeLosslessly (*reader))
+    {
+        juce::FlacAudioFormat flac;
+        auto* out = new juce::MemoryOutputStream (embeddedData, false);
+        std::unique_ptr<juce::AudioFormatWriter> writer (flac.createWriterFor (out, reader->sampleRate, reader->numChannels,
+                                                                               reader->bitsPerSample > 16 ? 24 : 16,
+                                                                               {}, flacQualityOption));
+
+        if (writer != nullptr)
+        {
+            // the writer owns the stream, which only finishes writing to the block once it is deleted
+            auto written = writer->writeFromAudioReader (*reader, 0, -1);
+            writer.reset();
+
+            if (written)
+            {
+                embeddedExtension = flac.getFileExtensions()[0];
+                return true;
+            }
+        }
+        else
+        {
+            delete out;
+        }
+
+        embeddedData.reset();
+    }
+
+    if (! file.loadFileAsData (embeddedData))
+    {
+        embeddedData.reset();
+        return false;
+    }
+
+    embeddedExtension = file.getFileExtension();
+    return true;
+}
+
+juce::File SampleReference::extractEmbedded() const
+{
+    if (! hasEmbeddedData() || contentHash == 0)
+        return {};
+
+    // named after the original content, so every session holding it shares one copy; the
+    // fingerprint alone could give two different samples the same name
+    const auto name = fullContentHash != 0 ? fullContentHash : contentHash;
+    auto directory = getEmbeddedSampleDirectory();
+    auto target = directory.getChildFile (juce::String::toHexString ((juce::int64) name).paddedLeft ('0', 16)
+                                            + embeddedExtension);
+
+    if (target.getSize() == (juce::int64) embeddedData.getSize())
+        return target;
+
+    if (! directory.createDirectory())
+        return {};
+
+    juce::TemporaryFile temp (target);
+
+    if (! temp.getFile().replaceWithData (embeddedData.getData(), embeddedData.getSize())
+         || ! temp.overwriteTargetFileWithTemporary())
+        return {};
+
+    return target;
+}
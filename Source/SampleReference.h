@@ -0,0 +1,71 @@
+/*
+  ==============================================================================
+
+    SampleReference.h
+    How a session refers to its sample: by path, and by what the file held.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Identifies the file a session loaded well enough to find it again after it
+    has been moved, or on another machine: its path, plus the content hashes,
+    length and format it had when it was loaded. Optionally carries the file
+    itself, for sessions that have to work without it.
+
+    The content hash is a quick fingerprint, good for finding candidates; the
+    full content hash covers every byte, and is what a candidate has to match
+    before it's used. Sessions saved before full hashes were kept have none, and
+    get by with the fingerprint.
+
+    A reference with no content hash is just a path, which is what a file
+    dropped on the editor starts as; the loader fills in the rest.
+*/
+struct SampleReference
+{
+    juce::File file;
+    juce::uint64 contentHash = 0;
+    juce::uint64 fullContentHash = 0;
+    juce::int64 lengthInSamples = 0;
+    juce::String formatName;
+
+    /** The sample's content, compressed losslessly, when it is embedded in the
+        session. Empty otherwise.
+    */
+    juce::MemoryBlock embeddedData;
+    juce::String embeddedExtension;     // the format embeddedData is in, like ".flac"
+
+    bool hasEmbeddedData() const noexcept           { return embeddedData.getSize() > 0; }
+    bool isEmpty() const noexcept                   { return file == juce::File() && ! hasEmbeddedData(); }
+
+    /** True if both refer to the same content, or the same path when either has no hash.
+        The full hashes are compared too when both have them.
+    */
+    bool refersToSameSample (const SampleReference&) const noexcept;
+
+    //==============================================================================
+    juce::ValueTree toValueTree() const;
+    static SampleReference fromValueTree (const juce::ValueTree&);
+
+    /** Fills in embeddedData from the file. Integer PCM of up to 24 bits becomes
+        FLAC; anything else, like float WAVs or files that are already compressed,
+        is stored as it is, since re-encoding it wouldn't be lossless or smaller.
+        Returns false if the file couldn't be read. Not for SFZ instruments.
+    */
+    bool embed (juce::AudioFormatManager&);
+
+    /** Writes embeddedData to a file named after the content hash (the full one, if
+        there is one) in the user's
+        application data, and returns it, or File() if it couldn't be written. If
+        an earlier session already extracted the same content, that file is
+        returned without writing anything.
+    */
+    juce::File extractEmbedded() const;
+
+    static juce::Identifier getType()               { return "SampleReference"; }
+};
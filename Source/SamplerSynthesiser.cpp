@@ -0,0 +1,454 @@
+/*
+  ==============================================================================
+
+    SamplerSynthesiser.cpp
+    Synthesiser whose sounds can be replaced while it is playing.
+
+  ==============================================================================
+*/
+
+#include "SamplerSynthesiser.h"
+
+//==============================================================================
+bool SoundSet::isUnused() const noexcept
+{
+    for (auto* sound : sounds)
+        if (sound->getReferenceCount() > 1)
+            return false;
+
+    return true;
+}
+
+//==============================================================================
+SamplerSynthesiser::SamplerSynthesiser()
+    : mRenderState (new RenderState())
+{
+}
+
+SamplerSynthesiser::~SamplerSynthesiser()
+{
+    // the pointers the synth holds on to carry a reference each
+    if (auto* pending = mPendingSet.exchange (nullptr))
+        pending->decReferenceCount();
+
+    if (mActiveSet != nullptr)
+        mActiveSet->decReferenceCount();
+
+    int start1, size1, start2, size2;
+    mRetireFifo.prepareToRead (mRetireFifo.getNumReady(), start1, size1, start2, size2);
+
+    for (int i = 0; i < size1; ++i)  mRetireQueue[(size_t) (start1 + i)]->decReferenceCount();
+    for (int i = 0; i < size2; ++i)  mRetireQueue[(size_t) (start2 + i)]->decReferenceCount();
+
+    delete mPendingState.exchange (nullptr);
+    delete mRetiredState.exchange (nullptr);
+}
+
+void SamplerSynthesiser::addStreamingVoice (StreamingSamplerVoice* newVoice)
+{
+    mStreamingVoices.add (newVoice);
+    addVoice (newVoice);
+
+    mLanes.setNumVoices (mStreamingVoices.size());
+    newVoice->attachToLanes (mLanes, mStreamingVoices.size() - 1);
+
+    // so that gathering the playing voices never allocates
+    mActiveGroups.ensureStorageAllocated (mLanes.getNumGroups() * voicesPerChunk);
+}
+
+int SamplerSynthesiser::getNumActiveVoices() const noexcept
+{
+    int numActive = 0;
+
+    for (auto* voice : mStreamingVoices)
+        if (voice->isVoiceActive())
+            ++numActive;
+
+    return numActive;
+}
+
+bool SamplerSynthesiser::hasActiveVoices() const noexcept
+{
+    for (auto* voice : mStreamingVoices)
+        if (voice->isVoiceActive())
+            return true;
+
+    return false;
+}
+
+void SamplerSynthesiser::setEnvelopeParameters (const juce::ADSR::Parameters& newParameters) noexcept
+{
+    mEnvelope = newParameters;
+
+    for (auto* voice : mStreamingVoices)
+        if (voice->isVoiceActive())
+            voice->setEnvelopeParameters (newParameters);
+}
+
+void SamplerSynthesiser::setFilterParameters (const VoiceFilterParameters& newParameters) noexcept
+{
+    mFilter = newParameters;
+
+    for (auto* voice : mStreamingVoices)
+        if (voice->isVoiceActive())
+            voice->setFilterParameters (newParameters);
+}
+
+void SamplerSynthesiser::setNumRenderThreads (int numThreads)
+{
+    numThreads = juce::jlimit (1, VoiceRenderPool::maxWorkers + 1, numThreads);
+
+    if (numThreads == mNumRenderThreads)
+        return;
+
+    // the old pool's threads are stopped once the last state using it has been collected
+    mRenderPool.reset (numThreads > 1 ? new VoiceRenderPool (numThreads - 1) : nullptr);
+    mNumRenderThreads = numThreads;
+    handOverRenderState();
+}
+
+void SamplerSynthesiser::prepareToRender (int maximumBlockSize, int numOutputChannels)
+{
+    mMaximumBlockSize = maximumBlockSize;
+    mNumOutputChannels = numOutputChannels;
+    handOverRenderState();
+}
+
+void SamplerSynthesiser::setOutputBuses (const juce::Array<juce::Range<int>>& busChannels,
+                                         const juce::Array<juce::AudioChannelSet>& busLayouts)
+{
+    jassert (busLayouts.size() == busChannels.size());
+
+    mOutputBuses = busChannels;
+    mOutputLayouts.clearQuick();
+
+    for (int bus = 0; bus < mOutputBuses.size(); ++bus)
+        mOutputLayouts.add (Downmix::getLayout (busLayouts[bus]));
+
+    handOverRenderState();
+}
+
+void SamplerSynthesiser::handOverRenderState()
+{
+    const auto numChunks = (mStreamingVoices.size() + voicesPerChunk - 1) / voicesPerChunk;
+    jassert (numChunks <= VoiceRenderPool::maxChunks);
+
+    std::unique_ptr<RenderState> state (new RenderState());
+    state->pool = mRenderPool;
+    state->channelsPerChunk = juce::jmax (1, mNumOutputChannels);
+    state->outputBuses = mOutputBuses;
+    state->outputLayouts = mOutputLayouts;
+
+    // only worth having when there are threads to share the chunks with
+    if (mRenderPool != nullptr)
+        state->chunkBuffers.setSize (numChunks * state->channelsPerChunk, mMaximumBlockSize, false, true);
+
+    // one the audio thread never got round to picking up is simply replaced
+    delete mPendingState.exchange (state.release(), std::memory_order_acq_rel);
+}
+
+void SamplerSynthesiser::updateRenderState() noexcept
+{
+    // a new state is only picked up once the one before it has been collected, so the
+    // audio thread never frees anything; until then the old one keeps being used
+    if (mPendingState.load (std::memory_order_relaxed) != nullptr && mRetiredState.load (std::memory_order_acquire) == nullptr)
+    {
+        mRetiredState.store (mRenderState.release(), std::memory_order_release);
+        mRenderState.reset (mPendingState.exchange (nullptr, std::memory_order_acq_rel));
+    }
+}
+
+void SamplerSynthesiser::collectRetiredRenderState()
+{
+    delete mRetiredState.exchange (nullptr, std::memory_order_acq_rel);
+}
+
+int SamplerSynthesiser::getPlayingOutputBus (int bus) const noexcept
+{
+    const auto& buses = mRenderState->outputBuses;
+
+    if (juce::isPositiveAndBelow (bus, buses.size()) && ! buses.getReference (bus).isEmpty())
+        return bus;
+
+    // -1 until the buses are known, for the first two channels as a stereo pair
+    return buses.isEmpty() ? -1 : 0;
+}
+
+void SamplerSynthesiser::setSoundSet (SoundSet::Ptr newSet)
+{
+    if (newSet != nullptr)
+        newSet->incReferenceCount();
+
+    // if the audio thread never picked up the previous pending set, nobody else has seen it
+    if (auto* unused = mPendingSet.exchange (newSet.get(), std::memory_order_acq_rel))
+        unused->decReferenceCount();
+}
+
+void SamplerSynthesiser::updateSoundSet() noexcept
+{
+    if (mPendingSet.load (std::memory_order_relaxed) == nullptr)
+        return;
+
+    // leave the swap for a later block if the message thread hasn't emptied the queue
+    if (mActiveSet != nullptr && mRetireFifo.getFreeSpace() == 0)
+        return;
+
+    auto* newSet = mPendingSet.exchange (nullptr, std::memory_order_acq_rel);
+
+    if (newSet == nullptr)
+        return;
+
+    if (mActiveSet != nullptr)
+    {
+        int start1, size1, start2, size2;
+        mRetireFifo.prepareToWrite (1, start1, size1, start2, size2);
+        mRetireQueue[(size_t) start1] = mActiveSet;
+        mRetireFifo.finishedWrite (1);
+    }
+
+    mActiveSet = newSet;
+    mRoundRobinCounters.fill (0);
+}
+
+void SamplerSynthesiser::collectRetiredSets (juce::ReferenceCountedArray<SoundSet>& destination)
+{
+    int start1, size1, start2, size2;
+    mRetireFifo.prepareToRead (mRetireFifo.getNumReady(), start1, size1, start2, size2);
+
+    auto takeOwnership = [&destination] (SoundSet* set)
+    {
+        destination.addIfNotAlreadyThere (set);
+        set->decReferenceCount();   // drop the reference the audio thread was holding
+    };
+
+    for (int i = 0; i < size1; ++i)  takeOwnership (mRetireQueue[(size_t) (start1 + i)]);
+    for (int i = 0; i < size2; ++i)  takeOwnership (mRetireQueue[(size_t) (start2 + i)]);
+
+    mRetireFifo.finishedRead (size1 + size2);
+}
+
+//==============================================================================
+void SamplerSynthesiser::renderVoices (juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+    static_assert (voicesPerChunk == VoiceLanes::numLanes, "a chunk is one group of the lanes");
+
+    mActiveGroups.clearQuick();
+
+    for (int first = 0; first < mStreamingVoices.size(); first += voicesPerChunk)
+    {
+        StreamingSamplerVoice* group[voicesPerChunk] = {};
+        bool isPlaying = false;
+
+        for (int lane = 0; lane < voicesPerChunk && first + lane < mStreamingVoices.size(); ++lane)
+        {
+            auto* voice = mStreamingVoices.getUnchecked (first + lane);
+
+            if (voice->isVoiceActive())
+            {
+                group[lane] = voice;
+                isPlaying = true;
+            }
+        }
+
+        if (isPlaying)
+            mActiveGroups.addArray (group, voicesPerChunk);
+    }
+
+    const auto numChunks = mActiveGroups.size() / voicesPerChunk;
+    auto* groups = mActiveGroups.getRawDataPointer();
+
+    auto& state = *mRenderState;
+    auto& chunkBuffers = state.chunkBuffers;
+    const auto channelsPerChunk = state.channelsPerChunk;
+
+    // not worth waking anybody up for; hosts are also allowed to go over the block size
+    // they promised, if only rarely
+    if (state.pool == nullptr || numChunks < 2
+         || numChunks > chunkBuffers.getNumChannels() / channelsPerChunk
+         || numSamples > chunkBuffers.getNumSamples())
+    {
+        for (int chunk = 0; chunk < numChunks; ++chunk)
+            StreamingSamplerVoice::renderLanes (groups + chunk * voicesPerChunk, outputAudio, startSample, numSamples);
+
+        return;
+    }
+
+    mChunkRenderer.chunkChannels = chunkBuffers.getArrayOfWritePointers();
+    mChunkRenderer.channelsPerChunk = channelsPerChunk;
+    mChunkRenderer.numChannels = juce::jmin (channelsPerChunk, outputAudio.getNumChannels());
+    mChunkRenderer.numSamples = numSamples;
+    state.pool->perform (mChunkRenderer, numChunks);
+
+    for (int chunk = 0; chunk < numChunks; ++chunk)
+        for (int channel = 0; channel < mChunkRenderer.numChannels; ++channel)
+            outputAudio.addFrom (channel, startSample, chunkBuffers, chunk * channelsPerChunk + channel, 0, numSamples);
+}
+
+void SamplerSynthesiser::ChunkRenderer::renderChunk (int chunkIndex) noexcept
+{
+    // refers to the chunk's channels without allocating anything
+    juce::AudioBuffer<float> chunkBuffer (chunkChannels + chunkIndex * channelsPerChunk, numChannels, numSamples);
+    chunkBuffer.clear();
+
+    StreamingSamplerVoice::renderLanes (synth.mActiveGroups.getRawDataPointer() + chunkIndex * voicesPerChunk,
+                                        chunkBuffer, 0, numSamples);
+}
+
+//==============================================================================
+void SamplerSynthesiser::setCurrentPlaybackSampleRate (double sampleRate)
+{
+    juce::Synthesiser::setCurrentPlaybackSampleRate (sampleRate);
+    mLanes.setSampleRate (sampleRate);
+}
+
+void SamplerSynthesiser::noteOn (int midiChannel, int midiNoteNumber, float velocity)
+{
+    // same as juce::Synthesiser::noteOn, but instead of asking every sound whether it
+    // applies to the note, the key map of the active set says which ones play
+    if (mActiveSet == nullptr)
+        return;
+
+    int numSlots = 0;
+    auto* slots = mActiveSet->keyMap.getSlots (midiNoteNumber, juce::roundToInt (velocity * 127.0f), numSlots);
+
+    if (numSlots == 0)
+        return;
+
+    // If hitting a note that's still ringing, stop it first (it could be
+    // still playing because of the sustain or sostenuto pedal).
+    for (auto* voice : voices)
+        if (voice->getCurrentlyPlayingNote() == midiNoteNumber && voice->isPlayingChannel (midiChannel))
+            stopVoice (voice, 1.0f, true);
+
+    for (int i = 0; i < numSlots; ++i)
+    {
+        auto& slot = slots[i];
+        auto zone = slot.firstZone;
+
+        // each zone of a round-robin group gets its turn
+        if (slot.roundRobinGroup >= 0)
+            zone += (int) (mRoundRobinCounters[(size_t) slot.roundRobinGroup]++ % (juce::uint32) slot.numZones);
+
+        auto* sound = mActiveSet->sounds.getObjectPointerUnchecked (mActiveSet->keyMap.getZone (zone));
+
+        if (! sound->appliesToChannel (midiChannel))
+            continue;
+
+        auto* voice = findFreeVoice (sound, midiChannel, midiNoteNumber, isNoteStealingEnabled());
+
+        if (voice != nullptr)
+        {
+            auto* streamingVoice = static_cast<StreamingSamplerVoice*> (voice);
+            const auto bus = getPlayingOutputBus (sound->getOutputBus());
+
+            streamingVoice->setEnvelopeParameters (mEnvelope);
+            streamingVoice->setFilterParameters (mFilter);
+
+            if (bus >= 0)
+            {
+                const auto channels = mRenderState->outputBuses.getReference (bus);
+                streamingVoice->setOutputChannels (channels.getStart(), channels.getLength(),
+                                                   mRenderState->outputLayouts.getReference (bus));
+            }
+            else
+            {
+                streamingVoice->setOutputChannels (0, 2, Downmix::getStereoLayout());
+            }
+        }
+
+        startVoice (voice, sound, midiChannel, midiNoteNumber, velocity);
+    }
+}
+
+juce::SynthesiserVoice* SamplerSynthesiser::findFreeVoice (juce::SynthesiserSound* soundToPlay, int /*midiChannel*/,
+                                                          int midiNoteNumber, bool stealIfNoneAvailable) const
+{
+    const auto polyphony = getPolyphony();
+    const auto numUsable = juce::jmin (mStreamingVoices.size(), polyphony + stealReserve);
+
+    StreamingSamplerVoice* freeVoice = nullptr;
+    StreamingSamplerVoice* fadingVoice = nullptr;
+    int numSounding = 0;
+
+    for (int i = 0; i < mStreamingVoices.size(); ++i)
+    {
+        auto* voice = mStreamingVoices.getUnchecked (i);
+
+        if (voice->isVoiceActive())
+        {
+            if (voice->isBeingStolen())
+                fadingVoice = voice;
+            else
+                ++numSounding;
+        }
+        else if (freeVoice == nullptr && i < numUsable && voice->canPlaySound (soundToPlay))
+        {
+            freeVoice = voice;
+        }
+    }
+
+    if (numSounding < polyphony)
+    {
+        // every spare voice is still fading out something it lost, so cut one of them short
+        return freeVoice != nullptr ? freeVoice : fadingVoice;
+    }
+
+    if (! stealIfNoneAvailable)
+        return nullptr;
+
+    auto* victim = static_cast<StreamingSamplerVoice*> (findVoiceToSteal (soundToPlay, 0, midiNoteNumber));
+
+    if (victim != nullptr)
+        ++mNumSteals;
+
+    // without a spare voice to play the new note on, the victim is cut off rather than faded
+    if (victim == nullptr || freeVoice == nullptr)
+        return victim != nullptr ? victim : fadingVoice;
+
+    victim->startFastRelease();
+    return freeVoice;
+}
+
+juce::SynthesiserVoice* SamplerSynthesiser::findVoiceToSteal (juce::SynthesiserSound* /*soundToPlay*/, int /*midiChannel*/,
+                                                             int midiNoteNumber) const
+{
+    StreamingSamplerVoice* best = nullptr;
+
+    for (auto* voice : mStreamingVoices)
+    {
+        if (! voice->isVoiceActive() || voice->isBeingStolen())
+            continue;
+
+        if (best == nullptr || isBetterToSteal (*voice, *best, midiNoteNumber))
+            best = voice;
+    }
+
+    return best;
+}
+
+bool SamplerSynthesiser::isBetterToSteal (const StreamingSamplerVoice& candidate, const StreamingSamplerVoice& current,
+                                          int midiNoteNumber) const noexcept
+{
+    const auto policy = getStealingPolicy();
+
+    if (policy == VoiceStealingPolicy::sameNoteFirst)
+    {
+        const auto candidateMatches = candidate.getCurrentlyPlayingNote() == midiNoteNumber;
+        const auto currentMatches = current.getCurrentlyPlayingNote() == midiNoteNumber;
+
+        if (candidateMatches != currentMatches)
+            return candidateMatches;
+    }
+
+    // whatever the policy, notes that have been let go of go before ones still being held
+    const auto candidateHeld = candidate.isKeyDown() || candidate.isSustainPedalDown();
+    const auto currentHeld = current.isKeyDown() || current.isSustainPedalDown();
+
+    if (candidateHeld != currentHeld)
+        return ! candidateHeld;
+
+    if (policy == VoiceStealingPolicy::quietest)
+        return candidate.getCurrentLevel() < current.getCurrentLevel();
+
+    return candidate.wasStartedBefore (current);
+}
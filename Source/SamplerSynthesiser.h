@@ -0,0 +1,253 @@
+/*
+  ==============================================================================
+
+    SamplerSynthesiser.h
+    Synthesiser whose sounds can be replaced while it is playing.
+
+    Sounds are loaded off the audio thread into a SoundSet, which is handed to
+    the audio thread with a single atomic pointer swap at the start of a block.
+    The set that was replaced goes into a retire queue, from where the message
+    thread collects it and frees it once no voice is still playing its sounds.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StreamingSampler.h"
+#include "VoiceRenderPool.h"
+#include "KeyMap.h"
+#include "SampleReference.h"
+
+//==============================================================================
+/**
+    Everything produced by one sample load: the sounds the synth plays, the map
+    of which of them play for each note and velocity, and the peaks the editor
+    draws. Immutable once it has been handed to the synth.
+*/
+struct SoundSet  : public juce::ReferenceCountedObject
+{
+    using Ptr = juce::ReferenceCountedObjectPtr<SoundSet>;
+
+    juce::ReferenceCountedArray<StreamingSamplerSound> sounds;
+    KeyMap keyMap;                                      // zone i of the map is sounds[i]
+    PeakPyramid::Ptr peaks;                             // nullptr if the load didn't build any
+    juce::String name;
+    SampleReference reference;                          // what the set was loaded from, without any embedded data
+
+    /** True once no voice holds on to any of the sounds any more. */
+    bool isUnused() const noexcept;
+};
+
+//==============================================================================
+/** Which voice gives way when a note arrives and every voice is in use. */
+enum class VoiceStealingPolicy
+{
+    oldest = 0,         // the voice that started first
+    quietest,           // the voice with the lowest level right now
+    sameNoteFirst       // a voice already playing the new note, otherwise the oldest
+};
+
+//==============================================================================
+/**
+    Besides swapping sound sets, this handles polyphony for a fixed pool of
+    StreamingSamplerVoices that is allocated up front.
+
+    Only getPolyphony() voices sound at once. When a note comes in and they are
+    all busy, a voice is chosen by the stealing policy and faded out over a few
+    milliseconds, and the new note starts on one of stealReserve spare voices
+    meanwhile. So the pool has to hold polyphony + stealReserve voices.
+
+    The voices' envelopes and filters are kept in a VoiceLanes, voice n in lane
+    n % voicesPerChunk of group n / voicesPerChunk, and each group with a voice
+    playing is rendered in one go. With more than one render thread every such
+    group is a chunk, which is mixed into a buffer of its own by whichever thread
+    gets to it. Those buffers are then added to the output in chunk order, so the
+    result only depends on which voices are playing, never on how the chunks were
+    shared out between the threads.
+*/
+class SamplerSynthesiser  : public juce::Synthesiser
+{
+public:
+    SamplerSynthesiser();
+    ~SamplerSynthesiser() override;
+
+    /** Voices that aren't sounding but are kept free for notes that steal. */
+    static constexpr int stealReserve = 16;
+
+    /** Adds a voice to the pool. Use this rather than addVoice(). */
+    void addStreamingVoice (StreamingSamplerVoice* newVoice);
+    StreamingSamplerVoice* getStreamingVoice (int index) const noexcept     { return mStreamingVoices[index]; }
+
+    /** Sets how many voices may sound at once. The first numVoices + stealReserve
+        voices must already have been prepared to stream. Can be called from any thread.
+    */
+    void setPolyphony (int numVoices) noexcept              { mPolyphony = numVoices; }
+    int getPolyphony() const noexcept                       { return mPolyphony.load(); }
+
+    void setStealingPolicy (VoiceStealingPolicy policy) noexcept    { mStealingPolicy = policy; }
+    VoiceStealingPolicy getStealingPolicy() const noexcept          { return mStealingPolicy.load(); }
+
+    /** How many notes have taken a voice from another since the synth was created.
+        Audio thread only.
+    */
+    int getNumSteals() const noexcept                       { return mNumSteals; }
+
+    /** Counts the voices that are sounding, fading out stolen notes included. */
+    int getNumActiveVoices() const noexcept;
+
+    /** True if any voice is sounding. Stops at the first one, so it's cheap to call
+        every block to find out whether there's anything to render.
+    */
+    bool hasActiveVoices() const noexcept;
+
+    /** Sets the envelope for new notes, and for the ones already playing. Audio
+        thread only, between calls to renderNextBlock().
+    */
+    void setEnvelopeParameters (const juce::ADSR::Parameters& newParameters) noexcept;
+    const juce::ADSR::Parameters& getEnvelopeParameters() const noexcept   { return mEnvelope; }
+
+    /** Sets the filter for new notes, and for the ones already playing. Audio thread
+        only, between calls to renderNextBlock().
+    */
+    void setFilterParameters (const VoiceFilterParameters& newParameters) noexcept;
+    const VoiceFilterParameters& getFilterParameters() const noexcept       { return mFilter; }
+
+    /** Sets how many threads render voices, counting the audio thread. 1 renders
+        everything on the audio thread. Message thread only.
+
+        This and the two below build a new RenderState for the audio thread to pick
+        up in updateRenderState(), so none of them waits for a block to finish.
+    */
+    void setNumRenderThreads (int numThreads);
+    int getNumRenderThreads() const noexcept                { return mNumRenderThreads; }
+
+    /** Allocates the buffers the render threads mix into. Call before rendering,
+        whenever the block size or the number of output channels may have changed.
+        Message thread only.
+    */
+    void prepareToRender (int maximumBlockSize, int numOutputChannels);
+
+    /** Says where each output bus's channels are in the buffers the synth renders
+        into, bus 0 being the main output, and which speakers they are, so sounds can
+        be mixed down onto them. Sounds whose bus isn't in the list, or has no
+        channels, play through the main bus. Call before rendering, whenever the bus
+        layout may have changed. Message thread only.
+    */
+    void setOutputBuses (const juce::Array<juce::Range<int>>& busChannels,
+                         const juce::Array<juce::AudioChannelSet>& busLayouts);
+
+    /** Swaps in the render state the calls above made last, unless the one it
+        replaced before hasn't been collected yet. Audio thread only, call before
+        rendering.
+    */
+    void updateRenderState() noexcept;
+
+    /** Frees the render state the audio thread has swapped out, and with it the old
+        render threads if nothing uses them any more. Message thread only.
+    */
+    void collectRetiredRenderState();
+
+    static constexpr int voicesPerChunk = VoiceLanes::numLanes;
+
+    /** Queues a new set of sounds for the audio thread to pick up at its next
+        block. Can be called from any thread, and never waits for the audio thread.
+    */
+    void setSoundSet (SoundSet::Ptr newSet);
+
+    /** Swaps in a pending sound set. Audio thread only, call before rendering. */
+    void updateSoundSet() noexcept;
+
+    /** Moves the sets the audio thread has swapped out into the given array. The
+        caller is responsible for only freeing them once SoundSet::isUnused() says
+        no voice is still playing them. Message thread only.
+    */
+    void collectRetiredSets (juce::ReferenceCountedArray<SoundSet>& destination);
+
+    //==============================================================================
+    void setCurrentPlaybackSampleRate (double sampleRate) override;
+    void noteOn (int midiChannel, int midiNoteNumber, float velocity) override;
+
+protected:
+    //==============================================================================
+    juce::SynthesiserVoice* findFreeVoice (juce::SynthesiserSound*, int midiChannel,
+                                           int midiNoteNumber, bool stealIfNoneAvailable) const override;
+
+    juce::SynthesiserVoice* findVoiceToSteal (juce::SynthesiserSound*, int midiChannel,
+                                              int midiNoteNumber) const override;
+
+    using juce::Synthesiser::renderVoices;
+    void renderVoices (juce::AudioBuffer<float>&, int startSample, int numSamples) override;
+
+private:
+    //==============================================================================
+    // what rendering uses besides the voices; the audio thread only ever has one, and
+    // the message thread replaces it as a whole
+    struct RenderState
+    {
+        std::shared_ptr<VoiceRenderPool> pool;      // nullptr to render on the audio thread alone
+        juce::AudioBuffer<float> chunkBuffers;      // channelsPerChunk channels per chunk
+        int channelsPerChunk = 2;
+        juce::Array<juce::Range<int>> outputBuses;  // empty until the first setOutputBuses()
+        juce::Array<Downmix::Layout> outputLayouts; // one for each of outputBuses
+    };
+
+    // renders one group of mActiveGroups into its own part of the chunk buffers
+    struct ChunkRenderer  : public VoiceRenderPool::Job
+    {
+        explicit ChunkRenderer (SamplerSynthesiser& s) : synth (s) {}
+        void renderChunk (int chunkIndex) noexcept override;
+
+        SamplerSynthesiser& synth;
+        float* const* chunkChannels = nullptr;
+        int channelsPerChunk = 0, numChannels = 0, numSamples = 0;
+    };
+
+    int getPlayingOutputBus (int bus) const noexcept;
+    bool isBetterToSteal (const StreamingSamplerVoice& candidate, const StreamingSamplerVoice& current,
+                          int midiNoteNumber) const noexcept;
+
+    //==============================================================================
+    static constexpr int retireQueueSize = 32;
+
+    juce::Array<StreamingSamplerVoice*> mStreamingVoices;   // the same voices as the base class's list
+    std::atomic<int> mPolyphony { 0 };
+    std::atomic<VoiceStealingPolicy> mStealingPolicy { VoiceStealingPolicy::oldest };
+    mutable int mNumSteals = 0;                             // findFreeVoice() is const in the base class
+    juce::ADSR::Parameters mEnvelope;                       // audio thread
+    VoiceFilterParameters mFilter;                          // audio thread
+    VoiceLanes mLanes;
+
+    void handOverRenderState();
+
+    // message thread: the settings the next render state is made from
+    std::shared_ptr<VoiceRenderPool> mRenderPool;
+    int mNumRenderThreads = 1;
+    int mMaximumBlockSize = 0, mNumOutputChannels = 2;
+    juce::Array<juce::Range<int>> mOutputBuses;
+    juce::Array<Downmix::Layout> mOutputLayouts;
+
+    // only the audio thread touches the current state; new ones come through
+    // mPendingState and old ones leave through mRetiredState
+    std::unique_ptr<RenderState> mRenderState;
+    std::atomic<RenderState*> mPendingState { nullptr };
+    std::atomic<RenderState*> mRetiredState { nullptr };
+
+    ChunkRenderer mChunkRenderer { *this };
+    // voicesPerChunk entries for each group with a voice playing in this block,
+    // nullptr for the group's voices that aren't playing
+    juce::Array<StreamingSamplerVoice*> mActiveGroups;
+
+    SoundSet* mActiveSet = nullptr;                     // owned by the audio thread
+    std::atomic<SoundSet*> mPendingSet { nullptr };
+
+    // audio thread pushes sets it has replaced, message thread pops them
+    juce::AbstractFifo mRetireFifo { retireQueueSize };
+    std::array<SoundSet*, retireQueueSize> mRetireQueue {};
+
+    // how many times each round-robin group of the active set has played
+    std::array<juce::uint32, KeyMap::maxRoundRobinGroups> mRoundRobinCounters {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SamplerSynthesiser)
+};
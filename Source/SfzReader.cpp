@@ -0,0 +1,239 @@
+/*
+  ==============================================================================
+
+    SfzReader.cpp
+    Reads the key mapping of an instrument from an SFZ file.
+
+  ==============================================================================
+*/
+
+#include "SfzReader.h"
+
+namespace
+{
+    using Opcodes = std::map<juce::String, juce::String>;
+
+    // a MIDI note number, or a name like c4, f#3 or eb-1, with middle C as c4
+    int parseNote (const juce::String& text)
+    {
+        auto note = text.trim().toLowerCase();
+
+        if (note.isEmpty())
+            return -1;
+
+        if (note.containsOnly ("-0123456789"))
+            return note.getIntValue();
+
+        const auto letter = note[0];
+
+        if (letter < 'a' || letter > 'g')
+            return -1;
+
+        static const int semitones[] = { 9, 11, 0, 2, 4, 5, 7 };    // a to g
+        auto number = semitones[letter - 'a'];
+        int octaveStart = 1;
+
+        if (note[1] == '#')       { ++number; ++octaveStart; }
+        else if (note[1] == 'b')  { --number; ++octaveStart; }
+
+        return (note.substring (octaveStart).getIntValue() + 1) * 12 + number;
+    }
+
+    juce::String stripComments (const juce::String& text)
+    {
+        juce::String result;
+        juce::StringArray lines;
+        lines.addLines (text);
+
+        for (auto& line : lines)
+        {
+            auto comment = line.indexOf ("//");
+            result << (comment >= 0 ? line.substring (0, comment) : line) << '\n';
+        }
+
+        return result;
+    }
+
+    // calls onHeader for every <header>, and onOpcode for every name=value; values
+    // run up to the next opcode or header, as sample paths may have spaces in them
+    template <typename HeaderCallback, typename OpcodeCallback>
+    void parse (const juce::String& text, HeaderCallback&& onHeader, OpcodeCallback&& onOpcode)
+    {
+        const auto length = text.length();
+        int pos = 0;
+
+        while (pos < length)
+        {
+            if (juce::CharacterFunctions::isWhitespace (text[pos]))
+            {
+                ++pos;
+                continue;
+            }
+
+            if (text[pos] == '<')
+            {
+                auto end = text.indexOfChar (pos, '>');
+
+                if (end < 0)
+                    return;
+
+                onHeader (text.substring (pos + 1, end).trim().toLowerCase());
+                pos = end + 1;
+                continue;
+            }
+
+            auto equals = text.indexOfChar (pos, '=');
+            auto lineEnd = text.indexOfChar (pos, '\n');
+
+            if (lineEnd < 0)
+                lineEnd = length;
+
+            // a stray word without a value
+            if (equals < 0 || equals > lineEnd)
+            {
+                pos = lineEnd;
+                continue;
+            }
+
+            auto valueEnd = lineEnd;
+            auto nextHeader = text.indexOfChar (equals, '<');
+
+            if (nextHeader >= 0 && nextHeader < valueEnd)
+                valueEnd = nextHeader;
+
+            auto nextEquals = text.indexOfChar (equals + 1, '=');
+
+            if (nextEquals >= 0 && nextEquals < valueEnd)
+            {
+                // the value ends where the next opcode's name starts
+                auto nameStart = nextEquals;
+
+                while (nameStart > equals + 1 && ! juce::CharacterFunctions::isWhitespace (text[nameStart - 1]))
+                    --nameStart;
+
+                valueEnd = nameStart;
+            }
+
+            onOpcode (text.substring (pos, equals).trim().toLowerCase(),
+                      text.substring (equals + 1, valueEnd).trim());
+            pos = valueEnd;
+        }
+    }
+}
+
+//==============================================================================
+bool readSfzZones (const juce::File& sfzFile, std::vector<ZoneSource>& zones)
+{
+    if (! sfzFile.existsAsFile())
+        return false;
+
+    const auto firstZone = zones.size();
+
+    Opcodes control, global, group, region;
+    Opcodes* current = nullptr;
+    int groupIndex = 0;
+    bool inRegion = false;
+
+    auto getOpcode = [&] (const char* name) -> juce::String
+    {
+        for (auto* scope : { &region, &group, &global })
+        {
+            auto found = scope->find (name);
+
+            if (found != scope->end())
+                return found->second;
+        }
+
+        return {};
+    };
+
+    auto getNote = [&] (const char* name, int defaultNote)
+    {
+        auto note = parseNote (getOpcode (name));
+        return note >= 0 ? note : defaultNote;
+    };
+
+    auto addRegion = [&]
+    {
+        auto sample = getOpcode ("sample");
+
+        if (sample.isEmpty())
+            return;
+
+        auto path = (control["default_path"] + sample).replaceCharacter ('\\', '/');
+
+        ZoneSource source;
+        source.file = sfzFile.getParentDirectory().getChildFile (path);
+
+        auto& zone = source.zone;
+        auto key = getNote ("key", -1);
+
+        zone.lowNote = getNote ("lokey", key >= 0 ? key : 0);
+        zone.highNote = getNote ("hikey", key >= 0 ? key : 127);
+        zone.rootNote = getNote ("pitch_keycenter", key >= 0 ? key : 60);
+
+        auto lowVelocity = getOpcode ("lovel"), highVelocity = getOpcode ("hivel");
+        zone.lowVelocity = juce::jmax (1, lowVelocity.isEmpty() ? 1 : lowVelocity.getIntValue());
+        zone.highVelocity = juce::jmin (127, highVelocity.isEmpty() ? 127 : highVelocity.getIntValue());
+
+        if (getOpcode ("seq_length").getIntValue() > 1)
+        {
+            zone.roundRobinGroup = groupIndex;
+            zone.roundRobinPosition = getOpcode ("seq_position").getIntValue();
+        }
+
+        zone.outputBus = juce::jmax (0, getOpcode ("output").getIntValue());
+
+        if (zone.lowNote <= zone.highNote && zone.lowVelocity <= zone.highVelocity
+             && juce::isPositiveAndBelow (zone.rootNote, 128))
+            zones.push_back (source);
+    };
+
+    auto onHeader = [&] (const juce::String& header)
+    {
+        if (inRegion)
+            addRegion();
+
+        inRegion = false;
+        region.clear();
+
+        if (header == "region")
+        {
+            inRegion = true;
+            current = &region;
+        }
+        else if (header == "group")
+        {
+            ++groupIndex;
+            group.clear();
+            current = &group;
+        }
+        else if (header == "global")
+        {
+            global.clear();
+            group.clear();
+            current = &global;
+        }
+        else if (header == "control")
+        {
+            current = &control;
+        }
+        else
+        {
+            current = nullptr;  // a header this doesn't know about, whose opcodes are skipped
+        }
+    };
+
+    auto onOpcode = [&] (const juce::String& name, const juce::String& value)
+    {
+        if (current != nullptr)
+            (*current)[name] = value;
+    };
+
+    parse (stripComments (sfzFile.loadFileAsString()), onHeader, onOpcode);
+
+    if (inRegion)
+        addRegion();
+
+    return zones.size() > firstZone;
+}
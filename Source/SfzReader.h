@@ -0,0 +1,28 @@
+/*
+  ==============================================================================
+
+    SfzReader.h
+    Reads the key mapping of an instrument from an SFZ file.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SampleLoader.h"
+
+//==============================================================================
+/**
+    Reads the zones of an SFZ instrument.
+
+    Only the mapping is read: the <control>, <global>, <group> and <region>
+    headers, and the opcodes default_path, sample, key, lokey, hikey,
+    pitch_keycenter, lovel, hivel, seq_length, seq_position and output, which
+    picks the output bus as it does in ARIA. Everything else is ignored.
+    Regions with a seq_length above 1 become a round-robin group per <group>
+    header.
+
+    Returns false if the file couldn't be read or has no playable regions.
+*/
+bool readSfzZones (const juce::File& sfzFile, std::vector<ZoneSource>& zones);
@@ -0,0 +1,638 @@
+/*
+  ==============================================================================
+
+    StreamingSampler.cpp
+    Sampler sound and voice that stream their samples from disk.
+
+  ==============================================================================
+*/
+
+#include "StreamingSampler.h"
+#include "VoiceKernels.h"
+
+namespace
+{
+    // how many samples the disk thread reads in one go
+    constexpr int diskReadChunkSize = 4096;
+
+    // how far ahead of a voice the disk thread pages in a mapped file
+    constexpr int mappedPrefetchLength = 65536;
+
+    // the most output samples the voice kernels are run on in one go, and the
+    // number of source frames a voice gathers for them
+    constexpr int kernelBlockSize = 256;
+    constexpr int sourceScratchSize = 1024;
+
+    static_assert (kernelBlockSize <= VoiceLanes::maxBlockSize, "the lanes work on a kernel block at a time");
+    static_assert (SampleData::maxChannels <= VoiceLanes::maxChannels, "the lanes filter every channel of a sound");
+
+    // how long a stolen voice takes to fade out
+    constexpr double stealFadeSeconds = 0.005;
+
+    // a voice whose envelope and velocity take it below this (-100 dB) on the way down is ended
+    constexpr float silenceLevel = 1.0e-5f;
+}
+
+//==============================================================================
+DiskStreamer::DiskStreamer()
+    : juce::TimeSliceThread ("Sample Disk Streamer")
+{
+    startThread (7);
+}
+
+DiskStreamer::~DiskStreamer()
+{
+    stopThread (2000);
+}
+
+//==============================================================================
+StreamingSamplerSound::StreamingSamplerSound (const juce::String& soundName,
+                                              SampleData::Ptr data,
+                                              const juce::BigInteger& notes,
+                                              int midiNoteForNormalPitch)
+    : mName (soundName),
+      mData (std::move (data)),
+      mMidiNotes (notes),
+      mMidiRootNote (midiNoteForNormalPitch)
+{
+    jassert (mData != nullptr);
+}
+
+StreamingSamplerSound::~StreamingSamplerSound()
+{
+}
+
+bool StreamingSamplerSound::appliesToNote (int midiNoteNumber)
+{
+    return mMidiNotes[midiNoteNumber];
+}
+
+bool StreamingSamplerSound::appliesToChannel (int /*midiChannel*/)
+{
+    return true;
+}
+
+//==============================================================================
+StreamingSamplerVoice::StreamingSamplerVoice (DiskStreamer& streamer, std::atomic<int>& underrunCounter)
+    : mStreamer (streamer), mUnderruns (underrunCounter),
+      mSourceScratch (SampleData::maxChannels, sourceScratchSize),
+      mKernelScratch (2 + SampleData::maxChannels, kernelBlockSize),
+      mIndexScratch ((size_t) kernelBlockSize)
+{
+}
+
+StreamingSamplerVoice::~StreamingSamplerVoice()
+{
+    mStreamer.removeTimeSliceClient (this);
+}
+
+void StreamingSamplerVoice::prepareToStream (int numChannels, int ringBufferLength)
+{
+    const auto ringSize = numChannels * ringBufferLength;
+
+    if (mRingSize == ringSize)
+        return;
+
+    jassert (! isVoiceActive());
+
+    {
+        const juce::ScopedLock sl (mStreamer.getStreamLock());
+        mRing.allocate ((size_t) ringSize, true);
+        mRingSize = ringSize;
+    }
+
+    // voices only take up the disk thread's time once they can be played
+    mStreamer.addTimeSliceClient (this);
+}
+
+bool StreamingSamplerVoice::canPlaySound (juce::SynthesiserSound* sound)
+{
+    return dynamic_cast<const StreamingSamplerSound*> (sound) != nullptr;
+}
+
+void StreamingSamplerVoice::startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound* s, int /*pitchWheel*/)
+{
+    if (auto* sound = dynamic_cast<StreamingSamplerSound*> (s))
+    {
+        mPitchRatio = std::pow (2.0, (midiNoteNumber - sound->getMidiRootNote()) / 12.0)
+                        * sound->getSourceSampleRate() / getSampleRate();
+
+        // every octave up halves the rate of the copy the note reads from
+        mMipLevel = nullptr;
+
+        if (auto* mipMap = sound->getData().getMipMap())
+        {
+            for (int level = 1; level <= mipMap->getNumLevels() && mPitchRatio >= 2.0; ++level)
+            {
+                mMipLevel = &mipMap->getLevel (level);
+                mPitchRatio *= 0.5;
+            }
+        }
+
+        mSourceSamplePosition = 0.0;
+        mGain = velocity;
+        mDownmixLayout = nullptr;
+        mEnvelopeLevel = 0.0f;
+        mIsBeingStolen = false;
+
+        jassert (mLanes != nullptr); // the synth has to attach the voice to its lanes
+        mLanes->noteOn (mLaneIndex, midiNoteNumber);
+
+        startStreaming (*sound);
+    }
+    else
+    {
+        jassertfalse; // this object can only play StreamingSamplerSounds!
+    }
+}
+
+void StreamingSamplerVoice::stopNote (float /*velocity*/, bool allowTailOff)
+{
+    if (allowTailOff)
+    {
+        mLanes->noteOff (mLaneIndex);
+    }
+    else
+    {
+        stopStreaming();
+        clearCurrentNote();
+        mLanes->reset (mLaneIndex);
+        mIsBeingStolen = false;
+        mCurrentLevel = 0.0f;
+    }
+}
+
+void StreamingSamplerVoice::startFastRelease() noexcept
+{
+    if (! isVoiceActive() || isBeingStolen())
+        return;
+
+    mLanes->fadeOut (mLaneIndex, juce::roundToInt (getSampleRate() * stealFadeSeconds));
+    mIsBeingStolen = true;
+}
+
+void StreamingSamplerVoice::pitchWheelMoved (int /*newValue*/) {}
+void StreamingSamplerVoice::controllerMoved (int /*controllerNumber*/, int /*newValue*/) {}
+
+//==============================================================================
+void StreamingSamplerVoice::startStreaming (StreamingSamplerSound& sound)
+{
+    // the head comes from memory, so the ring picks up where the preload ends
+    mReadPosition.store (sound.getPreloadLength(), std::memory_order_relaxed);
+    mAvailableEnd = sound.getPreloadLength();
+
+    auto canStream = sound.isMemoryMapped() || isPreparedToStream();
+    auto needsStreaming = sound.needsStreaming() && mMipLevel == nullptr;
+
+    mStreamSound.store (needsStreaming && canStream ? &sound : nullptr,
+                        std::memory_order_release);
+    mRequestedGeneration.fetch_add (1, std::memory_order_release);
+}
+
+void StreamingSamplerVoice::stopStreaming()
+{
+    mStreamSound.store (nullptr, std::memory_order_release);
+    mRequestedGeneration.fetch_add (1, std::memory_order_release);
+}
+
+bool StreamingSamplerVoice::readSourceRange (const StreamingSamplerSound& sound, juce::int64 start, int numFrames,
+                                             float* const* dest) const noexcept
+{
+    const auto length = mMipLevel != nullptr ? (juce::int64) mMipLevel->getNumSamples() : sound.getLengthInSamples();
+    const auto numChannels = sound.getNumChannels();
+    int done = 0;
+
+    auto clearFrom = [&] (int index, int num)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::clear (dest[channel] + index, num);
+    };
+
+    // the wider interpolators read a few frames before the start of the sound
+    if (start < 0)
+    {
+        const auto numBefore = (int) juce::jmin ((juce::int64) numFrames, -start);
+        clearFrom (0, numBefore);
+        done = numBefore;
+        start += numBefore;
+    }
+
+    // from here on, frame start + i goes to dest[channel][offset + i]
+    const auto offset = done;
+    const auto numInSound = (int) juce::jlimit ((juce::int64) 0, (juce::int64) (numFrames - offset), length - start);
+    done = 0;
+
+    if (mMipLevel != nullptr)
+    {
+        for (int channel = 0; channel < numChannels && numInSound > 0; ++channel)
+            juce::FloatVectorOperations::copy (dest[channel] + offset, mMipLevel->getReadPointer (channel, (int) start), numInSound);
+
+        done = numInSound;
+    }
+    else if (sound.isMemoryMapped())
+    {
+        float frame[SampleData::maxChannels];
+
+        for (; done < numInSound; ++done)
+        {
+            sound.getMappedFrame (start + done, frame);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                dest[channel][offset + done] = frame[channel];
+        }
+    }
+    else
+    {
+        // the head comes from the preload buffer...
+        const auto& preload = sound.getPreloadBuffer();
+        const auto numFromPreload = (int) juce::jlimit ((juce::int64) 0, (juce::int64) numInSound,
+                                                        sound.getPreloadLength() - start);
+
+        for (int channel = 0; channel < numChannels && numFromPreload > 0; ++channel)
+            juce::FloatVectorOperations::copy (dest[channel] + offset, preload.getReadPointer (channel, (int) start), numFromPreload);
+
+        done = juce::jmax (0, numFromPreload);
+
+        // ...and the rest from whatever the disk thread has put in the ring so far
+        const auto capacity = getRingCapacity (numChannels);
+        const auto ringEnd = juce::jmin (start + numInSound, mAvailableEnd);
+
+        while (capacity > 0 && start + done < ringEnd)
+        {
+            const auto ringIndex = (int) ((start + done) % capacity);
+            const auto num = (int) juce::jmin ((juce::int64) (capacity - ringIndex), ringEnd - (start + done));
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                juce::FloatVectorOperations::copy (dest[channel] + offset + done, mRing + channel * capacity + ringIndex, num);
+
+            done += num;
+        }
+    }
+
+    // silence past the end of the sound, and for anything the disk thread hasn't got to yet
+    if (offset + done < numFrames)
+        clearFrom (offset + done, numFrames - offset - done);
+
+    // the whole of a mip-map level is in memory, so there's never anything to wait for
+    return mMipLevel == nullptr && start + numInSound > mAvailableEnd;
+}
+
+void StreamingSamplerVoice::renderNextBlock (juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+{
+    // on its own, the voice is the only lane of its group that's rendered
+    StreamingSamplerVoice* group[VoiceLanes::numLanes] = {};
+    group[mLaneIndex % VoiceLanes::numLanes] = this;
+
+    renderLanes (group, outputBuffer, startSample, numSamples);
+}
+
+void StreamingSamplerVoice::renderLanes (StreamingSamplerVoice* const* voices, juce::AudioBuffer<float>& outputBuffer,
+                                         int startSample, int numSamples)
+{
+    constexpr auto numLanes = VoiceLanes::numLanes;
+
+    VoiceLanes* lanes = nullptr;
+    int group = 0;
+    juce::uint32 laneMask = 0;
+
+    // what the lanes work on: each voice's envelope, and its interpolated channels
+    float* envelopes[numLanes] = {};
+    float* const* channels[numLanes] = {};
+    int numChannels[numLanes] = {};
+
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        auto* voice = voices[lane];
+
+        if (voice == nullptr || voice->getCurrentlyPlayingSound() == nullptr)
+            continue;
+
+        jassert (voice->mLanes != nullptr && voice->mLaneIndex % numLanes == lane);
+        jassert (lanes == nullptr || (voice->mLanes == lanes && voice->mLaneIndex / numLanes == group));
+
+        lanes = voice->mLanes;
+        group = voice->mLaneIndex / numLanes;
+        laneMask |= 1u << lane;
+
+        envelopes[lane] = voice->mKernelScratch.getWritePointer (1);
+        channels[lane] = voice->mKernelScratch.getArrayOfWritePointers() + 2;
+        numChannels[lane] = static_cast<StreamingSamplerSound*> (voice->getCurrentlyPlayingSound().get())->getNumChannels();
+
+        voice->updateAvailableEnd();
+    }
+
+    const auto playingLanes = laneMask;
+
+    // a kernel block at a time, so whatever the lanes work on fits in the voices' scratch buffers
+    for (int done = 0; done < numSamples && laneMask != 0;)
+    {
+        const auto num = juce::jmin (numSamples - done, kernelBlockSize);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+            if ((laneMask & (1u << lane)) != 0)
+                voices[lane]->renderSource (num);
+
+        lanes->processEnvelopes (group, laneMask, envelopes, num);
+        lanes->processFilters (group, laneMask, channels, numChannels, num);
+
+        // voices that end are left out of the rest of the block
+        for (int lane = 0; lane < numLanes; ++lane)
+            if ((laneMask & (1u << lane)) != 0 && ! voices[lane]->mixToOutputs (outputBuffer, startSample + done, num))
+                laneMask &= ~(1u << lane);
+
+        done += num;
+    }
+
+    for (int lane = 0; lane < numLanes; ++lane)
+        if ((playingLanes & (1u << lane)) != 0)
+            voices[lane]->finishRendering();
+}
+
+void StreamingSamplerVoice::updateAvailableEnd() noexcept
+{
+    const auto generation = mRequestedGeneration.load (std::memory_order_relaxed);
+
+    // work out how much of the stream is readable for this block, without waiting for it
+    if (mStreamSound.load (std::memory_order_relaxed) != nullptr
+         && mReadyGeneration.load (std::memory_order_acquire) == generation)
+        mAvailableEnd = mWritePosition.load (std::memory_order_acquire);
+
+    mSourceEnded = false;
+    mHitUnderrun = false;
+}
+
+void StreamingSamplerVoice::renderSource (int numSamples) noexcept
+{
+    auto* playingSound = static_cast<StreamingSamplerSound*> (getCurrentlyPlayingSound().get());
+    const auto length = mMipLevel != nullptr ? (juce::int64) mMipLevel->getNumSamples() : playingSound->getLengthInSamples();
+
+    // fall back to linear if the sinc tables haven't been built
+    auto quality = mQuality;
+    auto* sincTable = mInterpolationTables->getSincTable (quality, mPitchRatio);
+
+    if (getNumSincTaps (quality) > 0 && sincTable == nullptr)
+        quality = InterpolationQuality::linear;
+
+    // at the root note of a sample at the host's rate every read lands on a frame,
+    // so the source frames are played as they are, with nothing either side of them
+    const auto playsFrames = mPitchRatio == 1.0;
+    const auto footprint = playsFrames ? InterpolationFootprint { 0, 0 } : getInterpolationFootprint (quality);
+
+    // every channel is read and interpolated into a scratch channel of its own
+    const auto numChannels = playingSound->getNumChannels();
+    float* sources[SampleData::maxChannels];
+    float* interpolated[SampleData::maxChannels];
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        sources[channel] = mSourceScratch.getWritePointer (channel);
+        interpolated[channel] = mKernelScratch.getWritePointer (2 + channel);
+    }
+
+    auto* index = mIndexScratch.get();
+    auto* alpha = mKernelScratch.getWritePointer (0);
+
+    // each pass has to fit the source frames it reads into the source scratch
+    const auto maxPerPass = (int) juce::jlimit (1.0, (double) kernelBlockSize,
+                                                (sourceScratchSize - footprint.framesBefore - footprint.framesAfter - 2)
+                                                  / mPitchRatio + 1.0);
+
+    int done = 0;
+
+    while (done < numSamples && ! mSourceEnded)
+    {
+        auto numThisPass = juce::jmin (numSamples - done, maxPerPass);
+        const auto spanStart = (juce::int64) mSourceSamplePosition;
+        const auto startFraction = mSourceSamplePosition - (double) spanStart;
+
+        // the sound runs out after the sample that takes it past the end
+        const auto samplesToEnd = (juce::int64) (((double) length - mSourceSamplePosition) / mPitchRatio) + 1;
+
+        if (samplesToEnd <= numThisPass)
+        {
+            numThisPass = (int) juce::jmax ((juce::int64) 1, samplesToEnd);
+            mSourceEnded = true;
+        }
+
+        float* dest[SampleData::maxChannels];
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            dest[channel] = interpolated[channel] + done;
+
+        if (playsFrames)
+        {
+            jassert (startFraction == 0.0);
+            mSourceSamplePosition += numThisPass;
+
+            if (readSourceRange (*playingSound, spanStart, numThisPass, dest))
+                mHitUnderrun = true;
+        }
+        else
+        {
+            VoiceKernels::computeReadPositions (startFraction, mPitchRatio, index, alpha, numThisPass);
+            mSourceSamplePosition += numThisPass * mPitchRatio;
+
+            const auto spanLength = footprint.framesBefore + index[numThisPass - 1] + footprint.framesAfter + 1;
+            jassert (spanLength <= sourceScratchSize);
+
+            if (readSourceRange (*playingSound, spanStart - footprint.framesBefore, spanLength, sources))
+                mHitUnderrun = true;
+
+            // the indices are relative to the frame after the ones read for the interpolator's history
+            for (int channel = 0; channel < numChannels; ++channel)
+                interpolate (quality, sincTable, sources[channel] + footprint.framesBefore, index, alpha,
+                             dest[channel], numThisPass);
+        }
+
+        done += numThisPass;
+    }
+
+    // once the sound has run out, the rest of the block is silent
+    if (done < numSamples)
+        for (int channel = 0; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::clear (interpolated[channel] + done, numSamples - done);
+}
+
+bool StreamingSamplerVoice::mixToOutputs (juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+{
+    auto* playingSound = static_cast<StreamingSamplerSound*> (getCurrentlyPlayingSound().get());
+
+    // the channels of the bus the voice plays through
+    auto firstOutput = mFirstOutputChannel;
+    auto numOutputs = juce::jmin (mNumOutputChannels, outputBuffer.getNumChannels() - firstOutput, SampleData::maxChannels);
+    const auto* outputLayout = &mOutputLayout;
+
+    if (firstOutput < 0 || numOutputs < mNumOutputChannels)
+    {
+        firstOutput = 0;
+        numOutputs = juce::jmin (2, outputBuffer.getNumChannels());
+        outputLayout = &Downmix::getStereoLayout();
+    }
+
+    float* outputs[SampleData::maxChannels];
+
+    for (int channel = 0; channel < numOutputs; ++channel)
+        outputs[channel] = outputBuffer.getWritePointer (firstOutput + channel, startSample);
+
+    const auto numChannels = playingSound->getNumChannels();
+    const float* channels[SampleData::maxChannels];
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        channels[channel] = mKernelScratch.getReadPointer (2 + channel);
+
+    if (mDownmixLayout != outputLayout || mDownmixNumOutputs != numOutputs)
+    {
+        Downmix::computeMatrix (playingSound->getData().getChannelLayout(), numChannels,
+                                *outputLayout, numOutputs, mDownmix);
+        mDownmixLayout = outputLayout;
+        mDownmixNumOutputs = numOutputs;
+    }
+
+    const auto* envelope = mKernelScratch.getReadPointer (1);
+    addToOutputs (outputs, numOutputs, channels, numChannels, mDownmix, envelope, numSamples);
+
+    // the voice stops once its sound has run out, its envelope or fade has finished, or it
+    // has fallen out of hearing on the way down; past the attack the envelope never rises
+    // again, so a note held on a sustain of 0 ends too
+    const auto level = envelope[numSamples - 1];
+    const auto isFalling = level <= mEnvelopeLevel;
+
+    mEnvelopeLevel = level;
+    mCurrentLevel = level * mGain;
+
+    if (mSourceEnded || mLanes->hasFinished (mLaneIndex) || (isFalling && mCurrentLevel < silenceLevel))
+    {
+        stopNote (0.0f, false);
+        return false;
+    }
+
+    return true;
+}
+
+void StreamingSamplerVoice::finishRendering() noexcept
+{
+    // keep the frames the interpolators look back at from being overwritten in the ring
+    if (isVoiceActive())
+        mReadPosition.store ((juce::int64) mSourceSamplePosition - InterpolationTables::maxTaps / 2,
+                             std::memory_order_release);
+
+    if (mHitUnderrun)
+        mUnderruns.fetch_add (1, std::memory_order_relaxed);
+}
+
+void StreamingSamplerVoice::addToOutputs (float* const* outputs, int numOutputs, const float* const* channels,
+                                          int numChannels, const Downmix::Matrix& downmix, const float* envelope,
+                                          int numSamples) const noexcept
+{
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        for (int output = 0; output < numOutputs; ++output)
+        {
+            const auto gain = downmix.gains[channel][output];
+
+            if (gain != 0.0f)
+                VoiceKernels::addChannel (outputs[output], channels[channel], envelope, mGain * gain, numSamples);
+        }
+    }
+}
+
+void StreamingSamplerVoice::interpolate (InterpolationQuality quality, const float* sincTable, const float* source,
+                                         const int* index, const float* alpha, float* dest, int numSamples) noexcept
+{
+    switch (quality)
+    {
+        case InterpolationQuality::hermite:
+            VoiceKernels::interpolateHermite (source, index, alpha, dest, numSamples);
+            break;
+
+        case InterpolationQuality::sinc8:
+        case InterpolationQuality::sinc16:
+        case InterpolationQuality::sinc32:
+            VoiceKernels::interpolateSinc (source, index, alpha, dest, numSamples, sincTable, getNumSincTaps (quality));
+            break;
+
+        case InterpolationQuality::linear:
+        default:
+            VoiceKernels::interpolateLinear (source, index, alpha, dest, numSamples);
+            break;
+    }
+}
+
+//==============================================================================
+int StreamingSamplerVoice::useTimeSlice()
+{
+    const juce::ScopedLock sl (mStreamer.getStreamLock());
+
+    const auto generation = mRequestedGeneration.load (std::memory_order_acquire);
+    auto* sound = mStreamSound.load (std::memory_order_acquire);
+
+    if (sound == nullptr)
+        return 20;
+
+    if (generation != mFilledGeneration)
+    {
+        // a new note has started: restart from the end of the preloaded head
+        mFilledGeneration = generation;
+        mWritePosition.store (sound->getPreloadLength(), std::memory_order_relaxed);
+        mReadyGeneration.store (generation, std::memory_order_release);
+    }
+
+    return sound->isMemoryMapped() ? prefetchMappedSound (*sound)
+                                   : fillRingBuffer (*sound);
+}
+
+int StreamingSamplerVoice::prefetchMappedSound (const StreamingSamplerSound& sound)
+{
+    // for a mapped sound the write position marks how far ahead the pages have been touched
+    const auto prefetchedEnd = mWritePosition.load (std::memory_order_relaxed);
+    const auto readPos = juce::jmax ((juce::int64) sound.getPreloadLength(),
+                                     mReadPosition.load (std::memory_order_acquire));
+
+    const auto target = juce::jmin (sound.getLengthInSamples(), readPos + mappedPrefetchLength);
+    const auto start = juce::jmax (prefetchedEnd, readPos);
+
+    if (start >= target)
+        return 5;
+
+    sound.prefetch (start, target);
+    mWritePosition.store (target, std::memory_order_release);
+
+    return 1;
+}
+
+int StreamingSamplerVoice::fillRingBuffer (StreamingSamplerSound& sound)
+{
+    const auto numChannels = sound.getNumChannels();
+    const auto capacity = (juce::int64) getRingCapacity (numChannels);
+
+    auto writePos = mWritePosition.load (std::memory_order_relaxed);
+    const auto readPos = juce::jmax ((juce::int64) sound.getPreloadLength(),
+                                     mReadPosition.load (std::memory_order_acquire));
+
+    const auto freeSpace = capacity - (writePos - readPos);
+    const auto numToRead = (int) juce::jmin (freeSpace, (juce::int64) diskReadChunkSize,
+                                             sound.getLengthInSamples() - writePos);
+
+    if (numToRead <= 0)
+        return freeSpace <= 0 ? 2 : 20;
+
+    // the chunk may wrap around the end of the ring
+    const auto ringStart = (int) (writePos % capacity);
+    const auto firstPart = juce::jmin (numToRead, (int) capacity - ringStart);
+
+    // refers to the ring's channels without allocating anything
+    float* channels[SampleData::maxChannels];
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        channels[channel] = mRing + channel * capacity;
+
+    juce::AudioBuffer<float> ring (channels, numChannels, (int) capacity);
+    sound.readFromDisk (ring, ringStart, writePos, firstPart);
+
+    if (firstPart < numToRead)
+        sound.readFromDisk (ring, 0, writePos + firstPart, numToRead - firstPart);
+
+    mWritePosition.store (writePos + numToRead, std::memory_order_release);
+
+    return 0;
+}
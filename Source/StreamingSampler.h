@@ -0,0 +1,296 @@
+/*
+  ==============================================================================
+
+    StreamingSampler.h
+    Sampler sound and voice that stream their samples from disk.
+
+    Only the first few seconds of every sample (the preload head) are kept in
+    memory. While a note plays past the head, a background disk thread keeps a
+    small per-voice ring buffer filled ahead of the voice's read position, so
+    the audio thread never has to wait for I/O.
+
+    Uncompressed files can instead be memory-mapped. Voices then read straight
+    from the mapping, and the disk thread's job is just to touch the pages ahead
+    of each voice so the audio thread doesn't take the page faults.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Downmix.h"
+#include "SamplePool.h"
+#include "Interpolation.h"
+#include "VoiceLanes.h"
+
+//==============================================================================
+/**
+    One disk thread shared by every sampler instance in the process.
+
+    Voices register themselves as TimeSliceClients and are asked to top up their
+    ring buffers whenever the thread comes round to them. The stream lock is held
+    for the whole of each time slice, so code on the message thread can take it to
+    be sure the disk thread isn't touching a sound it is about to release.
+*/
+class DiskStreamer  : public juce::TimeSliceThread
+{
+public:
+    DiskStreamer();
+    ~DiskStreamer() override;
+
+    const juce::CriticalSection& getStreamLock() const noexcept   { return mStreamLock; }
+
+private:
+    juce::CriticalSection mStreamLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DiskStreamer)
+};
+
+//==============================================================================
+/**
+    A sampler sound that plays a SampleData from the process-wide pool.
+
+    Only the preloaded head of the sample is in memory. The rest is read on demand
+    by the disk thread through the data's reader, or, if the data is memory-mapped,
+    straight from the mapping. Several sounds, in several instances, can share the
+    same data; what is per-sound is the key range, root note and output bus.
+*/
+class StreamingSamplerSound  : public juce::SynthesiserSound
+{
+public:
+    StreamingSamplerSound (const juce::String& name,
+                           SampleData::Ptr data,
+                           const juce::BigInteger& midiNotes,
+                           int midiNoteForNormalPitch);
+
+    ~StreamingSamplerSound() override;
+
+    //==============================================================================
+    const juce::String& getName() const noexcept                    { return mName; }
+    SampleData& getData() const noexcept                            { return *mData; }
+
+    bool appliesToNote (int midiNoteNumber) override;
+    bool appliesToChannel (int midiChannel) override;
+
+    //==============================================================================
+    int getNumChannels() const noexcept                             { return mData->getNumChannels(); }
+    juce::int64 getLengthInSamples() const noexcept                 { return mData->getLengthInSamples(); }
+    double getSourceSampleRate() const noexcept                     { return mData->getSampleRate(); }
+    int getMidiRootNote() const noexcept                            { return mMidiRootNote; }
+
+    /** The output bus the sound plays through, 0 being the main one. Set it before
+        the sound is handed to the synth.
+    */
+    void setOutputBus (int newOutputBus) noexcept                   { mOutputBus = newOutputBus; }
+    int getOutputBus() const noexcept                               { return mOutputBus; }
+
+    const juce::AudioBuffer<float>& getPreloadBuffer() const noexcept { return mData->getPreloadBuffer(); }
+    int getPreloadLength() const noexcept                           { return mData->getPreloadLength(); }
+
+    /** True if the sample is longer than its preloaded head. */
+    bool needsStreaming() const noexcept                            { return getLengthInSamples() > getPreloadLength(); }
+
+    /** Reads a section of the sample from disk. Disk thread only. */
+    void readFromDisk (juce::AudioBuffer<float>& dest, int destStartSample,
+                       juce::int64 sourceStartSample, int numSamples)
+    {
+        mData->readFromDisk (dest, destStartSample, sourceStartSample, numSamples);
+    }
+
+    bool isMemoryMapped() const noexcept                            { return mData->isMemoryMapped(); }
+    void getMappedFrame (juce::int64 index, float* frame) const noexcept { mData->getMappedFrame (index, frame); }
+    void prefetch (juce::int64 start, juce::int64 end) const noexcept    { mData->prefetch (start, end); }
+
+private:
+    juce::String mName;
+    SampleData::Ptr mData;
+    juce::BigInteger mMidiNotes;
+    int mMidiRootNote = 0;
+    int mOutputBus = 0;
+
+    JUCE_LEAK_DETECTOR (StreamingSamplerSound)
+};
+
+//==============================================================================
+/**
+    A voice that plays a StreamingSamplerSound.
+
+    Blocks are rendered in passes: the voice gathers the source frames a pass
+    needs into a contiguous scratch buffer, then hands the interpolation and
+    mixing to the SIMD kernels in VoiceKernels.
+
+    The envelope and filter live in a lane of a VoiceLanes, which works out a
+    whole group of voices' at once. renderLanes() renders the playing voices of
+    a group together: each voice interpolates its sound, the group's envelopes
+    and filters are run across all of them, then each voice mixes itself in.
+
+    The first getPreloadLength() samples come straight from the sound's head.
+    Everything after that is read from a ring buffer that the disk thread fills.
+    If the ring buffer hasn't caught up, the voice plays silence for the missing
+    samples and bumps the underrun counter it was given; it never waits.
+
+    For mapped sounds the voice reads the mapping directly, and the disk thread
+    prefetches ahead of it. Running past the prefetched region still plays the
+    right samples but counts as an underrun, as it may have stalled on a fault.
+
+    Notes an octave or more above the root read the level of the sample's mip-map
+    that brings their step through it back under two frames, if the mip-map was
+    ready when they started. Mip-map levels are all in memory, so those notes
+    don't stream.
+
+    Every channel of the sound is played. Each is interpolated on its own and
+    added to the bus channel for the same speaker; a mono sound plays on the
+    first two, and a sound with speakers the bus doesn't have is mixed down onto
+    it as Downmix::computeMatrix() describes.
+*/
+class StreamingSamplerVoice  : public juce::SynthesiserVoice,
+                               private juce::TimeSliceClient
+{
+public:
+    StreamingSamplerVoice (DiskStreamer& streamer, std::atomic<int>& underrunCounter);
+    ~StreamingSamplerVoice() override;
+
+    /** Gives the voice its lane, voiceIndex % VoiceLanes::numLanes of group voiceIndex
+        / VoiceLanes::numLanes. The synth does this when the voice is added; the voice
+        can't play until it has been done.
+    */
+    void attachToLanes (VoiceLanes& lanes, int voiceIndex) noexcept     { mLanes = &lanes; mLaneIndex = voiceIndex; }
+
+    /** Allocates the ring buffer and registers the voice with the disk thread. Call
+        this while the voice isn't playing; it does nothing if the ring is already
+        the right size.
+
+        The ring holds numChannels * ringBufferLength floats whatever the sound, so
+        sounds with fewer channels get to read further ahead, and ones with more
+        don't read as far. That is the bulk of a voice's memory: 4 bytes a sample,
+        so 94 KB for a quarter of a second of stereo at 48 kHz.
+    */
+    void prepareToStream (int numChannels, int ringBufferLength);
+    bool isPreparedToStream() const noexcept                        { return mRingSize > 0; }
+
+    /** Sets the channels of the synth's output buffer the voice plays through: a
+        bus's worth, starting at firstChannel, with the speakers in layout. If they
+        aren't all there, the voice plays through the first two channels instead, as
+        a stereo pair. The synth sets this before starting a note; call it from the
+        audio thread.
+    */
+    void setOutputChannels (int firstChannel, int numChannels, const Downmix::Layout& layout) noexcept
+    {
+        mFirstOutputChannel = firstChannel;
+        mNumOutputChannels = numChannels;
+        mOutputLayout = layout;
+        mDownmixLayout = nullptr;
+    }
+
+    //==============================================================================
+    bool canPlaySound (juce::SynthesiserSound*) override;
+
+    void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int pitchWheel) override;
+    void stopNote (float velocity, bool allowTailOff) override;
+
+    /** Fades the note out over a few milliseconds and then ends it. Used when the
+        voice is stolen, so the note it was playing doesn't click.
+    */
+    void startFastRelease() noexcept;
+    bool isBeingStolen() const noexcept                             { return mIsBeingStolen; }
+
+    /** Roughly how loud the voice was at the end of the last block it rendered. */
+    float getCurrentLevel() const noexcept                          { return mCurrentLevel; }
+
+    /** Changes the envelope, including that of a note that is already playing. The
+        synth sets this before starting a note; call it from the audio thread.
+    */
+    void setEnvelopeParameters (const juce::ADSR::Parameters& newParameters) noexcept   { mLanes->setEnvelopeParameters (mLaneIndex, newParameters); }
+
+    /** Changes the filter, including that of a note that is already playing. The synth
+        sets this before starting a note; call it from the audio thread.
+    */
+    void setFilterParameters (const VoiceFilterParameters& newParameters) noexcept      { mLanes->setFilterParameters (mLaneIndex, newParameters); }
+
+    void pitchWheelMoved (int newValue) override;
+    void controllerMoved (int controllerNumber, int newValue) override;
+
+    void renderNextBlock (juce::AudioBuffer<float>&, int startSample, int numSamples) override;
+    using juce::SynthesiserVoice::renderNextBlock;
+
+    /** Renders the voices of one group of a VoiceLanes together, adding them to the
+        buffer. voices holds one entry per lane of the group, nullptr for the lanes
+        to leave out; the ones that are there must all be attached to the same group.
+    */
+    static void renderLanes (StreamingSamplerVoice* const* voices, juce::AudioBuffer<float>&,
+                             int startSample, int numSamples);
+
+    /** Sets how the voice interpolates between source frames. Takes effect from the
+        next block; call it from the audio thread, or while the voice isn't rendering.
+    */
+    void setInterpolationQuality (InterpolationQuality newQuality) noexcept  { mQuality = newQuality; }
+    InterpolationQuality getInterpolationQuality() const noexcept           { return mQuality; }
+
+private:
+    //==============================================================================
+    int useTimeSlice() override;
+
+    void startStreaming (StreamingSamplerSound&);
+    void stopStreaming();
+    int getRingCapacity (int numChannels) const noexcept          { return mRingSize / juce::jmax (1, numChannels); }
+    bool readSourceRange (const StreamingSamplerSound&, juce::int64 start, int numFrames,
+                          float* const* dest) const noexcept;
+    void updateAvailableEnd() noexcept;
+    void renderSource (int numSamples) noexcept;
+    bool mixToOutputs (juce::AudioBuffer<float>&, int startSample, int numSamples);
+    void finishRendering() noexcept;
+    void addToOutputs (float* const* outputs, int numOutputs, const float* const* channels, int numChannels,
+                       const Downmix::Matrix&, const float* envelope, int numSamples) const noexcept;
+    static void interpolate (InterpolationQuality, const float* sincTable, const float* source,
+                             const int* index, const float* alpha, float* dest, int numSamples) noexcept;
+    int prefetchMappedSound (const StreamingSamplerSound&);
+    int fillRingBuffer (StreamingSamplerSound&);
+
+    //==============================================================================
+    DiskStreamer& mStreamer;
+    std::atomic<int>& mUnderruns;
+
+    double mPitchRatio = 0;                 // relative to the mip-map level, if there is one
+    double mSourceSamplePosition = 0;
+    const juce::AudioBuffer<float>* mMipLevel = nullptr;    // or nullptr to read the sound itself
+    float mGain = 0;
+    int mFirstOutputChannel = 0, mNumOutputChannels = 2;
+    Downmix::Layout mOutputLayout = Downmix::getStereoLayout();
+
+    // how the sound's channels go onto the outputs, worked out again whenever the
+    // sound, or the layout or number of outputs it plays through, changes
+    Downmix::Matrix mDownmix;
+    const Downmix::Layout* mDownmixLayout = nullptr;
+    int mDownmixNumOutputs = 0;
+
+    VoiceLanes* mLanes = nullptr;           // where the envelope and filter are
+    int mLaneIndex = 0;
+    float mEnvelopeLevel = 0;               // the envelope's last sample
+    float mCurrentLevel = 0;
+    bool mIsBeingStolen = false;            // fading out after the voice has been stolen
+
+    // the sound ran out during the block, or some of it wasn't there in time
+    bool mSourceEnded = false, mHitUnderrun = false;
+
+    InterpolationQuality mQuality = InterpolationQuality::linear;
+    juce::SharedResourcePointer<InterpolationTables> mInterpolationTables;
+
+    // per-block inputs for the voice kernels: the source frames a block reads, each
+    // output sample's frame index, interpolation fraction and envelope level, and
+    // the interpolated channels, which the voice's filter works on in place
+    juce::AudioBuffer<float> mSourceScratch, mKernelScratch;
+    juce::HeapBlock<int> mIndexScratch;
+
+    // ring buffer shared with the disk thread, split into one run of getRingCapacity()
+    // samples per channel of the sound; sample n of the source lives at n % capacity
+    juce::HeapBlock<float> mRing;
+    int mRingSize = 0;
+    std::atomic<StreamingSamplerSound*> mStreamSound { nullptr };
+    std::atomic<juce::uint32> mRequestedGeneration { 0 }, mReadyGeneration { 0 };
+    std::atomic<juce::int64> mWritePosition { 0 }, mReadPosition { 0 };
+    juce::int64 mAvailableEnd = 0;          // audio thread: end of readable (or prefetched) data for this block
+    juce::uint32 mFilledGeneration = 0;     // disk thread: generation the ring currently holds
+
+    JUCE_LEAK_DETECTOR (StreamingSamplerVoice)
+};
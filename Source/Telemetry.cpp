@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    Telemetry.cpp
+    What the audio thread did in each block, for the editor's meter and for
+    working out what went wrong after a dropout.
+
+  ==============================================================================
+*/
+
+#include "Telemetry.h"
+
+static_assert ((TelemetryRing::capacity & (TelemetryRing::capacity - 1)) == 0, "the capacity must be a power of two");
+
+//==============================================================================
+TelemetryRing::TelemetryRing()
+    : mRecords ((size_t) capacity)
+{
+}
+
+void TelemetryRing::push (const BlockTelemetry& record) noexcept
+{
+    // only this thread writes the count, so it can be read back without ordering
+    const auto position = mNumWritten.load (std::memory_order_relaxed);
+    mRecords[(size_t) (position & (capacity - 1))] = record;
+
+    if (record.isOverrun())
+        mNumOverruns.fetch_add (1, std::memory_order_relaxed);
+
+    mNumWritten.store (position + 1, std::memory_order_release);
+}
+
+int TelemetryRing::read (juce::uint64& readPosition, BlockTelemetry* dest, int maxRecords, int* numMissed) const noexcept
+{
+    // the writer may already be overwriting the slot of record written - capacity with
+    // the next one, so only the capacity - 1 records after it can be relied on
+    auto getOldestIntact = [] (juce::uint64 numWritten)
+    {
+        return numWritten >= (juce::uint64) capacity ? numWritten - (juce::uint64) capacity + 1 : 0;
+    };
+
+    const auto written = mNumWritten.load (std::memory_order_acquire);
+    const auto oldest = getOldestIntact (written);
+
+    if (numMissed != nullptr)
+        *numMissed = (int) juce::jmin ((juce::uint64) std::numeric_limits<int>::max(),
+                                       oldest > readPosition ? oldest - readPosition : 0);
+
+    auto start = juce::jmax (readPosition, oldest);
+    const auto end = juce::jmin (written, start + (juce::uint64) juce::jmax (0, maxRecords));
+
+    for (auto position = start; position < end; ++position)
+        dest[position - start] = mRecords[(size_t) (position & (capacity - 1))];
+
+    // anything the writer got to while those were being copied may be half new, half old
+    std::atomic_thread_fence (std::memory_order_acquire);
+    const auto writtenAfter = mNumWritten.load (std::memory_order_relaxed);
+    const auto oldestIntact = getOldestIntact (writtenAfter);
+
+    auto numCopied = (int) (end - start);
+
+    if (oldestIntact > start)
+    {
+        const auto numTorn = (int) juce::jmin ((juce::uint64) numCopied, oldestIntact - start);
+        std::copy (dest + numTorn, dest + numCopied, dest);
+        numCopied -= numTorn;
+
+        if (numMissed != nullptr)
+            *numMissed += numTorn;
+    }
+
+    readPosition = end;
+    return numCopied;
+}
+
+bool TelemetryRing::writeToFile (const juce::File& file) const
+{
+    std::vector<BlockTelemetry> records ((size_t) capacity);
+    juce::uint64 position = 0;
+    records.resize ((size_t) read (position, records.data(), capacity));
+
+    juce::MemoryOutputStream out;
+    int numOverruns = 0, numUnderruns = 0;
+
+    for (auto& record : records)
+    {
+        numOverruns += record.isOverrun() ? 1 : 0;
+        numUnderruns += record.underruns;
+    }
+
+    out << "# simpleSampler telemetry, written " << juce::Time::getCurrentTime().toString (true, true, true, true) << "\n"
+        << "# " << (int) records.size() << " blocks, " << numOverruns << " over their deadline, "
+        << numUnderruns << " streaming underruns; " << (juce::int64) getNumOverruns() << " overruns since the plugin was created\n"
+        << "block,startTimeMs,numSamples,renderMicroseconds,budgetMicroseconds,load,activeVoices,polyphony,steals,underruns,overrun\n";
+
+    for (auto& record : records)
+        out << (juce::int64) record.blockNumber << ","
+            << juce::String (record.startTime, 3) << ","
+            << record.numSamples << ","
+            << juce::String (record.renderMicroseconds, 1) << ","
+            << juce::String (record.budgetMicroseconds, 1) << ","
+            << juce::String (record.getLoad(), 3) << ","
+            << record.activeVoices << ","
+            << record.polyphony << ","
+            << record.steals << ","
+            << record.underruns << ","
+            << (record.isOverrun() ? 1 : 0) << "\n";
+
+    return file.replaceWithData (out.getData(), out.getDataSize());
+}
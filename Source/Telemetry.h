@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    Telemetry.h
+    What the audio thread did in each block, for the editor's meter and for
+    working out what went wrong after a dropout.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/** One processBlock() call. */
+struct BlockTelemetry
+{
+    juce::uint64 blockNumber = 0;       // counted from when the processor was created
+    double startTime = 0.0;             // when the block started, in ms on Time::getHighResolutionTicks()'s clock
+    float renderMicroseconds = 0.0f;    // how long processBlock() took
+    float budgetMicroseconds = 0.0f;    // how much audio the block held, which is all the time it had
+    int numSamples = 0;
+    int activeVoices = 0;               // voices sounding at the end of the block
+    int polyphony = 0;
+    int steals = 0;                     // voices taken for new notes during the block
+    int underruns = 0;                  // voices that ran out of streamed audio during the block
+
+    /** The fraction of its budget the block used; more than 1 is a missed deadline. */
+    float getLoad() const noexcept          { return budgetMicroseconds > 0.0f ? renderMicroseconds / budgetMicroseconds : 0.0f; }
+    bool isOverrun() const noexcept         { return renderMicroseconds > budgetMicroseconds; }
+};
+
+//==============================================================================
+/**
+    The last few thousand BlockTelemetry records, written by the audio thread
+    and read by any number of others.
+
+    Writing never waits: the newest record overwrites the oldest whether or not
+    anyone has read it. Readers keep their own position and are told how many
+    records they missed if they fall too far behind. A record the audio thread
+    overwrote while it was being copied is dropped rather than returned torn.
+*/
+class TelemetryRing
+{
+public:
+    TelemetryRing();
+
+    /** At a block a few ms long, this is a minute or so. The last capacity - 1
+        records can be read; the slot after them may be being written.
+    */
+    static constexpr int capacity = 8192;
+
+    /** Audio thread only. Wait-free. */
+    void push (const BlockTelemetry& record) noexcept;
+
+    /** Copies up to maxRecords of the records written since readPosition into
+        dest, oldest first, and moves readPosition on past them. Start with a
+        readPosition of 0 to get everything that's still in the ring. Returns how
+        many were copied; numMissed, if given, is set to how many were lost
+        because they were overwritten before this was called.
+    */
+    int read (juce::uint64& readPosition, BlockTelemetry* dest, int maxRecords, int* numMissed = nullptr) const noexcept;
+
+    /** Totals since the processor was created. */
+    juce::uint64 getNumBlocks() const noexcept          { return mNumWritten.load (std::memory_order_acquire); }
+    juce::uint64 getNumOverruns() const noexcept        { return mNumOverruns.load (std::memory_order_relaxed); }
+
+    /** Writes everything still in the ring to a CSV file, one block per line, and
+        a summary of the overruns at the top. Returns false if it couldn't be written.
+    */
+    bool writeToFile (const juce::File& file) const;
+
+private:
+    std::vector<BlockTelemetry> mRecords;
+    std::atomic<juce::uint64> mNumWritten { 0 };
+    std::atomic<juce::uint64> mNumOverruns { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TelemetryRing)
+};
@@ -0,0 +1,426 @@
+/*
+  ==============================================================================
+
+    VoiceKernels.cpp
+    Block-based inner loops for the sampler voices.
+
+  ==============================================================================
+*/
+
+#include "VoiceKernels.h"
+
+#if defined (__AVX__)
+ #include <immintrin.h>
+ #define VOICE_KERNELS_USE_SIMD 1
+#elif JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+ #define VOICE_KERNELS_USE_SIMD 1
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+ #define VOICE_KERNELS_USE_SIMD 1
+#else
+ #define VOICE_KERNELS_USE_SIMD 0
+#endif
+
+namespace VoiceKernels
+{
+namespace
+{
+    //==============================================================================
+    // The kernels are written once against this small set of operations, which
+    // each instruction set provides. gather() loads src[index[n]] into lane n.
+   #if defined (__AVX__)
+    struct PositionVec
+    {
+        static constexpr int width = 4;
+
+        static void compute (double startFraction, double ratio, int i, int* index, float* alpha) noexcept
+        {
+            auto pos = _mm256_add_pd (_mm256_set1_pd (startFraction),
+                                      _mm256_mul_pd (_mm256_set1_pd (ratio),
+                                                     _mm256_setr_pd (i, i + 1, i + 2, i + 3)));
+            auto whole = _mm256_cvttpd_epi32 (pos);
+            _mm_storeu_si128 (reinterpret_cast<__m128i*> (index + i), whole);
+            _mm_storeu_ps (alpha + i, _mm256_cvtpd_ps (_mm256_sub_pd (pos, _mm256_cvtepi32_pd (whole))));
+        }
+    };
+
+    struct Vec
+    {
+        using Type = __m256;
+        static constexpr int width = 8;
+        static const char* getName() noexcept                   { return "AVX"; }
+
+        static Type load (const float* p) noexcept              { return _mm256_loadu_ps (p); }
+        static void store (float* p, Type v) noexcept           { _mm256_storeu_ps (p, v); }
+        static Type broadcast (float v) noexcept                { return _mm256_set1_ps (v); }
+        static Type add (Type a, Type b) noexcept               { return _mm256_add_ps (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return _mm256_sub_ps (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return _mm256_mul_ps (a, b); }
+
+        static float sum (Type v) noexcept
+        {
+            auto s = _mm_add_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1));
+            s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+            return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, 1)));
+        }
+
+        // _mm256_i32gather_ps measured slower than this on the machines we tried
+        static Type gather (const float* src, const int* index) noexcept
+        {
+            return _mm256_setr_ps (src[index[0]], src[index[1]], src[index[2]], src[index[3]],
+                                   src[index[4]], src[index[5]], src[index[6]], src[index[7]]);
+        }
+    };
+   #elif JUCE_USE_SSE_INTRINSICS
+    struct PositionVec
+    {
+        static constexpr int width = 4;
+
+        static void compute (double startFraction, double ratio, int i, int* index, float* alpha) noexcept
+        {
+            auto start = _mm_set1_pd (startFraction), step = _mm_set1_pd (ratio);
+            auto posLo = _mm_add_pd (start, _mm_mul_pd (step, _mm_setr_pd (i, i + 1)));
+            auto posHi = _mm_add_pd (start, _mm_mul_pd (step, _mm_setr_pd (i + 2, i + 3)));
+            auto wholeLo = _mm_cvttpd_epi32 (posLo), wholeHi = _mm_cvttpd_epi32 (posHi);
+
+            _mm_storeu_si128 (reinterpret_cast<__m128i*> (index + i), _mm_unpacklo_epi64 (wholeLo, wholeHi));
+            _mm_storeu_ps (alpha + i, _mm_movelh_ps (_mm_cvtpd_ps (_mm_sub_pd (posLo, _mm_cvtepi32_pd (wholeLo))),
+                                                     _mm_cvtpd_ps (_mm_sub_pd (posHi, _mm_cvtepi32_pd (wholeHi)))));
+        }
+    };
+
+    struct Vec
+    {
+        using Type = __m128;
+        static constexpr int width = 4;
+        static const char* getName() noexcept                   { return "SSE"; }
+
+        static Type load (const float* p) noexcept              { return _mm_loadu_ps (p); }
+        static void store (float* p, Type v) noexcept           { _mm_storeu_ps (p, v); }
+        static Type broadcast (float v) noexcept                { return _mm_set1_ps (v); }
+        static Type add (Type a, Type b) noexcept               { return _mm_add_ps (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return _mm_sub_ps (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return _mm_mul_ps (a, b); }
+
+        static float sum (Type v) noexcept
+        {
+            auto s = _mm_add_ps (v, _mm_movehl_ps (v, v));
+            return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, 1)));
+        }
+
+        static Type gather (const float* src, const int* index) noexcept
+        {
+            return _mm_setr_ps (src[index[0]], src[index[1]], src[index[2]], src[index[3]]);
+        }
+    };
+   #elif JUCE_USE_ARM_NEON
+    struct PositionVec
+    {
+        static constexpr int width = 4;
+
+        static void compute (double startFraction, double ratio, int i, int* index, float* alpha) noexcept
+        {
+           #if JUCE_64BIT
+            const double offsets[] = { (double) i, (double) (i + 1), (double) (i + 2), (double) (i + 3) };
+            auto start = vdupq_n_f64 (startFraction), step = vdupq_n_f64 (ratio);
+            auto posLo = vfmaq_f64 (start, step, vld1q_f64 (offsets));
+            auto posHi = vfmaq_f64 (start, step, vld1q_f64 (offsets + 2));
+            auto wholeLo = vcvtq_s64_f64 (posLo), wholeHi = vcvtq_s64_f64 (posHi);
+
+            vst1q_s32 (index + i, vcombine_s32 (vmovn_s64 (wholeLo), vmovn_s64 (wholeHi)));
+            vst1q_f32 (alpha + i, vcombine_f32 (vcvt_f32_f64 (vsubq_f64 (posLo, vcvtq_f64_s64 (wholeLo))),
+                                                vcvt_f32_f64 (vsubq_f64 (posHi, vcvtq_f64_s64 (wholeHi)))));
+           #else
+            for (int n = i; n < i + width; ++n)
+            {
+                auto pos = startFraction + n * ratio;
+                index[n] = (int) pos;
+                alpha[n] = (float) (pos - (double) index[n]);
+            }
+           #endif
+        }
+    };
+
+    struct Vec
+    {
+        using Type = float32x4_t;
+        static constexpr int width = 4;
+        static const char* getName() noexcept                   { return "NEON"; }
+
+        static Type load (const float* p) noexcept              { return vld1q_f32 (p); }
+        static void store (float* p, Type v) noexcept           { vst1q_f32 (p, v); }
+        static Type broadcast (float v) noexcept                { return vdupq_n_f32 (v); }
+        static Type add (Type a, Type b) noexcept               { return vaddq_f32 (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return vsubq_f32 (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return vmulq_f32 (a, b); }
+
+        static float sum (Type v) noexcept
+        {
+           #if JUCE_64BIT
+            return vaddvq_f32 (v);
+           #else
+            auto s = vadd_f32 (vget_low_f32 (v), vget_high_f32 (v));
+            return vget_lane_f32 (vpadd_f32 (s, s), 0);
+           #endif
+        }
+
+        static Type gather (const float* src, const int* index) noexcept
+        {
+            const float lanes[] = { src[index[0]], src[index[1]], src[index[2]], src[index[3]] };
+            return vld1q_f32 (lanes);
+        }
+    };
+   #endif
+
+    //==============================================================================
+    // The scalar loops take a start index so they can finish off what the SIMD loops leave.
+    void computeReadPositionsFrom (int start, double startFraction, double ratio,
+                                   int* index, float* alpha, int numSamples) noexcept
+    {
+        for (int i = start; i < numSamples; ++i)
+        {
+            auto pos = startFraction + i * ratio;
+            index[i] = (int) pos;
+            alpha[i] = (float) (pos - (double) index[i]);
+        }
+    }
+
+    void interpolateLinearFrom (int start, const float* source, const int* index, const float* alpha,
+                                float* dest, int numSamples) noexcept
+    {
+        for (int i = start; i < numSamples; ++i)
+        {
+            auto* s = source + index[i];
+            dest[i] = s[0] + alpha[i] * (s[1] - s[0]);
+        }
+    }
+
+    // 4-point, 3rd-order Hermite (Catmull-Rom)
+    inline float hermite (const float* s, float t) noexcept
+    {
+        auto c1 = 0.5f * (s[1] - s[-1]);
+        auto c2 = s[-1] - 2.5f * s[0] + 2.0f * s[1] - 0.5f * s[2];
+        auto c3 = 0.5f * (s[2] - s[-1]) + 1.5f * (s[0] - s[1]);
+
+        return ((c3 * t + c2) * t + c1) * t + s[0];
+    }
+
+    void interpolateHermiteFrom (int start, const float* source, const int* index, const float* alpha,
+                                 float* dest, int numSamples) noexcept
+    {
+        for (int i = start; i < numSamples; ++i)
+            dest[i] = hermite (source + index[i], alpha[i]);
+    }
+
+    inline const float* getSincPhase (const float* sincTable, int numTaps, float alpha, float& phaseFraction) noexcept
+    {
+        auto phase = alpha * (float) numSincPhases;
+        auto whole = juce::jlimit (0, numSincPhases, (int) phase);
+        phaseFraction = phase - (float) whole;
+
+        return sincTable + whole * 2 * numTaps;
+    }
+
+    void interpolateSincScalarOne (const float* source, int index, float alpha, float* dest,
+                                   const float* sincTable, int numTaps) noexcept
+    {
+        float t;
+        auto* coeffs = getSincPhase (sincTable, numTaps, alpha, t);
+        auto* deltas = coeffs + numTaps;
+        auto* s = source + index - (numTaps / 2 - 1);
+
+        float sum = 0.0f;
+
+        for (int k = 0; k < numTaps; ++k)
+            sum += s[k] * (coeffs[k] + t * deltas[k]);
+
+        *dest = sum;
+    }
+
+    void addChannelFrom (int start, float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept
+    {
+        for (int i = start; i < numSamples; ++i)
+            out[i] += in[i] * (envelope[i] * gain);
+    }
+
+    //==============================================================================
+   #if VOICE_KERNELS_USE_SIMD
+    // these return how many samples they did; the rest is left for the scalar loops
+    int computeReadPositionsSimd (double startFraction, double ratio, int* index, float* alpha, int numSamples) noexcept
+    {
+        int i = 0;
+
+        for (; i + PositionVec::width <= numSamples; i += PositionVec::width)
+            PositionVec::compute (startFraction, ratio, i, index, alpha);
+
+        return i;
+    }
+
+    int interpolateLinearSimd (const float* source, const int* index, const float* alpha,
+                               float* dest, int numSamples) noexcept
+    {
+        int i = 0;
+
+        for (; i + Vec::width <= numSamples; i += Vec::width)
+        {
+            auto s0 = Vec::gather (source, index + i);
+            auto s1 = Vec::gather (source + 1, index + i);
+            Vec::store (dest + i, Vec::add (s0, Vec::mul (Vec::load (alpha + i), Vec::sub (s1, s0))));
+        }
+
+        return i;
+    }
+
+    int interpolateHermiteSimd (const float* source, const int* index, const float* alpha,
+                                float* dest, int numSamples) noexcept
+    {
+        const auto half = Vec::broadcast (0.5f), oneAndHalf = Vec::broadcast (1.5f);
+        const auto two = Vec::broadcast (2.0f), twoAndHalf = Vec::broadcast (2.5f);
+        int i = 0;
+
+        for (; i + Vec::width <= numSamples; i += Vec::width)
+        {
+            auto sm1 = Vec::gather (source - 1, index + i);
+            auto s0  = Vec::gather (source,     index + i);
+            auto s1  = Vec::gather (source + 1, index + i);
+            auto s2  = Vec::gather (source + 2, index + i);
+            auto t   = Vec::load (alpha + i);
+
+            auto c1 = Vec::mul (half, Vec::sub (s1, sm1));
+            auto c2 = Vec::sub (Vec::add (sm1, Vec::mul (two, s1)),
+                                Vec::add (Vec::mul (twoAndHalf, s0), Vec::mul (half, s2)));
+            auto c3 = Vec::add (Vec::mul (half, Vec::sub (s2, sm1)), Vec::mul (oneAndHalf, Vec::sub (s0, s1)));
+
+            auto y = Vec::add (Vec::mul (c3, t), c2);
+            y = Vec::add (Vec::mul (y, t), c1);
+            Vec::store (dest + i, Vec::add (Vec::mul (y, t), s0));
+        }
+
+        return i;
+    }
+
+    // vectorised across the taps rather than the output samples, as each sample's
+    // taps are contiguous in both the source and the table
+    int interpolateSincSimd (const float* source, const int* index, const float* alpha,
+                             float* dest, int numSamples, const float* sincTable, int numTaps) noexcept
+    {
+        if (numTaps % Vec::width != 0)
+            return 0;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float t;
+            auto* coeffs = getSincPhase (sincTable, numTaps, alpha[i], t);
+            auto* deltas = coeffs + numTaps;
+            auto* s = source + index[i] - (numTaps / 2 - 1);
+
+            const auto tv = Vec::broadcast (t);
+            auto acc = Vec::broadcast (0.0f);
+
+            for (int k = 0; k < numTaps; k += Vec::width)
+            {
+                auto c = Vec::add (Vec::load (coeffs + k), Vec::mul (tv, Vec::load (deltas + k)));
+                acc = Vec::add (acc, Vec::mul (Vec::load (s + k), c));
+            }
+
+            dest[i] = Vec::sum (acc);
+        }
+
+        return numSamples;
+    }
+
+    int addChannelSimd (float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept
+    {
+        const auto g = Vec::broadcast (gain);
+        int i = 0;
+
+        for (; i + Vec::width <= numSamples; i += Vec::width)
+        {
+            auto scaled = Vec::mul (Vec::load (in + i), Vec::mul (Vec::load (envelope + i), g));
+            Vec::store (out + i, Vec::add (Vec::load (out + i), scaled));
+        }
+
+        return i;
+    }
+   #else
+    int computeReadPositionsSimd (double, double, int*, float*, int) noexcept                       { return 0; }
+    int interpolateLinearSimd (const float*, const int*, const float*, float*, int) noexcept         { return 0; }
+    int interpolateHermiteSimd (const float*, const int*, const float*, float*, int) noexcept        { return 0; }
+    int interpolateSincSimd (const float*, const int*, const float*, float*, int, const float*, int) noexcept { return 0; }
+    int addChannelSimd (float*, const float*, const float*, float, int) noexcept                    { return 0; }
+   #endif
+}
+
+//==============================================================================
+void computeReadPositions (double startFraction, double ratio, int* index, float* alpha, int numSamples) noexcept
+{
+    auto done = computeReadPositionsSimd (startFraction, ratio, index, alpha, numSamples);
+    computeReadPositionsFrom (done, startFraction, ratio, index, alpha, numSamples);
+}
+
+void interpolateLinear (const float* source, const int* index, const float* alpha, float* dest, int numSamples) noexcept
+{
+    auto done = interpolateLinearSimd (source, index, alpha, dest, numSamples);
+    interpolateLinearFrom (done, source, index, alpha, dest, numSamples);
+}
+
+void interpolateHermite (const float* source, const int* index, const float* alpha, float* dest, int numSamples) noexcept
+{
+    auto done = interpolateHermiteSimd (source, index, alpha, dest, numSamples);
+    interpolateHermiteFrom (done, source, index, alpha, dest, numSamples);
+}
+
+void interpolateSinc (const float* source, const int* index, const float* alpha, float* dest, int numSamples,
+                      const float* sincTable, int numTaps) noexcept
+{
+    auto done = interpolateSincSimd (source, index, alpha, dest, numSamples, sincTable, numTaps);
+
+    for (int i = done; i < numSamples; ++i)
+        interpolateSincScalarOne (source, index[i], alpha[i], dest + i, sincTable, numTaps);
+}
+
+void addChannel (float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept
+{
+    auto done = addChannelSimd (out, in, envelope, gain, numSamples);
+    addChannelFrom (done, out, in, envelope, gain, numSamples);
+}
+
+//==============================================================================
+void computeReadPositionsScalar (double startFraction, double ratio, int* index, float* alpha, int numSamples) noexcept
+{
+    computeReadPositionsFrom (0, startFraction, ratio, index, alpha, numSamples);
+}
+
+void interpolateLinearScalar (const float* source, const int* index, const float* alpha, float* dest, int numSamples) noexcept
+{
+    interpolateLinearFrom (0, source, index, alpha, dest, numSamples);
+}
+
+void interpolateHermiteScalar (const float* source, const int* index, const float* alpha, float* dest, int numSamples) noexcept
+{
+    interpolateHermiteFrom (0, source, index, alpha, dest, numSamples);
+}
+
+void interpolateSincScalar (const float* source, const int* index, const float* alpha, float* dest, int numSamples,
+                            const float* sincTable, int numTaps) noexcept
+{
+    for (int i = 0; i < numSamples; ++i)
+        interpolateSincScalarOne (source, index[i], alpha[i], dest + i, sincTable, numTaps);
+}
+
+void addChannelScalar (float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept
+{
+    addChannelFrom (0, out, in, envelope, gain, numSamples);
+}
+
+const char* getInstructionSetName() noexcept
+{
+   #if VOICE_KERNELS_USE_SIMD
+    return Vec::getName();
+   #else
+    return "scalar";
+   #endif
+}
+
+} // namespace VoiceKernels
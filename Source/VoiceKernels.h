@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    VoiceKernels.h
+    Block-based inner loops for the sampler voices.
+
+    A voice works out, for a whole block, which source frame and fraction each
+    output sample reads and what its envelope level is. These kernels then do
+    the interpolation, and the envelope, gain and mixing, a block at a time,
+    using SSE, AVX or NEON where the build has them.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+namespace VoiceKernels
+{
+    /** The number of fractional positions a sinc table has coefficients for.
+        A table holds numSincPhases + 1 phases of 2 * numTaps floats each: the
+        coefficients, followed by their difference to the next phase's.
+    */
+    constexpr int numSincPhases = 256;
+
+    /** Fills in the read positions for a block that starts at a fraction of a frame
+        past the first source frame and steps through the source at the given ratio:
+        index[i] + alpha[i] = startFraction + i * ratio.
+    */
+    void computeReadPositions (double startFraction, double ratio, int* index, float* alpha, int numSamples) noexcept;
+
+    //==============================================================================
+    /** Each interpolator reads one channel of the source at index[i] + alpha[i] and
+        writes the result to dest[i]. Linear reads the frame at index[i] and the one
+        after it, Hermite one frame before and two after, and an N-tap sinc N/2 - 1
+        frames before and N/2 after.
+    */
+    void interpolateLinear (const float* source, const int* index, const float* alpha,
+                            float* dest, int numSamples) noexcept;
+
+    void interpolateHermite (const float* source, const int* index, const float* alpha,
+                             float* dest, int numSamples) noexcept;
+
+    void interpolateSinc (const float* source, const int* index, const float* alpha,
+                          float* dest, int numSamples, const float* sincTable, int numTaps) noexcept;
+
+    /** Adds one interpolated channel to one output channel:
+        out[i] += in[i] * envelope[i] * gain. Voices call it once for each pair of
+        source and output channel, as the channels are stored separately.
+    */
+    void addChannel (float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept;
+
+    //==============================================================================
+    /** Plain C++ versions of the kernels above, doing what they fall back to where
+        no SIMD instruction set is available. Tools/Benchmarks --kernels checks the
+        SIMD paths against these and times the two.
+    */
+    void computeReadPositionsScalar (double startFraction, double ratio, int* index, float* alpha, int numSamples) noexcept;
+
+    void interpolateLinearScalar (const float* source, const int* index, const float* alpha,
+                                  float* dest, int numSamples) noexcept;
+
+    void interpolateHermiteScalar (const float* source, const int* index, const float* alpha,
+                                   float* dest, int numSamples) noexcept;
+
+    void interpolateSincScalar (const float* source, const int* index, const float* alpha,
+                                float* dest, int numSamples, const float* sincTable, int numTaps) noexcept;
+
+    void addChannelScalar (float* out, const float* in, const float* envelope, float gain, int numSamples) noexcept;
+
+    /** The name of the instruction set the kernels were built for. */
+    const char* getInstructionSetName() noexcept;
+}
@@ -0,0 +1,626 @@
+/*
+  ==============================================================================
+
+    VoiceLanes.cpp
+    Envelope and filter state for groups of voices, processed a group at a time.
+
+  ==============================================================================
+*/
+
+#include "VoiceLanes.h"
+
+#if defined (__AVX__)
+ #include <immintrin.h>
+#elif JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+namespace
+{
+    //==============================================================================
+    // A group's lanes are worked on numLanes / Vec::width registers at a time.
+    // anyAtLeast() is true if any lane of a is at least the same lane of b.
+   #if defined (__AVX__)
+    struct Vec
+    {
+        using Type = __m256;
+        static constexpr int width = 8;
+
+        static Type load (const float* p) noexcept              { return _mm256_loadu_ps (p); }
+        static void store (float* p, Type v) noexcept           { _mm256_storeu_ps (p, v); }
+        static Type broadcast (float v) noexcept                { return _mm256_set1_ps (v); }
+        static Type add (Type a, Type b) noexcept               { return _mm256_add_ps (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return _mm256_sub_ps (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return _mm256_mul_ps (a, b); }
+        static Type max (Type a, Type b) noexcept               { return _mm256_max_ps (a, b); }
+        static bool anyAtLeast (Type a, Type b) noexcept        { return _mm256_movemask_ps (_mm256_cmp_ps (a, b, _CMP_GE_OQ)) != 0; }
+    };
+   #elif JUCE_USE_SSE_INTRINSICS
+    struct Vec
+    {
+        using Type = __m128;
+        static constexpr int width = 4;
+
+        static Type load (const float* p) noexcept              { return _mm_loadu_ps (p); }
+        static void store (float* p, Type v) noexcept           { _mm_storeu_ps (p, v); }
+        static Type broadcast (float v) noexcept                { return _mm_set1_ps (v); }
+        static Type add (Type a, Type b) noexcept               { return _mm_add_ps (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return _mm_sub_ps (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return _mm_mul_ps (a, b); }
+        static Type max (Type a, Type b) noexcept               { return _mm_max_ps (a, b); }
+        static bool anyAtLeast (Type a, Type b) noexcept        { return _mm_movemask_ps (_mm_cmpge_ps (a, b)) != 0; }
+    };
+   #elif JUCE_USE_ARM_NEON
+    struct Vec
+    {
+        using Type = float32x4_t;
+        static constexpr int width = 4;
+
+        static Type load (const float* p) noexcept              { return vld1q_f32 (p); }
+        static void store (float* p, Type v) noexcept           { vst1q_f32 (p, v); }
+        static Type broadcast (float v) noexcept                { return vdupq_n_f32 (v); }
+        static Type add (Type a, Type b) noexcept               { return vaddq_f32 (a, b); }
+        static Type sub (Type a, Type b) noexcept               { return vsubq_f32 (a, b); }
+        static Type mul (Type a, Type b) noexcept               { return vmulq_f32 (a, b); }
+        static Type max (Type a, Type b) noexcept               { return vmaxq_f32 (a, b); }
+
+        static bool anyAtLeast (Type a, Type b) noexcept
+        {
+            auto mask = vcgeq_f32 (a, b);
+           #if JUCE_64BIT
+            return vmaxvq_u32 (mask) != 0;
+           #else
+            auto half = vorr_u32 (vget_low_u32 (mask), vget_high_u32 (mask));
+            return (vget_lane_u32 (half, 0) | vget_lane_u32 (half, 1)) != 0;
+           #endif
+        }
+    };
+   #else
+    struct Vec
+    {
+        using Type = float;
+        static constexpr int width = 1;
+
+        static Type load (const float* p) noexcept              { return *p; }
+        static void store (float* p, Type v) noexcept           { *p = v; }
+        static Type broadcast (float v) noexcept                { return v; }
+        static Type add (Type a, Type b) noexcept               { return a + b; }
+        static Type sub (Type a, Type b) noexcept               { return a - b; }
+        static Type mul (Type a, Type b) noexcept               { return a * b; }
+        static Type max (Type a, Type b) noexcept               { return a > b ? a : b; }
+        static bool anyAtLeast (Type a, Type b) noexcept        { return a >= b; }
+    };
+   #endif
+
+    constexpr int numLanes = VoiceLanes::numLanes;
+    constexpr int numRegisters = numLanes / Vec::width;
+
+    static_assert (numLanes % Vec::width == 0, "a group has to fill whole registers");
+    static_assert (numLanes <= 32, "lane masks are 32 bits");
+
+    inline bool isLaneSet (juce::uint32 laneMask, int lane) noexcept
+    {
+        return (laneMask & (1u << lane)) != 0;
+    }
+
+    // the lanes' samples are interleaved while they're processed: sample i of lane n is at i * numLanes + n
+    void interleave (float* interleaved, const float* laneSamples, int lane, int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+            interleaved[i * numLanes + lane] = laneSamples[i];
+    }
+
+    void deinterleave (float* laneSamples, const float* interleaved, int lane, int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+            laneSamples[i] = interleaved[i * numLanes + lane];
+    }
+}
+
+//==============================================================================
+VoiceLanes::VoiceLanes()
+{
+}
+
+VoiceLanes::~VoiceLanes()
+{
+}
+
+void VoiceLanes::setNumVoices (int numVoices)
+{
+    const auto numGroups = (size_t) ((numVoices + numLanes - 1) / numLanes);
+    const auto oldNumGroups = mGroups.size();
+
+    mGroups.resize (numGroups);
+
+    for (auto group = oldNumGroups; group < numGroups; ++group)
+    {
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const auto voice = (int) group * numLanes + lane;
+            auto& settings = mGroups[group].settings[lane];
+
+            reset (voice);
+            updateFilterCoefficients (mGroups[group].filters, settings, lane);
+        }
+    }
+}
+
+//==============================================================================
+void VoiceLanes::setEnvelopeParameters (int voice, const juce::ADSR::Parameters& parameters) noexcept
+{
+    auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+    auto& settings = group.settings[lane];
+    auto& envelopes = group.envelopes;
+
+    // the same rates as juce::ADSR, in level per sample; -1 for segments that are skipped
+    auto getRate = [this] (float distance, float seconds)
+    {
+        return seconds > 0.0f ? (float) (distance / (seconds * mSampleRate)) : -1.0f;
+    };
+
+    const auto oldDecaySamples = settings.decaySamples;
+    const auto oldReleaseSamples = settings.releaseSamples;
+
+    settings.attackRate = getRate (1.0f, parameters.attack);
+    settings.decayRate = getRate (1.0f - parameters.sustain, parameters.decay);
+    settings.sustain = parameters.sustain;
+    settings.decaySamples = (float) (parameters.decay * mSampleRate);
+    settings.releaseSamples = (float) (parameters.release * mSampleRate);
+
+    // a segment that is under way keeps the progress it has made: only its rate changes, by
+    // as much as its time has, so sending the same parameters again leaves it as it was
+    switch (settings.stage)
+    {
+        case Stage::attack:
+            if (settings.attackRate > 0.0f)
+                envelopes.rate[lane] = settings.attackRate;
+            else
+                endSegment (envelopes, settings, lane);
+            break;
+
+        case Stage::decay:
+            if (settings.decayRate <= 0.0f || envelopes.level[lane] <= settings.sustain)
+            {
+                endSegment (envelopes, settings, lane);
+            }
+            else
+            {
+                if (settings.decaySamples != oldDecaySamples)
+                    envelopes.rate[lane] *= oldDecaySamples / settings.decaySamples;
+
+                envelopes.limit[lane] = settings.sustain;
+            }
+            break;
+
+        case Stage::sustain:
+            startSegment (envelopes, settings, lane, Stage::sustain);
+            break;
+
+        case Stage::release:
+            if (settings.releaseSamples <= 0.0f)
+                endSegment (envelopes, settings, lane);
+            else if (settings.releaseSamples != oldReleaseSamples)
+                envelopes.rate[lane] *= oldReleaseSamples / settings.releaseSamples;
+            break;
+
+        case Stage::idle:
+        default:
+            break;
+    }
+}
+
+void VoiceLanes::setFilterParameters (int voice, const VoiceFilterParameters& parameters) noexcept
+{
+    auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+
+    group.settings[lane].filter = parameters;
+    updateFilterCoefficients (group.filters, group.settings[lane], lane);
+}
+
+void VoiceLanes::noteOn (int voice, int midiNoteNumber) noexcept
+{
+    auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+    auto& settings = group.settings[lane];
+    auto& envelopes = group.envelopes;
+
+    envelopes.level[lane] = 0.0f;
+    envelopes.fade[lane] = 1.0f;
+    envelopes.fadeStep[lane] = 0.0f;
+
+    // with no attack the envelope starts at the top of the decay, or straight at the sustain level
+    if (settings.attackRate > 0.0f)
+    {
+        startSegment (envelopes, settings, lane, Stage::attack);
+    }
+    else
+    {
+        envelopes.level[lane] = 1.0f;
+        startSegment (envelopes, settings, lane, settings.decayRate > 0.0f ? Stage::decay : Stage::sustain);
+    }
+
+    settings.midiNoteNumber = midiNoteNumber;
+    updateFilterCoefficients (group.filters, settings, lane);
+
+    for (int channel = 0; channel < maxChannels; ++channel)
+    {
+        group.filters.ic1[channel][lane] = 0.0f;
+        group.filters.ic2[channel][lane] = 0.0f;
+    }
+}
+
+void VoiceLanes::noteOff (int voice) noexcept
+{
+    auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+
+    if (group.settings[lane].stage != Stage::idle)
+        startSegment (group.envelopes, group.settings[lane], lane, Stage::release);
+}
+
+void VoiceLanes::fadeOut (int voice, int numSamples) noexcept
+{
+    auto& envelopes = getGroup (voice).envelopes;
+    const auto lane = voice % numLanes;
+
+    envelopes.fadeStep[lane] = envelopes.fade[lane] / (float) juce::jmax (1, numSamples);
+}
+
+void VoiceLanes::reset (int voice) noexcept
+{
+    auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+
+    group.envelopes.level[lane] = 0.0f;
+    group.envelopes.fade[lane] = 1.0f;
+    group.envelopes.fadeStep[lane] = 0.0f;
+    startSegment (group.envelopes, group.settings[lane], lane, Stage::idle);
+}
+
+float VoiceLanes::getLevel (int voice) const noexcept
+{
+    const auto& envelopes = getGroup (voice).envelopes;
+    const auto lane = voice % numLanes;
+
+    return envelopes.level[lane] * envelopes.fade[lane];
+}
+
+bool VoiceLanes::hasFinished (int voice) const noexcept
+{
+    const auto& group = getGroup (voice);
+    const auto lane = voice % numLanes;
+
+    return group.settings[lane].stage == Stage::idle
+        || (group.envelopes.fadeStep[lane] > 0.0f && group.envelopes.fade[lane] <= 0.0f);
+}
+
+//==============================================================================
+void VoiceLanes::startSegment (Envelopes& envelopes, LaneSettings& settings, int lane, Stage stage) noexcept
+{
+    auto& level = envelopes.level[lane];
+
+    // a limit the level never gets below, for the segments that only end when told to
+    constexpr float unreachable = -1.0f;
+
+    settings.stage = stage;
+    envelopes.rate[lane] = 0.0f;
+    envelopes.limit[lane] = unreachable;
+    envelopes.direction[lane] = -1.0f;
+
+    switch (stage)
+    {
+        case Stage::attack:
+            envelopes.rate[lane] = settings.attackRate;
+            envelopes.limit[lane] = 1.0f;
+            envelopes.direction[lane] = 1.0f;
+            break;
+
+        case Stage::decay:
+            envelopes.rate[lane] = -settings.decayRate;
+            envelopes.limit[lane] = settings.sustain;
+            break;
+
+        case Stage::sustain:
+            // juce::ADSR holds the level it got to for a sample before it jumps to the sustain
+            // level, so this steps there over one sample and ends on it exactly
+            if (level != settings.sustain)
+            {
+                envelopes.rate[lane] = settings.sustain - level;
+                envelopes.limit[lane] = level;
+                envelopes.direction[lane] = envelopes.rate[lane] > 0.0f ? 1.0f : -1.0f;
+            }
+            break;
+
+        case Stage::release:
+            // from wherever the level is, down to nothing in the release time
+            if (settings.releaseSamples > 0.0f && level > 0.0f)
+            {
+                envelopes.rate[lane] = -level / settings.releaseSamples;
+                envelopes.limit[lane] = 0.0f;
+            }
+            else
+            {
+                settings.stage = Stage::idle;
+                level = 0.0f;
+            }
+            break;
+
+        case Stage::idle:
+        default:
+            level = 0.0f;
+            break;
+    }
+}
+
+void VoiceLanes::endSegment (Envelopes& envelopes, LaneSettings& settings, int lane) noexcept
+{
+    // the level stops exactly at the end of the segment, as juce::ADSR's does
+    switch (settings.stage)
+    {
+        case Stage::attack:
+            envelopes.level[lane] = 1.0f;
+            startSegment (envelopes, settings, lane, settings.decayRate > 0.0f ? Stage::decay : Stage::sustain);
+            break;
+
+        case Stage::decay:
+        case Stage::sustain:
+            envelopes.level[lane] = settings.sustain;
+            startSegment (envelopes, settings, lane, Stage::sustain);
+            break;
+
+        case Stage::release:
+            startSegment (envelopes, settings, lane, Stage::idle);
+            break;
+
+        case Stage::idle:
+        default:
+            break;
+    }
+}
+
+void VoiceLanes::updateFilterCoefficients (Filters& filters, const LaneSettings& settings, int lane) const noexcept
+{
+    const auto& parameters = settings.filter;
+
+    // key tracking moves the cutoff by up to an octave per octave away from middle C
+    const auto tracking = std::exp2 (parameters.keyTracking * (float) (settings.midiNoteNumber - 60) / 12.0f);
+    const auto cutoff = juce::jlimit (10.0, 0.49 * mSampleRate, (double) (parameters.cutoff * tracking));
+
+    const auto g = std::tan (juce::MathConstants<double>::pi * cutoff / mSampleRate);
+    const auto k = 1.0 / juce::jmax (0.1, (double) parameters.resonance);
+    const auto a1 = 1.0 / (1.0 + g * (g + k));
+
+    filters.a1[lane] = (float) a1;
+    filters.a2[lane] = (float) (g * a1);
+    filters.a3[lane] = (float) (g * g * a1);
+
+    // the output is dryGain * input + bandGain * band + lowGain * low, where high = input - k * band - low,
+    // and the band pass is scaled by k to peak at unity
+    float dry = 1.0f, band = 0.0f, low = 0.0f;
+
+    switch (parameters.type)
+    {
+        case VoiceFilterType::lowPass:      dry = 0.0f; low = 1.0f; break;
+        case VoiceFilterType::bandPass:     dry = 0.0f; band = (float) k; break;
+        case VoiceFilterType::highPass:     band = (float) -k; low = -1.0f; break;
+        case VoiceFilterType::off:
+        default:                            break;
+    }
+
+    filters.dryGain[lane] = dry;
+    filters.bandGain[lane] = band;
+    filters.lowGain[lane] = low;
+}
+
+//==============================================================================
+void VoiceLanes::processEnvelopes (int groupIndex, juce::uint32 laneMask, float* const* envelopes, int numSamples) noexcept
+{
+    jassert (juce::isPositiveAndBelow (groupIndex, getNumGroups()) && numSamples <= maxBlockSize);
+
+    auto& group = mGroups[(size_t) groupIndex];
+
+    // the lanes that weren't asked for are held where they are in a copy that's thrown away
+    auto state = group.envelopes;
+
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        if (! isLaneSet (laneMask, lane))
+        {
+            state.level[lane] = 0.0f;
+            state.rate[lane] = state.fadeStep[lane] = 0.0f;
+            state.limit[lane] = state.direction[lane] = -1.0f;
+        }
+    }
+
+    Vec::Type level[numRegisters], rate[numRegisters], limit[numRegisters], direction[numRegisters];
+    Vec::Type fade[numRegisters], fadeStep[numRegisters];
+
+    auto loadSegments = [&]
+    {
+        for (int r = 0; r < numRegisters; ++r)
+        {
+            level[r] = Vec::load (state.level + r * Vec::width);
+            rate[r] = Vec::load (state.rate + r * Vec::width);
+            limit[r] = Vec::load (state.limit + r * Vec::width);
+            direction[r] = Vec::load (state.direction + r * Vec::width);
+        }
+    };
+
+    loadSegments();
+
+    for (int r = 0; r < numRegisters; ++r)
+    {
+        fade[r] = Vec::load (state.fade + r * Vec::width);
+        fadeStep[r] = Vec::load (state.fadeStep + r * Vec::width);
+    }
+
+    const auto zero = Vec::broadcast (0.0f);
+    float output[maxBlockSize * numLanes];
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        bool anySegmentEnded = false;
+
+        for (int r = 0; r < numRegisters; ++r)
+        {
+            level[r] = Vec::add (level[r], rate[r]);
+            anySegmentEnded |= Vec::anyAtLeast (Vec::mul (Vec::sub (level[r], limit[r]), direction[r]), zero);
+        }
+
+        // only a few samples per note end a segment, so the lanes that did are moved on one by one
+        if (anySegmentEnded)
+        {
+            for (int r = 0; r < numRegisters; ++r)
+                Vec::store (state.level + r * Vec::width, level[r]);
+
+            for (int lane = 0; lane < numLanes; ++lane)
+                if (isLaneSet (laneMask, lane)
+                     && (state.level[lane] - state.limit[lane]) * state.direction[lane] >= 0.0f)
+                    endSegment (state, group.settings[lane], lane);
+
+            loadSegments();
+        }
+
+        for (int r = 0; r < numRegisters; ++r)
+        {
+            fade[r] = Vec::max (zero, Vec::sub (fade[r], fadeStep[r]));
+            Vec::store (output + i * numLanes + r * Vec::width, Vec::mul (level[r], fade[r]));
+        }
+    }
+
+    for (int r = 0; r < numRegisters; ++r)
+    {
+        Vec::store (state.level + r * Vec::width, level[r]);
+        Vec::store (state.fade + r * Vec::width, fade[r]);
+    }
+
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        if (! isLaneSet (laneMask, lane))
+            continue;
+
+        deinterleave (envelopes[lane], output, lane, numSamples);
+
+        group.envelopes.level[lane] = state.level[lane];
+        group.envelopes.rate[lane] = state.rate[lane];
+        group.envelopes.limit[lane] = state.limit[lane];
+        group.envelopes.direction[lane] = state.direction[lane];
+        group.envelopes.fade[lane] = state.fade[lane];
+    }
+}
+
+void VoiceLanes::processFilters (int groupIndex, juce::uint32 laneMask, float* const* const* channels,
+                                 const int* numChannels, int numSamples) noexcept
+{
+    jassert (juce::isPositiveAndBelow (groupIndex, getNumGroups()) && numSamples <= maxBlockSize);
+
+    auto& group = mGroups[(size_t) groupIndex];
+    auto& filters = group.filters;
+
+    juce::uint32 filteredLanes = 0;
+    int maxNumChannels = 0;
+
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        if (isLaneSet (laneMask, lane) && group.settings[lane].filter.type != VoiceFilterType::off)
+        {
+            filteredLanes |= 1u << lane;
+            maxNumChannels = juce::jmax (maxNumChannels, juce::jmin (maxChannels, numChannels[lane]));
+        }
+    }
+
+    if (filteredLanes == 0)
+        return;
+
+    Vec::Type a1[numRegisters], a2[numRegisters], a3[numRegisters];
+    Vec::Type dryGain[numRegisters], bandGain[numRegisters], lowGain[numRegisters];
+
+    for (int r = 0; r < numRegisters; ++r)
+    {
+        a1[r] = Vec::load (filters.a1 + r * Vec::width);
+        a2[r] = Vec::load (filters.a2 + r * Vec::width);
+        a3[r] = Vec::load (filters.a3 + r * Vec::width);
+        dryGain[r] = Vec::load (filters.dryGain + r * Vec::width);
+        bandGain[r] = Vec::load (filters.bandGain + r * Vec::width);
+        lowGain[r] = Vec::load (filters.lowGain + r * Vec::width);
+    }
+
+    float samples[maxBlockSize * numLanes];
+
+    // channel n of every lane that has one goes through the filters together
+    for (int channel = 0; channel < maxNumChannels; ++channel)
+    {
+        juce::uint32 channelLanes = 0;
+
+        for (int lane = 0; lane < numLanes; ++lane)
+            if (isLaneSet (filteredLanes, lane) && channel < numChannels[lane])
+                channelLanes |= 1u << lane;
+
+        if (channelLanes == 0)
+            continue;
+
+        // the other lanes filter silence from silence, and what they come up with is dropped
+        float ic1State[numLanes], ic2State[numLanes];
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const auto isFiltered = isLaneSet (channelLanes, lane);
+            ic1State[lane] = isFiltered ? filters.ic1[channel][lane] : 0.0f;
+            ic2State[lane] = isFiltered ? filters.ic2[channel][lane] : 0.0f;
+
+            if (isFiltered)
+                interleave (samples, channels[lane][channel], lane, numSamples);
+            else
+                for (int i = 0; i < numSamples; ++i)
+                    samples[i * numLanes + lane] = 0.0f;
+        }
+
+        Vec::Type ic1[numRegisters], ic2[numRegisters];
+
+        for (int r = 0; r < numRegisters; ++r)
+        {
+            ic1[r] = Vec::load (ic1State + r * Vec::width);
+            ic2[r] = Vec::load (ic2State + r * Vec::width);
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            for (int r = 0; r < numRegisters; ++r)
+            {
+                auto* sample = samples + i * numLanes + r * Vec::width;
+
+                const auto v0 = Vec::load (sample);
+                const auto v3 = Vec::sub (v0, ic2[r]);
+                const auto v1 = Vec::add (Vec::mul (a1[r], ic1[r]), Vec::mul (a2[r], v3));
+                const auto v2 = Vec::add (ic2[r], Vec::add (Vec::mul (a2[r], ic1[r]), Vec::mul (a3[r], v3)));
+
+                ic1[r] = Vec::sub (Vec::add (v1, v1), ic1[r]);
+                ic2[r] = Vec::sub (Vec::add (v2, v2), ic2[r]);
+
+                Vec::store (sample, Vec::add (Vec::mul (dryGain[r], v0),
+                                              Vec::add (Vec::mul (bandGain[r], v1), Vec::mul (lowGain[r], v2))));
+            }
+        }
+
+        for (int r = 0; r < numRegisters; ++r)
+        {
+            Vec::store (ic1State + r * Vec::width, ic1[r]);
+            Vec::store (ic2State + r * Vec::width, ic2[r]);
+        }
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            if (! isLaneSet (channelLanes, lane))
+                continue;
+
+            deinterleave (channels[lane][channel], samples, lane, numSamples);
+            filters.ic1[channel][lane] = ic1State[lane];
+            filters.ic2[channel][lane] = ic2State[lane];
+        }
+    }
+}
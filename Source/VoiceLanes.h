@@ -0,0 +1,166 @@
+/*
+  ==============================================================================
+
+    VoiceLanes.h
+    Envelope and filter state for groups of voices, processed a group at a time.
+
+    Each voice owns a lane of a group of numLanes voices. The group's envelopes
+    and filters are stored as arrays of numLanes values, one array per quantity,
+    so a sample of every lane is worked out at once: one AVX register or two
+    SSE or NEON registers per quantity.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/** What the per-voice filter does. */
+enum class VoiceFilterType
+{
+    off = 0,
+    lowPass,
+    bandPass,
+    highPass
+};
+
+/** Settings for the per-voice filter, the same for every voice they're given to. */
+struct VoiceFilterParameters
+{
+    VoiceFilterType type = VoiceFilterType::off;
+    float cutoff = 20000.0f;        // Hz, for a note at middle C
+    float resonance = 0.707f;       // Q; 0.707 has no peak
+    float keyTracking = 0.0f;       // how far the cutoff follows the note, from 0 to 1 octave per octave
+};
+
+//==============================================================================
+/**
+    The amplitude envelopes and state-variable filters of every voice of a synth.
+
+    Voice n is lane n % numLanes of group n / numLanes, and stays there. A group is
+    processed for up to maxBlockSize samples at a time, for whichever of its lanes
+    are asked for; the others keep their state. Lanes in a group that aren't asked
+    for still go through the arithmetic, so it's cheapest when the playing voices
+    are packed into the first groups, as the synth's voice allocation does.
+
+    The envelope follows juce::ADSR, segment for segment, with a fade on top of it
+    for voices that are being stolen. The filter is a trapezoidal-integrated state
+    variable filter (Simper's SVF), whose coefficients are set per lane when a
+    note starts or the parameters change, so each voice can have its own cutoff.
+
+    Each lane is only ever touched by one thread at a time: the audio thread for
+    the per-voice calls, then whichever render thread gets the voice's group.
+*/
+class VoiceLanes
+{
+public:
+    VoiceLanes();
+    ~VoiceLanes();
+
+    static constexpr int numLanes = 8;
+    static constexpr int maxChannels = 8;
+    static constexpr int maxBlockSize = 256;
+
+    /** Makes room for this many voices. Call before any of them plays. */
+    void setNumVoices (int numVoices);
+    int getNumGroups() const noexcept                           { return (int) mGroups.size(); }
+
+    /** The rate the envelope and filter times are worked out at. Affects notes that start after it. */
+    void setSampleRate (double newSampleRate) noexcept          { mSampleRate = newSampleRate; }
+
+    //==============================================================================
+    /** Sets a voice's envelope, including that of a note it is already playing. */
+    void setEnvelopeParameters (int voice, const juce::ADSR::Parameters&) noexcept;
+
+    /** Sets a voice's filter, including that of a note it is already playing. */
+    void setFilterParameters (int voice, const VoiceFilterParameters&) noexcept;
+
+    /** Starts the voice's envelope from silence and clears its filter. */
+    void noteOn (int voice, int midiNoteNumber) noexcept;
+
+    /** Starts the voice's release, or ends the envelope if there is none. */
+    void noteOff (int voice) noexcept;
+
+    /** Fades the voice out over the given number of samples, whatever its envelope does. */
+    void fadeOut (int voice, int numSamples) noexcept;
+
+    /** Silences the voice straight away. */
+    void reset (int voice) noexcept;
+
+    /** The voice's envelope, with any fade, as of the last sample processed. */
+    float getLevel (int voice) const noexcept;
+
+    /** True once the envelope has finished its release, or the voice has faded out. */
+    bool hasFinished (int voice) const noexcept;
+
+    //==============================================================================
+    /** Runs the envelopes of the lanes of a group set in laneMask for a block, writing
+        each lane's levels to envelopes[lane].
+    */
+    void processEnvelopes (int group, juce::uint32 laneMask, float* const* envelopes, int numSamples) noexcept;
+
+    /** Filters, in place, channels[lane][0 to numChannels[lane] - 1] of the lanes of a
+        group set in laneMask. Lanes whose filter is off are left as they are, and if
+        none of them has it on this returns straight away.
+    */
+    void processFilters (int group, juce::uint32 laneMask, float* const* const* channels,
+                         const int* numChannels, int numSamples) noexcept;
+
+private:
+    //==============================================================================
+    enum class Stage : int
+    {
+        idle = 0,
+        attack,
+        decay,
+        sustain,
+        release
+    };
+
+    // each segment adds rate to the level every sample, and ends once it crosses limit in
+    // the segment's direction; segments that don't end have a limit that can't be crossed
+    struct Envelopes
+    {
+        float level[numLanes], rate[numLanes], limit[numLanes], direction[numLanes];
+        float fade[numLanes], fadeStep[numLanes];
+    };
+
+    struct Filters
+    {
+        float a1[numLanes], a2[numLanes], a3[numLanes];
+        float dryGain[numLanes], bandGain[numLanes], lowGain[numLanes];
+        float ic1[maxChannels][numLanes], ic2[maxChannels][numLanes];
+    };
+
+    // what the segments are worked out from, only needed when one ends or the parameters change
+    struct LaneSettings
+    {
+        Stage stage = Stage::idle;
+        float attackRate = -1.0f, decayRate = -1.0f, sustain = 1.0f;
+        float decaySamples = 0.0f, releaseSamples = 0.0f;
+        VoiceFilterParameters filter;
+        int midiNoteNumber = 60;
+    };
+
+    struct Group
+    {
+        Envelopes envelopes;
+        Filters filters;
+        LaneSettings settings[numLanes];
+    };
+
+    Group& getGroup (int voice) noexcept                        { return mGroups[(size_t) (voice / numLanes)]; }
+    const Group& getGroup (int voice) const noexcept            { return mGroups[(size_t) (voice / numLanes)]; }
+
+    static void startSegment (Envelopes&, LaneSettings&, int lane, Stage) noexcept;
+    static void endSegment (Envelopes&, LaneSettings&, int lane) noexcept;
+    void updateFilterCoefficients (Filters&, const LaneSettings&, int lane) const noexcept;
+
+    //==============================================================================
+    std::vector<Group> mGroups;
+    double mSampleRate = 44100.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VoiceLanes)
+};
@@ -0,0 +1,194 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.cpp
+    Real-time worker threads that help the audio thread render its voices.
+
+  ==============================================================================
+*/
+
+#include "VoiceRenderPool.h"
+#include "RealtimeChecker.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#endif
+
+namespace
+{
+    // a synth renders a block in several pieces when it has MIDI events in it, so the
+    // workers keep looking for the next piece for a little while before going to sleep
+    constexpr double idleSpinMilliseconds = 0.25;
+
+    inline void spinPause() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #elif JUCE_ARM && ! JUCE_MSVC
+        __asm__ __volatile__ ("yield");
+       #endif
+    }
+}
+
+//==============================================================================
+class VoiceRenderPool::Worker  : public juce::Thread
+{
+public:
+    Worker (VoiceRenderPool& pool, int participant)
+        : juce::Thread ("Voice Render " + juce::String (participant)),
+          mPool (pool),
+          mParticipant (participant)
+    {
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        mWakeUp.signal();
+        stopThread (1000);
+    }
+
+    void wakeUpIfSleeping() noexcept
+    {
+        if (mSleeping.load())
+            mWakeUp.signal();
+    }
+
+    void run() override
+    {
+        juce::ScopedNoDenormals noDenormals;
+
+        auto lastGeneration = mPool.mGeneration.load();
+        auto spinUntil = 0.0;
+
+        while (! threadShouldExit())
+        {
+            const auto generation = mPool.mGeneration.load (std::memory_order_acquire);
+
+            if (generation != lastGeneration)
+            {
+                lastGeneration = generation;
+
+                {
+                    const RealtimeChecker::ScopedRealtimeThread realtimeThread;
+                    mPool.joinJob (mParticipant);
+                }
+
+                spinUntil = juce::Time::getMillisecondCounterHiRes() + idleSpinMilliseconds;
+                continue;
+            }
+
+            if (juce::Time::getMillisecondCounterHiRes() < spinUntil)
+            {
+                spinPause();
+                continue;
+            }
+
+            // perform() checks the flag after bumping the generation, so one of the
+            // two always sees the other and a job can't slip past a sleeping worker
+            mSleeping.store (true);
+
+            if (mPool.mGeneration.load() == lastGeneration)
+                mWakeUp.wait (100);
+
+            mSleeping.store (false);
+            spinUntil = juce::Time::getMillisecondCounterHiRes() + idleSpinMilliseconds;
+        }
+    }
+
+private:
+    VoiceRenderPool& mPool;
+    const int mParticipant;
+    std::atomic<bool> mSleeping { false };
+    juce::WaitableEvent mWakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Worker)
+};
+
+//==============================================================================
+VoiceRenderPool::VoiceRenderPool (int numWorkers)
+{
+    numWorkers = juce::jlimit (0, maxWorkers, numWorkers);
+    mNumParticipants = numWorkers + 1;
+
+    for (int i = 1; i <= numWorkers; ++i)
+        mWorkers.add (new Worker (*this, i))->startThread (juce::Thread::realtimeAudioPriority);
+}
+
+VoiceRenderPool::~VoiceRenderPool()
+{
+    jassert (! mJobOpen.load());
+    mWorkers.clear();
+}
+
+void VoiceRenderPool::perform (Job& job, int numChunks) noexcept
+{
+    jassert (numChunks <= maxChunks);
+
+    if (numChunks <= 0)
+        return;
+
+    // nobody is inside the previous job any more, so nothing else is looking at these
+    mJob = &job;
+    mNumChunksDone.store (0, std::memory_order_relaxed);
+
+    for (int i = 0; i < mNumParticipants; ++i)
+    {
+        mShares[(size_t) i].next.store (numChunks * i / mNumParticipants, std::memory_order_relaxed);
+        mShares[(size_t) i].end = numChunks * (i + 1) / mNumParticipants;
+    }
+
+    mJobOpen.store (true);
+    mGeneration.fetch_add (1);
+
+    for (auto* worker : mWorkers)
+        worker->wakeUpIfSleeping();
+
+    workOn (0);
+
+    // every chunk has been claimed by now, but the workers may still be rendering some
+    while (mNumChunksDone.load (std::memory_order_acquire) < numChunks)
+        spinPause();
+
+    // a worker that turns up from here on sees the job is closed and leaves it alone
+    mJobOpen.store (false);
+
+    while (mNumWorkersInJob.load() != 0)
+        spinPause();
+
+    mJob = nullptr;
+}
+
+void VoiceRenderPool::joinJob (int participant) noexcept
+{
+    mNumWorkersInJob.fetch_add (1);
+
+    // perform() may already have finished the job this worker was woken for, or
+    // even started the next one, which is fine to help with too
+    if (mJobOpen.load())
+        workOn (participant);
+
+    mNumWorkersInJob.fetch_sub (1);
+}
+
+void VoiceRenderPool::workOn (int participant) noexcept
+{
+    auto* job = mJob;
+
+    // its own share first, then whatever is left of everybody else's
+    for (int i = 0; i < mNumParticipants; ++i)
+    {
+        auto& share = mShares[(size_t) ((participant + i) % mNumParticipants)];
+
+        while (share.next.load (std::memory_order_relaxed) < share.end)
+        {
+            const auto chunk = share.next.fetch_add (1, std::memory_order_relaxed);
+
+            if (chunk >= share.end)
+                break;
+
+            job->renderChunk (chunk);
+            mNumChunksDone.fetch_add (1, std::memory_order_release);
+        }
+    }
+}
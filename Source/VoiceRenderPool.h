@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.h
+    Real-time worker threads that help the audio thread render its voices.
+
+    The audio thread splits a block's voices into numbered chunks and hands
+    them to the pool. Every thread, the audio thread included, starts on its
+    own share of the chunks and then takes chunks from the shares of the
+    threads that haven't got to theirs yet, so a worker that wakes up late or
+    gets descheduled holds nobody up for longer than one chunk.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+class VoiceRenderPool
+{
+public:
+    /** Work that can be split into numbered chunks which don't depend on each other. */
+    struct Job
+    {
+        virtual ~Job() = default;
+
+        /** Called once for each chunk, on whichever thread gets to it first. Runs on
+            real-time threads, so it mustn't allocate, lock or wait on anything.
+        */
+        virtual void renderChunk (int chunkIndex) noexcept = 0;
+    };
+
+    /** Starts the worker threads. Message thread only. */
+    explicit VoiceRenderPool (int numWorkers);
+    ~VoiceRenderPool();
+
+    int getNumWorkers() const noexcept                  { return mWorkers.size(); }
+
+    /** Calls job.renderChunk() for every index below numChunks, spread across the
+        workers and the calling thread, and returns once all of them have finished.
+        Never blocks on a lock, but spins while the last chunks are being finished
+        by the workers. Only one thread may call this at a time.
+    */
+    void perform (Job& job, int numChunks) noexcept;
+
+    static constexpr int maxWorkers = 7;
+    static constexpr int maxChunks = 64;
+
+private:
+    //==============================================================================
+    class Worker;
+
+    // the chunks one thread starts out with; other threads take from the same counter.
+    // Padded out to a cache line, so threads working on their own shares don't collide.
+    struct Share
+    {
+        std::atomic<int> next { 0 };
+        int end = 0;
+        char padding[64 - sizeof (std::atomic<int>) - sizeof (int)];
+    };
+
+    void joinJob (int participant) noexcept;
+    void workOn (int participant) noexcept;
+
+    //==============================================================================
+    // participant 0 is the thread calling perform(), the workers are 1 and up
+    std::array<Share, maxWorkers + 1> mShares;
+    int mNumParticipants = 1;
+
+    Job* mJob = nullptr;
+
+    std::atomic<juce::uint32> mGeneration { 0 };    // bumped for every job
+    std::atomic<bool> mJobOpen { false };
+    std::atomic<int> mNumWorkersInJob { 0 };
+    char mPadding[64];
+    std::atomic<int> mNumChunksDone { 0 };
+
+    juce::OwnedArray<Worker> mWorkers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VoiceRenderPool)
+};
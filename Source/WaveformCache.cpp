@@ -0,0 +1,165 @@
+/*
+  ==============================================================================
+
+    WaveformCache.cpp
+    Renders the editor's background and waveform into an image, off the
+    message thread.
+
+  ==============================================================================
+*/
+
+#include "WaveformCache.h"
+
+namespace
+{
+    const juce::Colour backgroundColour (51, 153, 102);
+    const juce::Colour waveformColour (juce::Colours::yellow);
+    const juce::Colour textColour (juce::Colours::white);
+
+    // the waveform is drawn this many logical pixels above and below the middle
+    constexpr float waveformHalfHeight = 150.0f;
+}
+
+//==============================================================================
+bool WaveformCache::Contents::operator== (const Contents& other) const noexcept
+{
+    return peaks == other.peaks
+        && width == other.width
+        && height == other.height
+        && scale == other.scale
+        && loading == other.loading
+        && name == other.name;
+}
+
+//==============================================================================
+WaveformCache::WaveformCache()
+    : juce::Thread ("Waveform renderer")
+{
+    startThread();
+}
+
+WaveformCache::~WaveformCache()
+{
+    cancelPendingUpdate();
+    stopThread (2000);
+}
+
+void WaveformCache::update (const Contents& contents)
+{
+    if (contents == mLastUpdate)
+        return;
+
+    mLastUpdate = contents;
+
+    {
+        const juce::ScopedLock sl (mLock);
+        mRequested = contents;
+        ++mRequestedVersion;
+    }
+
+    notify();
+}
+
+void WaveformCache::run()
+{
+    int renderedVersion = 0;
+
+    while (! threadShouldExit())
+    {
+        Contents contents;
+        int version;
+
+        {
+            const juce::ScopedLock sl (mLock);
+            contents = mRequested;
+            version = mRequestedVersion;
+        }
+
+        if (version == renderedVersion)
+        {
+            wait (-1);
+            continue;
+        }
+
+        auto image = render (contents);
+
+        {
+            const juce::ScopedLock sl (mLock);
+
+            // a newer request came in while this one was drawn, so go straight on to that
+            if (version != mRequestedVersion)
+                continue;
+
+            mFinished = image;
+        }
+
+        renderedVersion = version;
+        triggerAsyncUpdate();
+    }
+}
+
+void WaveformCache::handleAsyncUpdate()
+{
+    {
+        const juce::ScopedLock sl (mLock);
+        mImage = mFinished;
+    }
+
+    if (onImageReady != nullptr)
+        onImageReady();
+}
+
+juce::Image WaveformCache::render (const Contents& contents)
+{
+    const auto width = juce::roundToInt ((float) contents.width * contents.scale);
+    const auto height = juce::roundToInt ((float) contents.height * contents.scale);
+
+    if (width <= 0 || height <= 0)
+        return {};
+
+    // a software image, as other image types may only be drawn on the message thread
+    juce::Image image (juce::Image::RGB, width, height, false, juce::SoftwareImageType());
+    juce::Graphics g (image);
+    g.fillAll (backgroundColour);
+
+    auto* peaks = contents.peaks.get();
+
+    if (peaks != nullptr && peaks->getLengthInSamples() > 0)
+    {
+        // one min/max span per physical pixel, however long the sample is
+        std::vector<juce::Range<float>> columns ((size_t) width);
+        peaks->getPeaks (0, peaks->getLengthInSamples(), columns.data(), width);
+
+        const auto middle = (float) height * 0.5f;
+        const auto halfHeight = waveformHalfHeight * contents.scale;
+        g.setColour (waveformColour);
+
+        for (int x = 0; x < width; ++x)
+        {
+            auto top = juce::jmap (columns[(size_t) x].getEnd(), -1.0f, 1.0f, middle + halfHeight, middle - halfHeight);
+            auto bottom = juce::jmap (columns[(size_t) x].getStart(), -1.0f, 1.0f, middle + halfHeight, middle - halfHeight);
+
+            // at least a pixel tall, so silent stretches still show
+            g.drawVerticalLine (x, top - 0.5f, juce::jmax (bottom, top + 0.5f) + 0.5f);
+        }
+    }
+
+    g.addTransform (juce::AffineTransform::scale (contents.scale));
+    g.setColour (textColour);
+
+    const juce::Rectangle<int> bounds (contents.width, contents.height);
+
+    if (peaks != nullptr)
+    {
+        g.setFont (15.0f);
+        g.drawFittedText (contents.name, bounds.reduced (10, 10), juce::Justification::topRight, 1);
+    }
+    else
+    {
+        g.setFont (40.0f);
+        g.drawFittedText (contents.loading ? "Loading..." : "Drop an Audio File to Load",
+                          bounds, juce::Justification::centred, 1);
+    }
+
+    return image;
+}
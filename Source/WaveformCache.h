@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    WaveformCache.h
+    Renders the editor's background and waveform into an image, off the
+    message thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PeakPyramid.h"
+
+//==============================================================================
+/**
+    Keeps an image of everything behind the editor's controls: the background,
+    the waveform and the sample's name.
+
+    The image is only redrawn when update() is called with a different sample,
+    name, size or scale, and that happens on a thread of its own, so paint()
+    only has to blit the part of the image it's asked to repaint. A request
+    made while one is being drawn replaces it, so resizing doesn't queue up
+    renders of sizes that are already gone.
+*/
+class WaveformCache  : private juce::Thread,
+                       private juce::AsyncUpdater
+{
+public:
+    WaveformCache();
+    ~WaveformCache() override;
+
+    /** What the image shows. The peaks may be nullptr, for when nothing is loaded. */
+    struct Contents
+    {
+        PeakPyramid::Ptr peaks;
+        juce::String name;
+        bool loading = false;       // shown instead of the drop prompt when there are no peaks yet
+        int width = 0, height = 0;
+        float scale = 1.0f;         // physical pixels per logical pixel
+
+        bool operator== (const Contents&) const noexcept;
+        bool operator!= (const Contents& other) const noexcept  { return ! operator== (other); }
+    };
+
+    /** Starts drawing a new image, unless these are the contents already drawn or
+        being drawn. Message thread only.
+    */
+    void update (const Contents&);
+
+    /** The latest finished image, which may be of older contents than the last
+        update() asked for. Null until the first one is done. Message thread only.
+    */
+    const juce::Image& getImage() const noexcept            { return mImage; }
+
+    /** Called on the message thread whenever a new image is ready. */
+    std::function<void()> onImageReady;
+
+private:
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    static juce::Image render (const Contents&);
+
+    juce::CriticalSection mLock;
+    Contents mRequested;            // guarded by mLock
+    juce::Image mFinished;          // guarded by mLock
+    int mRequestedVersion = 0;      // guarded by mLock
+
+    Contents mLastUpdate;           // message thread only
+    juce::Image mImage;             // message thread only
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveformCache)
+};
@@ -0,0 +1,848 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Times the sampler's hot paths over a sweep of settings, and writes the
+    results as JSON so runs from different versions can be compared.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/VoiceKernels.h"
+
+namespace
+{
+    //==============================================================================
+    const InterpolationQuality allQualities[] { InterpolationQuality::linear, InterpolationQuality::hermite,
+                                                InterpolationQuality::sinc8, InterpolationQuality::sinc16,
+                                                InterpolationQuality::sinc32 };
+
+    /** The quality's name as it's given on the command line and in result ids: "sinc16" for "Sinc 16". */
+    juce::String getQualityId (InterpolationQuality quality)
+    {
+        return getInterpolationQualityName (quality).toLowerCase().removeCharacters (" ");
+    }
+
+    /** One point of the processBlock sweep. */
+    struct BlockSettings
+    {
+        int polyphony;
+        int blockSize;
+        double sampleRate;
+        double pitchRatio;
+        int sampleMegabytes;
+        InterpolationQuality quality;
+        int numThreads;
+
+        juce::String getId() const
+        {
+            return "processBlock/voices=" + juce::String (polyphony) + "/block=" + juce::String (blockSize)
+                     + "/rate=" + juce::String (sampleRate) + "/pitch=" + juce::String (pitchRatio)
+                     + "/sampleMB=" + juce::String (sampleMegabytes) + "/quality=" + getQualityId (quality)
+                     + "/threads=" + juce::String (numThreads);
+        }
+    };
+
+    /** The values each setting is swept over. Unless the whole grid is asked for,
+        each is swept on its own with the others held at their first value.
+    */
+    struct Sweep
+    {
+        juce::Array<int> polyphony { 32, 1, 4, 16, 64, 128, 256 };
+        juce::Array<int> blockSizes { 512, 16, 32, 64, 128, 256, 1024, 2048 };
+        juce::Array<double> sampleRates { 48000.0, 44100.0, 96000.0, 192000.0 };
+        juce::Array<double> pitchRatios { 1.0, 0.5, 0.75, 1.5, 2.0 };
+        juce::Array<int> sampleMegabytes { 8, 64 };
+        juce::Array<InterpolationQuality> qualities { allQualities, juce::numElementsInArray (allQualities) };
+        juce::Array<int> renderThreads { 1, 2, 4 };
+    };
+
+    constexpr double defaultSecondsPerRun = 2.0;
+    constexpr int minBlocksPerRun = 64;         // fewer and the high percentiles are just the slowest block
+    constexpr double warmUpSeconds = 0.1;
+    constexpr int defaultLoadRuns = 3;
+    constexpr double defaultTolerance = 0.15;
+
+    // the kernels are run on blocks of this size, reading at a ratio that lands on
+    // every fraction of a frame rather than just a few
+    constexpr int kernelBlockSize = 512;
+    constexpr double kernelPitchRatio = 1.37;
+    constexpr int kernelCallsPerTiming = 16;    // one call is too quick for the timer
+    constexpr float kernelTolerance = 1.0e-5f;
+
+    // the test samples: 24-bit stereo, like most sample libraries
+    constexpr double testSampleRate = 48000.0;
+    constexpr int testNumChannels = 2;
+    constexpr int testBitDepth = 24;
+
+    void printUsage()
+    {
+        std::cout << "Usage: Benchmarks [--out=results.json] [--label=<version>] [--baseline=<results.json>]" << std::endl
+                  << "                  [--voices=32,1,4,...] [--block=512,16,...] [--rate=48000,44100,...]" << std::endl
+                  << "                  [--pitch=1,0.5,...] [--sampleMB=8,64] [--quality=linear,hermite,sinc8,sinc16,sinc32]" << std::endl
+                  << "                  [--grid] [--seconds=" << defaultSecondsPerRun << "]" << std::endl
+                  << "                  [--loads=" << defaultLoadRuns << "] [--threads=1,2,4] [--offline] [--streaming] [--filter]"
+                  << " [--reverb=<ir.wav>]"
+                  << " [--tolerance=" << defaultTolerance << "]" << std::endl
+                  << "       Benchmarks --kernels [--out=results.json] [--label=<version>] [--baseline=<results.json>]"
+                  << " [--seconds=" << defaultSecondsPerRun << "]" << std::endl
+                  << std::endl
+                  << "Times loadFile() for each sample size, then processBlock() with the sampler's voices all" << std::endl
+                  << "playing, for every setting in the sweep, interpolation quality included. Each setting is" << std::endl
+                  << "swept on its own, with the others held at the first value in their list, unless --grid asks" << std::endl
+                  << "for every combination." << std::endl
+                  << std::endl
+                  << "The results are written as JSON to --out, or to stdout. With --baseline, each result is" << std::endl
+                  << "compared with the one of the same id in an earlier run, and any that got slower by more" << std::endl
+                  << "than --tolerance (a fraction) are listed, and the exit code is 2." << std::endl
+                  << std::endl
+                  << "--offline times the offline (bouncing) interpolation, --streaming plays the samples from" << std::endl
+                  << "disk rather than a memory-mapped file, and --filter runs every voice through a low-pass" << std::endl
+                  << "filter. --reverb convolves the output with the given impulse response. --threads sweeps the" << std::endl
+                  << "number of render threads, to show how rendering scales; more than the machine has physical" << std::endl
+                  << "cores are left out." << std::endl
+                  << std::endl
+                  << "--kernels runs each of the voice kernels' SIMD paths and its plain C++ version on the same" << std::endl
+                  << "input instead, fails if their results differ, and times both." << std::endl;
+    }
+
+    int fail (const juce::String& message)
+    {
+        std::cerr << "Benchmarks: " << message << std::endl;
+        return 1;
+    }
+
+    template <typename Type>
+    juce::Array<Type> parseList (const juce::ArgumentList& args, juce::StringRef option, const juce::Array<Type>& defaultValues)
+    {
+        if (! args.containsOption (option))
+            return defaultValues;
+
+        juce::Array<Type> values;
+
+        for (auto& token : juce::StringArray::fromTokens (args.getValueForOption (option), ",", ""))
+            if (token.trim().isNotEmpty())
+                values.addIfNotAlreadyThere ((Type) token.getDoubleValue());
+
+        return values;
+    }
+
+    /** Reads a list of quality ids. Returns an empty list if any of them isn't one. */
+    juce::Array<InterpolationQuality> parseQualities (const juce::ArgumentList& args, const juce::Array<InterpolationQuality>& defaultValues)
+    {
+        if (! args.containsOption ("--quality"))
+            return defaultValues;
+
+        juce::Array<InterpolationQuality> values;
+
+        for (auto& token : juce::StringArray::fromTokens (args.getValueForOption ("--quality"), ",", ""))
+        {
+            if (token.trim().isEmpty())
+                continue;
+
+            auto found = std::find_if (std::begin (allQualities), std::end (allQualities),
+                                       [&] (InterpolationQuality q) { return getQualityId (q) == token.trim().toLowerCase(); });
+
+            if (found == std::end (allQualities))
+                return {};
+
+            values.addIfNotAlreadyThere (*found);
+        }
+
+        return values;
+    }
+
+    //==============================================================================
+    struct Statistics
+    {
+        double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, p999 = 0.0, max = 0.0;
+    };
+
+    Statistics getStatistics (std::vector<double> values)
+    {
+        Statistics stats;
+
+        if (values.empty())
+            return stats;
+
+        std::sort (values.begin(), values.end());
+
+        auto percentile = [&values] (double fraction)
+        {
+            auto index = (size_t) std::ceil (fraction * (double) values.size());
+            return values[juce::jlimit ((size_t) 0, values.size() - 1, index > 0 ? index - 1 : 0)];
+        };
+
+        stats.mean = std::accumulate (values.begin(), values.end(), 0.0) / (double) values.size();
+        stats.p50 = percentile (0.5);
+        stats.p90 = percentile (0.9);
+        stats.p99 = percentile (0.99);
+        stats.p999 = percentile (0.999);
+        stats.max = values.back();
+        return stats;
+    }
+
+    void setStatistics (juce::DynamicObject& result, const juce::String& prefix, const Statistics& stats)
+    {
+        result.setProperty (prefix + "Mean", stats.mean);
+        result.setProperty (prefix + "P50", stats.p50);
+        result.setProperty (prefix + "P90", stats.p90);
+        result.setProperty (prefix + "P99", stats.p99);
+        result.setProperty (prefix + "P999", stats.p999);
+        result.setProperty (prefix + "Max", stats.max);
+    }
+
+    double getSecondsSince (juce::int64 startTicks)
+    {
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    }
+
+    //==============================================================================
+    /** Writes a WAV of noise-modulated sines of about the given size, unless the
+        one from an earlier run is still there. Noise keeps it from being any
+        cheaper to read than a real recording.
+    */
+    juce::File createTestSample (const juce::File& directory, int megabytes)
+    {
+        auto file = directory.getChildFile ("benchmark_" + juce::String (megabytes) + "MB.wav");
+        const auto numFrames = (juce::int64) megabytes * 1024 * 1024 / (testNumChannels * testBitDepth / 8);
+
+        juce::WavAudioFormat wav;
+
+        if (file.existsAsFile())
+        {
+            std::unique_ptr<juce::AudioFormatReader> reader (wav.createReaderFor (file.createInputStream().release(), true));
+
+            if (reader != nullptr && reader->lengthInSamples == numFrames)
+                return file;
+        }
+
+        if (! directory.createDirectory() || ! file.deleteFile())
+            return {};
+
+        std::unique_ptr<juce::FileOutputStream> out (file.createOutputStream());
+
+        if (out == nullptr)
+            return {};
+
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (out.get(), testSampleRate, testNumChannels,
+                                                                              testBitDepth, {}, 0));
+
+        if (writer == nullptr)
+            return {};
+
+        out.release();
+
+        juce::AudioBuffer<float> buffer (testNumChannels, 65536);
+        juce::Random random (megabytes);
+        double phase = 0.0;
+        const auto phaseDelta = juce::MathConstants<double>::twoPi * 220.0 / testSampleRate;
+
+        for (juce::int64 position = 0; position < numFrames; position += buffer.getNumSamples())
+        {
+            const auto numSamples = (int) juce::jmin ((juce::int64) buffer.getNumSamples(), numFrames - position);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto sine = (float) std::sin (phase);
+                phase += phaseDelta;
+
+                for (int channel = 0; channel < testNumChannels; ++channel)
+                    buffer.setSample (channel, i, 0.5f * sine + 0.1f * (random.nextFloat() - 0.5f));
+            }
+
+            if (! writer->writeFromAudioSampleBuffer (buffer, 0, numSamples))
+                return {};
+        }
+
+        return file;
+    }
+
+    // the processor hands loaded samples over on the message thread
+    bool waitForSample (SimpleSamplerAudioProcessor& processor)
+    {
+        auto* messageManager = juce::MessageManager::getInstance();
+
+        while (processor.isLoading())
+            messageManager->runDispatchLoopUntil (1);
+
+        messageManager->runDispatchLoopUntil (1);
+        return processor.getNumSamplerSounds() > 0;
+    }
+
+    // notes an octave or more up read the mip-maps once they're there
+    void waitForMipMaps (SimpleSamplerAudioProcessor& processor)
+    {
+        while (processor.isBuildingMipMaps())
+            juce::MessageManager::getInstance()->runDispatchLoopUntil (10);
+    }
+
+    //==============================================================================
+    /** Loads the sample into fresh processors, one after another, so that nothing
+        is shared from the SamplePool. The file will be in the OS's cache after the
+        first run, so this measures the sampler's own decoding and analysis.
+    */
+    juce::var benchmarkLoad (const juce::File& sample, int megabytes, int numRuns, bool useMemoryMapping)
+    {
+        std::vector<double> seconds;
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            SimpleSamplerAudioProcessor processor;
+            processor.setUseMemoryMapping (useMemoryMapping);
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            processor.loadFile (sample.getFullPathName());
+
+            if (! waitForSample (processor))
+                return {};
+
+            seconds.push_back (getSecondsSince (start));
+        }
+
+        auto stats = getStatistics (seconds);
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("id", "loadFile/sampleMB=" + juce::String (megabytes));
+        result->setProperty ("benchmark", "loadFile");
+        result->setProperty ("sampleMB", megabytes);
+        result->setProperty ("runs", numRuns);
+        result->setProperty ("secondsMin", *std::min_element (seconds.begin(), seconds.end()));
+        result->setProperty ("secondsMedian", stats.p50);
+        result->setProperty ("megabytesPerSecond", megabytes / juce::jmax (stats.p50, 1.0e-9));
+        return result;
+    }
+
+    /** Starts the given number of notes, all at about the pitch ratio. Notes on the
+        same key and channel would cut each other off, so they're spread over every
+        channel first, then over the neighbouring keys.
+    */
+    void addNoteOns (juce::MidiBuffer& midi, int numVoices, double pitchRatio)
+    {
+        constexpr int rootNote = 60;
+        const auto centreNote = rootNote + juce::roundToInt (12.0 * std::log2 (pitchRatio));
+        const auto notesPerChannel = (numVoices + 15) / 16;
+
+        for (int i = 0; i < numVoices; ++i)
+        {
+            const auto note = juce::jlimit (0, 127, centreNote + i / 16 - notesPerChannel / 2);
+            midi.addEvent (juce::MidiMessage::noteOn (1 + i % 16, note, 0.8f), 0);
+        }
+    }
+
+    juce::var benchmarkProcessBlock (const juce::File& sample, const BlockSettings& settings, double secondsPerRun,
+                                     bool offline, bool useMemoryMapping, bool useFilter, const juce::File& impulseResponse)
+    {
+        SimpleSamplerAudioProcessor processor;
+        processor.setUseMemoryMapping (useMemoryMapping);
+        processor.setNumRenderThreads (settings.numThreads);
+        processor.setNonRealtime (offline);
+        processor.setPolyphony (settings.polyphony);
+
+        if (offline)
+            processor.setOfflineInterpolationQuality (settings.quality);
+        else
+            processor.setRealtimeInterpolationQuality (settings.quality);
+
+        if (useFilter)
+        {
+            auto& parameters = processor.getParameters();
+            auto* type = parameters.getParameter (ParameterIDs::filterType);
+            auto* cutoff = parameters.getParameter (ParameterIDs::cutoff);
+
+            type->setValueNotifyingHost (type->convertTo0to1 ((float) VoiceFilterType::lowPass));
+            cutoff->setValueNotifyingHost (cutoff->convertTo0to1 (2000.0f));
+        }
+
+        processor.setRateAndBufferSizeDetails (settings.sampleRate, settings.blockSize);
+        processor.prepareToPlay (settings.sampleRate, settings.blockSize);
+
+        processor.loadFile (sample.getFullPathName());
+
+        if (! waitForSample (processor))
+            return {};
+
+        // the response is made for the rate prepareToPlay gave, and shared with the processors before
+        if (impulseResponse != juce::File())
+        {
+            processor.loadImpulseResponse (impulseResponse);
+
+            while (processor.isLoadingImpulseResponse())
+                juce::MessageManager::getInstance()->runDispatchLoopUntil (1);
+        }
+
+        // at any other rate than the sample's, this plays a converted copy with a mip-map of its own
+        waitForMipMaps (processor);
+
+        const auto blockSeconds = settings.blockSize / settings.sampleRate;
+        const auto numWarmUpBlocks = juce::jmax (1, (int) std::ceil (warmUpSeconds / blockSeconds));
+        const auto numBlocks = juce::jmax (minBlocksPerRun, (int) std::ceil (secondsPerRun / blockSeconds));
+
+        juce::AudioBuffer<float> buffer (processor.getTotalNumOutputChannels(), settings.blockSize);
+        juce::MidiBuffer midi;
+        addNoteOns (midi, settings.polyphony, settings.pitchRatio);
+
+        std::vector<double> microseconds;
+        microseconds.reserve ((size_t) numBlocks);
+        const auto underrunsBefore = processor.getNumStreamingUnderruns();
+
+        for (int block = 0; block < numWarmUpBlocks + numBlocks; ++block)
+        {
+            buffer.clear();
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            const auto elapsed = getSecondsSince (start);
+
+            midi.clear();
+
+            if (block >= numWarmUpBlocks)
+                microseconds.push_back (elapsed * 1.0e6);
+        }
+
+        // voices that have run off the end of the sample cost next to nothing, so a
+        // silent last block means the run measured less than it says
+        const auto endedEarly = buffer.getMagnitude (0, buffer.getNumSamples()) == 0.0f;
+
+        auto stats = getStatistics (microseconds);
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("id", settings.getId());
+        result->setProperty ("benchmark", "processBlock");
+        result->setProperty ("voices", settings.polyphony);
+        result->setProperty ("blockSize", settings.blockSize);
+        result->setProperty ("sampleRate", settings.sampleRate);
+        result->setProperty ("pitchRatio", settings.pitchRatio);
+        result->setProperty ("sampleMB", settings.sampleMegabytes);
+        result->setProperty ("quality", getQualityId (settings.quality));
+        result->setProperty ("renderThreads", settings.numThreads);
+        result->setProperty ("blocks", numBlocks);
+        setStatistics (*result, "microseconds", stats);
+        result->setProperty ("nanosecondsPerVoiceSample", stats.mean * 1000.0 / (settings.polyphony * settings.blockSize));
+        result->setProperty ("cpuLoad", stats.mean * 1.0e-6 / blockSeconds);
+        result->setProperty ("cpuLoadP99", stats.p99 * 1.0e-6 / blockSeconds);
+        result->setProperty ("streamingUnderruns", processor.getNumStreamingUnderruns() - underrunsBefore);
+        result->setProperty ("sampleEndedEarly", endedEarly);
+        return result;
+    }
+
+    std::vector<BlockSettings> getBlockSettings (const Sweep& sweep, bool fullGrid)
+    {
+        std::vector<BlockSettings> all;
+        juce::StringArray ids;
+
+        auto add = [&] (const BlockSettings& settings)
+        {
+            if (! ids.contains (settings.getId()))
+            {
+                ids.add (settings.getId());
+                all.push_back (settings);
+            }
+        };
+
+        const BlockSettings base { sweep.polyphony[0], sweep.blockSizes[0], sweep.sampleRates[0],
+                                   sweep.pitchRatios[0], sweep.sampleMegabytes[0], sweep.qualities[0],
+                                   sweep.renderThreads[0] };
+
+        if (fullGrid)
+        {
+            for (auto numThreads : sweep.renderThreads)
+                for (auto quality : sweep.qualities)
+                    for (auto megabytes : sweep.sampleMegabytes)
+                        for (auto rate : sweep.sampleRates)
+                            for (auto ratio : sweep.pitchRatios)
+                                for (auto blockSize : sweep.blockSizes)
+                                    for (auto polyphony : sweep.polyphony)
+                                        add ({ polyphony, blockSize, rate, ratio, megabytes, quality, numThreads });
+
+            return all;
+        }
+
+        add (base);
+
+        for (auto polyphony : sweep.polyphony)      { auto s = base; s.polyphony = polyphony;        add (s); }
+        for (auto blockSize : sweep.blockSizes)     { auto s = base; s.blockSize = blockSize;        add (s); }
+        for (auto rate : sweep.sampleRates)         { auto s = base; s.sampleRate = rate;            add (s); }
+        for (auto ratio : sweep.pitchRatios)        { auto s = base; s.pitchRatio = ratio;           add (s); }
+        for (auto megabytes : sweep.sampleMegabytes) { auto s = base; s.sampleMegabytes = megabytes; add (s); }
+        for (auto quality : sweep.qualities)        { auto s = base; s.quality = quality;            add (s); }
+        for (auto numThreads : sweep.renderThreads) { auto s = base; s.numThreads = numThreads;      add (s); }
+
+        return all;
+    }
+
+    //==============================================================================
+    /** Times a kernel over a block, kernelCallsPerTiming calls at a time, and gives
+        the microseconds each call took.
+    */
+    Statistics timeKernel (const std::function<void()>& kernel, double seconds)
+    {
+        std::vector<double> microseconds;
+        const auto runStart = juce::Time::getHighResolutionTicks();
+
+        while (microseconds.size() < (size_t) minBlocksPerRun || getSecondsSince (runStart) < seconds)
+        {
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            for (int i = 0; i < kernelCallsPerTiming; ++i)
+                kernel();
+
+            microseconds.push_back (getSecondsSince (start) * 1.0e6 / kernelCallsPerTiming);
+        }
+
+        return getStatistics (microseconds);
+    }
+
+    juce::var getKernelResult (const juce::String& name, const juce::String& instructionSet, const Statistics& stats)
+    {
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("id", "kernel/" + name + "/" + (instructionSet == "scalar" ? "scalar" : "simd"));
+        result->setProperty ("benchmark", "kernel");
+        result->setProperty ("kernel", name);
+        result->setProperty ("instructionSet", instructionSet);
+        result->setProperty ("blockSize", kernelBlockSize);
+        setStatistics (*result, "microseconds", stats);
+        result->setProperty ("nanosecondsPerSample", stats.mean * 1000.0 / kernelBlockSize);
+        return result;
+    }
+
+    /** Runs every VoiceKernels kernel and its scalar version on the same random
+        input, then times both. The interpolators are all given the scalar read
+        positions, so each comparison is of one kernel alone. Returns an error
+        message if any of them differ by more than kernelTolerance.
+    */
+    juce::String benchmarkKernels (double secondsPerRun, juce::Array<juce::var>& results)
+    {
+        juce::SharedResourcePointer<InterpolationTables> tables;
+        tables->prepare();
+
+        // room either side for the widest sinc
+        constexpr int padding = InterpolationTables::maxTaps;
+        const auto numSourceFrames = (int) std::ceil (kernelBlockSize * kernelPitchRatio) + 2 * padding;
+
+        std::vector<float> source ((size_t) numSourceFrames), envelope ((size_t) kernelBlockSize);
+        juce::Random random (1);
+
+        for (auto& sample : source)
+            sample = 2.0f * random.nextFloat() - 1.0f;
+
+        for (auto& level : envelope)
+            level = random.nextFloat();
+
+        const auto* in = source.data() + padding;
+        const auto startFraction = 0.25;
+        const auto gain = 0.7f;
+
+        std::vector<int> index ((size_t) kernelBlockSize), simdIndex ((size_t) kernelBlockSize);
+        std::vector<float> alpha ((size_t) kernelBlockSize), simdAlpha ((size_t) kernelBlockSize);
+        std::vector<float> out ((size_t) kernelBlockSize), simdOut ((size_t) kernelBlockSize);
+
+        const juce::String instructionSet (VoiceKernels::getInstructionSetName());
+
+        auto withinTolerance = [] (double a, double b)
+        {
+            return std::abs (a - b) <= kernelTolerance * juce::jmax (1.0, std::abs (b));
+        };
+
+        auto check = [&] (const juce::String& name, const std::function<void()>& simd, const std::function<void()>& scalar,
+                          const std::function<double (int)>& simdValue, const std::function<double (int)>& scalarValue) -> juce::String
+        {
+            simd();
+            scalar();
+
+            double maxError = 0.0;
+
+            for (int i = 0; i < kernelBlockSize; ++i)
+            {
+                if (! withinTolerance (simdValue (i), scalarValue (i)))
+                    return "the " + instructionSet + " " + name + " kernel gives " + juce::String (simdValue (i))
+                             + " at sample " + juce::String (i) + " where the scalar one gives " + juce::String (scalarValue (i));
+
+                maxError = juce::jmax (maxError, std::abs (simdValue (i) - scalarValue (i)));
+            }
+
+            std::cerr << "kernel/" << name << std::endl;
+
+            const auto simdStats = timeKernel (simd, secondsPerRun);
+            const auto scalarStats = timeKernel (scalar, secondsPerRun);
+
+            auto simdResult = getKernelResult (name, instructionSet, simdStats);
+            simdResult.getDynamicObject()->setProperty ("maxError", maxError);
+            simdResult.getDynamicObject()->setProperty ("speedup", scalarStats.mean / juce::jmax (simdStats.mean, 1.0e-9));
+
+            results.add (simdResult);
+            results.add (getKernelResult (name, "scalar", scalarStats));
+            return {};
+        };
+
+        auto error = check ("readPositions",
+                            [&] { VoiceKernels::computeReadPositions (startFraction, kernelPitchRatio, simdIndex.data(), simdAlpha.data(), kernelBlockSize); },
+                            [&] { VoiceKernels::computeReadPositionsScalar (startFraction, kernelPitchRatio, index.data(), alpha.data(), kernelBlockSize); },
+                            [&] (int i) { return simdIndex[(size_t) i] + (double) simdAlpha[(size_t) i]; },
+                            [&] (int i) { return index[(size_t) i] + (double) alpha[(size_t) i]; });
+
+        auto simdOutput = [&] (int i) { return (double) simdOut[(size_t) i]; };
+        auto scalarOutput = [&] (int i) { return (double) out[(size_t) i]; };
+
+        if (error.isEmpty())
+            error = check ("linear",
+                           [&] { VoiceKernels::interpolateLinear (in, index.data(), alpha.data(), simdOut.data(), kernelBlockSize); },
+                           [&] { VoiceKernels::interpolateLinearScalar (in, index.data(), alpha.data(), out.data(), kernelBlockSize); },
+                           simdOutput, scalarOutput);
+
+        if (error.isEmpty())
+            error = check ("hermite",
+                           [&] { VoiceKernels::interpolateHermite (in, index.data(), alpha.data(), simdOut.data(), kernelBlockSize); },
+                           [&] { VoiceKernels::interpolateHermiteScalar (in, index.data(), alpha.data(), out.data(), kernelBlockSize); },
+                           simdOutput, scalarOutput);
+
+        for (auto quality : { InterpolationQuality::sinc8, InterpolationQuality::sinc16, InterpolationQuality::sinc32 })
+        {
+            const auto* table = tables->getSincTable (quality, kernelPitchRatio);
+            const auto numTaps = getNumSincTaps (quality);
+
+            if (error.isEmpty())
+                error = check ("sinc" + juce::String (numTaps),
+                               [&] { VoiceKernels::interpolateSinc (in, index.data(), alpha.data(), simdOut.data(), kernelBlockSize, table, numTaps); },
+                               [&] { VoiceKernels::interpolateSincScalar (in, index.data(), alpha.data(), out.data(), kernelBlockSize, table, numTaps); },
+                               simdOutput, scalarOutput);
+        }
+
+        // out accumulates, so both start from the same block and are compared after one call
+        if (error.isEmpty())
+            error = check ("addChannel",
+                           [&] { std::copy (source.begin(), source.begin() + kernelBlockSize, simdOut.begin());
+                                 VoiceKernels::addChannel (simdOut.data(), in, envelope.data(), gain, kernelBlockSize); },
+                           [&] { std::copy (source.begin(), source.begin() + kernelBlockSize, out.begin());
+                                 VoiceKernels::addChannelScalar (out.data(), in, envelope.data(), gain, kernelBlockSize); },
+                           simdOutput, scalarOutput);
+
+        return error;
+    }
+
+    //==============================================================================
+    juce::var getSystemInfo()
+    {
+        auto* info = new juce::DynamicObject();
+        info->setProperty ("cpu", juce::SystemStats::getCpuModel());
+        info->setProperty ("logicalCpus", juce::SystemStats::getNumCpus());
+        info->setProperty ("physicalCpus", juce::SystemStats::getNumPhysicalCpus());
+        info->setProperty ("os", juce::SystemStats::getOperatingSystemName());
+        info->setProperty ("juce", juce::SystemStats::getJUCEVersion());
+       #if JUCE_DEBUG
+        info->setProperty ("build", "debug");
+       #else
+        info->setProperty ("build", "release");
+       #endif
+        return info;
+    }
+
+    /** Lists the results that are slower than the same ones in the baseline, and
+        returns how many there were. Loads compare their median time, blocks and
+        kernels their median and 99th percentile. The list goes to stderr, so it
+        never gets mixed into the JSON when that is written to stdout.
+    */
+    int compareWithBaseline (const juce::Array<juce::var>& results, const juce::var& baseline, double tolerance)
+    {
+        std::map<juce::String, juce::var> previous;
+
+        if (auto* baselineResults = baseline["results"].getArray())
+            for (auto& result : *baselineResults)
+                previous[result["id"].toString()] = result;
+
+        int numRegressions = 0;
+
+        auto check = [&] (const juce::var& result, const juce::var& old, const char* metric)
+        {
+            const auto now = (double) result[metric];
+            const auto before = (double) old[metric];
+
+            if (before > 0.0 && now > before * (1.0 + tolerance))
+            {
+                std::cerr << "Slower: " << result["id"].toString() << " " << metric << " " << juce::String (before, 3)
+                          << " -> " << juce::String (now, 3) << " (+" << juce::String (100.0 * (now / before - 1.0), 1)
+                          << "%)" << std::endl;
+                ++numRegressions;
+            }
+        };
+
+        for (auto& result : results)
+        {
+            auto found = previous.find (result["id"].toString());
+
+            if (found == previous.end())
+                continue;
+
+            if (result["benchmark"].toString() == "loadFile")
+            {
+                check (result, found->second, "secondsMedian");
+            }
+            else
+            {
+                check (result, found->second, "microsecondsP50");
+                check (result, found->second, "microsecondsP99");
+            }
+        }
+
+        return numRegressions;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+
+    if (args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    Sweep sweep;
+    sweep.polyphony = parseList (args, "--voices", sweep.polyphony);
+    sweep.blockSizes = parseList (args, "--block", sweep.blockSizes);
+    sweep.sampleRates = parseList (args, "--rate", sweep.sampleRates);
+    sweep.pitchRatios = parseList (args, "--pitch", sweep.pitchRatios);
+    sweep.sampleMegabytes = parseList (args, "--sampleMB", sweep.sampleMegabytes);
+    sweep.qualities = parseQualities (args, sweep.qualities);
+    sweep.renderThreads = parseList (args, "--threads", sweep.renderThreads);
+
+    const auto secondsPerRun = args.containsOption ("--seconds") ? args.getValueForOption ("--seconds").getDoubleValue() : defaultSecondsPerRun;
+    const auto numLoadRuns = args.containsOption ("--loads") ? args.getValueForOption ("--loads").getIntValue() : defaultLoadRuns;
+    const auto tolerance = args.containsOption ("--tolerance") ? args.getValueForOption ("--tolerance").getDoubleValue() : defaultTolerance;
+    const auto offline = args.containsOption ("--offline");
+    const auto useMemoryMapping = ! args.containsOption ("--streaming");
+    const auto useFilter = args.containsOption ("--filter");
+    const auto impulseResponse = args.containsOption ("--reverb") ? args.getExistingFileForOption ("--reverb") : juce::File();
+
+    auto valid = [] (auto& list, auto low, auto high)
+    {
+        return ! list.isEmpty() && std::all_of (list.begin(), list.end(), [=] (auto v) { return v >= low && v <= high; });
+    };
+
+    if (! valid (sweep.polyphony, 1, SimpleSamplerAudioProcessor::getMaxPolyphony()))
+        return fail ("--voices must be between 1 and " + juce::String (SimpleSamplerAudioProcessor::getMaxPolyphony()));
+
+    // the processor wouldn't use more threads than that, so the result would be mislabelled
+    sweep.renderThreads.removeIf ([] (int n) { return n > SimpleSamplerAudioProcessor::getMaxRenderThreads(); });
+
+    if (! valid (sweep.renderThreads, 1, SimpleSamplerAudioProcessor::getMaxRenderThreads()))
+        return fail ("--threads must be between 1 and " + juce::String (SimpleSamplerAudioProcessor::getMaxRenderThreads())
+                       + " on this machine");
+
+    if (! valid (sweep.blockSizes, 1, 1 << 16) || ! valid (sweep.sampleRates, 1000.0, 768000.0)
+         || ! valid (sweep.pitchRatios, 1.0 / 16.0, 16.0) || ! valid (sweep.sampleMegabytes, 1, 4096)
+         || sweep.qualities.isEmpty()
+         || secondsPerRun <= 0.0 || numLoadRuns <= 0)
+        return fail ("a setting is out of range; see --help");
+
+    juce::var baseline;
+
+    if (args.containsOption ("--baseline"))
+    {
+        baseline = juce::JSON::parse (args.getExistingFileForOption ("--baseline"));
+
+        if (! baseline.isObject())
+            return fail ("couldn't read the baseline " + args.getValueForOption ("--baseline"));
+    }
+
+    juce::Array<juce::var> results;
+
+    if (args.containsOption ("--kernels"))
+    {
+        auto error = benchmarkKernels (secondsPerRun, results);
+
+        if (error.isNotEmpty())
+            return fail (error);
+    }
+    else
+    {
+        // loading, and handing loaded samples to the processor, need a message manager
+        juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+        const auto sampleDirectory = juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("simpleSamplerBenchmarks");
+        std::map<int, juce::File> samples;
+
+        for (auto megabytes : sweep.sampleMegabytes)
+        {
+            std::cerr << "Writing the " << megabytes << " MB test sample..." << std::endl;
+            samples[megabytes] = createTestSample (sampleDirectory, megabytes);
+
+            if (samples[megabytes] == juce::File())
+                return fail ("couldn't write a test sample to " + sampleDirectory.getFullPathName());
+        }
+
+        for (auto megabytes : sweep.sampleMegabytes)
+        {
+            std::cerr << "loadFile, " << megabytes << " MB" << std::endl;
+            auto result = benchmarkLoad (samples[megabytes], megabytes, numLoadRuns, useMemoryMapping);
+
+            if (result.isVoid())
+                return fail ("couldn't load " + samples[megabytes].getFullPathName());
+
+            results.add (result);
+        }
+
+        // keeps each sample in the SamplePool, so the processors below don't decode it again
+        std::vector<std::unique_ptr<SimpleSamplerAudioProcessor>> sampleHolders;
+
+        for (auto megabytes : sweep.sampleMegabytes)
+        {
+            sampleHolders.emplace_back (new SimpleSamplerAudioProcessor());
+            sampleHolders.back()->setUseMemoryMapping (useMemoryMapping);
+            sampleHolders.back()->loadFile (samples[megabytes].getFullPathName());
+            waitForSample (*sampleHolders.back());
+        }
+
+        waitForMipMaps (*sampleHolders.back());
+
+        for (auto& settings : getBlockSettings (sweep, args.containsOption ("--grid")))
+        {
+            std::cerr << settings.getId() << std::endl;
+            auto result = benchmarkProcessBlock (samples[settings.sampleMegabytes], settings, secondsPerRun,
+                                                 offline, useMemoryMapping, useFilter, impulseResponse);
+
+            if (result.isVoid())
+                return fail ("couldn't load " + samples[settings.sampleMegabytes].getFullPathName());
+
+            results.add (result);
+        }
+    }
+
+    auto* settings = new juce::DynamicObject();
+    settings->setProperty ("secondsPerRun", secondsPerRun);
+    settings->setProperty ("offline", offline);
+    settings->setProperty ("memoryMapping", useMemoryMapping);
+    settings->setProperty ("filter", useFilter);
+    settings->setProperty ("reverb", impulseResponse.getFileName());
+    settings->setProperty ("kernels", args.containsOption ("--kernels"));
+
+    auto* report = new juce::DynamicObject();
+    report->setProperty ("label", args.getValueForOption ("--label"));
+    report->setProperty ("date", juce::Time::getCurrentTime().toISO8601 (true));
+    report->setProperty ("system", getSystemInfo());
+    report->setProperty ("settings", settings);
+    report->setProperty ("results", results);
+
+    const auto json = juce::JSON::toString (juce::var (report));
+
+    if (args.containsOption ("--out"))
+    {
+        auto outputFile = args.getFileForOption ("--out");
+
+        if (! outputFile.replaceWithText (json))
+            return fail ("couldn't write to " + outputFile.getFullPathName());
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+
+    if (baseline.isObject() && compareWithBaseline (results, baseline, tolerance) > 0)
+        return 2;
+
+    return 0;
+}
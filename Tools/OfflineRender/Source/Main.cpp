@@ -0,0 +1,210 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Renders a MIDI file through the sampler into a WAV file, as fast as it can,
+    without an audio device or a host.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+
+namespace
+{
+    constexpr double defaultSampleRate = 48000.0;
+    constexpr int defaultBlockSize = 512;
+    constexpr double defaultTailSeconds = 2.0;
+    constexpr int defaultBitDepth = 24;
+
+    void printUsage()
+    {
+        std::cout << "Usage: OfflineRender --sample=<file> --midi=<file> --out=<file.wav>" << std::endl
+                  << "                     [--rate=" << defaultSampleRate << "] [--block=" << defaultBlockSize << "]"
+                  << " [--tail=" << defaultTailSeconds << "] [--bits=" << defaultBitDepth << "|32]"
+                  << " [--threads=1] [--realtime]" << std::endl
+                  << std::endl
+                  << "Plays the MIDI file (all tracks, on every channel) through the sampler with the sample" << std::endl
+                  << "(a WAV, AIFF, MP3, FLAC or SFZ) loaded, calling processBlock back to back, and writes the" << std::endl
+                  << "output to a WAV file. The sampler runs non-realtime, as it would in a host's bounce," << std::endl
+                  << "unless --realtime is given. --tail is how long to keep rendering after the last event." << std::endl;
+    }
+
+    int fail (const juce::String& message)
+    {
+        std::cerr << "OfflineRender: " << message << std::endl;
+        return 1;
+    }
+
+    // every track, merged, with timestamps in seconds
+    bool readMidiFile (const juce::File& file, juce::MidiMessageSequence& sequence)
+    {
+        juce::FileInputStream in (file);
+        juce::MidiFile midiFile;
+
+        if (! in.openedOk() || ! midiFile.readFrom (in))
+            return false;
+
+        midiFile.convertTimestampTicksToSeconds();
+
+        for (int i = 0; i < midiFile.getNumTracks(); ++i)
+            sequence.addSequence (*midiFile.getTrack (i), 0.0);
+
+        sequence.sort();
+        sequence.updateMatchedPairs();
+        return true;
+    }
+
+    // the processor hands loaded samples over on the message thread
+    bool waitForSample (SimpleSamplerAudioProcessor& processor)
+    {
+        auto* messageManager = juce::MessageManager::getInstance();
+
+        // high notes sound different before the mip-maps are ready, so they're waited for too
+        while (processor.isLoading() || processor.isBuildingMipMaps())
+            messageManager->runDispatchLoopUntil (10);
+
+        messageManager->runDispatchLoopUntil (10);
+        return processor.getNumSamplerSounds() > 0;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+
+    if (args.containsOption ("--help|-h") || args.size() == 0)
+    {
+        printUsage();
+        return 0;
+    }
+
+    // the ArgumentList getters throw on a missing option, and there's no ConsoleApplication
+    // here to catch it, so the paths are checked first
+    for (auto* option : { "--sample", "--midi", "--out" })
+    {
+        if (args.getValueForOption (option).isEmpty())
+        {
+            printUsage();
+            return fail (juce::String (option) + " needs a file");
+        }
+    }
+
+    const juce::File sampleFile (args.getFileForOption ("--sample"));
+    const juce::File midiFile (args.getFileForOption ("--midi"));
+    const juce::File outputFile (args.getFileForOption ("--out"));
+
+    for (auto& file : { sampleFile, midiFile })
+        if (! file.existsAsFile())
+            return fail ("there's no file at " + file.getFullPathName());
+
+    const auto sampleRate = args.containsOption ("--rate") ? args.getValueForOption ("--rate").getDoubleValue() : defaultSampleRate;
+    const auto blockSize = args.containsOption ("--block") ? args.getValueForOption ("--block").getIntValue() : defaultBlockSize;
+    const auto tailSeconds = args.containsOption ("--tail") ? args.getValueForOption ("--tail").getDoubleValue() : defaultTailSeconds;
+    const auto bitDepth = args.containsOption ("--bits") ? args.getValueForOption ("--bits").getIntValue() : defaultBitDepth;
+    const auto numThreads = args.containsOption ("--threads") ? args.getValueForOption ("--threads").getIntValue() : 1;
+
+    if (sampleRate <= 0.0 || blockSize <= 0 || tailSeconds < 0.0)
+        return fail ("the rate, block size and tail must be positive");
+
+    if (bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+        return fail ("--bits must be 16, 24 or 32");
+
+    // the sampler's loader, timers and async updates all need a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::MidiMessageSequence sequence;
+
+    if (! readMidiFile (midiFile, sequence))
+        return fail ("couldn't read the MIDI file " + midiFile.getFullPathName());
+
+    SimpleSamplerAudioProcessor processor;
+    processor.setNumRenderThreads (numThreads);
+    processor.setNonRealtime (! args.containsOption ("--realtime"));
+    processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+    processor.prepareToPlay (sampleRate, blockSize);
+
+    const auto loadStart = juce::Time::getMillisecondCounterHiRes();
+    processor.loadFile (sampleFile.getFullPathName());
+
+    if (! waitForSample (processor))
+        return fail ("couldn't load the sample " + sampleFile.getFullPathName());
+
+    const auto loadSeconds = (juce::Time::getMillisecondCounterHiRes() - loadStart) * 0.001;
+
+    const auto numChannels = processor.getTotalNumOutputChannels();
+    const auto endTime = (sequence.getNumEvents() > 0 ? sequence.getEndTime() : 0.0) + tailSeconds;
+    const auto totalSamples = (juce::int64) std::ceil (endTime * sampleRate);
+
+    outputFile.deleteFile();
+    std::unique_ptr<juce::FileOutputStream> out (outputFile.createOutputStream());
+
+    if (out == nullptr)
+        return fail ("couldn't write to " + outputFile.getFullPathName());
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (out.get(), sampleRate, (unsigned int) numChannels,
+                                                                          bitDepth, {}, 0));
+
+    if (writer == nullptr)
+        return fail ("couldn't create a WAV writer");
+
+    out.release();  // the writer owns it now
+
+    juce::AudioBuffer<float> buffer (numChannels, blockSize);
+    juce::MidiBuffer midi;
+    int nextEvent = 0;
+    double renderSeconds = 0.0;
+
+    for (juce::int64 position = 0; position < totalSamples; position += blockSize)
+    {
+        const auto numSamples = (int) juce::jmin ((juce::int64) blockSize, totalSamples - position);
+        const auto blockEnd = position + numSamples;
+
+        // the events that fall in this block, at their offsets into it
+        midi.clear();
+
+        for (; nextEvent < sequence.getNumEvents(); ++nextEvent)
+        {
+            auto& message = sequence.getEventPointer (nextEvent)->message;
+            auto samplePosition = (juce::int64) std::llround (message.getTimeStamp() * sampleRate);
+
+            if (samplePosition >= blockEnd)
+                break;
+
+            if (! message.isMetaEvent())
+                midi.addEvent (message, (int) juce::jmax ((juce::int64) 0, samplePosition - position));
+        }
+
+        // a short last block is passed on as it is, like hosts do at the end of a bounce
+        buffer.setSize (numChannels, numSamples, false, false, true);
+        buffer.clear();
+
+        const auto blockStart = juce::Time::getHighResolutionTicks();
+        processor.processBlock (buffer, midi);
+        renderSeconds += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - blockStart);
+
+        if (! writer->writeFromAudioSampleBuffer (buffer, 0, numSamples))
+            return fail ("couldn't write to " + outputFile.getFullPathName());
+    }
+
+    writer.reset();
+    processor.releaseResources();
+
+    const auto audioSeconds = (double) totalSamples / sampleRate;
+
+    std::cout << "Loaded " << sampleFile.getFileName() << " in " << juce::String (loadSeconds, 3) << " s" << std::endl
+              << "Rendered " << juce::String (audioSeconds, 3) << " s of audio in " << juce::String (renderSeconds, 3)
+              << " s of processBlock: " << juce::String (audioSeconds / juce::jmax (renderSeconds, 1.0e-9), 1)
+              << "x real time" << std::endl
+              << "Wrote " << outputFile.getFullPathName() << std::endl;
+
+    // samples streamed from disk can fall behind a render this fast; mapped ones can't
+    if (auto underruns = processor.getNumStreamingUnderruns())
+        std::cout << "Warning: " << underruns << " blocks had to wait on the disk, so the output may differ between runs"
+                  << std::endl;
+
+    return 0;
+}
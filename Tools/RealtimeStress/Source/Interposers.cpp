@@ -0,0 +1,295 @@
+/*
+  ==============================================================================
+
+    Interposers.cpp
+    Replaces glibc's allocator entry points, the pthread mutex lock and the
+    system calls that can block with versions that tell the RealtimeChecker
+    about them, then carry on as normal.
+
+    Functions defined in the executable take the place of the C library's for
+    every caller in the process, JUCE and the C++ runtime included, so nothing
+    else needs to change. This only works in an executable, and relies on glibc
+    exporting its allocator as __libc_malloc and friends.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/RealtimeChecker.h"
+
+#if JUCE_LINUX && SIMPLESAMPLER_CHECK_REALTIME
+
+#include <cstdarg>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void* __libc_memalign (size_t, size_t);
+    void __libc_free (void*);
+}
+
+namespace
+{
+    using Violation = RealtimeChecker::Violation;
+
+    // dlsym() can allocate, and that isn't the caller's fault
+    template <typename Function>
+    Function findNext (const char* name, const char* version = nullptr) noexcept
+    {
+        const RealtimeChecker::ScopedPermit permit;
+        void* found = nullptr;
+
+        // the pthread_cond functions have an older version that dlsym() may pick
+        if (version != nullptr)
+            found = dlvsym (RTLD_NEXT, name, version);
+
+        if (found == nullptr)
+            found = dlsym (RTLD_NEXT, name);
+
+        return reinterpret_cast<Function> (found);
+    }
+
+    struct NextFunctions
+    {
+        int (*mutexLock) (pthread_mutex_t*) = findNext<decltype (mutexLock)> ("pthread_mutex_lock");
+        int (*mutexTryLock) (pthread_mutex_t*) = findNext<decltype (mutexTryLock)> ("pthread_mutex_trylock");
+        int (*condWait) (pthread_cond_t*, pthread_mutex_t*) = findNext<decltype (condWait)> ("pthread_cond_wait", "GLIBC_2.3.2");
+        int (*condTimedWait) (pthread_cond_t*, pthread_mutex_t*, const timespec*) = findNext<decltype (condTimedWait)> ("pthread_cond_timedwait", "GLIBC_2.3.2");
+        int (*join) (pthread_t, void**) = findNext<decltype (join)> ("pthread_join");
+        int (*semWait) (sem_t*) = findNext<decltype (semWait)> ("sem_wait");
+        int (*semTimedWait) (sem_t*, const timespec*) = findNext<decltype (semTimedWait)> ("sem_timedwait");
+        int (*sleepFor) (const timespec*, timespec*) = findNext<decltype (sleepFor)> ("nanosleep");
+        int (*clockSleep) (clockid_t, int, const timespec*, timespec*) = findNext<decltype (clockSleep)> ("clock_nanosleep");
+        int (*microSleep) (useconds_t) = findNext<decltype (microSleep)> ("usleep");
+        unsigned int (*secondSleep) (unsigned int) = findNext<decltype (secondSleep)> ("sleep");
+        int (*openFile) (const char*, int, ...) = findNext<decltype (openFile)> ("open");
+        int (*closeFile) (int) = findNext<decltype (closeFile)> ("close");
+        ssize_t (*readFile) (int, void*, size_t) = findNext<decltype (readFile)> ("read");
+        ssize_t (*writeFile) (int, const void*, size_t) = findNext<decltype (writeFile)> ("write");
+        ssize_t (*preadFile) (int, void*, size_t, off_t) = findNext<decltype (preadFile)> ("pread");
+        ssize_t (*pwriteFile) (int, const void*, size_t, off_t) = findNext<decltype (pwriteFile)> ("pwrite");
+        int (*syncFile) (int) = findNext<decltype (syncFile)> ("fsync");
+        int (*pollFiles) (pollfd*, nfds_t, int) = findNext<decltype (pollFiles)> ("poll");
+        int (*selectFiles) (int, fd_set*, fd_set*, fd_set*, timeval*) = findNext<decltype (selectFiles)> ("select");
+    };
+
+    // looked up the first time any of them is called, which is before main()
+    const NextFunctions& next() noexcept
+    {
+        static const NextFunctions functions;
+        return functions;
+    }
+
+    inline void blocking (const char* function) noexcept
+    {
+        RealtimeChecker::report (Violation::blockingCall, function);
+    }
+}
+
+//==============================================================================
+extern "C"
+{
+    void* malloc (size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "malloc");
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "calloc");
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* block, size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "realloc");
+        return __libc_realloc (block, size);
+    }
+
+    void* memalign (size_t alignment, size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "memalign");
+        return __libc_memalign (alignment, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "aligned_alloc");
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** result, size_t alignment, size_t size) noexcept
+    {
+        RealtimeChecker::report (Violation::allocation, "posix_memalign");
+
+        if (alignment % sizeof (void*) != 0 || ! juce::isPowerOfTwo (alignment))
+            return EINVAL;
+
+        *result = __libc_memalign (alignment, size);
+        return *result != nullptr ? 0 : ENOMEM;
+    }
+
+    void free (void* block) noexcept
+    {
+        if (block != nullptr)
+            RealtimeChecker::report (Violation::deallocation, "free");
+
+        __libc_free (block);
+    }
+
+    //==============================================================================
+    int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+    {
+        if (RealtimeChecker::isCheckingThisThread())
+        {
+            // a free mutex is still a violation, just one that didn't cost anything this time
+            if (next().mutexTryLock (mutex) == 0)
+            {
+                RealtimeChecker::report (Violation::lock, "pthread_mutex_lock");
+                return 0;
+            }
+
+            RealtimeChecker::report (Violation::contendedLock, "pthread_mutex_lock");
+        }
+
+        return next().mutexLock (mutex);
+    }
+
+    int pthread_cond_wait (pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        blocking ("pthread_cond_wait");
+        return next().condWait (condition, mutex);
+    }
+
+    int pthread_cond_timedwait (pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* time)
+    {
+        blocking ("pthread_cond_timedwait");
+        return next().condTimedWait (condition, mutex, time);
+    }
+
+    int pthread_join (pthread_t thread, void** result)
+    {
+        blocking ("pthread_join");
+        return next().join (thread, result);
+    }
+
+    int sem_wait (sem_t* semaphore)
+    {
+        blocking ("sem_wait");
+        return next().semWait (semaphore);
+    }
+
+    int sem_timedwait (sem_t* semaphore, const timespec* time)
+    {
+        blocking ("sem_timedwait");
+        return next().semTimedWait (semaphore, time);
+    }
+
+    int nanosleep (const timespec* duration, timespec* remaining)
+    {
+        blocking ("nanosleep");
+        return next().sleepFor (duration, remaining);
+    }
+
+    int clock_nanosleep (clockid_t clock, int flags, const timespec* time, timespec* remaining)
+    {
+        blocking ("clock_nanosleep");
+        return next().clockSleep (clock, flags, time, remaining);
+    }
+
+    int usleep (useconds_t microseconds)
+    {
+        blocking ("usleep");
+        return next().microSleep (microseconds);
+    }
+
+    unsigned int sleep (unsigned int seconds)
+    {
+        blocking ("sleep");
+        return next().secondSleep (seconds);
+    }
+
+    //==============================================================================
+    int open (const char* path, int flags, ...)
+    {
+        blocking ("open");
+
+        mode_t mode = 0;
+
+        auto needsMode = (flags & O_CREAT) != 0;
+       #ifdef O_TMPFILE
+        needsMode = needsMode || (flags & O_TMPFILE) == O_TMPFILE;
+       #endif
+
+        if (needsMode)
+        {
+            va_list args;
+            va_start (args, flags);
+            mode = (mode_t) va_arg (args, int);
+            va_end (args);
+        }
+
+        return next().openFile (path, flags, mode);
+    }
+
+    int close (int file)
+    {
+        blocking ("close");
+        return next().closeFile (file);
+    }
+
+    ssize_t read (int file, void* buffer, size_t size)
+    {
+        blocking ("read");
+        return next().readFile (file, buffer, size);
+    }
+
+    ssize_t write (int file, const void* buffer, size_t size)
+    {
+        blocking ("write");
+        return next().writeFile (file, buffer, size);
+    }
+
+    ssize_t pread (int file, void* buffer, size_t size, off_t offset)
+    {
+        blocking ("pread");
+        return next().preadFile (file, buffer, size, offset);
+    }
+
+    ssize_t pwrite (int file, const void* buffer, size_t size, off_t offset)
+    {
+        blocking ("pwrite");
+        return next().pwriteFile (file, buffer, size, offset);
+    }
+
+    int fsync (int file)
+    {
+        blocking ("fsync");
+        return next().syncFile (file);
+    }
+
+    int poll (pollfd* files, nfds_t numFiles, int timeout)
+    {
+        blocking ("poll");
+        return next().pollFiles (files, numFiles, timeout);
+    }
+
+    int select (int numFiles, fd_set* readFiles, fd_set* writeFiles, fd_set* errorFiles, timeval* timeout)
+    {
+        blocking ("select");
+        return next().selectFiles (numFiles, readFiles, writeFiles, errorFiles, timeout);
+    }
+}
+
+#endif
@@ -0,0 +1,335 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Renders on a thread of its own while the message thread loads samples,
+    restores sessions and changes settings as fast as it can, with the
+    RealtimeChecker watching everything the audio side does.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/RealtimeChecker.h"
+
+#if ! SIMPLESAMPLER_CHECK_REALTIME
+ #error "build this with SIMPLESAMPLER_CHECK_REALTIME=1, which the project sets"
+#endif
+
+namespace
+{
+    constexpr double defaultSeconds = 30.0;
+    constexpr double defaultSampleRate = 48000.0;
+    constexpr int defaultBlockSize = 256;
+
+    void printUsage()
+    {
+        std::cout << "Usage: RealtimeStress [--seconds=" << defaultSeconds << "] [--rate=" << defaultSampleRate << "]"
+                  << " [--block=" << defaultBlockSize << "] [--seed=<n>] [--strict]" << std::endl
+                  << std::endl
+                  << "Plays random MIDI through the sampler on an audio thread while the message thread keeps" << std::endl
+                  << "loading samples, restoring sessions and changing the polyphony, render threads, voice" << std::endl
+                  << "stealing, interpolation and parameters. Anything the audio thread does that could block" << std::endl
+                  << "it is printed with its call stack, once per stack." << std::endl
+                  << std::endl
+                  << "Exits with 1 if the audio thread allocated, freed, waited for a lock or made a blocking" << std::endl
+                  << "call. Taking a lock nobody else held is only counted, unless --strict is given." << std::endl;
+    }
+
+    //==============================================================================
+    juce::File writeTestSample (const juce::File& file, juce::AudioFormat& format, double sampleRate,
+                                int numChannels, int bitDepth, double seconds, double frequency)
+    {
+        file.deleteFile();
+        std::unique_ptr<juce::FileOutputStream> out (file.createOutputStream());
+
+        if (out == nullptr)
+            return {};
+
+        std::unique_ptr<juce::AudioFormatWriter> writer (format.createWriterFor (out.get(), sampleRate, (unsigned int) numChannels,
+                                                                                 bitDepth, {}, 0));
+
+        if (writer == nullptr)
+            return {};
+
+        out.release();
+
+        juce::AudioBuffer<float> buffer (numChannels, (int) (seconds * sampleRate));
+
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+            for (int channel = 0; channel < numChannels; ++channel)
+                buffer.setSample (channel, i, 0.5f * (float) std::sin (juce::MathConstants<double>::twoPi * frequency * i / sampleRate));
+
+        return writer->writeFromAudioSampleBuffer (buffer, 0, buffer.getNumSamples()) ? file : juce::File();
+    }
+
+    /** A few short samples of different shapes, and an instrument made of them
+        with key ranges, velocity layers and a round robin.
+    */
+    juce::StringArray writeTestSamples (const juce::File& directory)
+    {
+        if (! directory.createDirectory())
+            return {};
+
+        juce::WavAudioFormat wav;
+        juce::FlacAudioFormat flac;
+
+        juce::StringArray paths;
+        paths.add (writeTestSample (directory.getChildFile ("stress_stereo.wav"), wav, 48000.0, 2, 24, 2.0, 220.0).getFullPathName());
+        paths.add (writeTestSample (directory.getChildFile ("stress_mono.wav"), wav, 44100.0, 1, 16, 0.5, 330.0).getFullPathName());
+        paths.add (writeTestSample (directory.getChildFile ("stress_long.wav"), wav, 96000.0, 2, 24, 8.0, 110.0).getFullPathName());
+        paths.add (writeTestSample (directory.getChildFile ("stress_compressed.flac"), flac, 48000.0, 2, 16, 1.0, 440.0).getFullPathName());
+
+        auto sfz = directory.getChildFile ("stress.sfz");
+        sfz.replaceWithText ("<group> seq_length=2\n"
+                             "<region> sample=stress_stereo.wav lokey=0 hikey=59 seq_position=1\n"
+                             "<region> sample=stress_mono.wav lokey=0 hikey=59 seq_position=2\n"
+                             "<group>\n"
+                             "<region> sample=stress_long.wav lokey=60 hikey=127 lovel=0 hivel=63 pitch_keycenter=72\n"
+                             "<region> sample=stress_compressed.flac lokey=60 hikey=127 lovel=64 hivel=127\n");
+        paths.add (sfz.getFullPathName());
+
+        for (auto& path : paths)
+            if (! juce::File (path).existsAsFile())
+                return {};
+
+        return paths;
+    }
+
+    //==============================================================================
+    /** Calls processBlock() back to back, with random notes, pedal and automation
+        in every block, like a host playing back a busy project.
+    */
+    class AudioThread  : public juce::Thread
+    {
+    public:
+        AudioThread (SimpleSamplerAudioProcessor& processorToUse, int maxBlockSize, juce::int64 seed)
+            : juce::Thread ("Stress Audio"),
+              mProcessor (processorToUse),
+              mBuffer (processorToUse.getTotalNumOutputChannels(), maxBlockSize),
+              mRandom (seed)
+        {
+            mMidi.ensureSize (4096);
+
+            // the processor's own getParameters() returns its value tree state
+            for (auto* parameter : mProcessor.juce::AudioProcessor::getParameters())
+                mParameters.add (parameter);
+        }
+
+        ~AudioThread() override
+        {
+            stopThread (5000);
+        }
+
+        juce::int64 getNumBlocks() const noexcept       { return mNumBlocks.load(); }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                // hosts send shorter blocks than they promised now and then
+                const auto numSamples = mRandom.nextInt (8) == 0 ? 1 + mRandom.nextInt (mBuffer.getNumSamples())
+                                                                   : mBuffer.getNumSamples();
+                fillMidi (numSamples);
+
+                {
+                    // hosts automate parameters from the audio thread, between blocks
+                    const RealtimeChecker::ScopedRealtimeThread realtimeThread;
+
+                    if (mRandom.nextInt (4) == 0 && ! mParameters.isEmpty())
+                        mParameters[mRandom.nextInt (mParameters.size())]->setValueNotifyingHost (mRandom.nextFloat());
+                }
+
+                juce::AudioBuffer<float> block (mBuffer.getArrayOfWritePointers(), mBuffer.getNumChannels(), numSamples);
+                block.clear();
+                mProcessor.processBlock (block, mMidi);
+                ++mNumBlocks;
+            }
+        }
+
+    private:
+        void fillMidi (int numSamples)
+        {
+            mMidi.clear();
+
+            // mostly a few events, sometimes a chord of everything at once
+            const auto numEvents = mRandom.nextInt (16) == 0 ? 64 : mRandom.nextInt (6);
+
+            for (int i = 0; i < numEvents; ++i)
+            {
+                const auto channel = 1 + mRandom.nextInt (16);
+                const auto position = mRandom.nextInt (numSamples);
+                const auto choice = mRandom.nextInt (20);
+
+                if (choice < 10)
+                    mMidi.addEvent (juce::MidiMessage::noteOn (channel, mRandom.nextInt (128), (juce::uint8) (1 + mRandom.nextInt (127))), position);
+                else if (choice < 18)
+                    mMidi.addEvent (juce::MidiMessage::noteOff (channel, mRandom.nextInt (128)), position);
+                else if (choice < 19)
+                    mMidi.addEvent (juce::MidiMessage::controllerEvent (channel, 64, mRandom.nextBool() ? 127 : 0), position);
+                else
+                    mMidi.addEvent (juce::MidiMessage::allNotesOff (channel), position);
+            }
+        }
+
+        SimpleSamplerAudioProcessor& mProcessor;
+        juce::AudioBuffer<float> mBuffer;
+        juce::MidiBuffer mMidi;
+        juce::Array<juce::AudioProcessorParameter*> mParameters;
+        juce::Random mRandom;
+        std::atomic<juce::int64> mNumBlocks { 0 };
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioThread)
+    };
+
+    //==============================================================================
+    /** One of the things a user or host does on the message thread while audio plays. */
+    void doSomething (SimpleSamplerAudioProcessor& processor, const juce::StringArray& samples, juce::Random& random)
+    {
+        switch (random.nextInt (10))
+        {
+            case 0:
+            case 1:
+            case 2:
+                processor.loadFile (samples[random.nextInt (samples.size())]);
+                break;
+
+            case 3:
+                processor.setPolyphony (1 + random.nextInt (SimpleSamplerAudioProcessor::getMaxPolyphony()));
+                break;
+
+            case 4:
+                processor.setNumRenderThreads (1 + random.nextInt (SimpleSamplerAudioProcessor::getMaxRenderThreads()));
+                break;
+
+            case 5:
+                processor.setVoiceStealingPolicy ((VoiceStealingPolicy) random.nextInt (3));
+                break;
+
+            case 6:
+                processor.setRealtimeInterpolationQuality ((InterpolationQuality) random.nextInt (5));
+                break;
+
+            case 7:
+            {
+                // the editor's sliders
+                auto& parameters = processor.juce::AudioProcessor::getParameters();
+
+                if (! parameters.isEmpty())
+                    parameters[random.nextInt (parameters.size())]->setValueNotifyingHost (random.nextFloat());
+
+                break;
+            }
+
+            default:
+            {
+                // saving, and reopening a session or switching presets
+                processor.setEmbedSamples (random.nextInt (4) == 0);
+
+                juce::MemoryBlock state;
+                processor.getStateInformation (state);
+
+                if (random.nextBool())
+                    processor.setStateInformation (state.getData(), (int) state.getSize());
+
+                break;
+            }
+        }
+    }
+
+    int getNumFailures (bool strict)
+    {
+        using Violation = RealtimeChecker::Violation;
+
+        auto total = RealtimeChecker::getNumViolations (Violation::allocation)
+                   + RealtimeChecker::getNumViolations (Violation::deallocation)
+                   + RealtimeChecker::getNumViolations (Violation::contendedLock)
+                   + RealtimeChecker::getNumViolations (Violation::blockingCall);
+
+        return strict ? total + RealtimeChecker::getNumViolations (Violation::lock) : total;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ArgumentList args (argc, argv);
+
+    if (args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    const auto seconds = args.containsOption ("--seconds") ? args.getValueForOption ("--seconds").getDoubleValue() : defaultSeconds;
+    const auto sampleRate = args.containsOption ("--rate") ? args.getValueForOption ("--rate").getDoubleValue() : defaultSampleRate;
+    const auto blockSize = args.containsOption ("--block") ? args.getValueForOption ("--block").getIntValue() : defaultBlockSize;
+    const auto seed = args.containsOption ("--seed") ? args.getValueForOption ("--seed").getLargeIntValue() : juce::Time::currentTimeMillis();
+    const auto strict = args.containsOption ("--strict");
+
+    if (seconds <= 0.0 || sampleRate <= 0.0 || blockSize <= 0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const auto directory = juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("simpleSamplerStress");
+    const auto samples = writeTestSamples (directory);
+
+    if (samples.isEmpty())
+    {
+        std::cerr << "RealtimeStress: couldn't write the test samples to " << directory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Seed " << seed << ", " << seconds << " s at " << sampleRate << " Hz, blocks of up to " << blockSize << std::endl;
+
+    juce::int64 numBlocks = 0, numActions = 0;
+
+    {
+        SimpleSamplerAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+        processor.loadFile (samples[0]);
+
+        AudioThread audioThread (processor, blockSize, seed);
+        audioThread.startThread (juce::Thread::realtimeAudioPriority);
+
+        juce::Random random (seed + 1);
+        auto* messageManager = juce::MessageManager::getInstance();
+        const auto endTime = juce::Time::getMillisecondCounterHiRes() + seconds * 1000.0;
+
+        while (juce::Time::getMillisecondCounterHiRes() < endTime)
+        {
+            doSomething (processor, samples, random);
+            ++numActions;
+
+            // lets the loads finish and hand their samples over, some of the time
+            messageManager->runDispatchLoopUntil (random.nextInt (20));
+        }
+
+        audioThread.stopThread (5000);
+        numBlocks = audioThread.getNumBlocks();
+        processor.releaseResources();
+    }
+
+    using Violation = RealtimeChecker::Violation;
+
+    std::cout << std::endl << numBlocks << " blocks rendered while " << numActions << " changes were made" << std::endl;
+
+    for (int i = 0; i < (int) Violation::numViolations; ++i)
+        std::cout << "  " << RealtimeChecker::getName ((Violation) i) << ": "
+                  << RealtimeChecker::getNumViolations ((Violation) i) << std::endl;
+
+    if (getNumFailures (strict) > 0)
+    {
+        std::cout << "FAILED: the audio thread did something that can block it; see the stacks above" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Passed" << std::endl;
+    return 0;
+}